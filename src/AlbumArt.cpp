@@ -0,0 +1,820 @@
+#include "AlbumArt.h"
+
+// natural index of the n-th coefficient in zigzag order
+static const uint8_t zigzag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+// 4x4 ordered dither thresholds
+static const uint8_t bayer[4][4] = {
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5}};
+
+// ----------------Input----------------
+
+int AlbumArtDecoder::readByte()
+{
+    if (inputPosition == inputLength)
+    {
+        if (remaining == 0)
+        {
+            return -1;
+        }
+        // never ask for more than is there, readBytes would wait for the timeout
+        int count = stream->available();
+        if (count < 1)
+        {
+            count = 1;
+        }
+        if (count > (int)sizeof(inputBuffer))
+        {
+            count = sizeof(inputBuffer);
+        }
+        if (remaining > 0 && count > remaining)
+        {
+            count = remaining;
+        }
+        inputLength = stream->readBytes(inputBuffer, count);
+        inputPosition = 0;
+        if (inputLength == 0)
+        {
+            return -1;
+        }
+        if (remaining > 0)
+        {
+            remaining -= inputLength;
+        }
+    }
+    return inputBuffer[inputPosition++];
+}
+
+int AlbumArtDecoder::readWord()
+{
+    int high = readByte();
+    int low = readByte();
+    if (high < 0 || low < 0)
+    {
+        return -1;
+    }
+    return (high << 8) | low;
+}
+
+bool AlbumArtDecoder::skipSegment()
+{
+    int length = readWord();
+    if (length < 2)
+    {
+        return false;
+    }
+    for (length -= 2; length > 0; length--)
+    {
+        if (readByte() < 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ----------------Headers----------------
+
+bool AlbumArtDecoder::readQuantTables()
+{
+    int length = readWord() - 2;
+    while (length > 0)
+    {
+        int info = readByte();
+        if (info < 0 || (info & 0x0F) > 3)
+        {
+            error = "bad quantization table";
+            return false;
+        }
+        bool sixteenBit = (info >> 4) != 0;
+        uint16_t *table = quantTables[info & 0x0F];
+        for (uint8_t i = 0; i < 64; i++)
+        {
+            int value = sixteenBit ? readWord() : readByte();
+            if (value < 0)
+            {
+                error = "truncated quantization table";
+                return false;
+            }
+            table[zigzag[i]] = value;
+        }
+        length -= 1 + (sixteenBit ? 128 : 64);
+    }
+    return true;
+}
+
+bool AlbumArtDecoder::readHuffmanTables()
+{
+    int length = readWord() - 2;
+    while (length > 0)
+    {
+        int info = readByte();
+        if (info < 0 || (info & 0x0F) > 1 || (info >> 4) > 1)
+        {
+            error = "bad huffman table";
+            return false;
+        }
+        HuffmanTable &table = (info >> 4) ? acTables[info & 0x0F] : dcTables[info & 0x0F];
+
+        uint8_t counts[17];
+        int total = 0;
+        for (uint8_t bits = 1; bits <= 16; bits++)
+        {
+            int count = readByte();
+            if (count < 0)
+            {
+                error = "truncated huffman table";
+                return false;
+            }
+            counts[bits] = count;
+            total += count;
+        }
+        if (total > 256)
+        {
+            error = "bad huffman table";
+            return false;
+        }
+        for (int i = 0; i < total; i++)
+        {
+            int value = readByte();
+            if (value < 0)
+            {
+                error = "truncated huffman table";
+                return false;
+            }
+            table.values[i] = value;
+        }
+
+        // canonical codes, short ones also go into the 8 bit lookup
+        memset(table.lookup, 0, sizeof(table.lookup));
+        int32_t code = 0;
+        int index = 0;
+        for (uint8_t bits = 1; bits <= 16; bits++)
+        {
+            // more codes than the length has room for would run past the lookup
+            if (code + counts[bits] > (1L << bits))
+            {
+                error = "bad huffman table";
+                return false;
+            }
+            table.valueOffset[bits] = index - code;
+            table.maxCode[bits] = counts[bits] ? code + counts[bits] - 1 : -1;
+            for (uint8_t i = 0; i < counts[bits] && bits <= 8; i++)
+            {
+                uint16_t first = (code + i) << (8 - bits);
+                uint16_t entry = (bits << 8) | table.values[index + i];
+                for (uint16_t fill = 0; fill < (1 << (8 - bits)); fill++)
+                {
+                    table.lookup[first + fill] = entry;
+                }
+            }
+            code += counts[bits];
+            index += counts[bits];
+            code <<= 1;
+        }
+        length -= 17 + total;
+    }
+    return true;
+}
+
+bool AlbumArtDecoder::readFrame()
+{
+    readWord();
+    int precision = readByte();
+    imageHeight = readWord();
+    imageWidth = readWord();
+    componentCount = readByte();
+    if (precision != 8)
+    {
+        error = "only 8 bit JPEGs are supported";
+        return false;
+    }
+    if (componentCount != 1 && componentCount != 3)
+    {
+        error = "only grayscale and YCbCr JPEGs are supported";
+        return false;
+    }
+    if (imageWidth < ALBUM_ART_SIZE || imageHeight < ALBUM_ART_SIZE ||
+        imageWidth > ALBUM_ART_MAX_SOURCE_SIZE || imageHeight > ALBUM_ART_MAX_SOURCE_SIZE)
+    {
+        error = "image size not supported";
+        return false;
+    }
+
+    maxH = 1;
+    maxV = 1;
+    for (uint8_t i = 0; i < componentCount; i++)
+    {
+        Component &component = components[i];
+        component.id = readByte();
+        int sampling = readByte();
+        int quantTable = readByte();
+        if (sampling < 0 || quantTable < 0 || quantTable > 3)
+        {
+            error = "bad frame header";
+            return false;
+        }
+        component.h = sampling >> 4;
+        component.v = sampling & 0x0F;
+        component.quantTable = quantTable;
+        if (component.h < 1 || component.h > 2 || component.v < 1 || component.v > 2)
+        {
+            error = "sampling factors not supported";
+            return false;
+        }
+        if (component.h > maxH)
+        {
+            maxH = component.h;
+        }
+        if (component.v > maxV)
+        {
+            maxV = component.v;
+        }
+    }
+    if (componentCount == 1)
+    {
+        // a single component scan has one block per MCU whatever the sampling says
+        components[0].h = components[0].v = maxH = maxV = 1;
+    }
+    return true;
+}
+
+bool AlbumArtDecoder::readScan()
+{
+    readWord();
+    int count = readByte();
+    if (count != componentCount)
+    {
+        error = "only interleaved scans are supported";
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        int id = readByte();
+        int tables = readByte();
+        Component *component = NULL;
+        for (uint8_t c = 0; c < componentCount; c++)
+        {
+            if (components[c].id == id)
+            {
+                component = &components[c];
+            }
+        }
+        if (component == NULL || tables < 0 || (tables >> 4) > 1 || (tables & 0x0F) > 1)
+        {
+            error = "bad scan header";
+            return false;
+        }
+        component->dcTable = tables >> 4;
+        component->acTable = tables & 0x0F;
+    }
+    // spectral selection and approximation are fixed for baseline
+    readByte();
+    readByte();
+    return readByte() >= 0;
+}
+
+// ----------------Entropy decoding----------------
+
+void AlbumArtDecoder::fillBits()
+{
+    while (bitCount <= 24)
+    {
+        int value = 0;
+        if (!markerReached)
+        {
+            value = readByte();
+            if (value == 0xFF)
+            {
+                int next = readByte();
+                // 0xFF00 is a stuffed 0xFF, anything else is a marker (restart or end)
+                if (next != 0)
+                {
+                    markerReached = true;
+                    inputEnded = next < 0;
+                    value = 0;
+                }
+            }
+            else if (value < 0)
+            {
+                markerReached = true;
+                inputEnded = true;
+                value = 0;
+            }
+        }
+        bitBuffer = (bitBuffer << 8) | value;
+        bitCount += 8;
+    }
+}
+
+int AlbumArtDecoder::getBits(uint8_t count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (bitCount < count)
+    {
+        fillBits();
+    }
+    bitCount -= count;
+    return (bitBuffer >> bitCount) & ((1UL << count) - 1);
+}
+
+int AlbumArtDecoder::decodeHuffman(const HuffmanTable &table)
+{
+    if (bitCount < 16)
+    {
+        fillBits();
+    }
+    uint16_t entry = table.lookup[(bitBuffer >> (bitCount - 8)) & 0xFF];
+    if (entry != 0)
+    {
+        bitCount -= entry >> 8;
+        return entry & 0xFF;
+    }
+
+    int32_t code = getBits(8);
+    for (uint8_t bits = 9; bits <= 16; bits++)
+    {
+        code = (code << 1) | getBits(1);
+        if (code <= table.maxCode[bits])
+        {
+            return table.values[table.valueOffset[bits] + code];
+        }
+    }
+    return -1;
+}
+
+// value of a coefficient with its category (number of bits)
+static inline int extend(int value, uint8_t bits)
+{
+    return value < (1 << (bits - 1)) ? value - (1 << bits) + 1 : value;
+}
+
+bool AlbumArtDecoder::decodeBlock(Component &component, uint8_t *out, uint8_t stride)
+{
+    const uint16_t *quant = quantTables[component.quantTable];
+    int coefficients[64];
+
+    int category = decodeHuffman(dcTables[component.dcTable]);
+    if (category < 0 || category > 11)
+    {
+        error = "corrupt image data";
+        return false;
+    }
+    component.dcPredictor += category ? extend(getBits(category), category) : 0;
+    int dc = component.dcPredictor * quant[0];
+
+    if (!dcOnly)
+    {
+        memset(coefficients, 0, sizeof(coefficients));
+        coefficients[0] = dc;
+    }
+    for (uint8_t k = 1; k < 64; k++)
+    {
+        int symbol = decodeHuffman(acTables[component.acTable]);
+        if (symbol < 0)
+        {
+            error = "corrupt image data";
+            return false;
+        }
+        uint8_t run = symbol >> 4;
+        uint8_t bits = symbol & 0x0F;
+        if (bits == 0)
+        {
+            if (run != 15)
+            {
+                // end of block
+                break;
+            }
+            k += 15;
+            continue;
+        }
+        k += run;
+        if (k > 63)
+        {
+            error = "corrupt image data";
+            return false;
+        }
+        int value = extend(getBits(bits), bits);
+        if (!dcOnly)
+        {
+            coefficients[zigzag[k]] = value * quant[zigzag[k]];
+        }
+    }
+
+    if (dcOnly)
+    {
+        // the DC coefficient is eight times the block average
+        int average = 128 + ((dc + 4) >> 3);
+        uint8_t value = average < 0 ? 0 : (average > 255 ? 255 : average);
+        for (uint8_t row = 0; row < 8; row++)
+        {
+            memset(out + row * stride, value, 8);
+        }
+        return true;
+    }
+    idct(coefficients, out, stride);
+    return true;
+}
+
+// Integer IDCT, the accurate variant of the IJG library (jidctint.c)
+#define IDCT_CONST_BITS 13
+#define IDCT_PASS1_BITS 2
+#define DESCALE(x, n) (((x) + (1 << ((n)-1))) >> (n))
+
+void AlbumArtDecoder::idct(const int *coefficients, uint8_t *out, uint8_t stride)
+{
+    int32_t workspace[64];
+
+    // columns
+    for (uint8_t column = 0; column < 8; column++)
+    {
+        const int *in = coefficients + column;
+        int32_t *ws = workspace + column;
+        if (in[8] == 0 && in[16] == 0 && in[24] == 0 && in[32] == 0 && in[40] == 0 && in[48] == 0 && in[56] == 0)
+        {
+            int32_t dc = (int32_t)in[0] * (1 << IDCT_PASS1_BITS);
+            for (uint8_t row = 0; row < 8; row++)
+            {
+                ws[row * 8] = dc;
+            }
+            continue;
+        }
+
+        int32_t z2 = in[16];
+        int32_t z3 = in[48];
+        int32_t z1 = (z2 + z3) * 4433;
+        int32_t tmp2 = z1 + z3 * -15137;
+        int32_t tmp3 = z1 + z2 * 6270;
+        int32_t tmp0 = ((int32_t)in[0] + in[32]) * (1 << IDCT_CONST_BITS);
+        int32_t tmp1 = ((int32_t)in[0] - in[32]) * (1 << IDCT_CONST_BITS);
+        int32_t tmp10 = tmp0 + tmp3;
+        int32_t tmp13 = tmp0 - tmp3;
+        int32_t tmp11 = tmp1 + tmp2;
+        int32_t tmp12 = tmp1 - tmp2;
+
+        tmp0 = in[56];
+        tmp1 = in[40];
+        tmp2 = in[24];
+        tmp3 = in[8];
+        z1 = tmp0 + tmp3;
+        z2 = tmp1 + tmp2;
+        z3 = tmp0 + tmp2;
+        int32_t z4 = tmp1 + tmp3;
+        int32_t z5 = (z3 + z4) * 9633;
+        tmp0 *= 2446;
+        tmp1 *= 16819;
+        tmp2 *= 25172;
+        tmp3 *= 12299;
+        z1 *= -7373;
+        z2 *= -20995;
+        z3 = z3 * -16069 + z5;
+        z4 = z4 * -3196 + z5;
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        ws[0] = DESCALE(tmp10 + tmp3, IDCT_CONST_BITS - IDCT_PASS1_BITS);
+        ws[56] = DESCALE(tmp10 - tmp3, IDCT_CONST_BITS - IDCT_PASS1_BITS);
+        ws[8] = DESCALE(tmp11 + tmp2, IDCT_CONST_BITS - IDCT_PASS1_BITS);
+        ws[48] = DESCALE(tmp11 - tmp2, IDCT_CONST_BITS - IDCT_PASS1_BITS);
+        ws[16] = DESCALE(tmp12 + tmp1, IDCT_CONST_BITS - IDCT_PASS1_BITS);
+        ws[40] = DESCALE(tmp12 - tmp1, IDCT_CONST_BITS - IDCT_PASS1_BITS);
+        ws[24] = DESCALE(tmp13 + tmp0, IDCT_CONST_BITS - IDCT_PASS1_BITS);
+        ws[32] = DESCALE(tmp13 - tmp0, IDCT_CONST_BITS - IDCT_PASS1_BITS);
+    }
+
+    // rows
+    const uint8_t shift = IDCT_CONST_BITS + IDCT_PASS1_BITS + 3;
+    for (uint8_t row = 0; row < 8; row++)
+    {
+        const int32_t *ws = workspace + row * 8;
+        uint8_t *pixels = out + row * stride;
+
+        int32_t z2 = ws[2];
+        int32_t z3 = ws[6];
+        int32_t z1 = (z2 + z3) * 4433;
+        int32_t tmp2 = z1 + z3 * -15137;
+        int32_t tmp3 = z1 + z2 * 6270;
+        int32_t tmp0 = (ws[0] + ws[4]) * (1 << IDCT_CONST_BITS);
+        int32_t tmp1 = (ws[0] - ws[4]) * (1 << IDCT_CONST_BITS);
+        int32_t tmp10 = tmp0 + tmp3;
+        int32_t tmp13 = tmp0 - tmp3;
+        int32_t tmp11 = tmp1 + tmp2;
+        int32_t tmp12 = tmp1 - tmp2;
+
+        tmp0 = ws[7];
+        tmp1 = ws[5];
+        tmp2 = ws[3];
+        tmp3 = ws[1];
+        z1 = tmp0 + tmp3;
+        z2 = tmp1 + tmp2;
+        z3 = tmp0 + tmp2;
+        int32_t z4 = tmp1 + tmp3;
+        int32_t z5 = (z3 + z4) * 9633;
+        tmp0 *= 2446;
+        tmp1 *= 16819;
+        tmp2 *= 25172;
+        tmp3 *= 12299;
+        z1 *= -7373;
+        z2 *= -20995;
+        z3 = z3 * -16069 + z5;
+        z4 = z4 * -3196 + z5;
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        int32_t values[8] = {
+            tmp10 + tmp3, tmp11 + tmp2, tmp12 + tmp1, tmp13 + tmp0,
+            tmp13 - tmp0, tmp12 - tmp1, tmp11 - tmp2, tmp10 - tmp3};
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            int32_t value = DESCALE(values[i], shift) + 128;
+            pixels[i] = value < 0 ? 0 : (value > 255 ? 255 : value);
+        }
+    }
+}
+
+// ----------------Scaling----------------
+
+void AlbumArtDecoder::accumulateMcu(uint16_t mcuX, uint16_t mcuY)
+{
+    const uint8_t mcuWidth = maxH * 8;
+    const uint8_t mcuHeight = maxV * 8;
+    const Component &luma = components[0];
+    // chroma is sampled at most 2x lower, so a shift maps MCU to chroma positions
+    const uint8_t chromaShiftX = componentCount == 3 && components[1].h < maxH ? 1 : 0;
+    const uint8_t chromaShiftY = componentCount == 3 && components[1].v < maxV ? 1 : 0;
+    const uint8_t chromaStride = componentCount == 3 ? components[1].h * 8 : 0;
+
+    for (uint8_t row = 0; row < mcuHeight; row++)
+    {
+        uint16_t sourceY = mcuY * mcuHeight + row;
+        if (sourceY >= imageHeight)
+        {
+            break;
+        }
+        uint8_t outputY = (uint32_t)sourceY * ALBUM_ART_SIZE / imageHeight;
+        BoxSums &sums = window[outputY % ALBUM_ART_WINDOW_ROWS];
+        const uint8_t *lumaRow = luma.samples + row * luma.h * 8;
+        const uint8_t *cbRow = components[1].samples + (row >> chromaShiftY) * chromaStride;
+        const uint8_t *crRow = components[2].samples + (row >> chromaShiftY) * chromaStride;
+
+        for (uint8_t column = 0; column < mcuWidth; column++)
+        {
+            uint16_t sourceX = mcuX * mcuWidth + column;
+            if (sourceX >= imageWidth)
+            {
+                break;
+            }
+            uint8_t outputX = columnMap[sourceX];
+            // YCbCr is averaged, the color conversion happens once per tile pixel
+            sums.y[outputX] += lumaRow[column];
+            if (componentCount == 3)
+            {
+                sums.cb[outputX] += cbRow[column >> chromaShiftX];
+                sums.cr[outputX] += crRow[column >> chromaShiftX];
+            }
+        }
+    }
+}
+
+void AlbumArtDecoder::flushRows(uint16_t sourceRowsDone, uint16_t *tile)
+{
+    while (nextRowToFlush < ALBUM_ART_SIZE && sourceRowsOfFlushed + rowCount[nextRowToFlush] <= sourceRowsDone)
+    {
+        uint8_t outputY = nextRowToFlush;
+        BoxSums &sums = window[outputY % ALBUM_ART_WINDOW_ROWS];
+        for (uint8_t outputX = 0; outputX < ALBUM_ART_SIZE; outputX++)
+        {
+            uint16_t pixels = columnCount[outputX] * rowCount[outputY];
+            int32_t y = (sums.y[outputX] + pixels / 2) / pixels;
+            int32_t r = y;
+            int32_t g = y;
+            int32_t b = y;
+            if (componentCount == 3)
+            {
+                int32_t cb = (int32_t)(sums.cb[outputX] + pixels / 2) / pixels - 128;
+                int32_t cr = (int32_t)(sums.cr[outputX] + pixels / 2) / pixels - 128;
+                r = y + ((91881 * cr) >> 16);
+                g = y - ((22554 * cb + 46802 * cr) >> 16);
+                b = y + ((116130 * cb) >> 16);
+            }
+
+            // ordered dither to 5/6/5 bits
+            uint8_t threshold = bayer[outputY & 3][outputX & 3];
+            r += threshold >> 1;
+            g += threshold >> 2;
+            b += threshold >> 1;
+            r = r < 0 ? 0 : (r > 255 ? 255 : r);
+            g = g < 0 ? 0 : (g > 255 ? 255 : g);
+            b = b < 0 ? 0 : (b > 255 ? 255 : b);
+            tile[outputY * ALBUM_ART_SIZE + outputX] = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+        }
+        memset(&sums, 0, sizeof(sums));
+        sourceRowsOfFlushed += rowCount[outputY];
+        nextRowToFlush++;
+    }
+}
+
+// ----------------Decoding----------------
+
+bool AlbumArtDecoder::restart()
+{
+    bitCount = 0;
+    bitBuffer = 0;
+    if (!markerReached)
+    {
+        // the marker is still ahead of us, everything before it is padding
+        int previous = 0;
+        int value;
+        while ((value = readByte()) >= 0 && !(previous == 0xFF && value >= 0xD0 && value <= 0xD7))
+        {
+            previous = value;
+        }
+        if (value < 0)
+        {
+            error = "restart marker missing";
+            return false;
+        }
+    }
+    markerReached = false;
+    for (uint8_t i = 0; i < componentCount; i++)
+    {
+        components[i].dcPredictor = 0;
+    }
+    return true;
+}
+
+bool AlbumArtDecoder::decodeScan(uint16_t *tile)
+{
+    for (uint16_t x = 0; x < imageWidth; x++)
+    {
+        columnMap[x] = (uint32_t)x * ALBUM_ART_SIZE / imageWidth;
+    }
+    memset(columnCount, 0, sizeof(columnCount));
+    memset(rowCount, 0, sizeof(rowCount));
+    for (uint16_t x = 0; x < imageWidth; x++)
+    {
+        columnCount[columnMap[x]]++;
+    }
+    for (uint16_t y = 0; y < imageHeight; y++)
+    {
+        rowCount[(uint32_t)y * ALBUM_ART_SIZE / imageHeight]++;
+    }
+    memset(window, 0, sizeof(window));
+    nextRowToFlush = 0;
+    sourceRowsOfFlushed = 0;
+    dcOnly = imageWidth >= ALBUM_ART_SIZE * 8 && imageHeight >= ALBUM_ART_SIZE * 8;
+
+    for (uint8_t i = 0; i < componentCount; i++)
+    {
+        components[i].dcPredictor = 0;
+    }
+    bitCount = 0;
+    bitBuffer = 0;
+    markerReached = false;
+    inputEnded = false;
+
+    const uint8_t mcuWidth = maxH * 8;
+    const uint8_t mcuHeight = maxV * 8;
+    const uint16_t mcusX = (imageWidth + mcuWidth - 1) / mcuWidth;
+    const uint16_t mcusY = (imageHeight + mcuHeight - 1) / mcuHeight;
+    uint32_t mcuIndex = 0;
+    for (uint16_t mcuY = 0; mcuY < mcusY; mcuY++)
+    {
+        for (uint16_t mcuX = 0; mcuX < mcusX; mcuX++, mcuIndex++)
+        {
+            if (restartInterval != 0 && mcuIndex != 0 && mcuIndex % restartInterval == 0 && !restart())
+            {
+                return false;
+            }
+            for (uint8_t i = 0; i < componentCount; i++)
+            {
+                Component &component = components[i];
+                uint8_t stride = component.h * 8;
+                for (uint8_t v = 0; v < component.v; v++)
+                {
+                    for (uint8_t h = 0; h < component.h; h++)
+                    {
+                        if (!decodeBlock(component, component.samples + v * 8 * stride + h * 8, stride))
+                        {
+                            return false;
+                        }
+                    }
+                }
+            }
+            accumulateMcu(mcuX, mcuY);
+        }
+        if (inputEnded)
+        {
+            // the rest of the scan would be decoded from the zeros fillBits pads with
+            error = "unexpected end of image";
+            return false;
+        }
+        uint16_t rowsDone = (mcuY + 1) * mcuHeight;
+        flushRows(rowsDone < imageHeight ? rowsDone : imageHeight, tile);
+        yield();
+    }
+    return true;
+}
+
+bool AlbumArtDecoder::decode(Stream &stream, uint16_t *tile, long length)
+{
+    this->stream = &stream;
+    remaining = length;
+    inputPosition = inputLength = 0;
+    restartInterval = 0;
+    componentCount = 0;
+    error = "";
+
+    if (readByte() != 0xFF || readByte() != 0xD8)
+    {
+        error = "not a JPEG";
+        return false;
+    }
+
+    while (true)
+    {
+        int value = readByte();
+        if (value < 0)
+        {
+            error = "unexpected end of image";
+            return false;
+        }
+        if (value != 0xFF)
+        {
+            continue;
+        }
+        int marker = readByte();
+        while (marker == 0xFF)
+        {
+            marker = readByte();
+        }
+
+        bool ok = true;
+        switch (marker)
+        {
+        case 0xC0:
+        case 0xC1:
+            ok = readFrame();
+            break;
+        case 0xC4:
+            ok = readHuffmanTables();
+            break;
+        case 0xDB:
+            ok = readQuantTables();
+            break;
+        case 0xDD:
+            readWord();
+            restartInterval = readWord();
+            break;
+        case 0xDA:
+            if (componentCount == 0)
+            {
+                error = "scan without frame";
+                return false;
+            }
+            return readScan() && decodeScan(tile);
+        case 0xC2:
+        case 0xC3:
+        case 0xC5:
+        case 0xC6:
+        case 0xC7:
+        case 0xC9:
+        case 0xCA:
+        case 0xCB:
+        case 0xCD:
+        case 0xCE:
+        case 0xCF:
+            error = "only baseline JPEGs are supported";
+            return false;
+        case 0xD9:
+        case -1:
+            error = "unexpected end of image";
+            return false;
+        default:
+            ok = skipSegment();
+            break;
+        }
+        if (!ok)
+        {
+            if (error[0] == '\0')
+            {
+                error = "truncated header";
+            }
+            return false;
+        }
+    }
+}
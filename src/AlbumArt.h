@@ -0,0 +1,117 @@
+/*
+AlbumArt - streaming baseline JPEG decoder for album covers
+
+Decodes the cover MCU by MCU while it comes in and box-filters it straight
+into a ALBUM_ART_SIZE x ALBUM_ART_SIZE RGB565 tile, so the full resolution
+image is never held in RAM. Everything lives in the decoder object
+(about 13 KB), decode() itself does not allocate.
+
+Supported: baseline huffman JPEGs (SOF0/SOF1), grayscale or YCbCr with
+1x1/2x1/1x2/2x2 sampling, restart markers, sizes from ALBUM_ART_SIZE up to
+ALBUM_ART_MAX_SOURCE_SIZE pixels. Progressive JPEGs are rejected (Spotify
+serves its covers as baseline).
+*/
+
+#ifndef AlbumArt_h
+#define AlbumArt_h
+
+#include <Arduino.h>
+
+#define ALBUM_ART_SIZE 64
+// keeps the box sums of one output pixel within 16 bits
+#define ALBUM_ART_MAX_SOURCE_SIZE 1024
+// output rows one MCU row can touch: 16 source lines at 1:1 plus one carried over
+#define ALBUM_ART_WINDOW_ROWS 18
+
+class AlbumArtDecoder
+{
+public:
+  // Decodes a JPEG of length bytes (-1 if unknown) into tile, which holds ALBUM_ART_SIZE^2 pixels
+  bool decode(Stream &stream, uint16_t *tile, long length = -1);
+
+  uint16_t imageWidth = 0;
+  uint16_t imageHeight = 0;
+  // why the last decode failed
+  const char *error = "";
+
+private:
+  struct HuffmanTable
+  {
+    // codes of up to 8 bits: (length << 8) | value, 0 for longer codes
+    uint16_t lookup[256];
+    int32_t maxCode[17];
+    int32_t valueOffset[17];
+    uint8_t values[256];
+  };
+
+  struct Component
+  {
+    uint8_t id;
+    uint8_t h;
+    uint8_t v;
+    uint8_t quantTable;
+    uint8_t dcTable;
+    uint8_t acTable;
+    int dcPredictor;
+    // samples of this component in the current MCU, row length h * 8
+    uint8_t samples[256];
+  };
+
+  struct BoxSums
+  {
+    uint16_t y[ALBUM_ART_SIZE];
+    uint16_t cb[ALBUM_ART_SIZE];
+    uint16_t cr[ALBUM_ART_SIZE];
+  };
+
+  HuffmanTable dcTables[2];
+  HuffmanTable acTables[2];
+  uint16_t quantTables[4][64];
+  Component components[3];
+  uint8_t componentCount = 0;
+  uint8_t maxH = 1;
+  uint8_t maxV = 1;
+  uint16_t restartInterval = 0;
+  // only the block averages are needed when a tile pixel covers 8x8 and more
+  bool dcOnly = false;
+
+  // output column of every source column, output row sizes in source rows
+  uint8_t columnMap[ALBUM_ART_MAX_SOURCE_SIZE];
+  uint8_t columnCount[ALBUM_ART_SIZE];
+  uint8_t rowCount[ALBUM_ART_SIZE];
+  BoxSums window[ALBUM_ART_WINDOW_ROWS];
+  uint8_t nextRowToFlush = 0;
+  uint16_t sourceRowsOfFlushed = 0;
+
+  Stream *stream;
+  long remaining;
+  uint8_t inputBuffer[128];
+  uint8_t inputPosition = 0;
+  uint8_t inputLength = 0;
+  uint32_t bitBuffer = 0;
+  int8_t bitCount = 0;
+  bool markerReached = false;
+  // the stream ended inside the scan, without the marker at its end
+  bool inputEnded = false;
+
+  int readByte();
+  int readWord();
+  bool skipSegment();
+  bool readQuantTables();
+  bool readHuffmanTables();
+  bool readFrame();
+  bool readScan();
+  bool decodeScan(uint16_t *tile);
+  bool restart();
+
+  void fillBits();
+  int getBits(uint8_t count);
+  int decodeHuffman(const HuffmanTable &table);
+  bool decodeBlock(Component &component, uint8_t *out, uint8_t stride);
+  static void idct(const int *coefficients, uint8_t *out, uint8_t stride);
+
+  void accumulateMcu(uint16_t mcuX, uint16_t mcuY);
+  void flushRows(uint16_t sourceRowsDone, uint16_t *tile);
+};
+
+#endif
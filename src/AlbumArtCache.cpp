@@ -0,0 +1,258 @@
+#include "AlbumArtCache.h"
+#include "Log.h"
+
+#define ALBUM_ART_CACHE_INDEX ALBUM_ART_CACHE_DIR "/index.bin"
+#define ALBUM_ART_CACHE_INDEX_NEW ALBUM_ART_CACHE_DIR "/index.new"
+#define ALBUM_ART_CACHE_INDEX_MAGIC 0x31434141 // "AAC1"
+#define ALBUM_ART_CACHE_TILE_MAGIC 0x31545241  // "ART1"
+
+static const size_t tileBytes = ALBUM_ART_SIZE * ALBUM_ART_SIZE * sizeof(uint16_t);
+
+AlbumArtCache::AlbumArtCache(fs::FS &fs, uint32_t budgetBytes) : fs(fs)
+{
+    uint32_t fitting = budgetBytes / (sizeof(TileHeader) + tileBytes);
+    maxEntries = fitting > ALBUM_ART_CACHE_MAX_ENTRIES ? ALBUM_ART_CACHE_MAX_ENTRIES : fitting;
+}
+
+// FNV-1a
+uint32_t AlbumArtCache::keyOf(const char *albumUri)
+{
+    uint32_t hash = 2166136261UL;
+    while (*albumUri)
+    {
+        hash = (hash ^ (uint8_t)*albumUri++) * 16777619UL;
+    }
+    return hash;
+}
+
+void AlbumArtCache::tilePath(uint32_t key, char *path)
+{
+    sprintf(path, ALBUM_ART_CACHE_DIR "/%08lx.bin", (unsigned long)key);
+}
+
+int AlbumArtCache::findEntry(uint32_t key)
+{
+    for (uint8_t i = 0; i < entryCount; i++)
+    {
+        if (entries[i].key == key)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool AlbumArtCache::begin()
+{
+    entryCount = 0;
+    useClock = 0;
+    if (!fs.exists(ALBUM_ART_CACHE_INDEX) && fs.exists(ALBUM_ART_CACHE_INDEX_NEW))
+    {
+        // power was lost between removing the old and renaming the new index
+        fs.rename(ALBUM_ART_CACHE_INDEX_NEW, ALBUM_ART_CACHE_INDEX);
+    }
+    File index = fs.open(ALBUM_ART_CACHE_INDEX, FILE_READ);
+    if (!index)
+    {
+        // first start, nothing cached yet
+        return true;
+    }
+
+    uint32_t magic = 0;
+    uint8_t count = 0;
+    bool valid = index.read((uint8_t *)&magic, sizeof(magic)) == sizeof(magic) &&
+                 magic == ALBUM_ART_CACHE_INDEX_MAGIC &&
+                 index.read((uint8_t *)&useClock, sizeof(useClock)) == sizeof(useClock) &&
+                 index.read(&count, 1) == 1 &&
+                 count <= ALBUM_ART_CACHE_MAX_ENTRIES &&
+                 index.read((uint8_t *)entries, count * sizeof(Entry)) == count * sizeof(Entry);
+    index.close();
+    if (!valid)
+    {
+        LOG_WARN("album art cache index is corrupt, starting empty");
+        useClock = 0;
+        return false;
+    }
+    entryCount = count;
+
+    // the budget may have shrunk since the index was written
+    while (entryCount > maxEntries && evictOldest())
+    {
+    }
+    return true;
+}
+
+File AlbumArtCache::openTile(const char *albumUri)
+{
+    uint32_t key = keyOf(albumUri);
+    int index = findEntry(key);
+    if (index < 0)
+    {
+        return File();
+    }
+    char path[24];
+    tilePath(key, path);
+    File file = fs.open(path, FILE_READ);
+    TileHeader header;
+    if (!file || file.read((uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != ALBUM_ART_CACHE_TILE_MAGIC ||
+        strncmp(header.albumUri, albumUri, ALBUM_ART_CACHE_URI_LENGTH) != 0)
+    {
+        // gone, damaged or a different album with the same key
+        file.close();
+        return File();
+    }
+    entries[index].lastUsed = ++useClock;
+    return file;
+}
+
+bool AlbumArtCache::contains(const char *albumUri)
+{
+    File file = openTile(albumUri);
+    if (!file)
+    {
+        stats.misses++;
+        return false;
+    }
+    file.close();
+    stats.hits++;
+    return true;
+}
+
+bool AlbumArtCache::draw(const char *albumUri, Adafruit_GFX &display, int16_t x, int16_t y)
+{
+    unsigned long start = micros();
+    File file = openTile(albumUri);
+    if (!file)
+    {
+        return false;
+    }
+    uint16_t row[ALBUM_ART_SIZE];
+    bool complete = true;
+    for (int16_t line = 0; line < ALBUM_ART_SIZE; line++)
+    {
+        if (file.read((uint8_t *)row, sizeof(row)) != sizeof(row))
+        {
+            complete = false;
+            break;
+        }
+        display.drawRGBBitmap(x, y + line, row, ALBUM_ART_SIZE, 1);
+    }
+    file.close();
+    stats.loads++;
+    stats.loadMicros += micros() - start;
+    return complete;
+}
+
+bool AlbumArtCache::load(const char *albumUri, uint16_t *tile)
+{
+    unsigned long start = micros();
+    File file = openTile(albumUri);
+    if (!file)
+    {
+        return false;
+    }
+    bool complete = file.read((uint8_t *)tile, tileBytes) == tileBytes;
+    file.close();
+    stats.loads++;
+    stats.loadMicros += micros() - start;
+    return complete;
+}
+
+bool AlbumArtCache::store(const char *albumUri, const uint16_t *tile)
+{
+    if (maxEntries == 0)
+    {
+        return false;
+    }
+    uint32_t key = keyOf(albumUri);
+    int existing = findEntry(key);
+    if (existing >= 0)
+    {
+        // replaced, e.g. after a collision or a damaged file
+        removeEntry(existing);
+    }
+    while (entryCount >= maxEntries && evictOldest())
+    {
+    }
+
+    TileHeader header;
+    header.magic = ALBUM_ART_CACHE_TILE_MAGIC;
+    memset(header.albumUri, 0, sizeof(header.albumUri));
+    strncpy(header.albumUri, albumUri, ALBUM_ART_CACHE_URI_LENGTH - 1);
+
+    char path[24];
+    tilePath(key, path);
+    for (uint8_t attempt = 0; attempt < 2; attempt++)
+    {
+        File file = fs.open(path, FILE_WRITE);
+        bool written = file &&
+                       file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+                       file.write((const uint8_t *)tile, tileBytes) == tileBytes;
+        file.close();
+        if (written)
+        {
+            entries[entryCount].key = key;
+            entries[entryCount].lastUsed = ++useClock;
+            entryCount++;
+            stats.stores++;
+            return saveIndex();
+        }
+        fs.remove(path);
+        // the partition is fuller than the budget assumed, make room and try once more
+        if (!evictOldest())
+        {
+            break;
+        }
+    }
+    LOG_WARN("album art not cached, filesystem full");
+    saveIndex();
+    return false;
+}
+
+void AlbumArtCache::removeEntry(int index)
+{
+    char path[24];
+    tilePath(entries[index].key, path);
+    fs.remove(path);
+    entries[index] = entries[--entryCount];
+}
+
+bool AlbumArtCache::evictOldest()
+{
+    if (entryCount == 0)
+    {
+        return false;
+    }
+    uint8_t oldest = 0;
+    for (uint8_t i = 1; i < entryCount; i++)
+    {
+        if (entries[i].lastUsed < entries[oldest].lastUsed)
+        {
+            oldest = i;
+        }
+    }
+    removeEntry(oldest);
+    stats.evictions++;
+    return true;
+}
+
+bool AlbumArtCache::saveIndex()
+{
+    // written next to the old one and swapped, a reset never leaves half an index
+    File index = fs.open(ALBUM_ART_CACHE_INDEX_NEW, FILE_WRITE);
+    uint32_t magic = ALBUM_ART_CACHE_INDEX_MAGIC;
+    bool written = index &&
+                   index.write((const uint8_t *)&magic, sizeof(magic)) == sizeof(magic) &&
+                   index.write((const uint8_t *)&useClock, sizeof(useClock)) == sizeof(useClock) &&
+                   index.write(&entryCount, 1) == 1 &&
+                   index.write((const uint8_t *)entries, entryCount * sizeof(Entry)) == entryCount * sizeof(Entry);
+    index.close();
+    if (!written)
+    {
+        LOG_WARN("album art cache index not written");
+        return false;
+    }
+    fs.remove(ALBUM_ART_CACHE_INDEX);
+    return fs.rename(ALBUM_ART_CACHE_INDEX_NEW, ALBUM_ART_CACHE_INDEX);
+}
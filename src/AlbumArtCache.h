@@ -0,0 +1,88 @@
+/*
+AlbumArtCache - decoded album covers on flash
+
+Keeps ALBUM_ART_SIZE x ALBUM_ART_SIZE RGB565 tiles on SPIFFS/LittleFS, one
+file per album, so every track of an album after the first one (and every
+album heard before) is shown without a download. The index is a small
+array of (album key, last use) pairs held in RAM and written to flash only
+when a tile is added; the least recently used tile goes when the byte
+budget is reached.
+
+Tiles are stored in the byte order of the CPU (little endian on the ESP32
+and on the host).
+*/
+
+#ifndef AlbumArtCache_h
+#define AlbumArtCache_h
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+#include <FS.h>
+
+#include "AlbumArt.h"
+
+#define ALBUM_ART_CACHE_DIR "/art"
+#define ALBUM_ART_CACHE_BUDGET (256 * 1024)
+#define ALBUM_ART_CACHE_MAX_ENTRIES 64
+// albumUri is "spotify:album:" + 22 characters
+#define ALBUM_ART_CACHE_URI_LENGTH 40
+
+struct AlbumArtCacheStats
+{
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long stores;
+  unsigned long evictions;
+  // tiles read back with draw() or load() and the time that took
+  unsigned long loads;
+  unsigned long loadMicros;
+};
+
+class AlbumArtCache
+{
+public:
+  AlbumArtCache(fs::FS &fs, uint32_t budgetBytes = ALBUM_ART_CACHE_BUDGET);
+
+  // Reads the index, call after the filesystem is mounted
+  bool begin();
+  // Counts as hit or miss and marks the tile as used
+  bool contains(const char *albumUri);
+  // Streams the tile row by row from flash onto the display
+  bool draw(const char *albumUri, Adafruit_GFX &display, int16_t x = 0, int16_t y = 0);
+  bool load(const char *albumUri, uint16_t *tile);
+  bool store(const char *albumUri, const uint16_t *tile);
+
+  uint8_t count() { return entryCount; }
+  uint8_t capacity() { return maxEntries; }
+  AlbumArtCacheStats stats = {0, 0, 0, 0, 0, 0};
+
+private:
+  struct Entry
+  {
+    uint32_t key;
+    uint32_t lastUsed;
+  };
+
+  struct TileHeader
+  {
+    uint32_t magic;
+    // the key is a hash, the full URI tells collisions apart
+    char albumUri[ALBUM_ART_CACHE_URI_LENGTH];
+  };
+
+  fs::FS &fs;
+  uint8_t maxEntries;
+  Entry entries[ALBUM_ART_CACHE_MAX_ENTRIES];
+  uint8_t entryCount = 0;
+  uint32_t useClock = 0;
+
+  static uint32_t keyOf(const char *albumUri);
+  static void tilePath(uint32_t key, char *path);
+  int findEntry(uint32_t key);
+  File openTile(const char *albumUri);
+  void removeEntry(int index);
+  bool evictOldest();
+  bool saveIndex();
+};
+
+#endif
@@ -0,0 +1,264 @@
+#include "AlbumPalette.h"
+
+#define ALBUM_PALETTE_SAMPLES ((ALBUM_ART_SIZE / ALBUM_PALETTE_SAMPLE_STEP) * (ALBUM_ART_SIZE / ALBUM_PALETTE_SAMPLE_STEP))
+
+struct PaletteBox
+{
+    uint16_t start;
+    uint16_t end;
+    uint8_t axis;
+    uint8_t range;
+};
+
+// red and blue have 5 bits, doubled they compare with the 6 bits of green
+static inline uint8_t channel(uint16_t color, uint8_t axis)
+{
+    switch (axis)
+    {
+    case 0:
+        return (color >> 11) << 1;
+    case 1:
+        return (color >> 5) & 0x3F;
+    default:
+        return (color & 0x1F) << 1;
+    }
+}
+
+// finds the channel with the widest spread of the box
+static void measureBox(const uint16_t *samples, PaletteBox &box)
+{
+    uint8_t low[3] = {63, 63, 63};
+    uint8_t high[3] = {0, 0, 0};
+    for (uint16_t i = box.start; i < box.end; i++)
+    {
+        for (uint8_t axis = 0; axis < 3; axis++)
+        {
+            uint8_t value = channel(samples[i], axis);
+            if (value < low[axis])
+            {
+                low[axis] = value;
+            }
+            if (value > high[axis])
+            {
+                high[axis] = value;
+            }
+        }
+    }
+    box.range = 0;
+    box.axis = 0;
+    for (uint8_t axis = 0; axis < 3; axis++)
+    {
+        if (box.end - box.start > 1 && high[axis] - low[axis] > box.range)
+        {
+            box.range = high[axis] - low[axis];
+            box.axis = axis;
+        }
+    }
+}
+
+// splits at the median of the widest channel, returns the start of the upper half
+static uint16_t splitBox(uint16_t *samples, const PaletteBox &box)
+{
+    uint16_t histogram[64];
+    memset(histogram, 0, sizeof(histogram));
+    uint8_t highest = 0;
+    for (uint16_t i = box.start; i < box.end; i++)
+    {
+        uint8_t value = channel(samples[i], box.axis);
+        histogram[value]++;
+        if (value > highest)
+        {
+            highest = value;
+        }
+    }
+    uint16_t half = (box.end - box.start) / 2;
+    uint16_t below = 0;
+    uint8_t median = 0;
+    while (below + histogram[median] <= half && median < highest)
+    {
+        below += histogram[median++];
+    }
+    // the upper half always keeps the highest value, so both halves have samples
+    if (median == highest)
+    {
+        median--;
+    }
+
+    uint16_t left = box.start;
+    uint16_t right = box.end;
+    while (left < right)
+    {
+        if (channel(samples[left], box.axis) <= median)
+        {
+            left++;
+        }
+        else
+        {
+            uint16_t swap = samples[left];
+            samples[left] = samples[--right];
+            samples[right] = swap;
+        }
+    }
+    return left;
+}
+
+uint8_t extractPalette(const uint16_t *tile, PaletteColor *palette, uint8_t maxColors)
+{
+    uint16_t samples[ALBUM_PALETTE_SAMPLES];
+    uint16_t sampleCount = 0;
+    for (uint8_t y = ALBUM_PALETTE_SAMPLE_STEP / 2; y < ALBUM_ART_SIZE; y += ALBUM_PALETTE_SAMPLE_STEP)
+    {
+        for (uint8_t x = ALBUM_PALETTE_SAMPLE_STEP / 2; x < ALBUM_ART_SIZE; x += ALBUM_PALETTE_SAMPLE_STEP)
+        {
+            samples[sampleCount++] = tile[y * ALBUM_ART_SIZE + x];
+        }
+    }
+
+    PaletteBox boxes[ALBUM_PALETTE_COLORS];
+    if (maxColors > ALBUM_PALETTE_COLORS)
+    {
+        maxColors = ALBUM_PALETTE_COLORS;
+    }
+    uint8_t boxCount = 1;
+    boxes[0].start = 0;
+    boxes[0].end = sampleCount;
+    measureBox(samples, boxes[0]);
+    while (boxCount < maxColors)
+    {
+        // the box with the widest spread goes next
+        uint8_t widest = 0;
+        for (uint8_t i = 1; i < boxCount; i++)
+        {
+            if (boxes[i].range > boxes[widest].range)
+            {
+                widest = i;
+            }
+        }
+        if (boxes[widest].range == 0)
+        {
+            // every box is a single color
+            break;
+        }
+        uint16_t middle = splitBox(samples, boxes[widest]);
+        boxes[boxCount].start = middle;
+        boxes[boxCount].end = boxes[widest].end;
+        boxes[widest].end = middle;
+        measureBox(samples, boxes[widest]);
+        measureBox(samples, boxes[boxCount]);
+        boxCount++;
+    }
+
+    for (uint8_t i = 0; i < boxCount; i++)
+    {
+        uint32_t r = 0;
+        uint32_t g = 0;
+        uint32_t b = 0;
+        for (uint16_t s = boxes[i].start; s < boxes[i].end; s++)
+        {
+            r += samples[s] >> 11;
+            g += (samples[s] >> 5) & 0x3F;
+            b += samples[s] & 0x1F;
+        }
+        uint16_t count = boxes[i].end - boxes[i].start;
+        // averages back to 8 bits per channel
+        palette[i].r = (r * 255 + count * 31 / 2) / (count * 31);
+        palette[i].g = (g * 255 + count * 63 / 2) / (count * 63);
+        palette[i].b = (b * 255 + count * 31 / 2) / (count * 31);
+        palette[i].count = count;
+    }
+
+    // most frequent first, there are only a few
+    for (uint8_t i = 1; i < boxCount; i++)
+    {
+        PaletteColor color = palette[i];
+        uint8_t j = i;
+        while (j > 0 && palette[j - 1].count < color.count)
+        {
+            palette[j] = palette[j - 1];
+            j--;
+        }
+        palette[j] = color;
+    }
+    return boxCount;
+}
+
+static inline uint8_t maxChannel(const PaletteColor &color)
+{
+    uint8_t high = color.r > color.g ? color.r : color.g;
+    return high > color.b ? high : color.b;
+}
+
+static inline uint8_t minChannel(const PaletteColor &color)
+{
+    uint8_t low = color.r < color.g ? color.r : color.g;
+    return low < color.b ? low : color.b;
+}
+
+// frequent and colorful wins, gray still counts a bit
+static inline uint32_t score(const PaletteColor &color)
+{
+    return (uint32_t)color.count * (maxChannel(color) - minChannel(color) + 32);
+}
+
+static inline uint16_t distance(const PaletteColor &a, const PaletteColor &b)
+{
+    return abs(a.r - b.r) + abs(a.g - b.g) + abs(a.b - b.b);
+}
+
+// dark colors are hardly visible on the panel, lift the brightest channel to 200
+static PaletteColor brighten(PaletteColor color)
+{
+    uint8_t high = maxChannel(color);
+    if (high < 200)
+    {
+        color.r = color.r * 200 / high;
+        color.g = color.g * 200 / high;
+        color.b = color.b * 200 / high;
+    }
+    return color;
+}
+
+static inline uint16_t toRgb565(uint8_t r, uint8_t g, uint8_t b)
+{
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+}
+
+PlaybackTheme themeFromPalette(const PaletteColor *palette, uint8_t count, const PlaybackTheme &fallback)
+{
+    // near black only works as background
+    const uint8_t minimumBrightness = 48;
+    const uint16_t minimumDistance = 96;
+
+    int bar = -1;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (maxChannel(palette[i]) >= minimumBrightness && (bar < 0 || score(palette[i]) > score(palette[bar])))
+        {
+            bar = i;
+        }
+    }
+    if (bar < 0)
+    {
+        return fallback;
+    }
+    int progress = -1;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (i != bar && maxChannel(palette[i]) >= minimumBrightness &&
+            distance(brighten(palette[i]), brighten(palette[bar])) >= minimumDistance &&
+            (progress < 0 || score(palette[i]) > score(palette[progress])))
+        {
+            progress = i;
+        }
+    }
+
+    PaletteColor barColor = brighten(palette[bar]);
+    PaletteColor progressColor = progress < 0 ? barColor : brighten(palette[progress]);
+
+    PlaybackTheme theme = fallback;
+    theme.bar = toRgb565(barColor.r, barColor.g, barColor.b);
+    theme.progress = toRgb565(progressColor.r, progressColor.g, progressColor.b);
+    theme.progressBackground = toRgb565(progressColor.r >> 2, progressColor.g >> 2, progressColor.b >> 2);
+    theme.text = toRgb565((255 + barColor.r) / 2, (255 + barColor.g) / 2, (255 + barColor.b) / 2);
+    return theme;
+}
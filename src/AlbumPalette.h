@@ -0,0 +1,39 @@
+/*
+AlbumPalette - dominant colors of an album cover
+
+Median cut in integers over every ALBUM_PALETTE_SAMPLE_STEP-th pixel of a
+decoded ALBUM_ART_SIZE tile (256 samples by default). Every split is one
+histogram and one partition pass over its box, so the cost is fixed by the
+sample count and not by the cover: well below a millisecond, small enough
+to run right after the decode between two frames.
+*/
+
+#ifndef AlbumPalette_h
+#define AlbumPalette_h
+
+#include <Arduino.h>
+
+#include "AlbumArt.h"
+#include "PlaybackRender.h"
+
+#define ALBUM_PALETTE_COLORS 8
+#define ALBUM_PALETTE_SAMPLE_STEP 4
+
+struct PaletteColor
+{
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+  // samples this color stands for
+  uint16_t count;
+};
+
+// Fills palette with up to maxColors colors, most frequent first, returns how many
+uint8_t extractPalette(const uint16_t *tile, PaletteColor *palette, uint8_t maxColors = ALBUM_PALETTE_COLORS);
+
+// Bars in the most prominent color, the progress in a second one that is
+// clearly different, text tinted with the bar color. Backgrounds stay as in
+// fallback, which is also returned for covers without usable colors.
+PlaybackTheme themeFromPalette(const PaletteColor *palette, uint8_t count, const PlaybackTheme &fallback);
+
+#endif
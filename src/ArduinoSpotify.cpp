@@ -19,16 +19,19 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
 #include "ArduinoSpotify.h"
+#include "Log.h"
 #include "iostream"
 
 ArduinoSpotify::ArduinoSpotify(Client &client)
 {
     this->client = &client;
+    initRequestBudgets();
 }
 
 ArduinoSpotify::ArduinoSpotify(Client &client, char *bearerToken)
 {
     this->client = &client;
+    initRequestBudgets();
     sprintf(this->_bearerToken, "Bearer %s", bearerToken);
     initStructs();
 }
@@ -36,6 +39,7 @@ ArduinoSpotify::ArduinoSpotify(Client &client, char *bearerToken)
 ArduinoSpotify::ArduinoSpotify(Client &client, const char *clientId, const char *clientSecret, const char *refreshToken)
 {
     this->client = &client;
+    initRequestBudgets();
     this->_clientId = clientId;
     this->_clientSecret = clientSecret;
     this->_refreshToken = refreshToken;
@@ -45,13 +49,11 @@ ArduinoSpotify::ArduinoSpotify(Client &client, const char *clientId, const char
 int ArduinoSpotify::makeRequestWithBody(const char *type, const char *command, const char *authorization, const char *body, const char *contentType, const char *host)
 {
     client->flush();
-    #ifdef SPOTIFY_DEBUG
-        Serial.println(host);
-    #endif
+    LOG_DEBUG("request to %s", host);
     client->setTimeout(SPOTIFY_TIMEOUT);
-    if (!client->connect(host, portNumber))
+    if (!(keepConnection && client->connected()) && !connectClient(host))
     {
-        Serial.println(F("Connection failed"));
+        LOG_WARN("connection to %s failed", host);
         return -1;
     }
 
@@ -88,7 +90,7 @@ int ArduinoSpotify::makeRequestWithBody(const char *type, const char *command, c
 
     if (client->println() == 0)
     {
-        Serial.println(F("Failed to send request"));
+        LOG_WARN("request not sent");
         return -2;
     }
 
@@ -111,8 +113,8 @@ int ArduinoSpotify::makeGetRequest(const char *command, const char *authorizatio
     client->flush();
     client->setTimeout(SPOTIFY_TIMEOUT);
     if(!client->connected()) {
-        if (!client->connect(host, portNumber)) {
-            Serial.println(F("Connection failed"));
+        if (!connectClient(host)) {
+            LOG_WARN("connection to %s failed", host);
             return -1;
         }
     }
@@ -145,7 +147,7 @@ int ArduinoSpotify::makeGetRequest(const char *command, const char *authorizatio
 
     if (client->println() == 0)
     {
-        Serial.println(F("Failed to send request"));
+        LOG_WARN("request not sent");
         return -2;
     }
 
@@ -161,11 +163,15 @@ void ArduinoSpotify::setRefreshToken(const char *refreshToken)
 
 bool ArduinoSpotify::refreshAccessToken()
 {
+    if (!requestAllowed(endpoint_token))
+    {
+        return false;
+    }
     char body[300];
     sprintf(body, refreshAccessTokensBody, _refreshToken, _clientId, _clientSecret);
 
+    LOG_DEBUG("token refresh");
 #ifdef SPOTIFY_DEBUG
-    Serial.println(body);
     printStack();
 #endif
 
@@ -174,12 +180,10 @@ bool ArduinoSpotify::refreshAccessToken()
     {
         skipHeaders();
     }
+    handleRateLimit(statusCode);
     unsigned long now = millis();
 
-#ifdef SPOTIFY_DEBUG
-    Serial.print("status Code");
-    Serial.println(statusCode);
-#endif
+    LOG_DEBUG("token status %d", statusCode);
 
     bool refreshed = false;
     if (statusCode == 200)
@@ -209,7 +213,7 @@ bool ArduinoSpotify::checkAndRefreshAccessToken()
     unsigned long timeSinceLastRefresh = millis() - timeTokenRefreshed;
     if (timeSinceLastRefresh >= tokenTimeToLiveMs)
     {
-        Serial.println("Refresh of the Access token is due, doing that now.");
+        LOG_INFO("access token expired, refreshing");
         closeClient();
         bool success = refreshAccessToken();
         return success;
@@ -219,27 +223,38 @@ bool ArduinoSpotify::checkAndRefreshAccessToken()
     return true;
 }
 
+void ArduinoSpotify::swapTokenContext(SpotifyTokenContext &context)
+{
+    SpotifyTokenContext own;
+    memcpy(own.bearerToken, _bearerToken, sizeof(own.bearerToken));
+    own.refreshToken = _refreshToken;
+    own.refreshedAt = timeTokenRefreshed;
+    own.timeToLiveMs = tokenTimeToLiveMs;
+
+    memcpy(_bearerToken, context.bearerToken, sizeof(_bearerToken));
+    _refreshToken = context.refreshToken;
+    timeTokenRefreshed = context.refreshedAt;
+    tokenTimeToLiveMs = context.timeToLiveMs;
+    context = own;
+}
+
 const char *ArduinoSpotify::requestAccessTokens(const char *code, const char *redirectUrl)
 {
 
     char body[500];
     sprintf(body, requestAccessTokensBody, code, redirectUrl, _clientId, _clientSecret);
 
-#ifdef SPOTIFY_DEBUG
-    Serial.println(body);
-#endif
+    LOG_DEBUG("token request");
 
     int statusCode = makePostRequest(SPOTIFY_TOKEN_ENDPOINT, NULL, body, "application/x-www-form-urlencoded", SPOTIFY_ACCOUNTS_HOST);
     if (statusCode > 0)
     {
         skipHeaders();
     }
+    handleRateLimit(statusCode);
     unsigned long now = millis();
 
-#ifdef SPOTIFY_DEBUG
-    Serial.print("status Code");
-    Serial.println(statusCode);
-#endif
+    LOG_DEBUG("token status %d", statusCode);
 
     if (statusCode == 200)
     {
@@ -266,7 +281,13 @@ const char *ArduinoSpotify::requestAccessTokens(const char *code, const char *re
 bool ArduinoSpotify::play(const char *deviceId)
 {
     char command[100] = SPOTIFY_PLAY_ENDPOINT;
-    return playerControl(command, deviceId);
+    bool success = playerControl(command, deviceId);
+    if (success)
+    {
+        applyLocalCommand(command_play, 0);
+        scheduleConfirmation();
+    }
+    return success;
 }
 
 bool ArduinoSpotify::playAdvanced(char *body, const char *deviceId)
@@ -278,18 +299,34 @@ bool ArduinoSpotify::playAdvanced(char *body, const char *deviceId)
 bool ArduinoSpotify::pause(const char *deviceId)
 {
     char command[100] = SPOTIFY_PAUSE_ENDPOINT;
-    return playerControl(command, deviceId);
+    bool success = playerControl(command, deviceId);
+    if (success)
+    {
+        applyLocalCommand(command_pause, 0);
+        scheduleConfirmation();
+    }
+    return success;
 }
 
 bool ArduinoSpotify::setVolume(int volume, const char *deviceId)
 {
     char command[125];
     sprintf(command, SPOTIFY_VOLUME_ENDPOINT, volume);
-    return playerControl(command, deviceId);
+    bool success = playerControl(command, deviceId);
+    if (success)
+    {
+        // not part of currently playing, so there is nothing to confirm
+        applyLocalCommand(command_volume, volume);
+    }
+    return success;
 }
 
 bool ArduinoSpotify::playerControl(char *command, const char *deviceId, const char *body)
 {
+    if (!requestAllowed(endpoint_player))
+    {
+        return false;
+    }
     if (deviceId[0] != 0)
     {
         char *questionMarkPointer;
@@ -307,16 +344,18 @@ bool ArduinoSpotify::playerControl(char *command, const char *deviceId, const ch
         strcat(command, deviceIdBuff);
     }
 
-#ifdef SPOTIFY_DEBUG
-    Serial.println(command);
-    Serial.println(body);
-#endif
+    LOG_DEBUG("%s", command);
 
     if (autoTokenRefresh)
     {
         checkAndRefreshAccessToken();
     }
     int statusCode = makePutRequest(command, _bearerToken, body);
+    if (statusCode == 429)
+    {
+        skipHeaders(false);
+    }
+    handleRateLimit(statusCode);
 
     closeClient();
     //Will return 204 if all went well.
@@ -325,6 +364,10 @@ bool ArduinoSpotify::playerControl(char *command, const char *deviceId, const ch
 
 bool ArduinoSpotify::playerNavigate(char *command, const char *deviceId)
 {
+    if (!requestAllowed(endpoint_player))
+    {
+        return false;
+    }
     if (deviceId[0] != 0)
     {
         char deviceIdBuff[50];
@@ -332,15 +375,18 @@ bool ArduinoSpotify::playerNavigate(char *command, const char *deviceId)
         strcat(command, deviceIdBuff);
     }
 
-#ifdef SPOTIFY_DEBUG
-    Serial.println(command);
-#endif
+    LOG_DEBUG("%s", command);
 
     if (autoTokenRefresh)
     {
         checkAndRefreshAccessToken();
     }
     int statusCode = makePostRequest(command, _bearerToken);
+    if (statusCode == 429)
+    {
+        skipHeaders(false);
+    }
+    handleRateLimit(statusCode);
 
     closeClient();
     //Will return 204 if all went well.
@@ -350,16 +396,32 @@ bool ArduinoSpotify::playerNavigate(char *command, const char *deviceId)
 bool ArduinoSpotify::nextTrack(const char *deviceId)
 {
     char command[100] = SPOTIFY_NEXT_TRACK_ENDPOINT;
-    return playerNavigate(command, deviceId);
+    bool success = playerNavigate(command, deviceId);
+    if (success)
+    {
+        applyLocalCommand(command_next, 0);
+        scheduleConfirmation();
+    }
+    return success;
 }
 
 bool ArduinoSpotify::previousTrack(const char *deviceId)
 {
     char command[100] = SPOTIFY_PREVIOUS_TRACK_ENDPOINT;
-    return playerNavigate(command, deviceId);
+    bool success = playerNavigate(command, deviceId);
+    if (success)
+    {
+        applyLocalCommand(command_previous, 0);
+        scheduleConfirmation();
+    }
+    return success;
 }
 bool ArduinoSpotify::seek(int position, const char *deviceId)
 {
+    if (!requestAllowed(endpoint_player))
+    {
+        return false;
+    }
     char command[100] = SPOTIFY_SEEK_ENDPOINT;
     char tempBuff[100];
     sprintf(tempBuff, "?position_ms=%d", position);
@@ -370,8 +432,8 @@ bool ArduinoSpotify::seek(int position, const char *deviceId)
         strcat(command, tempBuff);
     }
 
+    LOG_DEBUG("%s", command);
 #ifdef SPOTIFY_DEBUG
-    Serial.println(command);
     printStack();
 #endif
 
@@ -380,19 +442,32 @@ bool ArduinoSpotify::seek(int position, const char *deviceId)
         checkAndRefreshAccessToken();
     }
     int statusCode = makePutRequest(command, _bearerToken);
+    if (statusCode == 429)
+    {
+        skipHeaders(false);
+    }
+    handleRateLimit(statusCode);
     closeClient();
     //Will return 204 if all went well.
+    if (statusCode == 204)
+    {
+        applyLocalCommand(command_seek, position);
+        scheduleConfirmation();
+    }
     return statusCode == 204;
 }
 
 bool ArduinoSpotify::transferPlayback(const char *deviceId, bool play)
 {
+    if (!requestAllowed(endpoint_player))
+    {
+        return false;
+    }
     char body[100];
     sprintf(body, "{\"device_ids\":[\"%s\"],\"play\":\"%s\"}", deviceId, (play?"true":"false"));
 
+    LOG_DEBUG("transfer playback to %s", deviceId);
 #ifdef SPOTIFY_DEBUG
-    Serial.println(SPOTIFY_PLAYER_ENDPOINT);
-    Serial.println(body);
     printStack();
 #endif
 
@@ -401,6 +476,11 @@ bool ArduinoSpotify::transferPlayback(const char *deviceId, bool play)
         checkAndRefreshAccessToken();
     }
     int statusCode = makePutRequest(SPOTIFY_PLAYER_ENDPOINT, _bearerToken, body);
+    if (statusCode == 429)
+    {
+        skipHeaders(false);
+    }
+    handleRateLimit(statusCode);
     closeClient();
     //Will return 204 if all went well.
     return statusCode == 204;
@@ -416,14 +496,22 @@ CurrentlyPlaying ArduinoSpotify::getCurrentlyPlaying(const char *market)
         strcat(command, marketBuff);
     }
 
+    LOG_DEBUG("%s", command);
 #ifdef SPOTIFY_DEBUG
-    Serial.println(command);
     printStack();
 #endif
 
+    if (!requestAllowed(endpoint_currently_playing))
+    {
+        return cachedCurrentlyPlaying();
+    }
+
     // Get from https://arduinojson.org/v6/assistant/
     const size_t bufferSize = currentlyPlayingBufferSize;
     //CurrentlyPlaying currentlyPlaying;
+    // A 429 keeps the last result
+    bool lastError = currentlyPlaying.error;
+    currentlyPlaying.rateLimited = false;
     // This flag will get cleared if all goes well
     currentlyPlaying.error = true;
     if (autoTokenRefresh)
@@ -432,31 +520,35 @@ CurrentlyPlaying ArduinoSpotify::getCurrentlyPlaying(const char *market)
     }
     int statusCode = makeGetRequest(command, _bearerToken);
 
-Serial.print("Status Code: ");
-    Serial.println(statusCode);
-    if (statusCode < 0) {
+    LOG_DEBUG("currently playing: status %d", statusCode);
+    if (statusCode < 0)
+    {
         closeClient();
     }
-
-
-
-
 #ifdef SPOTIFY_DEBUG
-    Serial.print("Status Code: ");
-    Serial.println(statusCode);
     printStack();
 #endif
     if (statusCode > 0)
     {
         skipHeaders();
+    }
+    handleRateLimit(statusCode);
+    if (statusCode == 429)
+    {
+        closeClient();
+        currentlyPlaying.error = lastError;
+        return cachedCurrentlyPlaying();
+    }
+    if (statusCode > 0)
+    {
         currentlyPlaying.statusCode = statusCode;
     }
 
     if (statusCode == 200)
     {
         //Apply Json Filter: https://arduinojson.org/v6/example/filter/
-        DynamicJsonDocument filter(288);
-        //StaticJsonDocument<288> filter;
+        DynamicJsonDocument filter(384);
+        //StaticJsonDocument<384> filter;
         filter["is_playing"] = true;
         filter["progress_ms"] = true;
 
@@ -475,6 +567,10 @@ Serial.print("Status Code: ");
         filter_item_album["name"] = true;
         filter_item_album["uri"] = true;
 
+        JsonObject filter_item_album_images_0 = filter_item_album["images"].createNestedObject();
+        filter_item_album_images_0["url"] = true;
+        filter_item_album_images_0["width"] = true;
+
         // Allocate DynamicJsonDocument
         DynamicJsonDocument doc(bufferSize);
 
@@ -493,11 +589,7 @@ Serial.print("Status Code: ");
             currentlyPlaying.firstArtistName[SPOTIFY_NAME_CHAR_LENGTH-1] = '\0'; //In case the song was longer than the size of buffer
             
             // create a shorted version to display
-            strcpy(currentlyPlaying.shortFirstArtistName, currentlyPlaying.firstArtistName);
-            auto index_p = strchr(currentlyPlaying.shortFirstArtistName, '&');
-            if (index_p != NULL) {
-                *index_p = '\0';
-            }
+            shortenName(currentlyPlaying.shortFirstArtistName, currentlyPlaying.firstArtistName, "&");
             
             strncpy(currentlyPlaying.firstArtistUri, firstArtist["uri"].as<const char *>(), SPOTIFY_URI_CHAR_LENGTH);
             currentlyPlaying.firstArtistUri[SPOTIFY_URI_CHAR_LENGTH-1] = '\0';
@@ -512,6 +604,17 @@ Serial.print("Status Code: ");
             //currentlyPlaying.albumName = (char *)item["album"]["name"].as<char *>();
             //currentlyPlaying.albumUri = (char *)item["album"]["uri"].as<char *>();
 
+            // the images are sorted widest first, the last one that still fills the tile is the smallest download
+            currentlyPlaying.albumImageUrl[0] = '\0';
+            for (JsonObject image : item["album"]["images"].as<JsonArray>())
+            {
+                if (image["width"].as<int>() >= ALBUM_ART_SIZE)
+                {
+                    strncpy(currentlyPlaying.albumImageUrl, image["url"].as<const char *>(), SPOTIFY_URL_CHAR_LENGTH);
+                    currentlyPlaying.albumImageUrl[SPOTIFY_URL_CHAR_LENGTH-1] = '\0';
+                }
+            }
+
             // -----------Track-----------------
             strncpy(currentlyPlaying.trackId, item["id"].as<const char *>(), SPOTIFY_URI_CHAR_LENGTH);
             currentlyPlaying.trackId[SPOTIFY_URI_CHAR_LENGTH-1] = '\0';
@@ -519,19 +622,7 @@ Serial.print("Status Code: ");
             currentlyPlaying.trackName[SPOTIFY_NAME_CHAR_LENGTH-1] = '\0';
 
             // create a shorted version to display
-            strcpy(currentlyPlaying.shortTrackName, currentlyPlaying.trackName);
-            index_p = strchr(currentlyPlaying.shortTrackName, '(');
-            if (index_p != NULL) {
-                *index_p = '\0';
-            }
-            index_p = strchr(currentlyPlaying.shortTrackName, '[');
-            if (index_p != NULL) {
-                *index_p = '\0';
-            }
-            index_p = strchr(currentlyPlaying.shortTrackName, '-');
-            if (index_p != NULL) {
-                *index_p = '\0';
-            }
+            shortenName(currentlyPlaying.shortTrackName, currentlyPlaying.trackName, "([-");
             
             currentlyPlaying.trackPopularity = item["popularity"].as<short>();
             strncpy(currentlyPlaying.trackUri, item["uri"].as<char *>(), SPOTIFY_URI_CHAR_LENGTH);
@@ -544,13 +635,15 @@ Serial.print("Status Code: ");
 
             currentlyPlaying.progressMs = doc["progress_ms"].as<long>();
             currentlyPlaying.duraitonMs = item["duration_ms"].as<long>();
+            progressMsAtFetch = currentlyPlaying.progressMs;
+            timeFetched = millis();
+            reconcileLocalState();
 
             currentlyPlaying.error = false;
         }
         else
         {
-            Serial.print(F("deserializeJson() failed with code "));
-            Serial.println(error.c_str());
+            LOG_WARN("currently playing not parsed: %s", error.c_str());
         }
     }
     if (statusCode == 204)
@@ -563,6 +656,38 @@ Serial.print("Status Code: ");
 }
 
 AudioFeatures ArduinoSpotify::getAudioFeatures(const char *market, const char *trackId) {
+    requestAudioFeatures(market, trackId);
+    return audioFeatures;
+}
+
+bool ArduinoSpotify::getPackedAudioFeatures(PackedAudioFeatures &features, const char *market, const char *trackId) {
+    requestAudioFeatures(market, trackId);
+    packAudioFeatures(audioFeatures, features);
+    return !audioFeatures.error && !audioFeatures.rateLimited;
+}
+
+static uint8_t quantize(float value, float scale, float max) {
+    if (!(value > 0)) {
+        return 0;
+    }
+    return value >= max ? (uint8_t)(max * scale + 0.5f) : (uint8_t)(value * scale + 0.5f);
+}
+
+void ArduinoSpotify::packAudioFeatures(const AudioFeatures &features, PackedAudioFeatures &packed) {
+    packed.danceability = quantize(features.danceability, 255, 1);
+    packed.energy = quantize(features.energy, 255, 1);
+    packed.speechiness = quantize(features.speechiness, 255, 1);
+    packed.acousticness = quantize(features.acousticness, 255, 1);
+    packed.instrumentalness = quantize(features.instrumentalness, 255, 1);
+    packed.liveness = quantize(features.liveness, 255, 1);
+    packed.valence = quantize(features.valence, 255, 1);
+    packed.loudness = quantize(-features.loudness, 2, 127);
+    packed.tempo = features.tempo > 0 ? (features.tempo >= 6553 ? 65530 : (uint16_t)(features.tempo * 10 + 0.5f)) : 0;
+    packed.keyMode = (features.key >= 0 && features.key <= 11 ? features.key : PACKED_KEY_NONE) | (features.mode == 1 ? 0x80 : 0);
+    packed.reserved = 0;
+}
+
+void ArduinoSpotify::requestAudioFeatures(const char *market, const char *trackId) {
     char command[100] = SPOTIFY_AUDIO_FEATURES_ENDPOINT;
     if (trackId[0] != 0) {
         strncat(command, trackId, 100);
@@ -572,26 +697,41 @@ AudioFeatures ArduinoSpotify::getAudioFeatures(const char *market, const char *t
         sprintf(marketBuff, "?market=%s", market);
         strncat(command, marketBuff, 100);
     }
+    LOG_DEBUG("%s", command);
     #ifdef SPOTIFY_DEBUG
-        Serial.println(command);
         printStack();
     #endif
 
+    if (!requestAllowed(endpoint_audio_features)) {
+        audioFeatures.rateLimited = true;
+        return;
+    }
+
     const size_t bufferSize = audioFeaturesBufferSize;
+    bool lastError = audioFeatures.error;
+    audioFeatures.rateLimited = false;
     // This flag will get cleared if all goes well
     audioFeatures.error = true;
     if (autoTokenRefresh) {
         checkAndRefreshAccessToken();
     }
     int statusCode = makeGetRequest(command, _bearerToken);
+    LOG_DEBUG("status %d", statusCode);
     #ifdef SPOTIFY_DEBUG
-        Serial.print("Status Code: ");
-        Serial.println(statusCode);
         printStack();
     #endif
 
     if (statusCode > 0) {
         skipHeaders();
+    }
+    handleRateLimit(statusCode);
+    if (statusCode == 429) {
+        closeClient();
+        audioFeatures.error = lastError;
+        audioFeatures.rateLimited = true;
+        return;
+    }
+    if (statusCode > 0) {
         audioFeatures.statusCode = statusCode;
     }
     if (statusCode == 200) {
@@ -616,8 +756,7 @@ AudioFeatures ArduinoSpotify::getAudioFeatures(const char *market, const char *t
 
             audioFeatures.error = false;
         } else {
-            Serial.print(F("deserializeJson() failed with code "));
-            Serial.println(error.c_str());
+            LOG_WARN("audio features not parsed: %s", error.c_str());
         }
     #ifdef SPOTIFY_DEBUG
                 serializeJsonPretty(doc, Serial);
@@ -629,126 +768,1061 @@ AudioFeatures ArduinoSpotify::getAudioFeatures(const char *market, const char *t
         // TODO(jh) add empty content to the variables to show that there is no song playing
         audioFeatures.error = false;
     }
-
-    return audioFeatures;
 }
 
-int ArduinoSpotify::getContentLength()
+// The size line of a chunk ("1f4\r\n", extensions after ';' ignored), -1 on a broken response
+static long readChunkSize(Client &client)
 {
+    long size = -1;
+    bool extension = false;
+    while (true)
+    {
+        char c = 0;
+        if (client.readBytes(&c, 1) == 0)
+        {
+            return -1;
+        }
+        if (c == '\n')
+        {
+            return size;
+        }
+        if (c == ';')
+        {
+            extension = true;
+        }
+        if (extension || !isxdigit(c) || size >= 0x1000000)
+        {
+            continue;
+        }
+        int digit = isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+        size = (size < 0 ? 0 : size * 16) + digit;
+    }
+}
 
-    if (client->find("Content-Length:"))
+template <typename Parser>
+bool ArduinoSpotify::streamBody(Parser &parser)
+{
+    uint8_t buffer[128];
+    long remaining = responseChunked ? 0 : responseContentLength;
+    bool complete = !responseChunked && remaining < 0;
+    while (true)
     {
-        int contentLength = client->parseInt();
+        if (responseChunked && remaining == 0)
+        {
+            long size = readChunkSize(*client);
+            if (size <= 0)
+            {
+                complete = size == 0;
+                if (complete)
+                {
+                    // the empty line after the last chunk, so the connection can be reused
+                    char crlf[2];
+                    client->readBytes(crlf, 2);
+                }
+                break;
+            }
+            remaining = size;
+        }
+        size_t wanted = remaining < 0 || remaining > (long)sizeof(buffer) ? sizeof(buffer) : remaining;
+        size_t count = client->readBytes(buffer, wanted);
+        if (count == 0)
+        {
+            // without a length the body ends with the connection
+            break;
+        }
+        parser.feed(buffer, count);
+        if (remaining > 0)
+        {
+            remaining -= count;
+            if (remaining == 0 && !responseChunked)
+            {
+                complete = true;
+                break;
+            }
+            if (remaining == 0)
+            {
+                // the CRLF after the chunk
+                char crlf[2];
+                client->readBytes(crlf, 2);
+            }
+        }
+    }
+    return complete;
+}
+
+bool ArduinoSpotify::getAudioAnalysis(const char *trackId, AudioAnalysisParser &parser, BeatGrid &grid)
+{
+    char command[100] = SPOTIFY_AUDIO_ANALYSIS_ENDPOINT;
+    strncat(command, trackId, sizeof(command) - sizeof(SPOTIFY_AUDIO_ANALYSIS_ENDPOINT));
+    LOG_DEBUG("%s", command);
 #ifdef SPOTIFY_DEBUG
-        Serial.print(F("Content-Length: "));
-        Serial.println(contentLength);
+    printStack();
 #endif
-        return contentLength;
+
+    if (!requestAllowed(endpoint_audio_features))
+    {
+        return false;
+    }
+    if (autoTokenRefresh)
+    {
+        checkAndRefreshAccessToken();
+    }
+    int statusCode = makeGetRequest(command, _bearerToken);
+    if (statusCode > 0)
+    {
+        skipHeaders(false);
+    }
+    handleRateLimit(statusCode);
+    if (statusCode != 200)
+    {
+        LOG_WARN("audio analysis request failed: %d", statusCode);
+        closeClient();
+        return false;
     }
 
-    return -1;
+    // a few hundred kB, fed to the parser as it comes in
+    parser.begin(grid);
+    bool complete = streamBody(parser);
+    closeClient();
+    bool parsed = parser.finish();
+    if (!complete || !parsed)
+    {
+        LOG_WARN("audio analysis incomplete");
+        return false;
+    }
+    return true;
 }
 
-void ArduinoSpotify::skipHeaders(bool tossUnexpectedForJSON)
+int ArduinoSpotify::getPlaybackSummary(PlaybackSummaryParser &parser, PlaybackSummary &summary)
 {
-    // Skip HTTP headers
-    if (!client->find("\r\n\r\n"))
+    if (!requestAllowed(endpoint_currently_playing))
     {
-        Serial.println(F("Invalid response"));
-        return;
+        return 0;
+    }
+    if (autoTokenRefresh)
+    {
+        checkAndRefreshAccessToken();
+    }
+    // the server may have closed a connection that was idle, then it is opened again once
+    bool reused = client->connected();
+    int statusCode = makeGetRequest(SPOTIFY_CURRENTLY_PLAYING_ENDPOINT, _bearerToken);
+    if (statusCode < 0 && reused)
+    {
+        closeClient();
+        statusCode = makeGetRequest(SPOTIFY_CURRENTLY_PLAYING_ENDPOINT, _bearerToken);
+    }
+    if (statusCode > 0)
+    {
+        skipHeaders(false);
+    }
+    handleRateLimit(statusCode);
+    LOG_DEBUG("playback summary status %d", statusCode);
+    if (statusCode == 401)
+    {
+        // the next call refreshes the token
+        tokenTimeToLiveMs = 0;
     }
 
-    if (tossUnexpectedForJSON)
+    if (statusCode == 200)
     {
-        // Was getting stray characters between the headers and the body
-        // This should toss them away
-        while (client->available() && client->peek() != '{')
+        parser.begin(summary);
+        bool complete = streamBody(parser);
+        if (!parser.finish() || !complete)
         {
-            char c = 0;
-            client->readBytes(&c, 1);
-#ifdef SPOTIFY_DEBUG
-            Serial.print(F("Tossing an unexpected character: "));
-            Serial.println(c);
-#endif
+            LOG_WARN("playback summary incomplete");
+            closeClient();
+            return -3;
         }
     }
+    else if (statusCode > 0 && !responseChunked)
+    {
+        skipResponseBody();
+    }
+    else
+    {
+        closeClient();
+    }
+    if (!keepConnection)
+    {
+        closeClient();
+    }
+    return statusCode;
 }
 
-int ArduinoSpotify::getHttpStatusCode()
+int ArduinoSpotify::getDevices(SpotifyDevice *devices, uint8_t capacity)
 {
-    // Check HTTP status
-    if (client->find("HTTP/1.1"))
+    if (!requestAllowed(endpoint_player))
     {
-        int statusCode = client->parseInt();
-#ifdef SPOTIFY_DEBUG
-        Serial.print(F("Status Code: "));
-        Serial.println(statusCode);
-#endif
-        return statusCode;
+        return -1;
+    }
+    if (autoTokenRefresh)
+    {
+        checkAndRefreshAccessToken();
+    }
+    int statusCode = makeGetRequest(SPOTIFY_DEVICES_ENDPOINT, _bearerToken);
+    if (statusCode > 0)
+    {
+        skipHeaders(false);
+    }
+    handleRateLimit(statusCode);
+    if (statusCode != 200)
+    {
+        LOG_WARN("devices request failed: %d", statusCode);
+        closeClient();
+        return -1;
     }
 
-    return -1;
-}
-
-void ArduinoSpotify::parseError()
-{
-    DynamicJsonDocument doc(1000);
-    DeserializationError error = deserializeJson(doc, *client);
-    if (!error)
+    SpotifyDevicesParser parser;
+    parser.begin(devices, capacity);
+    bool complete = streamBody(parser);
+    if (!parser.finish() || !complete)
     {
-        Serial.print(F("getAuthToken error"));
-        serializeJson(doc, Serial);
+        LOG_WARN("devices incomplete");
+        closeClient();
+        return -2;
     }
-    else
+    if (!keepConnection)
     {
-        Serial.print(F("Could not parse error"));
+        closeClient();
     }
+    LOG_DEBUG("%d devices, %d kept", (int)parser.total(), (int)parser.count());
+    return parser.count();
 }
 
-void ArduinoSpotify::lateInit(const char *clientId, const char *clientSecret, const char *refreshToken)
+void ArduinoSpotify::setKeepAlive(bool keepAlive)
 {
-    this->_clientId = clientId;
-    this->_clientSecret = clientSecret;
-    this->_refreshToken = refreshToken;
-    initStructs();
+    keepConnection = keepAlive;
+    if (!keepAlive)
+    {
+        closeClient();
+    }
 }
 
-void ArduinoSpotify::initStructs()
+void ArduinoSpotify::shortenName(char *shortName, const char *name, const char *stopChars)
 {
-    currentlyPlaying.firstArtistName = (char *)malloc(SPOTIFY_NAME_CHAR_LENGTH);
-    currentlyPlaying.shortFirstArtistName = (char *)malloc(SPOTIFY_NAME_CHAR_LENGTH);
-    currentlyPlaying.firstArtistUri = (char *)malloc(SPOTIFY_URI_CHAR_LENGTH);
-    currentlyPlaying.albumName = (char *)malloc(SPOTIFY_NAME_CHAR_LENGTH);
-    currentlyPlaying.albumUri = (char *)malloc(SPOTIFY_URI_CHAR_LENGTH);
-    currentlyPlaying.trackId = (char *)malloc(SPOTIFY_URI_CHAR_LENGTH);
-    currentlyPlaying.trackName = (char *)malloc(SPOTIFY_NAME_CHAR_LENGTH);
-    currentlyPlaying.shortTrackName = (char *)malloc(SPOTIFY_NAME_CHAR_LENGTH);
-    currentlyPlaying.trackUri = (char *)malloc(SPOTIFY_URI_CHAR_LENGTH);
+    // everything from the first stop character on is dropped, e.g. "(Remastered 2011)"
+    size_t length = strcspn(name, stopChars);
+    memcpy(shortName, name, length);
+    shortName[length] = '\0';
 }
 
-// Not sure why this would ever be needed, but sure why not.
-void ArduinoSpotify::destroyStructs()
+bool ArduinoSpotify::getAlbumArt(const char *imageUrl, AlbumArtDecoder &decoder, uint16_t *tile)
 {
-    free(currentlyPlaying.firstArtistName);
-    free(currentlyPlaying.shortFirstArtistName);
-    free(currentlyPlaying.firstArtistUri);
-    free(currentlyPlaying.albumName);
-    free(currentlyPlaying.albumUri);
-    free(currentlyPlaying.trackId);
-    free(currentlyPlaying.trackName);
-    free(currentlyPlaying.shortTrackName);
-    free(currentlyPlaying.trackUri);
-
+    int contentLength = commonGetImage(imageUrl);
+    bool decoded = false;
+    if (contentLength != -1)
+    {
+        decoded = decoder.decode(*client, tile, contentLength == 0 ? -1 : contentLength);
+        if (!decoded)
+        {
+            LOG_WARN("album art not decoded: %s", decoder.error);
+        }
+    }
+    closeClient();
+    return decoded;
 }
 
-void ArduinoSpotify::closeClient()
+// Requests an image from the image server, returns its length (0 if unknown) or -1
+int ArduinoSpotify::commonGetImage(const char *imageUrl)
 {
-    if (client->connected())
+    // https://i.scdn.co/image/... -> host and path
+    const char *hostStart = strstr(imageUrl, "://");
+    hostStart = hostStart == NULL ? imageUrl : hostStart + 3;
+    const char *path = strchr(hostStart, '/');
+    if (path == NULL || path - hostStart >= 40)
     {
+        LOG_WARN("invalid image url");
+        return -1;
+    }
+    char host[40];
+    strncpy(host, hostStart, path - hostStart);
+    host[path - hostStart] = '\0';
+
+    LOG_DEBUG("image %s", path);
 #ifdef SPOTIFY_DEBUG
-        Serial.println(F("Closing client"));
+    printStack();
 #endif
-        Serial.println(F("Closing client ------------------------------------------"));
+
+    // an open connection would be to the api host
+    closeClient();
+    int statusCode = makeGetRequest(path, NULL, "image/jpeg", host);
+    if (statusCode > 0)
+    {
+        skipHeaders(false);
+    }
+    if (statusCode != 200)
+    {
+        LOG_WARN("image request failed: %d", statusCode);
+        return -1;
+    }
+    return responseContentLength == -1 ? 0 : responseContentLength;
+}
+
+int ArduinoSpotify::getContentLength()
+{
+
+    if (client->find("Content-Length:"))
+    {
+        int contentLength = client->parseInt();
+        LOG_DEBUG("content length %d", contentLength);
+        return contentLength;
+    }
+
+    return -1;
+}
+
+void ArduinoSpotify::skipHeaders(bool tossUnexpectedForJSON)
+{
+    // Skip HTTP headers, Retry-After and Content-Length are the only ones we need
+    retryAfterMs = 0;
+    responseContentLength = -1;
+    responseChunked = false;
+    char line[32];
+    uint8_t lineLength = 0;
+    while (true)
+    {
+        char c = 0;
+        if (client->readBytes(&c, 1) == 0)
+        {
+            LOG_WARN("invalid response");
+            return;
+        }
+        if (c == '\r')
+        {
+            continue;
+        }
+        if (c != '\n')
+        {
+            // header names are case insensitive, only the start of a line is kept
+            if (lineLength < sizeof(line) - 1)
+            {
+                line[lineLength++] = tolower(c);
+            }
+            continue;
+        }
+        if (lineLength == 0)
+        {
+            // empty line, the body starts
+            break;
+        }
+        line[lineLength] = '\0';
+        if (strncmp(line, "retry-after:", 12) == 0)
+        {
+            retryAfterMs = strtoul(line + 12, NULL, 10) * 1000;
+        }
+        else if (strncmp(line, "content-length:", 15) == 0)
+        {
+            responseContentLength = strtol(line + 15, NULL, 10);
+        }
+        else if (strncmp(line, "transfer-encoding:", 18) == 0)
+        {
+            responseChunked = strstr(line + 18, "chunked") != NULL;
+        }
+        lineLength = 0;
+    }
+
+    if (tossUnexpectedForJSON)
+    {
+        // Was getting stray characters between the headers and the body
+        // This should toss them away
+        while (client->available() && client->peek() != '{')
+        {
+            char c = 0;
+            client->readBytes(&c, 1);
+            LOG_DEBUG("unexpected character %d", c);
+        }
+    }
+}
+
+void ArduinoSpotify::skipResponseBody()
+{
+    // Needed to send the next request over the same connection
+    char buffer[64];
+    while (responseContentLength > 0)
+    {
+        size_t chunk = responseContentLength < (long)sizeof(buffer) ? responseContentLength : sizeof(buffer);
+        size_t count = client->readBytes(buffer, chunk);
+        if (count == 0)
+        {
+            break;
+        }
+        responseContentLength -= count;
+    }
+}
+
+void ArduinoSpotify::appendDeviceId(char *command, const char *deviceId)
+{
+    if (deviceId[0] != 0)
+    {
+        char deviceIdBuff[60];
+        // params may already be started
+        sprintf(deviceIdBuff, "%cdevice_id=%s", strchr(command, '?') == NULL ? '?' : '&', deviceId);
+        strcat(command, deviceIdBuff);
+    }
+}
+
+bool ArduinoSpotify::queueCommand(SpotifyCommandType type, int value, const char *deviceId, SpotifyCommandCallback callback)
+{
+    commandStats.queued++;
+    // the display shows the result right away, the confirmation poll follows the 204
+    applyLocalCommand(type, value);
+    // a seek or pause after a skip is meant for the new track, so only the
+    // commands since the last next/previous are merged
+    uint8_t mergeFrom = firstPendingCommand;
+    for (uint8_t i = commandCount; i > firstPendingCommand; i--)
+    {
+        if (commandQueue[i - 1].type == command_next || commandQueue[i - 1].type == command_previous)
+        {
+            mergeFrom = i;
+            break;
+        }
+    }
+    for (uint8_t i = mergeFrom; i < commandCount; i++)
+    {
+        SpotifyCommand &pending = commandQueue[i];
+        if (strcmp(pending.deviceId, deviceId) != 0)
+        {
+            continue;
+        }
+        // Only the latest target counts, next/previous add up and are never merged
+        bool playPause = (type == command_play || type == command_pause) &&
+                         (pending.type == command_play || pending.type == command_pause);
+        bool sameSetting = type == pending.type && type != command_next && type != command_previous;
+        if (playPause || sameSetting)
+        {
+            pending.type = type;
+            pending.value = value;
+            pending.callback = callback;
+            commandStats.coalesced++;
+            return true;
+        }
+    }
+
+    if (commandCount >= SPOTIFY_COMMAND_QUEUE_SIZE)
+    {
+        commandStats.dropped++;
+        return false;
+    }
+    SpotifyCommand &command = commandQueue[commandCount++];
+    command.type = type;
+    command.value = value;
+    strncpy(command.deviceId, deviceId, SPOTIFY_DEVICE_ID_CHAR_LENGTH);
+    command.deviceId[SPOTIFY_DEVICE_ID_CHAR_LENGTH - 1] = '\0';
+    command.callback = callback;
+    return true;
+}
+
+int ArduinoSpotify::sendCommand(SpotifyCommand &command)
+{
+    char path[150];
+    const char *type = "PUT ";
+    switch (command.type)
+    {
+    case command_play:
+        strcpy(path, SPOTIFY_PLAY_ENDPOINT);
+        break;
+    case command_pause:
+        strcpy(path, SPOTIFY_PAUSE_ENDPOINT);
+        break;
+    case command_volume:
+        sprintf(path, SPOTIFY_VOLUME_ENDPOINT, command.value);
+        break;
+    case command_seek:
+        sprintf(path, SPOTIFY_SEEK_ENDPOINT "?position_ms=%d", command.value);
+        break;
+    case command_next:
+        type = "POST ";
+        strcpy(path, SPOTIFY_NEXT_TRACK_ENDPOINT);
+        break;
+    case command_previous:
+        type = "POST ";
+        strcpy(path, SPOTIFY_PREVIOUS_TRACK_ENDPOINT);
+        break;
+    case command_shuffle:
+        sprintf(path, SPOTIFY_SHUFFLE_ENDPOINT, command.value ? "true" : "false");
+        break;
+    case command_repeat:
+        sprintf(path, SPOTIFY_REPEAT_ENDPOINT, command.value == repeat_track ? "track" : (command.value == repeat_context ? "context" : "off"));
+        break;
+    }
+    appendDeviceId(path, command.deviceId);
+
+    LOG_DEBUG("%s", path);
+
+    commandStats.sent++;
+    int statusCode = makeRequestWithBody(type, path, _bearerToken);
+    if (statusCode > 0)
+    {
+        skipHeaders(false);
+        if (responseChunked)
+        {
+            // the length of a chunked body is not known, the next command connects again
+            closeClient();
+        }
+        else
+        {
+            skipResponseBody();
+        }
+    }
+    handleRateLimit(statusCode);
+    return statusCode;
+}
+
+int ArduinoSpotify::processCommands()
+{
+    if (commandCount == 0)
+    {
+        return 0;
+    }
+    if (autoTokenRefresh)
+    {
+        checkAndRefreshAccessToken();
+    }
+
+    // The first command opens the connection, the others reuse it
+    closeClient();
+    keepConnection = true;
+    int processed = 0;
+    while (processed < commandCount)
+    {
+        if (!requestAllowed(endpoint_player))
+        {
+            break;
+        }
+        SpotifyCommand &command = commandQueue[processed];
+        int statusCode = sendCommand(command);
+        if (statusCode == 429)
+        {
+            // stays queued until the backoff is over
+            break;
+        }
+        processed++;
+        firstPendingCommand = processed;
+        if (statusCode != 204)
+        {
+            commandStats.failed++;
+        }
+        if (command.type != command_volume)
+        {
+            // also when the command failed, the poll brings back the real state
+            scheduleConfirmation();
+        }
+        if (command.callback != NULL)
+        {
+            command.callback(command.type, command.value, statusCode == 204, statusCode);
+        }
+        if (statusCode < 0)
+        {
+            // connection is gone, the next command connects again
+            closeClient();
+        }
+    }
+    keepConnection = false;
+    closeClient();
+
+    commandCount -= processed;
+    memmove(commandQueue, commandQueue + processed, commandCount * sizeof(SpotifyCommand));
+    firstPendingCommand = 0;
+    return processed;
+}
+
+void ArduinoSpotify::initRequestBudgets()
+{
+    // The display polls every 10s, the bursts are for song changes and buttons
+    setRequestBudget(endpoint_currently_playing, 3, 1000);
+    setRequestBudget(endpoint_audio_features, 3, 2000);
+    setRequestBudget(endpoint_player, 10, 200);
+    setRequestBudget(endpoint_token, 2, 30000);
+}
+
+void ArduinoSpotify::setRequestBudget(SpotifyEndpoint endpoint, uint16_t burst, unsigned long refillIntervalMs)
+{
+    SpotifyRequestBudget &budget = requestBudgets[endpoint];
+    budget.burst = burst;
+    budget.available = burst;
+    budget.refillIntervalMs = refillIntervalMs;
+    budget.lastRefill = millis();
+}
+
+unsigned long ArduinoSpotify::backoffRemainingMs()
+{
+    unsigned long sinceBackoff = millis() - backoffStart;
+    if (sinceBackoff >= backoffMs)
+    {
+        return 0;
+    }
+    return backoffMs - sinceBackoff;
+}
+
+bool ArduinoSpotify::requestAllowed(SpotifyEndpoint endpoint)
+{
+    // The accounts service has its own limits, a 429 of the API does not block a refresh
+    if (endpoint != endpoint_token && backoffRemainingMs() > 0)
+    {
+        rateLimitStats.suppressedBackoff++;
+        return false;
+    }
+
+    SpotifyRequestBudget &budget = requestBudgets[endpoint];
+    unsigned long now = millis();
+    if (budget.available < budget.burst)
+    {
+        unsigned long refills = (now - budget.lastRefill) / budget.refillIntervalMs;
+        if (refills > 0)
+        {
+            budget.available = (refills >= (unsigned long)(budget.burst - budget.available)) ? budget.burst : budget.available + refills;
+            budget.lastRefill += refills * budget.refillIntervalMs;
+        }
+    }
+    else
+    {
+        budget.lastRefill = now;
+    }
+
+    if (budget.available == 0)
+    {
+        rateLimitStats.suppressedBudget++;
+        return false;
+    }
+    budget.available--;
+    rateLimitStats.requests++;
+    return true;
+}
+
+void ArduinoSpotify::handleRateLimit(int statusCode)
+{
+    if (statusCode != 429)
+    {
+        if (statusCode > 0)
+        {
+            consecutiveRateLimits = 0;
+        }
+        return;
+    }
+
+    unsigned long waitMs = retryAfterMs;
+    if (waitMs == 0)
+    {
+        waitMs = (unsigned long)SPOTIFY_DEFAULT_BACKOFF_MS << (consecutiveRateLimits < 5 ? consecutiveRateLimits : 5);
+    }
+    if (consecutiveRateLimits < 255)
+    {
+        consecutiveRateLimits++;
+    }
+    backoffStart = millis();
+    backoffMs = waitMs;
+    rateLimitStats.rateLimited++;
+    rateLimitStats.lastBackoffMs = waitMs;
+    LOG_WARN("rate limited, backing off for %lu ms", waitMs);
+}
+
+CurrentlyPlaying ArduinoSpotify::cachedCurrentlyPlaying()
+{
+    currentlyPlaying.rateLimited = true;
+    return getLocalCurrentlyPlaying();
+}
+
+CurrentlyPlaying ArduinoSpotify::getLocalCurrentlyPlaying()
+{
+    // keep the song progressing between two polls
+    if (!currentlyPlaying.error && currentlyPlaying.isPlaying)
+    {
+        long progress = progressMsAtFetch + (long)(millis() - timeFetched);
+        currentlyPlaying.progressMs = progress < currentlyPlaying.duraitonMs ? progress : currentlyPlaying.duraitonMs;
+    }
+    return currentlyPlaying;
+}
+
+unsigned long ArduinoSpotify::hashString(const char *text)
+{
+    // djb2
+    unsigned long hash = 5381;
+    while (*text)
+    {
+        hash = hash * 33 + (uint8_t)*text++;
+    }
+    return hash;
+}
+
+void ArduinoSpotify::applyLocalCommand(SpotifyCommandType type, int value)
+{
+    if (currentlyPlaying.error)
+    {
+        return;
+    }
+    // freeze the progress at the moment of the command
+    getLocalCurrentlyPlaying();
+    if (!currentlyPlaying.provisional)
+    {
+        expectPlaying = currentlyPlaying.isPlaying;
+        expectTrackChange = false;
+        trackUriHashBeforeCommand = hashString(currentlyPlaying.trackUri);
+    }
+
+    switch (type)
+    {
+    case command_play:
+        currentlyPlaying.isPlaying = true;
+        break;
+    case command_pause:
+        currentlyPlaying.isPlaying = false;
+        break;
+    case command_seek:
+        currentlyPlaying.progressMs = value;
+        break;
+    case command_next:
+    case command_previous:
+        // the new track is unknown until the confirmation poll
+        currentlyPlaying.progressMs = 0;
+        expectTrackChange = true;
+        break;
+    case command_volume:
+        currentlyPlaying.volumePercent = value;
+        return;
+    default:
+        return;
+    }
+    expectPlaying = currentlyPlaying.isPlaying;
+    progressMsAtFetch = currentlyPlaying.progressMs;
+    timeFetched = millis();
+    currentlyPlaying.provisional = true;
+}
+
+void ArduinoSpotify::scheduleConfirmation()
+{
+    confirmationScheduled = true;
+    timeCommandAnswered = millis();
+}
+
+bool ArduinoSpotify::confirmationPollDue()
+{
+    if (confirmationScheduled && millis() - timeCommandAnswered >= SPOTIFY_CONFIRM_POLL_DELAY_MS)
+    {
+        confirmationScheduled = false;
+        return true;
+    }
+    return false;
+}
+
+// Called with a fresh poll result, the server always wins
+void ArduinoSpotify::reconcileLocalState()
+{
+    if (!currentlyPlaying.provisional)
+    {
+        return;
+    }
+    currentlyPlaying.provisional = false;
+    bool trackChanged = hashString(currentlyPlaying.trackUri) != trackUriHashBeforeCommand;
+    if (currentlyPlaying.isPlaying != expectPlaying || trackChanged != expectTrackChange)
+    {
+        commandStats.mismatched++;
+        LOG_DEBUG("player state differs from the applied command");
+    }
+    else
+    {
+        commandStats.confirmed++;
+    }
+}
+
+int ArduinoSpotify::getHttpStatusCode()
+{
+    // Check HTTP status
+    if (client->find("HTTP/1.1"))
+    {
+        int statusCode = client->parseInt();
+        LOG_DEBUG("status %d", statusCode);
+        return statusCode;
+    }
+
+    return -1;
+}
+
+void ArduinoSpotify::parseError()
+{
+    DynamicJsonDocument doc(1000);
+    DeserializationError error = deserializeJson(doc, *client);
+    if (!error)
+    {
+        // {"error": "invalid_grant", "error_description": ...} of the accounts service, {"error": {"message": ...}} of the API
+        const char *reason = doc["error_description"].as<const char *>();
+        if (reason == NULL)
+        {
+            reason = doc["error"]["message"].as<const char *>();
+        }
+        LOG_ERROR("token request failed: %s", reason);
+    }
+    else
+    {
+        LOG_ERROR("token request failed, error not parsed");
+    }
+}
+
+void ArduinoSpotify::lateInit(const char *clientId, const char *clientSecret, const char *refreshToken)
+{
+    this->_clientId = clientId;
+    this->_clientSecret = clientSecret;
+    this->_refreshToken = refreshToken;
+    initStructs();
+}
+
+void ArduinoSpotify::initStructs()
+{
+    currentlyPlaying.error = true;
+    currentlyPlaying.rateLimited = false;
+    currentlyPlaying.provisional = false;
+    currentlyPlaying.volumePercent = -1;
+    currentlyPlaying.statusCode = 0;
+    audioFeatures.error = true;
+    audioFeatures.rateLimited = false;
+    audioFeatures.statusCode = 0;
+    currentlyPlaying.firstArtistName = (char *)malloc(SPOTIFY_NAME_CHAR_LENGTH);
+    currentlyPlaying.shortFirstArtistName = (char *)malloc(SPOTIFY_NAME_CHAR_LENGTH);
+    currentlyPlaying.firstArtistUri = (char *)malloc(SPOTIFY_URI_CHAR_LENGTH);
+    currentlyPlaying.albumName = (char *)malloc(SPOTIFY_NAME_CHAR_LENGTH);
+    currentlyPlaying.albumUri = (char *)malloc(SPOTIFY_URI_CHAR_LENGTH);
+    currentlyPlaying.trackId = (char *)malloc(SPOTIFY_URI_CHAR_LENGTH);
+    currentlyPlaying.trackName = (char *)malloc(SPOTIFY_NAME_CHAR_LENGTH);
+    currentlyPlaying.shortTrackName = (char *)malloc(SPOTIFY_NAME_CHAR_LENGTH);
+    currentlyPlaying.trackUri = (char *)malloc(SPOTIFY_URI_CHAR_LENGTH);
+    currentlyPlaying.albumImageUrl = (char *)malloc(SPOTIFY_URL_CHAR_LENGTH);
+    currentlyPlaying.albumImageUrl[0] = '\0';
+}
+
+// Not sure why this would ever be needed, but sure why not.
+void ArduinoSpotify::destroyStructs()
+{
+    free(currentlyPlaying.firstArtistName);
+    free(currentlyPlaying.shortFirstArtistName);
+    free(currentlyPlaying.firstArtistUri);
+    free(currentlyPlaying.albumName);
+    free(currentlyPlaying.albumUri);
+    free(currentlyPlaying.trackId);
+    free(currentlyPlaying.trackName);
+    free(currentlyPlaying.shortTrackName);
+    free(currentlyPlaying.trackUri);
+    free(currentlyPlaying.albumImageUrl);
+
+}
+
+bool ArduinoSpotify::enableTlsSessions(SpotifyTlsClient &tlsClient)
+{
+    if (tlsSessions == NULL)
+    {
+        tlsSessions = (SpotifyTlsSession *)calloc(SPOTIFY_TLS_SESSIONS, sizeof(SpotifyTlsSession));
+        if (tlsSessions == NULL)
+        {
+            return false;
+        }
+    }
+    this->tlsClient = &tlsClient;
+    return true;
+}
+
+SpotifyTlsSession *ArduinoSpotify::tlsSessionFor(const char *host)
+{
+    SpotifyTlsSession *unused = NULL;
+    for (int i = 0; i < SPOTIFY_TLS_SESSIONS; i++)
+    {
+        if (strcmp(tlsSessions[i].host, host) == 0)
+        {
+            return &tlsSessions[i];
+        }
+        if (unused == NULL && tlsSessions[i].host[0] == '\0')
+        {
+            unused = &tlsSessions[i];
+        }
+    }
+    // the first hosts keep their slots, further ones always do a full handshake
+    if (unused != NULL && strlen(host) < SPOTIFY_TLS_HOST_LENGTH)
+    {
+        strcpy(unused->host, host);
+        unused->length = 0;
+    }
+    else
+    {
+        unused = NULL;
+    }
+    return unused;
+}
+
+void ArduinoSpotify::setResolver(SpotifyResolver &resolver)
+{
+    this->resolver = &resolver;
+    for (int i = 0; i < SPOTIFY_DNS_ENTRIES; i++)
+    {
+        dnsCache[i].host[0] = '\0';
+        dnsCache[i].resolvedAt = 0;
+        dnsCache[i].ttlMs = 0;
+    }
+}
+
+SpotifyDnsEntry *ArduinoSpotify::dnsEntryFor(const char *host)
+{
+    unsigned long now = millis();
+    SpotifyDnsEntry *oldest = &dnsCache[0];
+    for (int i = 0; i < SPOTIFY_DNS_ENTRIES; i++)
+    {
+        if (strcmp(dnsCache[i].host, host) == 0)
+        {
+            return &dnsCache[i];
+        }
+        // ages rather than times, they stay in order when millis() wraps after 49 days; an unused entry goes first
+        if (oldest->host[0] != '\0' &&
+            (dnsCache[i].host[0] == '\0' || now - dnsCache[i].resolvedAt > now - oldest->resolvedAt))
+        {
+            oldest = &dnsCache[i];
+        }
+    }
+    // unlike TLS sessions the answers are cheap, the oldest one makes room
+    if (strlen(host) >= sizeof(oldest->host))
+    {
+        return NULL;
+    }
+    strcpy(oldest->host, host);
+    oldest->ttlMs = 0;
+    return oldest;
+}
+
+bool ArduinoSpotify::lookupHost(const char *host, IPAddress &address, bool &cached)
+{
+    dnsStats.lookups++;
+    SpotifyDnsEntry *entry = dnsEntryFor(host);
+    unsigned long now = millis();
+    cached = entry != NULL && entry->ttlMs > 0 && now - entry->resolvedAt < entry->ttlMs;
+    if (cached)
+    {
+        dnsStats.hits++;
+        address = entry->address;
+        return true;
+    }
+
+    uint32_t ttlSeconds = 0;
+    unsigned long start = micros();
+    bool resolved = resolver->resolve(host, address, ttlSeconds);
+    dnsStats.resolveMicros += micros() - start;
+    if (!resolved)
+    {
+        dnsStats.failures++;
+        return false;
+    }
+    dnsStats.resolutions++;
+    if (entry != NULL)
+    {
+        entry->address = address;
+        entry->resolvedAt = now;
+        entry->ttlMs = (ttlSeconds > SPOTIFY_DNS_MAX_TTL_S ? SPOTIFY_DNS_MAX_TTL_S : ttlSeconds) * 1000;
+    }
+    return true;
+}
+
+bool ArduinoSpotify::openConnection(const char *host)
+{
+    if (resolver == NULL)
+    {
+        return client->connect(host, portNumber);
+    }
+    IPAddress address;
+    bool cached;
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (!lookupHost(host, address, cached))
+        {
+            return false;
+        }
+        // the TLS client still needs the name for SNI and the certificate
+        if (tlsClient != NULL)
+        {
+            tlsClient->setServerName(host);
+        }
+        if (client->connect(address, portNumber))
+        {
+            return true;
+        }
+        // the next connect asks again, the host may have moved before the TTL ran out
+        SpotifyDnsEntry *entry = dnsEntryFor(host);
+        if (entry != NULL)
+        {
+            entry->ttlMs = 0;
+        }
+        if (!cached)
+        {
+            return false;
+        }
+        dnsStats.staleRetries++;
+    }
+    return false;
+}
+
+bool ArduinoSpotify::connectClient(const char *host)
+{
+    if (tlsClient == NULL)
+    {
+        return openConnection(host);
+    }
+
+    SpotifyTlsSession *session = tlsSessionFor(host);
+    bool offered = session != NULL && session->length > 0;
+    tlsClient->setSession(offered ? session->data : NULL, offered ? session->length : 0);
+    if (!openConnection(host))
+    {
+        // the next attempt starts from scratch, in case the session was the problem
+        if (session != NULL)
+        {
+            session->length = 0;
+        }
+        connectedHost[0] = '\0';
+        return false;
+    }
+    strncpy(connectedHost, host, sizeof(connectedHost) - 1);
+    connectedHost[sizeof(connectedHost) - 1] = '\0';
+
+    if (tlsClient->sessionResumed())
+    {
+        tlsStats.resumedHandshakes++;
+    }
+    else
+    {
+        tlsStats.fullHandshakes++;
+        if (offered)
+        {
+            tlsStats.rejectedSessions++;
+        }
+        // TLS 1.2 sessions exist right after the handshake
+        saveTlsSession();
+    }
+    return true;
+}
+
+void ArduinoSpotify::saveTlsSession()
+{
+    if (tlsClient == NULL || connectedHost[0] == '\0')
+    {
+        return;
+    }
+    SpotifyTlsSession *session = tlsSessionFor(connectedHost);
+    if (session == NULL)
+    {
+        return;
+    }
+    size_t length = tlsClient->getSession(session->data, sizeof(session->data));
+    if (length > sizeof(session->data))
+    {
+        tlsStats.oversizedSessions++;
+    }
+    else if (length > 0)
+    {
+        session->length = length;
+        tlsStats.savedSessions++;
+    }
+}
+
+void ArduinoSpotify::closeClient()
+{
+    if (client->connected())
+    {
+        // TLS 1.3 tickets arrive with the response, so the session is taken at the end
+        saveTlsSession();
+        LOG_DEBUG("closing client");
         client->stop();
     }
 }
@@ -757,7 +1831,6 @@ void ArduinoSpotify::closeClient()
 void ArduinoSpotify::printStack()
 {
     char stack;
-    Serial.print (F("stack size "));
-    Serial.println (stack_start - &stack);
+    LOG_DEBUG("stack size %d", (int)(stack_start - &stack));
 }
 #endif
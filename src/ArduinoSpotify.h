@@ -31,6 +31,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <Client.h>
+#include "AlbumArt.h"
+#include "AudioAnalysis.h"
+#include "SpotifyTlsClient.h"
+#include "SpotifyDns.h"
+#include "SpotifyAccounts.h"
+#include "SpotifyDevices.h"
 
 #define SPOTIFY_HOST "api.spotify.com"
 #define SPOTIFY_ACCOUNTS_HOST "accounts.spotify.com"
@@ -43,13 +49,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
 #define SPOTIFY_URI_CHAR_LENGTH 40
 #define SPOTIFY_URL_CHAR_LENGTH 70
 
-#define SPOTIFY_DEVICE_ID_CHAR_LENGTH 45
-#define SPOTIFY_DEVICE_NAME_CHAR_LENGTH 80
-#define SPOTIFY_DEVICE_TYPE_CHAR_LENGTH 30
-
 #define SPOTIFY_CURRENTLY_PLAYING_ENDPOINT "/v1/me/player/currently-playing"
 
 #define SPOTIFY_AUDIO_FEATURES_ENDPOINT "/v1/audio-features/"
+#define SPOTIFY_AUDIO_ANALYSIS_ENDPOINT "/v1/audio-analysis/"
 
 #define SPOTIFY_PLAYER_ENDPOINT "/v1/me/player"
 #define SPOTIFY_DEVICES_ENDPOINT "/v1/me/player/devices"
@@ -67,6 +70,15 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
 
 #define SPOTIFY_TOKEN_ENDPOINT "/api/token"
 
+// Pending player commands, superseded ones are merged before they are sent
+#define SPOTIFY_COMMAND_QUEUE_SIZE 8
+
+// Delay of the poll that confirms the locally applied result of a command
+#define SPOTIFY_CONFIRM_POLL_DELAY_MS 1500
+
+// Backoff after a 429 without Retry-After, doubled for every further 429 (up to 32 times)
+#define SPOTIFY_DEFAULT_BACKOFF_MS 5000
+
 enum RepeatOptions
 {
   repeat_track,
@@ -74,6 +86,101 @@ enum RepeatOptions
   repeat_off
 };
 
+// Endpoint groups with their own request budget
+enum SpotifyEndpoint
+{
+  endpoint_currently_playing,
+  endpoint_audio_features,
+  endpoint_player,
+  endpoint_token,
+  SPOTIFY_ENDPOINT_COUNT
+};
+
+// Token bucket: up to burst requests at once, one more every refillIntervalMs
+struct SpotifyRequestBudget
+{
+  uint16_t burst;
+  uint16_t available;
+  unsigned long refillIntervalMs;
+  unsigned long lastRefill;
+};
+
+// TLS sessions kept for resumption: the api, accounts and image hosts
+#define SPOTIFY_TLS_SESSIONS 3
+// A serialized session holds the peer certificate with mbedtls and OpenSSL
+#ifndef SPOTIFY_TLS_SESSION_SIZE
+#define SPOTIFY_TLS_SESSION_SIZE 2048
+#endif
+#define SPOTIFY_TLS_HOST_LENGTH 40
+
+struct SpotifyTlsSession
+{
+  char host[SPOTIFY_TLS_HOST_LENGTH];
+  uint16_t length; // 0 while there is none to offer
+  uint8_t data[SPOTIFY_TLS_SESSION_SIZE];
+};
+
+struct SpotifyTlsStats
+{
+  unsigned long fullHandshakes;
+  unsigned long resumedHandshakes;
+  unsigned long rejectedSessions; // offered, but the server wanted a full handshake
+  unsigned long savedSessions;
+  unsigned long oversizedSessions; // larger than SPOTIFY_TLS_SESSION_SIZE, not kept
+};
+
+struct SpotifyDnsEntry
+{
+  char host[SPOTIFY_TLS_HOST_LENGTH];
+  IPAddress address;
+  unsigned long resolvedAt;
+  uint32_t ttlMs; // 0 while there is no answer to use
+};
+
+struct SpotifyRateLimitStats
+{
+  unsigned long requests;          // requests that were sent
+  unsigned long rateLimited;       // 429 answers
+  unsigned long suppressedBackoff; // calls skipped while backing off after a 429
+  unsigned long suppressedBudget;  // calls skipped because the endpoint budget was used up
+  unsigned long lastBackoffMs;
+};
+
+enum SpotifyCommandType
+{
+  command_play,
+  command_pause,
+  command_volume,
+  command_seek,
+  command_next,
+  command_previous,
+  command_shuffle,
+  command_repeat
+};
+
+// Called when a queued command was sent, statusCode is 204 if all went well
+typedef void (*SpotifyCommandCallback)(SpotifyCommandType type, int value, bool success, int statusCode);
+
+struct SpotifyCommand
+{
+  SpotifyCommandType type;
+  // volume in percent, position in ms, shuffle on/off or RepeatOptions
+  int value;
+  char deviceId[SPOTIFY_DEVICE_ID_CHAR_LENGTH];
+  SpotifyCommandCallback callback;
+};
+
+struct SpotifyCommandStats
+{
+  unsigned long queued;     // commands given to queueCommand
+  unsigned long coalesced;  // commands merged into a pending one
+  unsigned long sent;       // requests that went out
+  unsigned long failed;     // sent commands that were not answered with 204
+  unsigned long dropped;    // commands that did not fit into the queue
+  unsigned long confirmed;  // locally applied states the next poll agreed with
+  unsigned long mismatched; // locally applied states the next poll corrected
+};
+
 struct SpotifyImage
 {
   int height;
@@ -81,17 +188,6 @@ struct SpotifyImage
   char *url;
 };
 
-struct SpotifyDevice
-{
-  char *id;
-  char *name;
-  char *type;
-  bool isActive;
-  bool isRestricted;
-  bool isPrivateSession;
-  int volumePercent;
-};
-
 struct CurrentlyPlaying
 {
   char *firstArtistName;
@@ -103,6 +199,8 @@ struct CurrentlyPlaying
   char *trackName;
   char *shortTrackName;
   char *trackUri;
+  // smallest cover that is at least ALBUM_ART_SIZE wide, empty if there is none
+  char *albumImageUrl;
   short trackPopularity;
   bool isPlaying;
   long progressMs;
@@ -110,6 +208,12 @@ struct CurrentlyPlaying
 
   int statusCode;
   bool error;
+  // the call was not answered because of rate limiting, this is the last result
+  bool rateLimited;
+  // a player command was applied locally and is not confirmed by a poll yet
+  bool provisional;
+  // only known after setVolume, -1 otherwise
+  int volumePercent;
 };
 
 struct AudioFeatures
@@ -139,6 +243,58 @@ struct AudioFeatures
 
   int statusCode;
   bool error;
+  // the call was not answered because of rate limiting, this is the last result
+  bool rateLimited;
+};
+
+// key when the track has none
+#define PACKED_KEY_NONE 0x0F
+
+// AudioFeatures of one track in 12 bytes instead of 52, for history and
+// prefetch. Read it through AudioFeaturesView.
+struct PackedAudioFeatures
+{
+  // the 0.0 to 1.0 features in steps of 1/255
+  uint8_t danceability;
+  uint8_t energy;
+  uint8_t speechiness;
+  uint8_t acousticness;
+  uint8_t instrumentalness;
+  uint8_t liveness;
+  uint8_t valence;
+  // in steps of -0.5 dB
+  uint8_t loudness;
+  // in 1/10 BPM
+  uint16_t tempo;
+  // key (0 to 11 or PACKED_KEY_NONE) in the low nibble, mode in the highest bit
+  uint8_t keyMode;
+  uint8_t reserved;
+};
+
+static_assert(sizeof(PackedAudioFeatures) == 12, "PackedAudioFeatures grew");
+
+class AudioFeaturesView
+{
+public:
+  explicit AudioFeaturesView(const PackedAudioFeatures &features) : features(features) {}
+
+  float danceability() const { return features.danceability / 255.0f; }
+  float energy() const { return features.energy / 255.0f; }
+  float speechiness() const { return features.speechiness / 255.0f; }
+  float acousticness() const { return features.acousticness / 255.0f; }
+  float instrumentalness() const { return features.instrumentalness / 255.0f; }
+  float liveness() const { return features.liveness / 255.0f; }
+  float valence() const { return features.valence / 255.0f; }
+  float loudness() const { return features.loudness * -0.5f; }
+  float tempo() const { return features.tempo / 10.0f; }
+  // -1 if there is none
+  int key() const { return (features.keyMode & 0x0F) == PACKED_KEY_NONE ? -1 : features.keyMode & 0x0F; }
+  int mode() const { return features.keyMode >> 7; }
+
+  const PackedAudioFeatures &packed() const { return features; }
+
+private:
+  const PackedAudioFeatures &features;
 };
 
 class ArduinoSpotify
@@ -153,6 +309,19 @@ public:
   bool refreshAccessToken();
   bool checkAndRefreshAccessToken();
   const char *requestAccessTokens(const char *code, const char *redirectUrl);
+  // Exchanges the access token, refresh token and expiry with context, e.g. to
+  // make a request for another account (see SpotifyAccounts.h) and swap back
+  void swapTokenContext(SpotifyTokenContext &context);
+
+  // TLS session resumption. tlsClient is the client passed to the constructor
+  // (or the one a SpotifyRecordClient wraps), the sessions are allocated here
+  bool enableTlsSessions(SpotifyTlsClient &tlsClient);
+  SpotifyTlsStats tlsStats = {0, 0, 0, 0, 0};
+
+  // DNS cache: with a resolver, connects go to the address of the last answer
+  // until its TTL ran out (see SpotifyDns.h)
+  void setResolver(SpotifyResolver &resolver);
+  SpotifyDnsStats dnsStats = {0, 0, 0, 0, 0, 0};
 
   // Generic Request Methods
   int makeGetRequest(const char *command, const char *authorization, const char *accept = "application/json", const char *host = SPOTIFY_HOST);
@@ -163,6 +332,22 @@ public:
   // User methods
   CurrentlyPlaying getCurrentlyPlaying(const char *market = "");
   AudioFeatures getAudioFeatures(const char *market = "", const char *trackId = "");
+  // Same request, the result goes to features in packed form. False if it failed or was rate limited
+  bool getPackedAudioFeatures(PackedAudioFeatures &features, const char *market = "", const char *trackId = "");
+  static void packAudioFeatures(const AudioFeatures &features, PackedAudioFeatures &packed);
+  // Streams the audio analysis of trackId through parser into grid (see AudioAnalysis.h),
+  // counts against the audio features budget. False if it failed or was rate limited
+  bool getAudioAnalysis(const char *trackId, AudioAnalysisParser &parser, BeatGrid &grid);
+  // The currently playing track streamed through parser into summary, the connection
+  // stays open with setKeepAlive. Returns the status code, 0 if the budget did not
+  // allow the request, -3 if the body was incomplete
+  int getPlaybackSummary(PlaybackSummaryParser &parser, PlaybackSummary &summary);
+  // while set, requests reuse the open connection, clearing it closes the connection
+  void setKeepAlive(bool keepAlive);
+  // The devices of the account streamed into devices (see SpotifyDevices.h), counts against
+  // the player budget. Returns how many were written, -1 without an answer (devices is
+  // untouched) and -2 if the body was incomplete
+  int getDevices(SpotifyDevice *devices, uint8_t capacity);
   bool play(const char *deviceId = "");
   bool playAdvanced(char *body, const char *deviceId = "");
   bool pause(const char *deviceId = "");
@@ -174,6 +359,32 @@ public:
   bool seek(int position, const char *deviceId = "");
   bool transferPlayback(const char *deviceId, bool play = false);
 
+  // Downloads a cover (e.g. CurrentlyPlaying.albumImageUrl) and decodes it into
+  // tile, ALBUM_ART_SIZE x ALBUM_ART_SIZE RGB565 pixels
+  bool getAlbumArt(const char *imageUrl, AlbumArtDecoder &decoder, uint16_t *tile);
+
+  // Command queue: play/pause, volume, seek, shuffle and repeat replace a pending
+  // command of their kind queued after the last next/previous, processCommands
+  // sends all over one connection
+  bool queueCommand(SpotifyCommandType type, int value = 0, const char *deviceId = "", SpotifyCommandCallback callback = NULL);
+  int processCommands();
+  uint8_t pendingCommands() { return commandCount; }
+  SpotifyCommandStats commandStats = {0, 0, 0, 0, 0, 0, 0};
+
+  // The last result with the expected effect of player commands applied and the
+  // progress advanced to now, cheap enough to call every frame
+  CurrentlyPlaying getLocalCurrentlyPlaying();
+  // true once when the poll confirming a command result is due
+  bool confirmationPollDue();
+
+  // Rate limit governor, calls that are not allowed return the last result
+  bool requestAllowed(SpotifyEndpoint endpoint);
+  void setRequestBudget(SpotifyEndpoint endpoint, uint16_t burst, unsigned long refillIntervalMs);
+  unsigned long backoffRemainingMs();
+  SpotifyRateLimitStats rateLimitStats = {0, 0, 0, 0, 0};
+
+  // Copies name to shortName up to the first of stopChars (shortName needs strlen(name) + 1)
+  static void shortenName(char *shortName, const char *name, const char *stopChars);
 
   int portNumber = 443;
   int currentlyPlayingBufferSize = 4000;
@@ -188,19 +399,71 @@ public:
 #endif
 
 private:
-  char _bearerToken[200];
+  char _bearerToken[SPOTIFY_BEARER_TOKEN_LENGTH];
   const char *_refreshToken;
   const char *_clientId;
   const char *_clientSecret;
-  unsigned int timeTokenRefreshed;
-  unsigned int tokenTimeToLiveMs;
+  // expired until the first refresh
+  unsigned int timeTokenRefreshed = 0;
+  unsigned int tokenTimeToLiveMs = 0;
   CurrentlyPlaying currentlyPlaying;
   AudioFeatures audioFeatures;
-  int commonGetImage(char *imageUrl);
+  long progressMsAtFetch = 0;
+  unsigned long timeFetched = 0;
+  SpotifyRequestBudget requestBudgets[SPOTIFY_ENDPOINT_COUNT];
+  unsigned long backoffStart = 0;
+  unsigned long backoffMs = 0;
+  uint8_t consecutiveRateLimits = 0;
+  // Retry-After of the last response in ms, 0 if there was none
+  unsigned long retryAfterMs = 0;
+  SpotifyCommand commandQueue[SPOTIFY_COMMAND_QUEUE_SIZE];
+  uint8_t commandCount = 0;
+  // commands before this one are being sent right now
+  uint8_t firstPendingCommand = 0;
+  // while set, requests reuse the open connection
+  bool keepConnection = false;
+  // Content-Length of the last response, -1 if there was none
+  long responseContentLength = -1;
+  // Transfer-Encoding: chunked of the last response
+  bool responseChunked = false;
+  void skipResponseBody();
+  // feeds the body of the response to parser, false if it ended early
+  template <typename Parser>
+  bool streamBody(Parser &parser);
+  static void appendDeviceId(char *command, const char *deviceId);
+  int sendCommand(SpotifyCommand &command);
+  void initRequestBudgets();
+  void handleRateLimit(int statusCode);
+  CurrentlyPlaying cachedCurrentlyPlaying();
+  void requestAudioFeatures(const char *market, const char *trackId);
+  // expectation of the locally applied commands, checked by the next poll
+  bool expectPlaying = false;
+  bool expectTrackChange = false;
+  unsigned long trackUriHashBeforeCommand = 0;
+  bool confirmationScheduled = false;
+  unsigned long timeCommandAnswered = 0;
+  void applyLocalCommand(SpotifyCommandType type, int value);
+  void scheduleConfirmation();
+  void reconcileLocalState();
+  static unsigned long hashString(const char *text);
+  int commonGetImage(const char *imageUrl);
   int getContentLength();
   int getHttpStatusCode();
   void skipHeaders(bool tossUnexpectedForJSON = true);
   void closeClient();
+  // connects (or resumes the session of) host, the TLS handshake is counted in tlsStats
+  bool connectClient(const char *host);
+  SpotifyTlsClient *tlsClient = NULL;
+  SpotifyTlsSession *tlsSessions = NULL;
+  char connectedHost[SPOTIFY_TLS_HOST_LENGTH] = "";
+  SpotifyTlsSession *tlsSessionFor(const char *host);
+  SpotifyResolver *resolver = NULL;
+  SpotifyDnsEntry dnsCache[SPOTIFY_DNS_ENTRIES];
+  SpotifyDnsEntry *dnsEntryFor(const char *host);
+  bool lookupHost(const char *host, IPAddress &address, bool &cached);
+  // the connect to host, through the DNS cache if there is a resolver
+  bool openConnection(const char *host);
+  void saveTlsSession();
   void parseError();
   const char *requestAccessTokensBody =
       R"(grant_type=authorization_code&code=%s&redirect_uri=%s&client_id=%s&client_secret=%s)";
@@ -0,0 +1,195 @@
+#include "AudioAnalysis.h"
+
+void AudioAnalysisParser::begin(BeatGrid &grid)
+{
+    this->grid = &grid;
+    grid.count = 0;
+    grid.truncated = false;
+    beginScan();
+    elementKind = array_other;
+    segmentBeat = -1;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void AudioAnalysisParser::feed(const uint8_t *data, size_t length)
+{
+    unsigned long start = micros();
+    scan(data, length);
+    stats.bytes += length;
+    stats.parseMicros += micros() - start;
+}
+
+bool AudioAnalysisParser::finish()
+{
+    return endScan();
+}
+
+uint8_t AudioAnalysisParser::keyOf(const char *key)
+{
+    static const char *const keys[] = {"", "beats", "segments", "start", "loudness_max"};
+    for (uint8_t i = key_beats; i <= key_loudness_max; i++)
+    {
+        if (strcmp(key, keys[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return key_other;
+}
+
+void AudioAnalysisParser::openedContainer(bool array)
+{
+    // an element of the beats or segments array of the root object
+    if (depth == 3 && !array && isArray[1])
+    {
+        elementKind = path[0] == key_beats ? array_beats
+                      : path[0] == key_segments ? array_segments
+                      : array_other;
+        elementStart = -1;
+        elementLoudness = -1000;
+    }
+}
+
+void AudioAnalysisParser::closingContainer()
+{
+    if (depth == 3 && !isArray[2])
+    {
+        commitElement();
+        elementKind = array_other;
+    }
+}
+
+void AudioAnalysisParser::number(const char *text)
+{
+    if (depth != 3 || elementKind == array_other || isArray[2])
+    {
+        return;
+    }
+    // only the two numbers of an element are converted, not the pitches and timbre
+    uint8_t key = currentKey();
+    if (key == key_start)
+    {
+        elementStart = strtof(text, NULL);
+    }
+    else if (key == key_loudness_max)
+    {
+        elementLoudness = strtof(text, NULL);
+    }
+}
+
+void AudioAnalysisParser::commitElement()
+{
+    if (elementStart < 0)
+    {
+        return;
+    }
+    uint32_t units = (uint32_t)(elementStart * (1000 / BEAT_TIME_UNIT_MS) + 0.5f);
+    if (elementKind == array_beats)
+    {
+        stats.beats++;
+        if (grid->count >= BEAT_GRID_MAX_BEATS || units > 0xFFFF)
+        {
+            grid->truncated = true;
+            return;
+        }
+        // the grid is in time order
+        if (grid->count > 0 && units <= grid->start[grid->count - 1])
+        {
+            return;
+        }
+        grid->start[grid->count] = units;
+        grid->loudness[grid->count] = 0;
+        grid->count++;
+    }
+    else if (elementKind == array_segments)
+    {
+        stats.segments++;
+        while (segmentBeat + 1 < grid->count && grid->start[segmentBeat + 1] <= units)
+        {
+            segmentBeat++;
+        }
+        if (segmentBeat < 0)
+        {
+            return;
+        }
+        float above = elementLoudness - BEAT_LOUDNESS_FLOOR_DB;
+        uint16_t loudness = above <= 0 ? 0
+                            : above * BEAT_LOUDNESS_SCALE >= 0xFFFF ? 0xFFFF
+                            : (uint16_t)(above * BEAT_LOUDNESS_SCALE);
+        if (loudness > grid->loudness[segmentBeat])
+        {
+            grid->loudness[segmentBeat] = loudness;
+        }
+    }
+}
+
+BeatCursor::BeatCursor(const BeatGrid &grid) : grid(grid)
+{
+}
+
+int16_t BeatCursor::search(uint32_t units) const
+{
+    // the first beat after units, the one before is the current beat
+    uint16_t low = 0;
+    uint16_t high = grid.count;
+    while (low < high)
+    {
+        uint16_t middle = (low + high) / 2;
+        if (grid.start[middle] <= units)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return (int16_t)low - 1;
+}
+
+bool BeatCursor::at(long progressMs, BeatPhase &phase)
+{
+    if (grid.count == 0)
+    {
+        return false;
+    }
+    uint32_t units = progressMs > 0 ? progressMs / BEAT_TIME_UNIT_MS : 0;
+    if (cursor >= grid.count || (cursor >= 0 && grid.start[cursor] > units))
+    {
+        // a seek back or a new grid
+        searches++;
+        cursor = search(units);
+    }
+    else if (cursor + 1 < grid.count && grid.start[cursor + 1] <= units)
+    {
+        if (cursor + 2 < grid.count && grid.start[cursor + 2] <= units)
+        {
+            searches++;
+            cursor = search(units);
+        }
+        else
+        {
+            steps++;
+            cursor++;
+        }
+    }
+    if (cursor < 0)
+    {
+        return false;
+    }
+    // the last beat is as long as the one before
+    uint16_t lengthUnits = cursor + 1 < grid.count ? grid.start[cursor + 1] - grid.start[cursor]
+                           : cursor > 0 ? grid.start[cursor] - grid.start[cursor - 1]
+                           : 50;
+    long intoMs = progressMs - (long)grid.start[cursor] * BEAT_TIME_UNIT_MS;
+    long lengthMs = (long)lengthUnits * BEAT_TIME_UNIT_MS;
+    if (intoMs < 0 || intoMs >= lengthMs)
+    {
+        return false;
+    }
+    phase.index = cursor;
+    phase.phase = intoMs * 256 / lengthMs;
+    phase.loudness = grid.loudness[cursor];
+    phase.lengthMs = lengthMs;
+    return true;
+}
@@ -0,0 +1,119 @@
+/*
+AudioAnalysis - the beat grid of a track from /v1/audio-analysis
+
+The analysis of a track is a few hundred kB of JSON (bars, beats, sections,
+segments with pitches and timbre, tatums). It is not parsed into a document:
+AudioAnalysisParser is fed the body piece by piece and keeps only the start
+of every beat and the loudest segment within it, as packed uint16 arrays.
+The beats come before the segments in the response; segments that show up
+before any beat leave the loudness at 0.
+
+BeatCursor finds the beat of the local playback progress once per frame.
+It follows the playback with at most a step per frame and searches only
+after a seek.
+*/
+
+#ifndef AudioAnalysis_h
+#define AudioAnalysis_h
+
+#include <Arduino.h>
+#include "JsonScanner.h"
+
+// beats of a track up to BEAT_GRID_MAX_BEATS * 60 / bpm, e.g. 8.5 min at 120 bpm
+#define BEAT_GRID_MAX_BEATS 1024
+// beat starts in 10 ms, up to 10:55 min
+#define BEAT_TIME_UNIT_MS 10
+// loudness in 1/1000 dB above BEAT_LOUDNESS_FLOOR_DB, 0 at or below
+#define BEAT_LOUDNESS_FLOOR_DB -60
+#define BEAT_LOUDNESS_SCALE 1000
+
+struct BeatGrid
+{
+  uint16_t count;
+  // more beats than fit or later than the time range
+  bool truncated;
+  uint16_t start[BEAT_GRID_MAX_BEATS];
+  uint16_t loudness[BEAT_GRID_MAX_BEATS];
+};
+
+struct AudioAnalysisStats
+{
+  unsigned long bytes;
+  unsigned long beats;
+  unsigned long segments;
+  // time the parser spent on the body, without waiting for the network
+  unsigned long parseMicros;
+};
+
+class AudioAnalysisParser : private JsonScanner
+{
+public:
+  // the next body goes to grid, which is emptied
+  void begin(BeatGrid &grid);
+  void feed(const uint8_t *data, size_t length);
+  // true if the body was complete JSON
+  bool finish();
+
+  AudioAnalysisStats stats = {0, 0, 0, 0};
+
+private:
+  // the keys the grid is made of, any other is key_other
+  enum AnalysisKey : uint8_t
+  {
+    key_other,
+    key_beats,
+    key_segments,
+    key_start,
+    key_loudness_max
+  };
+
+  enum ArrayKind : uint8_t
+  {
+    array_other,
+    array_beats,
+    array_segments
+  };
+
+  BeatGrid *grid = NULL;
+  ArrayKind elementKind = array_other;
+  float elementStart = -1;
+  float elementLoudness = -1000;
+  // beat of the segments, they come in time order
+  int16_t segmentBeat = -1;
+
+  uint8_t keyOf(const char *key) override;
+  void openedContainer(bool array) override;
+  void closingContainer() override;
+  void number(const char *text) override;
+  void commitElement();
+};
+
+struct BeatPhase
+{
+  uint16_t index;
+  // 0 on the beat up to 255 just before the next one
+  uint8_t phase;
+  uint16_t loudness;
+  uint16_t lengthMs;
+};
+
+class BeatCursor
+{
+public:
+  explicit BeatCursor(const BeatGrid &grid);
+
+  void reset() { cursor = -1; }
+  // the beat at progressMs, false before the first and after the last beat
+  bool at(long progressMs, BeatPhase &phase);
+
+  unsigned long steps = 0;
+  unsigned long searches = 0;
+
+private:
+  const BeatGrid &grid;
+  int16_t cursor = -1;
+
+  int16_t search(uint32_t units) const;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "Brightness.h"
+
+BrightnessController::BrightnessController(const BrightnessStep *steps, uint8_t stepCount,
+                                           BrightnessSource source, const BrightnessLevel &initial,
+                                           uint32_t rampMs)
+    : steps(steps), stepCount(stepCount), source(source), rampMs(rampMs), current(initial), rampFrom(initial)
+{
+}
+
+uint8_t BrightnessController::stepFor(uint16_t value) const
+{
+    if (source == brightness_schedule)
+    {
+        // before the first step of the day the last one of the day before holds
+        uint8_t step = stepCount - 1;
+        for (uint8_t index = 0; index < stepCount && steps[index].from <= value; index++)
+        {
+            step = index;
+        }
+        return step;
+    }
+    // a step is only taken or left with a margin, so a reading at a threshold does not flicker
+    uint8_t step = target;
+    while (step + 1 < stepCount && value >= steps[step + 1].from + BRIGHTNESS_SENSOR_HYSTERESIS / 2)
+    {
+        step++;
+    }
+    while (step > 0 && value + BRIGHTNESS_SENSOR_HYSTERESIS / 2 < steps[step].from)
+    {
+        step--;
+    }
+    return step;
+}
+
+void BrightnessController::setInput(uint16_t value)
+{
+    uint16_t effective = value;
+    if (source == brightness_sensor)
+    {
+        if (!hasInput)
+        {
+            smoothed = (uint32_t)value << 8;
+        }
+        else
+        {
+            int32_t delta = ((int32_t)value << 8) - (int32_t)smoothed;
+            smoothed += delta * BRIGHTNESS_SENSOR_SMOOTHING / 256;
+        }
+        effective = smoothed >> 8;
+    }
+    uint8_t next = stepFor(effective);
+    if (next != target || !hasInput)
+    {
+        target = next;
+        rampFrom = current;
+        rampStartMs = millis();
+        ramping = true;
+    }
+    hasInput = true;
+}
+
+static int32_t interpolate(int32_t from, int32_t to, uint32_t elapsed, uint32_t total)
+{
+    return from + (to - from) * (int32_t)elapsed / (int32_t)total;
+}
+
+bool BrightnessController::update()
+{
+    if (!ramping)
+    {
+        return false;
+    }
+    const BrightnessLevel &to = steps[target].level;
+    BrightnessLevel previous = current;
+    uint32_t elapsed = millis() - rampStartMs;
+    if (elapsed >= rampMs)
+    {
+        current = to;
+        ramping = false;
+    }
+    else
+    {
+        current.brightness = interpolate(rampFrom.brightness, to.brightness, elapsed, rampMs);
+        current.drawTimeUs = interpolate(rampFrom.drawTimeUs, to.drawTimeUs, elapsed, rampMs);
+        current.refreshUs = interpolate(rampFrom.refreshUs, to.refreshUs, elapsed, rampMs);
+    }
+    return memcmp(&previous, &current, sizeof(BrightnessLevel)) != 0;
+}
+
+// Every interrupt shifts out all rows of one bit plane. A row stays on for
+// drawTimeUs scaled by the brightness in the most significant plane and half
+// as long in each plane below, so the average on-time over the planes is
+// draw_time * (2^depth - 1) / 2^(depth - 1) / depth.
+static float averageRowUs(const BrightnessLevel &level, uint8_t colorDepth)
+{
+    float onUs = (float)level.drawTimeUs * level.brightness / 255.0f;
+    float weights = (float)((1UL << colorDepth) - 1) / (float)(1UL << (colorDepth - 1));
+    return PANEL_ROW_SHIFT_US + onUs * weights / colorDepth;
+}
+
+float panelIsrShare(const BrightnessLevel &level, uint8_t colorDepth)
+{
+    if (level.refreshUs == 0 || colorDepth == 0)
+    {
+        return 0;
+    }
+    float share = PANEL_SCAN_ROWS * averageRowUs(level, colorDepth) / level.refreshUs;
+    return share > 1 ? 1 : share;
+}
+
+float panelRefreshHz(const BrightnessLevel &level, uint8_t colorDepth)
+{
+    if (level.refreshUs == 0 || colorDepth == 0)
+    {
+        return 0;
+    }
+    return 1000000.0f / ((float)level.refreshUs * colorDepth);
+}
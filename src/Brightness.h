@@ -0,0 +1,90 @@
+/*
+Brightness - brightness of the panel by the time of day or a light sensor
+
+A level sets the PxMatrix brightness, the on-time per row
+(display_draw_time) and the period of the refresh timer together: the
+on-time is waited out in the refresh interrupt, so a darker level also gives
+CPU back. Changes ramp over a few seconds instead of jumping.
+panelIsrShare() models the CPU the refresh takes per level, for the PC and
+to compare with the measurement.
+*/
+
+#ifndef Brightness_h
+#define Brightness_h
+
+#include <Arduino.h>
+
+struct BrightnessLevel
+{
+  // setBrightness() of PxMatrix, scales the on-time
+  uint8_t brightness;
+  // display_draw_time, on-time per row of the most significant bit plane
+  uint8_t drawTimeUs;
+  // alarm of the refresh timer, one bit plane per interrupt
+  uint16_t refreshUs;
+};
+
+// the level from a minute of the day (schedule) or an ADC reading (sensor) on
+struct BrightnessStep
+{
+  uint16_t from;
+  BrightnessLevel level;
+};
+
+enum BrightnessSource : uint8_t
+{
+  // input is the minute of the day, the last step of the day holds until the first
+  brightness_schedule,
+  // input is the ADC reading of a light sensor, 0 is dark
+  brightness_sensor
+};
+
+// a reading has to pass a step by this much before the level changes
+#define BRIGHTNESS_SENSOR_HYSTERESIS 96
+// of the exponential average of the readings, in 1/256
+#define BRIGHTNESS_SENSOR_SMOOTHING 32
+#define BRIGHTNESS_RAMP_MS 3000
+
+// the panel behind the model: 64x64 at 1/32 scan
+#define PANEL_SCAN_ROWS 32
+// shifting out one row pair and latching it
+#define PANEL_ROW_SHIFT_US 19
+
+class BrightnessController
+{
+public:
+  // steps sorted by from, initial is shown until the first input and ramps to its level
+  BrightnessController(const BrightnessStep *steps, uint8_t stepCount, BrightnessSource source,
+                       const BrightnessLevel &initial, uint32_t rampMs = BRIGHTNESS_RAMP_MS);
+
+  void setInput(uint16_t value);
+  // moves the output towards the level of the input, returns true when it changed
+  bool update();
+
+  const BrightnessLevel &output() const { return current; }
+  // index of the step the output is heading for
+  uint8_t targetStep() const { return target; }
+
+private:
+  const BrightnessStep *steps;
+  const uint8_t stepCount;
+  const BrightnessSource source;
+  const uint32_t rampMs;
+  // the smoothed reading in 1/256 for the sensor
+  uint32_t smoothed = 0;
+  bool hasInput = false;
+  uint8_t target = 0;
+  BrightnessLevel current;
+  BrightnessLevel rampFrom;
+  unsigned long rampStartMs = 0;
+  bool ramping = false;
+
+  uint8_t stepFor(uint16_t value) const;
+};
+
+// share of the CPU (0..1) the refresh interrupt takes with colorDepth bit planes
+float panelIsrShare(const BrightnessLevel &level, uint8_t colorDepth);
+// full frames (all bit planes) per second
+float panelRefreshHz(const BrightnessLevel &level, uint8_t colorDepth);
+
+#endif
@@ -0,0 +1,201 @@
+#include "DisplayPages.h"
+
+Widget::Widget(const Region &region, uint32_t costUs)
+    : region(region), costUs(costUs)
+{
+}
+
+static bool overlaps(const Region &a, const Region &b)
+{
+    return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+static bool onPage(const Page &page, const Widget *widget)
+{
+    for (uint8_t index = 0; index < page.widgetCount; index++)
+    {
+        if (page.widgets[index] == widget)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+PageScheduler::PageScheduler(const Page *pages, uint8_t pageCount, uint16_t background)
+    : pages(pages), pageCount(pageCount), background(background)
+{
+}
+
+bool PageScheduler::isAvailable(uint8_t index) const
+{
+    return index < pageCount && (pages[index].available == NULL || pages[index].available(pages[index].context));
+}
+
+void PageScheduler::showPage(uint8_t index)
+{
+    requested = index;
+}
+
+void PageScheduler::redrawAll(uint16_t background)
+{
+    this->background = background;
+    clearScreen = true;
+}
+
+uint8_t PageScheduler::selectPage()
+{
+    if (requested != PAGE_NONE)
+    {
+        uint8_t next = requested;
+        requested = PAGE_NONE;
+        if (isAvailable(next))
+        {
+            return next;
+        }
+    }
+    if (current == PAGE_NONE || !isAvailable(current))
+    {
+        // the first available page in the order of the table
+        for (uint8_t index = 0; index < pageCount; index++)
+        {
+            if (isAvailable(index))
+            {
+                return index;
+            }
+        }
+        return PAGE_NONE;
+    }
+    const Page &page = pages[current];
+    if (page.showMs == 0 || millis() - pageSinceMs < page.showMs)
+    {
+        return current;
+    }
+    for (uint8_t step = 1; step < pageCount; step++)
+    {
+        uint8_t index = (current + step) % pageCount;
+        if (isAvailable(index))
+        {
+            return index;
+        }
+    }
+    // the only available page, its time starts again
+    pageSinceMs = millis();
+    return current;
+}
+
+void PageScheduler::switchTo(Adafruit_GFX &display, uint8_t next)
+{
+    uint8_t previous = current;
+    current = next;
+    pageSinceMs = millis();
+    resumeIndex = 0;
+    stats.switches++;
+    if (next == PAGE_NONE)
+    {
+        return;
+    }
+    const Page &page = pages[next];
+    if (previous == PAGE_NONE || clearScreen)
+    {
+        clearScreen = true;
+        return;
+    }
+
+    // the widgets of both pages stay as they are, unless a cleared region overlaps them
+    const Page &oldPage = pages[previous];
+    for (uint8_t index = 0; index < page.widgetCount; index++)
+    {
+        if (!onPage(oldPage, page.widgets[index]))
+        {
+            page.widgets[index]->invalid = true;
+        }
+    }
+    for (uint8_t index = 0; index < oldPage.widgetCount; index++)
+    {
+        const Widget *leaving = oldPage.widgets[index];
+        if (onPage(page, leaving))
+        {
+            continue;
+        }
+        display.fillRect(leaving->region.x, leaving->region.y, leaving->region.w, leaving->region.h, background);
+        for (uint8_t kept = 0; kept < page.widgetCount; kept++)
+        {
+            if (overlaps(leaving->region, page.widgets[kept]->region))
+            {
+                page.widgets[kept]->invalid = true;
+            }
+        }
+    }
+}
+
+void PageScheduler::renderFrame(Adafruit_GFX &display, uint32_t budgetUs)
+{
+    unsigned long start = micros();
+    stats.frames++;
+    lastFrameDraws = 0;
+    pending = false;
+
+    uint8_t next = selectPage();
+    if (next != current)
+    {
+        switchTo(display, next);
+    }
+    if (current == PAGE_NONE)
+    {
+        return;
+    }
+    const Page &page = pages[current];
+    if (clearScreen)
+    {
+        clearScreen = false;
+        display.fillScreen(background);
+        for (uint8_t index = 0; index < page.widgetCount; index++)
+        {
+            page.widgets[index]->invalid = true;
+        }
+    }
+
+    uint8_t firstDeferred = PAGE_NONE;
+    for (uint8_t step = 0; step < page.widgetCount; step++)
+    {
+        uint8_t index = (resumeIndex + step) % page.widgetCount;
+        Widget *widget = page.widgets[index];
+        if (!widget->invalid && !widget->changed())
+        {
+            continue;
+        }
+        // one widget per frame is always drawn, so an expensive one is not starved
+        if (lastFrameDraws > 0 && micros() - start + widget->estimateUs() > budgetUs)
+        {
+            if (firstDeferred == PAGE_NONE)
+            {
+                firstDeferred = index;
+            }
+            stats.deferred++;
+            continue;
+        }
+        unsigned long drawStart = micros();
+        widget->draw(display);
+        uint32_t drawUs = micros() - drawStart;
+        if (drawUs > widget->slowestUs)
+        {
+            widget->slowestUs = drawUs;
+        }
+        widget->invalid = false;
+        lastFrameDraws++;
+        stats.draws++;
+    }
+    pending = firstDeferred != PAGE_NONE;
+    resumeIndex = pending ? firstDeferred : 0;
+
+    uint32_t frameUs = micros() - start;
+    if (frameUs > stats.slowestFrameUs)
+    {
+        stats.slowestFrameUs = frameUs;
+    }
+    if (frameUs > budgetUs)
+    {
+        stats.overBudget++;
+    }
+}
@@ -0,0 +1,111 @@
+/*
+DisplayPages - pages of widgets that are only drawn when they changed
+
+Pages of the display built from widgets. A widget owns a region of the
+screen and is only drawn when its content changed. Pages take turns by time
+and by what is available (playing, paused, error). A page switch only clears
+the regions the new page does not reuse and draws what is new. Every widget
+declares what a draw costs, a frame draws what fits in its budget and the
+rest follows in the next frames.
+*/
+
+#ifndef DisplayPages_h
+#define DisplayPages_h
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+
+#define PAGE_NONE 0xFF
+
+struct Region
+{
+  int16_t x;
+  int16_t y;
+  int16_t w;
+  int16_t h;
+};
+
+class Widget
+{
+public:
+  Widget(const Region &region, uint32_t costUs);
+  virtual ~Widget() {}
+
+  // the content differs from what was drawn last
+  virtual bool changed() = 0;
+  // draws the region, in full when invalid is set
+  virtual void draw(Adafruit_GFX &display) = 0;
+
+  // what the scheduler plans with, the declared cost until a draw was slower
+  uint32_t estimateUs() const { return slowestUs > costUs ? slowestUs : costUs; }
+
+  const Region region;
+  // declared worst case of draw() in microseconds
+  const uint32_t costUs;
+  uint32_t slowestUs = 0;
+  // the region was cleared or drawn over
+  bool invalid = true;
+};
+
+typedef bool (*PageCondition)(void *context);
+
+struct Page
+{
+  const char *name;
+  Widget *const *widgets;
+  uint8_t widgetCount;
+  // time on screen before the next available page, 0 stays while available
+  uint32_t showMs;
+  // NULL if the page is always available
+  PageCondition available;
+  void *context;
+};
+
+struct PageSchedulerStats
+{
+  unsigned long frames;
+  unsigned long draws;
+  // draws moved to a later frame because the budget was used up
+  unsigned long deferred;
+  unsigned long switches;
+  unsigned long overBudget;
+  uint32_t slowestFrameUs;
+};
+
+class PageScheduler
+{
+public:
+  PageScheduler(const Page *pages, uint8_t pageCount, uint16_t background);
+
+  // picks the page and draws the changed widgets that fit in budgetUs
+  void renderFrame(Adafruit_GFX &display, uint32_t budgetUs);
+  // switches with the next frame, if the page is available
+  void showPage(uint8_t index);
+  // clears the screen and draws everything again with the next frame
+  void redrawAll(uint16_t background);
+
+  uint8_t currentPage() const { return current; }
+  // nothing was deferred and nothing changed in the last frame
+  bool settled() const { return lastFrameDraws == 0 && !pending; }
+
+  PageSchedulerStats stats = {0, 0, 0, 0, 0, 0};
+
+private:
+  const Page *pages;
+  uint8_t pageCount;
+  uint16_t background;
+  uint8_t current = PAGE_NONE;
+  uint8_t requested = PAGE_NONE;
+  unsigned long pageSinceMs = 0;
+  bool clearScreen = true;
+  // the first widget deferred in the last frame goes first
+  uint8_t resumeIndex = 0;
+  bool pending = false;
+  uint8_t lastFrameDraws = 0;
+
+  bool isAvailable(uint8_t index) const;
+  uint8_t selectPage();
+  void switchTo(Adafruit_GFX &display, uint8_t next);
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include "Esp32Resolver.h"
+
+bool Esp32Resolver::query(const char *host, IPAddress &address, uint32_t &ttlSeconds)
+{
+    uint8_t message[SPOTIFY_DNS_MESSAGE_SIZE];
+    uint16_t id = esp_random();
+    size_t length = buildDnsQuery(message, sizeof(message), id, host);
+    if (length == 0 || !udp.begin(0))
+    {
+        return false;
+    }
+    bool answered = false;
+    if (udp.beginPacket(WiFi.dnsIP(), SPOTIFY_DNS_PORT) && udp.write(message, length) == length && udp.endPacket())
+    {
+        unsigned long start = millis();
+        while (!answered && millis() - start < DNS_TIMEOUT_MS)
+        {
+            if (udp.parsePacket() > 0)
+            {
+                int received = udp.read(message, sizeof(message));
+                // answers to other ids are late ones of earlier queries
+                answered = received > 0 && parseDnsAnswer(message, received, id, address, ttlSeconds);
+            }
+            else
+            {
+                delay(5);
+            }
+        }
+    }
+    udp.stop();
+    return answered;
+}
+
+bool Esp32Resolver::resolve(const char *host, IPAddress &address, uint32_t &ttlSeconds)
+{
+    if (query(host, address, ttlSeconds))
+    {
+        return true;
+    }
+    if (WiFi.hostByName(host, address) != 1)
+    {
+        return false;
+    }
+    fallbacks++;
+    ttlSeconds = DNS_FALLBACK_TTL_S;
+    return true;
+}
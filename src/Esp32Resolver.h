@@ -0,0 +1,33 @@
+/*
+Esp32Resolver - SpotifyResolver for the ESP32
+
+Only in the esp32dev build. Asks the DNS server of the WiFi connection
+itself to learn the TTL, and falls back to WiFi.hostByName (with a fixed
+TTL) if there is no usable answer.
+*/
+
+#ifndef Esp32Resolver_h
+#define Esp32Resolver_h
+
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <SpotifyDns.h>
+
+#define DNS_TIMEOUT_MS 1000
+// lwip does not tell the TTL of its answers
+#define DNS_FALLBACK_TTL_S 60
+
+class Esp32Resolver : public SpotifyResolver
+{
+public:
+  bool resolve(const char *host, IPAddress &address, uint32_t &ttlSeconds) override;
+
+  // resolutions that went through WiFi.hostByName
+  unsigned long fallbacks = 0;
+
+private:
+  WiFiUDP udp;
+  bool query(const char *host, IPAddress &address, uint32_t &ttlSeconds);
+};
+
+#endif
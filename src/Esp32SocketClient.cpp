@@ -0,0 +1,29 @@
+#include "Esp32SocketClient.h"
+
+#include <errno.h>
+#include <lwip/sockets.h>
+
+size_t Esp32SocketClient::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t Esp32SocketClient::write(const uint8_t *buf, size_t size)
+{
+    int socket = fd();
+    if (socket < 0 || !connected())
+    {
+        return 0;
+    }
+    int sent = send(socket, buf, size, MSG_DONTWAIT);
+    if (sent < 0)
+    {
+        // a full send buffer is no error, anything else ends the connection
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            stop();
+        }
+        return 0;
+    }
+    return sent;
+}
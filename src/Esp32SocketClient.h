@@ -0,0 +1,27 @@
+/*
+Esp32SocketClient - a WiFiClient whose writes never wait
+
+Only in the esp32dev build. WiFiClient::write waits in select() until all
+of the data is sent, up to ten seconds for a client that stops reading.
+This one sends only what the socket takes right away and returns the count,
+the rest is for the next call (StatusServer sends a section over several
+polls this way).
+*/
+
+#ifndef Esp32SocketClient_h
+#define Esp32SocketClient_h
+
+#include <WiFi.h>
+
+class Esp32SocketClient : public WiFiClient
+{
+public:
+  // takes a connection of WiFiServer::available()
+  using WiFiClient::operator=;
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  using WiFiClient::write;
+};
+
+#endif
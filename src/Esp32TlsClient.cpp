@@ -0,0 +1,294 @@
+#include "Esp32TlsClient.h"
+#include "Log.h"
+
+#define TLS_HANDSHAKE_TIMEOUT_MS 10000
+
+static int sendToSocket(void *context, const unsigned char *buf, size_t length)
+{
+    WiFiClient *tcp = (WiFiClient *)context;
+    if (!tcp->connected())
+    {
+        return MBEDTLS_ERR_NET_CONN_RESET;
+    }
+    size_t written = tcp->write(buf, length);
+    return written > 0 ? (int)written : MBEDTLS_ERR_SSL_WANT_WRITE;
+}
+
+static int receiveFromSocket(void *context, unsigned char *buf, size_t length)
+{
+    WiFiClient *tcp = (WiFiClient *)context;
+    if (tcp->available() == 0)
+    {
+        return tcp->connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+    }
+    int count = tcp->read(buf, length);
+    return count > 0 ? count : MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+Esp32TlsClient::Esp32TlsClient()
+{
+    mbedtls_ssl_init(&ssl);
+    mbedtls_ssl_config_init(&config);
+    mbedtls_x509_crt_init(&ca);
+    mbedtls_ctr_drbg_init(&random);
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ssl_session_init(&offered);
+}
+
+Esp32TlsClient::~Esp32TlsClient()
+{
+    stop();
+    mbedtls_ssl_session_free(&offered);
+    mbedtls_ssl_free(&ssl);
+    mbedtls_ssl_config_free(&config);
+    mbedtls_x509_crt_free(&ca);
+    mbedtls_ctr_drbg_free(&random);
+    mbedtls_entropy_free(&entropy);
+}
+
+bool Esp32TlsClient::setCACert(const char *rootCa)
+{
+    return mbedtls_x509_crt_parse(&ca, (const unsigned char *)rootCa, strlen(rootCa) + 1) == 0;
+}
+
+bool Esp32TlsClient::configure()
+{
+    if (configured)
+    {
+        return true;
+    }
+    if (mbedtls_ctr_drbg_seed(&random, mbedtls_entropy_func, &entropy, NULL, 0) != 0 ||
+        mbedtls_ssl_config_defaults(&config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0)
+    {
+        return false;
+    }
+    mbedtls_ssl_conf_authmode(&config, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&config, &ca, NULL);
+    mbedtls_ssl_conf_rng(&config, mbedtls_ctr_drbg_random, &random);
+    // tickets keep the server stateless, session IDs work as well
+    mbedtls_ssl_conf_session_tickets(&config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    configured = mbedtls_ssl_setup(&ssl, &config) == 0;
+    return configured;
+}
+
+void Esp32TlsClient::setServerName(const char *host)
+{
+    strncpy(serverName, host, sizeof(serverName) - 1);
+    serverName[sizeof(serverName) - 1] = '\0';
+}
+
+int Esp32TlsClient::connect(IPAddress ip, uint16_t port)
+{
+    stop();
+    if (!configure() || !tcp.connect(ip, port))
+    {
+        serverName[0] = '\0';
+        return 0;
+    }
+    // the name given with setServerName is used once
+    String address = ip.toString();
+    int connected = handshake(serverName[0] != '\0' ? serverName : address.c_str());
+    serverName[0] = '\0';
+    return connected;
+}
+
+int Esp32TlsClient::connect(const char *host, uint16_t port)
+{
+    stop();
+    if (!configure() || !tcp.connect(host, port))
+    {
+        return 0;
+    }
+    return handshake(host);
+}
+
+int Esp32TlsClient::handshake(const char *host)
+{
+    unsigned long start = micros();
+    mbedtls_ssl_session_reset(&ssl);
+    mbedtls_ssl_set_hostname(&ssl, host);
+    mbedtls_ssl_set_bio(&ssl, &tcp, sendToSocket, receiveFromSocket, NULL);
+    if (hasOffer)
+    {
+        mbedtls_ssl_set_session(&ssl, &offered);
+    }
+
+    int result;
+    while ((result = mbedtls_ssl_handshake(&ssl)) != 0)
+    {
+        if ((result != MBEDTLS_ERR_SSL_WANT_READ && result != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+            micros() - start > TLS_HANDSHAKE_TIMEOUT_MS * 1000UL)
+        {
+            LOG_WARN("TLS handshake failed: -0x%x", -result);
+            tcp.stop();
+            return 0;
+        }
+        delay(1);
+    }
+    handshakeUs = micros() - start;
+    resumed = false;
+    if (hasOffer)
+    {
+        mbedtls_ssl_session current;
+        mbedtls_ssl_session_init(&current);
+        if (mbedtls_ssl_get_session(&ssl, &current) == 0)
+        {
+            // the server echoes the offered session id when it resumes, a full handshake gets a new one
+            resumed = current.id_len > 0 && current.id_len == offered.id_len &&
+                      memcmp(current.id, offered.id, current.id_len) == 0;
+        }
+        mbedtls_ssl_session_free(&current);
+    }
+    open = true;
+    peeked = -1;
+    return 1;
+}
+
+void Esp32TlsClient::setSession(const uint8_t *session, size_t length)
+{
+    mbedtls_ssl_session_free(&offered);
+    mbedtls_ssl_session_init(&offered);
+    hasOffer = session != NULL && length > 0 && mbedtls_ssl_session_load(&offered, session, length) == 0;
+}
+
+size_t Esp32TlsClient::getSession(uint8_t *session, size_t size)
+{
+    if (!open)
+    {
+        return 0;
+    }
+    mbedtls_ssl_session current;
+    mbedtls_ssl_session_init(&current);
+    size_t length = 0;
+    if (mbedtls_ssl_get_session(&ssl, &current) == 0)
+    {
+        // asks for the length first, nothing is written then
+        mbedtls_ssl_session_save(&current, NULL, 0, &length);
+        if (length > 0 && length <= size)
+        {
+            mbedtls_ssl_session_save(&current, session, size, &length);
+        }
+    }
+    mbedtls_ssl_session_free(&current);
+    return length;
+}
+
+bool Esp32TlsClient::sessionResumed()
+{
+    return resumed;
+}
+
+size_t Esp32TlsClient::write(uint8_t b)
+{
+    return write(&b, 1);
+}
+
+size_t Esp32TlsClient::write(const uint8_t *buf, size_t size)
+{
+    if (!open)
+    {
+        return 0;
+    }
+    size_t written = 0;
+    unsigned long start = millis();
+    while (written < size)
+    {
+        int count = mbedtls_ssl_write(&ssl, buf + written, size - written);
+        if (count > 0)
+        {
+            written += count;
+            continue;
+        }
+        if ((count != MBEDTLS_ERR_SSL_WANT_READ && count != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+            millis() - start >= _timeout)
+        {
+            // a record is sent in part at most, the connection cannot go on
+            LOG_WARN("TLS write failed after %u of %u bytes: -0x%x", (unsigned)written, (unsigned)size, -count);
+            stop();
+            break;
+        }
+        // the socket is full, lets the WiFi task send
+        delay(1);
+    }
+    return written;
+}
+
+int Esp32TlsClient::available()
+{
+    if (!open)
+    {
+        return 0;
+    }
+    int count = peeked >= 0 ? 1 : 0;
+    if (mbedtls_ssl_get_bytes_avail(&ssl) == 0 && tcp.available() > 0)
+    {
+        // processes the next record without taking anything out
+        mbedtls_ssl_read(&ssl, NULL, 0);
+    }
+    return count + mbedtls_ssl_get_bytes_avail(&ssl);
+}
+
+int Esp32TlsClient::read()
+{
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+}
+
+int Esp32TlsClient::read(uint8_t *buf, size_t size)
+{
+    if (!open || size == 0)
+    {
+        return -1;
+    }
+    size_t count = 0;
+    if (peeked >= 0)
+    {
+        buf[count++] = peeked;
+        peeked = -1;
+    }
+    if (count < size && available() > 0)
+    {
+        int result = mbedtls_ssl_read(&ssl, buf + count, size - count);
+        if (result > 0)
+        {
+            count += result;
+        }
+    }
+    return count > 0 ? (int)count : -1;
+}
+
+int Esp32TlsClient::peek()
+{
+    if (peeked < 0)
+    {
+        peeked = read();
+    }
+    return peeked;
+}
+
+void Esp32TlsClient::flush()
+{
+    // mbedtls_ssl_write sends right away
+}
+
+void Esp32TlsClient::stop()
+{
+    if (open)
+    {
+        mbedtls_ssl_close_notify(&ssl);
+        open = false;
+    }
+    tcp.stop();
+    peeked = -1;
+}
+
+uint8_t Esp32TlsClient::connected()
+{
+    return open && (tcp.connected() || available() > 0);
+}
+
+Esp32TlsClient::operator bool()
+{
+    return open;
+}
@@ -0,0 +1,71 @@
+/*
+Esp32TlsClient - TLS client on mbedtls with session resumption
+
+Only in the esp32dev build. WiFiClientSecure runs the handshake inside
+connect() with no way to offer a session, so this one drives mbedtls itself
+over a WiFiClient. The CA certificate is checked like with
+WiFiClientSecure::setCACert. A write waits for the socket at most for the
+timeout of the stream (setTimeout).
+*/
+
+#ifndef Esp32TlsClient_h
+#define Esp32TlsClient_h
+
+#include <WiFi.h>
+#include <SpotifyTlsClient.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/x509_crt.h>
+
+class Esp32TlsClient : public SpotifyTlsClient
+{
+public:
+  Esp32TlsClient();
+  ~Esp32TlsClient();
+
+  // PEM, parsed once
+  bool setCACert(const char *rootCa);
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t size) override;
+  int peek() override;
+  void flush() override;
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override;
+  using Print::write;
+
+  void setServerName(const char *host) override;
+  void setSession(const uint8_t *session, size_t length) override;
+  size_t getSession(uint8_t *session, size_t size) override;
+  bool sessionResumed() override;
+
+  // time of the last handshake
+  uint32_t handshakeUs = 0;
+
+private:
+  WiFiClient tcp;
+  mbedtls_ssl_context ssl;
+  mbedtls_ssl_config config;
+  mbedtls_x509_crt ca;
+  mbedtls_ctr_drbg_context random;
+  mbedtls_entropy_context entropy;
+  mbedtls_ssl_session offered;
+  bool hasOffer = false;
+  bool configured = false;
+  bool open = false;
+  bool resumed = false;
+  int peeked = -1;
+  char serverName[64] = "";
+
+  bool configure();
+  int handshake(const char *host);
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include "Esp32WifiDriver.h"
+
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <lwip/dhcp.h>
+
+void Esp32WifiDriver::begin(const char *ssid, const char *password, const uint8_t *bssid, int32_t channel,
+                            const WifiAddress *address)
+{
+    // WifiConnection does the reconnects, and nothing goes to the flash
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(false);
+    WiFi.mode(WIFI_STA);
+    if (address != NULL)
+    {
+        WiFi.config(IPAddress(address->ip), IPAddress(address->gateway), IPAddress(address->subnet),
+                    IPAddress(address->dns));
+    }
+    else
+    {
+        // back to DHCP
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    }
+    WiFi.begin(ssid, password, channel, bssid);
+}
+
+void Esp32WifiDriver::disconnect()
+{
+    WiFi.disconnect();
+}
+
+WifiLinkStatus Esp32WifiDriver::status()
+{
+    switch (WiFi.status())
+    {
+        case WL_CONNECTED:
+            return wifi_link_up;
+        case WL_NO_SSID_AVAIL:
+        case WL_CONNECT_FAILED:
+            return wifi_link_failed;
+        case WL_IDLE_STATUS:
+        case WL_DISCONNECTED:
+            return wifi_link_connecting;
+        default:
+            return wifi_link_down;
+    }
+}
+
+void Esp32WifiDriver::bssid(uint8_t *bssidOut)
+{
+    uint8_t *current = WiFi.BSSID();
+    if (current != NULL)
+    {
+        memcpy(bssidOut, current, 6);
+    }
+}
+
+int32_t Esp32WifiDriver::channel()
+{
+    return WiFi.channel();
+}
+
+WifiAddress Esp32WifiDriver::address()
+{
+    WifiAddress address;
+    address.ip = WiFi.localIP();
+    address.gateway = WiFi.gatewayIP();
+    address.subnet = WiFi.subnetMask();
+    address.dns = WiFi.dnsIP();
+    return address;
+}
+
+uint32_t Esp32WifiDriver::leaseSeconds()
+{
+    esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    if (netif == NULL)
+    {
+        return 0;
+    }
+    esp_netif_dhcp_status_t dhcpStatus;
+    if (esp_netif_dhcpc_get_status(netif, &dhcpStatus) != ESP_OK || dhcpStatus != ESP_NETIF_DHCP_STARTED)
+    {
+        // a static address
+        return 0;
+    }
+    struct netif *lwipNetif = (struct netif *)esp_netif_get_netif_impl(netif);
+    struct dhcp *dhcp = lwipNetif != NULL ? netif_dhcp_data(lwipNetif) : NULL;
+    return dhcp != NULL ? dhcp->offered_t0_lease : 0;
+}
@@ -0,0 +1,27 @@
+/*
+Esp32WifiDriver - WifiDriver on the ESP32 WiFi library
+
+Only in the esp32dev build. The lease time is read from the DHCP client of
+lwIP, the WiFi library does not report it.
+*/
+
+#ifndef Esp32WifiDriver_h
+#define Esp32WifiDriver_h
+
+#include <WiFi.h>
+#include "WifiConnection.h"
+
+class Esp32WifiDriver : public WifiDriver
+{
+public:
+  void begin(const char *ssid, const char *password, const uint8_t *bssid, int32_t channel,
+             const WifiAddress *address) override;
+  void disconnect() override;
+  WifiLinkStatus status() override;
+  void bssid(uint8_t *bssidOut) override;
+  int32_t channel() override;
+  WifiAddress address() override;
+  uint32_t leaseSeconds() override;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#include "FeatureBars.h"
+
+static_assert(FEATURE_BARS[feature_tempo].max > FEATURE_BARS[feature_tempo].min, "empty tempo range");
+static_assert(featureBarLength(FEATURE_BARS[feature_energy], 1L << 15, 64) == 32, "half energy is half a bar");
+
+int32_t featureValueQ16(FeatureId feature, const AudioFeaturesView &audioFeatures, short popularity)
+{
+    const FeatureBarDescriptor &descriptor = FEATURE_BARS[feature];
+    int32_t raw;
+    if (descriptor.offset == FEATURE_OFFSET_POPULARITY)
+    {
+        raw = popularity;
+    }
+    else
+    {
+        const uint8_t *field = (const uint8_t *)&audioFeatures.packed() + descriptor.offset;
+        raw = descriptor.wide ? *(const uint16_t *)field : *field;
+    }
+    // keeps the shift below in range, such values give an empty or full bar anyway
+    if (raw >= (int32_t)descriptor.max * descriptor.scale)
+    {
+        return (int32_t)descriptor.max << 16;
+    }
+    if (raw <= (int32_t)descriptor.min * descriptor.scale)
+    {
+        return (int32_t)descriptor.min << 16;
+    }
+    // rounded up: a truncated value cuts a pixel off bars whose exact length is a whole number,
+    // while the excess of this one is too small to reach the next pixel
+    return ((raw << 16) + descriptor.scale - 1) / descriptor.scale;
+}
+
+void computeFeatureBars(const AudioFeaturesView &audioFeatures, short popularity, const FeatureId *features,
+                        uint8_t count, int16_t width, int16_t *lengths)
+{
+    for (uint8_t index = 0; index < count; index++)
+    {
+        int32_t valueQ16 = featureValueQ16(features[index], audioFeatures, popularity);
+        lengths[index] = featureBarLength(FEATURE_BARS[features[index]], valueQ16, width);
+    }
+}
@@ -0,0 +1,77 @@
+/*
+FeatureBars - bar lengths of the audio features and the track popularity
+
+Every feature is described once in a compile-time table, the bar lengths
+are computed in fixed point from PackedAudioFeatures once per track and
+only drawn afterwards.
+*/
+
+#ifndef FeatureBars_h
+#define FeatureBars_h
+
+#include <Arduino.h>
+#include <stddef.h>
+#include "ArduinoSpotify.h"
+
+enum FeatureId : uint8_t
+{
+  feature_popularity,
+  feature_tempo,
+  feature_danceability,
+  feature_energy,
+  feature_valence,
+  feature_speechiness,
+  feature_instrumentalness,
+  feature_acousticness,
+  feature_liveness,
+  FEATURE_COUNT
+};
+
+// the popularity is part of CurrentlyPlaying, not of PackedAudioFeatures
+#define FEATURE_OFFSET_POPULARITY -1
+// draws the bar in the bar color of the current theme
+#define FEATURE_COLOR_THEME 0
+
+struct FeatureBarDescriptor
+{
+  // offsetof the field in PackedAudioFeatures or FEATURE_OFFSET_POPULARITY
+  int8_t offset;
+  // the field is a uint16_t, not a uint8_t
+  bool wide;
+  // field steps per unit of min and max
+  uint8_t scale;
+  // values at or below min give an empty bar, max and above a full one
+  int16_t min;
+  int16_t max;
+  uint16_t color;
+};
+
+constexpr FeatureBarDescriptor FEATURE_BARS[FEATURE_COUNT] = {
+  {FEATURE_OFFSET_POPULARITY, false, 1, 0, 100, FEATURE_COLOR_THEME},
+  {offsetof(PackedAudioFeatures, tempo), true, 10, 50, 200, FEATURE_COLOR_THEME},
+  {offsetof(PackedAudioFeatures, danceability), false, 255, 0, 1, FEATURE_COLOR_THEME},
+  {offsetof(PackedAudioFeatures, energy), false, 255, 0, 1, FEATURE_COLOR_THEME},
+  {offsetof(PackedAudioFeatures, valence), false, 255, 0, 1, FEATURE_COLOR_THEME},
+  {offsetof(PackedAudioFeatures, speechiness), false, 255, 0, 1, FEATURE_COLOR_THEME},
+  {offsetof(PackedAudioFeatures, instrumentalness), false, 255, 0, 1, FEATURE_COLOR_THEME},
+  {offsetof(PackedAudioFeatures, acousticness), false, 255, 0, 1, FEATURE_COLOR_THEME},
+  {offsetof(PackedAudioFeatures, liveness), false, 255, 0, 1, FEATURE_COLOR_THEME},
+};
+
+// length of a bar of full length width for a value in 16.16 fixed point
+constexpr int16_t featureBarLength(const FeatureBarDescriptor &descriptor, int32_t valueQ16, int16_t width)
+{
+  return valueQ16 <= ((int32_t)descriptor.min << 16) ? 0
+       : valueQ16 >= ((int32_t)descriptor.max << 16) ? width
+       : (int16_t)((valueQ16 - ((int32_t)descriptor.min << 16)) * width /
+                   ((int32_t)(descriptor.max - descriptor.min) << 16));
+}
+
+// the feature as 16.16 fixed point
+int32_t featureValueQ16(FeatureId feature, const AudioFeaturesView &audioFeatures, short popularity);
+
+// fills lengths[i] for features[i], i < count
+void computeFeatureBars(const AudioFeaturesView &audioFeatures, short popularity, const FeatureId *features,
+                        uint8_t count, int16_t width, int16_t *lengths);
+
+#endif
@@ -0,0 +1,283 @@
+#include "JsonScanner.h"
+
+void JsonScanner::beginScan()
+{
+    state = scan_value;
+    failed = false;
+    scannedBytes = 0;
+    depth = 0;
+    expectKey = false;
+    stringIsKey = false;
+    tokenLength = 0;
+    target = NULL;
+}
+
+void JsonScanner::scan(const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length && !failed; i++)
+    {
+        scanChar((char)data[i]);
+    }
+    scannedBytes += length;
+}
+
+bool JsonScanner::endScan()
+{
+    if (state == scan_number || state == scan_literal)
+    {
+        // a bare number or literal at the very end, no container is waiting for it
+        state = scan_value;
+    }
+    return !failed && depth == 0 && state == scan_value && scannedBytes > 0;
+}
+
+uint8_t JsonScanner::currentKey() const
+{
+    if (depth == 0 || isArray[depth - 1])
+    {
+        return 0;
+    }
+    return path[depth - 1];
+}
+
+void JsonScanner::keepString(char *target, uint8_t size)
+{
+    this->target = target;
+    targetSize = size;
+    targetLength = 0;
+    target[0] = '\0';
+}
+
+void JsonScanner::openContainer(bool array)
+{
+    if (depth >= JSON_SCANNER_MAX_DEPTH)
+    {
+        failed = true;
+        return;
+    }
+    isArray[depth] = array;
+    path[depth] = 0;
+    depth++;
+    expectKey = !array;
+    openedContainer(array);
+}
+
+void JsonScanner::closeContainer()
+{
+    if (depth == 0)
+    {
+        failed = true;
+        return;
+    }
+    closingContainer();
+    depth--;
+    expectKey = false;
+}
+
+void JsonScanner::append(const char *text, uint8_t length)
+{
+    if (target == NULL)
+    {
+        return;
+    }
+    if (targetLength + length >= targetSize)
+    {
+        // the value is cut here, what follows is not kept
+        target = NULL;
+        return;
+    }
+    memcpy(target + targetLength, text, length);
+    targetLength += length;
+    target[targetLength] = '\0';
+}
+
+void JsonScanner::appendUtf8(uint16_t codePoint)
+{
+    char bytes[3];
+    if (codePoint >= 0xD800 && codePoint <= 0xDFFF)
+    {
+        // half of a character outside the BMP, the font has none of those
+        append("?", 1);
+    }
+    else if (codePoint < 0x80)
+    {
+        bytes[0] = codePoint;
+        append(bytes, 1);
+    }
+    else if (codePoint < 0x800)
+    {
+        bytes[0] = 0xC0 | (codePoint >> 6);
+        bytes[1] = 0x80 | (codePoint & 0x3F);
+        append(bytes, 2);
+    }
+    else
+    {
+        bytes[0] = 0xE0 | (codePoint >> 12);
+        bytes[1] = 0x80 | ((codePoint >> 6) & 0x3F);
+        bytes[2] = 0x80 | (codePoint & 0x3F);
+        append(bytes, 3);
+    }
+}
+
+void JsonScanner::scanChar(char c)
+{
+    switch (state)
+    {
+    case scan_string:
+        if (c == '\\')
+        {
+            state = scan_string_escape;
+        }
+        else if (c == '"')
+        {
+            if (stringIsKey && depth > 0)
+            {
+                token[tokenLength] = '\0';
+                path[depth - 1] = keyOf(token);
+            }
+            target = NULL;
+            state = scan_value;
+        }
+        else if (stringIsKey)
+        {
+            if (tokenLength < JSON_SCANNER_TOKEN_LENGTH - 1)
+            {
+                token[tokenLength++] = c;
+            }
+        }
+        else if (((uint8_t)c & 0xC0) == 0xC0 && target != NULL)
+        {
+            // the first byte of a character in UTF-8, it is kept only whole
+            uint8_t length = ((uint8_t)c & 0xF0) == 0xF0 ? 4 : ((uint8_t)c & 0xE0) == 0xE0 ? 3 : 2;
+            if (targetLength + length >= targetSize)
+            {
+                target = NULL;
+            }
+            else
+            {
+                append(&c, 1);
+            }
+        }
+        else
+        {
+            append(&c, 1);
+        }
+        return;
+    case scan_string_escape:
+        state = scan_string;
+        if (c == 'u')
+        {
+            unicode = 0;
+            unicodeDigits = 0;
+            state = scan_unicode;
+        }
+        else if (!stringIsKey)
+        {
+            // line breaks and tabs in a name are shown as a space
+            char plain = strchr("bfnrt", c) != NULL ? ' ' : c;
+            append(&plain, 1);
+        }
+        return;
+    case scan_unicode:
+        if (!isxdigit(c))
+        {
+            failed = true;
+            return;
+        }
+        unicode = (unicode << 4) | (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+        if (++unicodeDigits == 4)
+        {
+            if (!stringIsKey)
+            {
+                appendUtf8(unicode);
+            }
+            state = scan_string;
+        }
+        return;
+    case scan_number:
+        if (isdigit(c) || c == '.' || c == '-' || c == '+' || c == 'e' || c == 'E')
+        {
+            if (tokenLength < JSON_SCANNER_TOKEN_LENGTH - 1)
+            {
+                token[tokenLength++] = c;
+            }
+            return;
+        }
+        token[tokenLength] = '\0';
+        state = scan_value;
+        number(token);
+        // c ends the number and is scanned as what follows it
+        break;
+    case scan_literal:
+        if (isalpha(c))
+        {
+            return;
+        }
+        state = scan_value;
+        break;
+    default:
+        break;
+    }
+
+    switch (c)
+    {
+    case '{':
+        openContainer(false);
+        break;
+    case '[':
+        openContainer(true);
+        break;
+    case '}':
+    case ']':
+        closeContainer();
+        break;
+    case ',':
+        if (depth > 0 && isArray[depth - 1])
+        {
+            if (path[depth - 1] < 0xFF)
+            {
+                path[depth - 1]++;
+            }
+        }
+        else
+        {
+            expectKey = depth > 0;
+        }
+        break;
+    case ':':
+        expectKey = false;
+        break;
+    case '"':
+        stringIsKey = expectKey;
+        tokenLength = 0;
+        target = NULL;
+        if (!stringIsKey)
+        {
+            startValue(c);
+        }
+        state = scan_string;
+        break;
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+        break;
+    default:
+        if (isdigit(c) || c == '-')
+        {
+            token[0] = c;
+            tokenLength = 1;
+            state = scan_number;
+        }
+        else if (isalpha(c))
+        {
+            startValue(c);
+            state = scan_literal;
+        }
+        else
+        {
+            failed = true;
+        }
+        break;
+    }
+}
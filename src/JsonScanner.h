@@ -0,0 +1,88 @@
+/*
+JsonScanner - reads a JSON body as it comes in, without a document
+
+The scanner keeps only the nesting of the containers and, per container, the
+key of the current value in an object or the index of the element in an
+array. A parser derives from it and is told of the keys, the containers, the
+numbers and the start of every other value; it picks what it keeps from the
+path. A string value is only kept if the parser gives it a buffer when it
+starts, escapes are decoded and a value that is too long is cut before the
+first character that does not fit whole, so no half UTF-8 sequence remains.
+*/
+
+#ifndef JsonScanner_h
+#define JsonScanner_h
+
+#include <Arduino.h>
+
+#define JSON_SCANNER_MAX_DEPTH 8
+// keys and numbers, a longer key matches none
+#define JSON_SCANNER_TOKEN_LENGTH 24
+
+class JsonScanner
+{
+public:
+  virtual ~JsonScanner() {}
+
+protected:
+  // the next body starts
+  void beginScan();
+  void scan(const uint8_t *data, size_t length);
+  // true if the body so far is complete JSON
+  bool endScan();
+
+  // open containers, the root is at level 0
+  uint8_t depth = 0;
+  bool isArray[JSON_SCANNER_MAX_DEPTH];
+  // per open container: the key of the current value in an object, the index of the element in an array
+  uint8_t path[JSON_SCANNER_MAX_DEPTH];
+  bool failed = false;
+
+  // the key of the value at the innermost level, 0 in an array
+  uint8_t currentKey() const;
+  // the string value that starts now goes to target, cut to size - 1 bytes
+  void keepString(char *target, uint8_t size);
+
+  // the number of a key in path, 0 for any key the parser does not know
+  virtual uint8_t keyOf(const char *key) = 0;
+  // after the container was opened, depth includes it
+  virtual void openedContainer(bool array) {}
+  // before the container is closed
+  virtual void closingContainer() {}
+  virtual void number(const char *text) {}
+  // a string, true, false or null starts with c
+  virtual void startValue(char c) {}
+
+private:
+  enum ScanState : uint8_t
+  {
+    scan_value,
+    scan_string,
+    scan_string_escape,
+    scan_unicode,
+    scan_number,
+    scan_literal
+  };
+
+  ScanState state = scan_value;
+  unsigned long scannedBytes = 0;
+  // in an object before the colon
+  bool expectKey = false;
+  bool stringIsKey = false;
+  char token[JSON_SCANNER_TOKEN_LENGTH];
+  uint8_t tokenLength = 0;
+  // the string value being read goes here, NULL if it is not kept
+  char *target = NULL;
+  uint8_t targetSize = 0;
+  uint8_t targetLength = 0;
+  uint16_t unicode = 0;
+  uint8_t unicodeDigits = 0;
+
+  void scanChar(char c);
+  void openContainer(bool array);
+  void closeContainer();
+  void append(const char *text, uint8_t length);
+  void appendUtf8(uint16_t codePoint);
+};
+
+#endif
@@ -0,0 +1,288 @@
+#include "ListeningHistory.h"
+
+#define LISTENING_HISTORY_MAGIC 0x31484C53 // "SLH1"
+
+// ----------------ListeningWindow----------------
+
+ListeningWindow::ListeningWindow(uint32_t bucketSeconds) : bucketSeconds(bucketSeconds)
+{
+    clear();
+}
+
+void ListeningWindow::clear()
+{
+    newestBucket = 0;
+    memset(slotBucket, 0, sizeof(slotBucket));
+    memset(slots, 0, sizeof(slots));
+    memset(&total, 0, sizeof(total));
+}
+
+void ListeningWindow::advance(uint32_t now)
+{
+    uint32_t bucket = now / bucketSeconds;
+    if (bucket <= newestBucket)
+    {
+        return;
+    }
+    if (bucket - newestBucket >= LISTENING_WINDOW_BUCKETS)
+    {
+        // nothing of the window is left
+        memset(slots, 0, sizeof(slots));
+        memset(&total, 0, sizeof(total));
+        for (uint8_t i = 0; i < LISTENING_WINDOW_BUCKETS; i++)
+        {
+            slotBucket[(bucket - i) % LISTENING_WINDOW_BUCKETS] = bucket - i;
+        }
+    }
+    else
+    {
+        for (uint32_t next = newestBucket + 1; next <= bucket; next++)
+        {
+            Sums &slot = slots[next % LISTENING_WINDOW_BUCKETS];
+            total.tracks -= slot.tracks;
+            total.listenedSeconds -= slot.listenedSeconds;
+            total.featureTracks -= slot.featureTracks;
+            total.energy -= slot.energy;
+            total.valence -= slot.valence;
+            total.tempo -= slot.tempo;
+            memset(&slot, 0, sizeof(slot));
+            slotBucket[next % LISTENING_WINDOW_BUCKETS] = next;
+        }
+    }
+    newestBucket = bucket;
+}
+
+void ListeningWindow::add(const ListeningHistoryEntry &entry)
+{
+    uint32_t endedAt = entry.startedAt + entry.listenedSeconds;
+    advance(endedAt);
+    uint32_t bucket = endedAt / bucketSeconds;
+    uint8_t index = bucket % LISTENING_WINDOW_BUCKETS;
+    if (slotBucket[index] != bucket)
+    {
+        // ended before the window
+        return;
+    }
+    Sums &slot = slots[index];
+    slot.tracks++;
+    total.tracks++;
+    slot.listenedSeconds += entry.listenedSeconds;
+    total.listenedSeconds += entry.listenedSeconds;
+    if (entry.flags & LISTENING_HAS_FEATURES)
+    {
+        slot.featureTracks++;
+        total.featureTracks++;
+        slot.energy += entry.features.energy;
+        total.energy += entry.features.energy;
+        slot.valence += entry.features.valence;
+        total.valence += entry.features.valence;
+        slot.tempo += entry.features.tempo;
+        total.tempo += entry.features.tempo;
+    }
+}
+
+ListeningStats ListeningWindow::stats(uint32_t now)
+{
+    advance(now);
+    ListeningStats stats;
+    stats.tracks = total.tracks;
+    stats.listenedSeconds = total.listenedSeconds;
+    stats.featureTracks = total.featureTracks;
+    if (total.featureTracks == 0)
+    {
+        stats.energy = 0;
+        stats.valence = 0;
+        stats.tempo = 0;
+    }
+    else
+    {
+        // back from the steps of PackedAudioFeatures
+        stats.energy = total.energy / (255.0f * total.featureTracks);
+        stats.valence = total.valence / (255.0f * total.featureTracks);
+        stats.tempo = total.tempo / (10.0f * total.featureTracks);
+    }
+    return stats;
+}
+
+// ----------------ListeningHistory----------------
+
+ListeningHistory::ListeningHistory(fs::FS &fs) : fs(fs), hour(3600 / LISTENING_WINDOW_BUCKETS),
+                                                 day(86400 / LISTENING_WINDOW_BUCKETS)
+{
+}
+
+// FNV-1a
+static uint32_t fnv1a(const uint8_t *data, size_t length)
+{
+    uint32_t hash = 2166136261UL;
+    while (length--)
+    {
+        hash = (hash ^ *data++) * 16777619UL;
+    }
+    return hash;
+}
+
+uint32_t ListeningHistory::trackKey(const char *trackId)
+{
+    return fnv1a((const uint8_t *)trackId, strlen(trackId));
+}
+
+uint32_t ListeningHistory::checkOf(const ListeningHistoryEntry &entry)
+{
+    return fnv1a((const uint8_t *)&entry, sizeof(entry));
+}
+
+// the segments take turns, even generations go to log0.bin, odd ones to log1.bin
+void ListeningHistory::segmentPath(uint32_t generation, char *path)
+{
+    sprintf(path, LISTENING_HISTORY_DIR "/log%lu.bin", (unsigned long)(generation & 1));
+}
+
+void ListeningHistory::insert(const ListeningHistoryEntry &entry)
+{
+    entries[nextEntry] = entry;
+    nextEntry = (nextEntry + 1) % LISTENING_HISTORY_CAPACITY;
+    if (entryCount < LISTENING_HISTORY_CAPACITY)
+    {
+        entryCount++;
+    }
+    hour.add(entry);
+    day.add(entry);
+}
+
+const ListeningHistoryEntry &ListeningHistory::entry(uint16_t age)
+{
+    return entries[(nextEntry + LISTENING_HISTORY_CAPACITY - 1 - age) % LISTENING_HISTORY_CAPACITY];
+}
+
+bool ListeningHistory::readSegmentHeader(uint32_t slot, SegmentHeader &header)
+{
+    char path[24];
+    segmentPath(slot, path);
+    File segment = fs.open(path, FILE_READ);
+    bool valid = segment && segment.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+                 header.magic == LISTENING_HISTORY_MAGIC && (header.generation & 1) == slot;
+    segment.close();
+    return valid;
+}
+
+uint16_t ListeningHistory::replaySegment(uint32_t generation, bool &damaged)
+{
+    char path[24];
+    segmentPath(generation, path);
+    File segment = fs.open(path, FILE_READ);
+    uint16_t records = 0;
+    damaged = false;
+    if (!segment || !segment.seek(sizeof(SegmentHeader)))
+    {
+        damaged = true;
+        return 0;
+    }
+    Record record;
+    size_t length;
+    while ((length = segment.read((uint8_t *)&record, sizeof(record))) > 0)
+    {
+        if (length != sizeof(record) || record.check != checkOf(record.entry))
+        {
+            // power was lost during the write, everything before is fine
+            counters.damagedRecords++;
+            damaged = true;
+            break;
+        }
+        insert(record.entry);
+        records++;
+    }
+    segment.close();
+    return records;
+}
+
+bool ListeningHistory::begin()
+{
+    persistent = true;
+    log.close();
+    SegmentHeader headers[2];
+    bool valid[2];
+    for (uint8_t slot = 0; slot < 2; slot++)
+    {
+        valid[slot] = readSegmentHeader(slot, headers[slot]);
+    }
+    if (!valid[0] && !valid[1])
+    {
+        // first start, the first append starts the log
+        generation = 0;
+        segmentRecords = 0;
+        return true;
+    }
+
+    uint8_t newer = !valid[0] || (valid[1] && headers[1].generation > headers[0].generation) ? 1 : 0;
+    bool damaged;
+    if (valid[1 - newer])
+    {
+        replaySegment(headers[1 - newer].generation, damaged);
+    }
+    generation = headers[newer].generation;
+    segmentRecords = replaySegment(generation, damaged);
+    if (damaged)
+    {
+        // appending behind the damage would hide the new records, the next
+        // append starts a new segment instead
+        segmentRecords = LISTENING_HISTORY_SEGMENT_RECORDS;
+        return false;
+    }
+    if (segmentRecords < LISTENING_HISTORY_SEGMENT_RECORDS)
+    {
+        char path[24];
+        segmentPath(generation, path);
+        log = fs.open(path, FILE_APPEND);
+    }
+    return true;
+}
+
+bool ListeningHistory::startSegment()
+{
+    log.close();
+    generation++;
+    char path[24];
+    segmentPath(generation, path);
+    // truncates the older segment, the newer one keeps the last records
+    log = fs.open(path, FILE_WRITE);
+    SegmentHeader header = {LISTENING_HISTORY_MAGIC, generation};
+    if (!log || log.write((const uint8_t *)&header, sizeof(header)) != sizeof(header))
+    {
+        log.close();
+        return false;
+    }
+    segmentRecords = 0;
+    counters.segments++;
+    counters.bytesWritten += sizeof(header);
+    return true;
+}
+
+bool ListeningHistory::append(const ListeningHistoryEntry &entry)
+{
+    insert(entry);
+    counters.appends++;
+    if (!persistent)
+    {
+        return true;
+    }
+    if ((!log || segmentRecords >= LISTENING_HISTORY_SEGMENT_RECORDS) && !startSegment())
+    {
+        counters.writeErrors++;
+        return false;
+    }
+    Record record;
+    record.entry = entry;
+    record.check = checkOf(entry);
+    if (log.write((const uint8_t *)&record, sizeof(record)) != sizeof(record))
+    {
+        counters.writeErrors++;
+        // the segment may end in a partial record now, continue in a new one
+        segmentRecords = LISTENING_HISTORY_SEGMENT_RECORDS;
+        return false;
+    }
+    log.flush();
+    segmentRecords++;
+    counters.bytesWritten += sizeof(record);
+    return true;
+}
@@ -0,0 +1,155 @@
+/*
+ListeningHistory - the tracks listened to and rolling averages over them
+
+Keeps the last LISTENING_HISTORY_CAPACITY tracks in a ring in RAM and logs
+every track to flash as it is added. The log is append-only: records are
+never rewritten, two segment files take turns and a full segment only
+starts the next one, which replaces the older segment. So each track costs
+one small write and the flash pages are reused evenly.
+
+The averages of the last hour and the last day are kept in time buckets,
+adding a track or moving the time forward costs the same however many
+tracks there are. Without begin() the history stays in RAM, which is how
+the native build feeds it synthetic streams.
+*/
+
+#ifndef ListeningHistory_h
+#define ListeningHistory_h
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "ArduinoSpotify.h"
+
+#define LISTENING_HISTORY_DIR "/history"
+#define LISTENING_HISTORY_CAPACITY 256
+// records per log segment, the log holds between one and two segments
+#define LISTENING_HISTORY_SEGMENT_RECORDS 1024
+#define LISTENING_WINDOW_BUCKETS 24
+
+// ListeningHistoryEntry::flags, features holds the audio features of the track
+#define LISTENING_HAS_FEATURES 0x01
+
+struct ListeningHistoryEntry
+{
+  // ListeningHistory::trackKey() of the track ID
+  uint32_t trackKey;
+  // unix time in seconds
+  uint32_t startedAt;
+  uint16_t listenedSeconds;
+  uint8_t flags;
+  uint8_t reserved;
+  PackedAudioFeatures features;
+};
+
+static_assert(sizeof(ListeningHistoryEntry) == 24, "ListeningHistoryEntry grew");
+
+struct ListeningStats
+{
+  uint32_t tracks;
+  uint32_t listenedSeconds;
+  // averages over the tracks with audio features, 0 if there are none
+  uint32_t featureTracks;
+  float energy;
+  float valence;
+  float tempo;
+};
+
+struct ListeningHistoryCounters
+{
+  unsigned long appends;
+  unsigned long bytesWritten;
+  unsigned long writeErrors;
+  // segments started, each one replaces the older segment on flash
+  unsigned long segments;
+  // records of the log that did not pass the check when it was read back
+  unsigned long damagedRecords;
+};
+
+// Sums over the last LISTENING_WINDOW_BUCKETS buckets of bucketSeconds each.
+// A track counts in the bucket it ended in, the window moves in whole buckets.
+class ListeningWindow
+{
+public:
+  explicit ListeningWindow(uint32_t bucketSeconds);
+
+  void add(const ListeningHistoryEntry &entry);
+  // drops the buckets that are older than the window at now
+  void advance(uint32_t now);
+  ListeningStats stats(uint32_t now);
+  void clear();
+
+private:
+  struct Sums
+  {
+    uint32_t tracks;
+    uint32_t listenedSeconds;
+    uint32_t featureTracks;
+    uint32_t energy;
+    uint32_t valence;
+    uint32_t tempo;
+  };
+
+  uint32_t bucketSeconds;
+  // the bucket that now falls in, bucket n is in slot n % LISTENING_WINDOW_BUCKETS
+  uint32_t newestBucket;
+  uint32_t slotBucket[LISTENING_WINDOW_BUCKETS];
+  Sums slots[LISTENING_WINDOW_BUCKETS];
+  Sums total;
+};
+
+class ListeningHistory
+{
+public:
+  ListeningHistory(fs::FS &fs);
+
+  // Reads the log back, after that every append is also written to flash
+  bool begin();
+  // False if the entry could not be logged, it is in the history anyway
+  bool append(const ListeningHistoryEntry &entry);
+
+  uint16_t count() { return entryCount; }
+  uint16_t capacity() { return LISTENING_HISTORY_CAPACITY; }
+  // age 0 is the newest entry, age must be less than count()
+  const ListeningHistoryEntry &entry(uint16_t age);
+
+  ListeningStats lastHour(uint32_t now) { return hour.stats(now); }
+  ListeningStats lastDay(uint32_t now) { return day.stats(now); }
+
+  static uint32_t trackKey(const char *trackId);
+  ListeningHistoryCounters counters = {0, 0, 0, 0, 0};
+
+private:
+  struct SegmentHeader
+  {
+    uint32_t magic;
+    uint32_t generation;
+  };
+
+  struct Record
+  {
+    ListeningHistoryEntry entry;
+    uint32_t check;
+  };
+
+  fs::FS &fs;
+  bool persistent = false;
+  File log;
+  uint32_t generation = 0;
+  uint16_t segmentRecords = 0;
+
+  ListeningHistoryEntry entries[LISTENING_HISTORY_CAPACITY];
+  uint16_t nextEntry = 0;
+  uint16_t entryCount = 0;
+  ListeningWindow hour;
+  ListeningWindow day;
+
+  void insert(const ListeningHistoryEntry &entry);
+  static void segmentPath(uint32_t generation, char *path);
+  static uint32_t checkOf(const ListeningHistoryEntry &entry);
+  bool readSegmentHeader(uint32_t slot, SegmentHeader &header);
+  uint16_t replaySegment(uint32_t generation, bool &damaged);
+  bool startSegment();
+};
+
+#endif
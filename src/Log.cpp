@@ -0,0 +1,381 @@
+#include "Log.h"
+
+#include <atomic>
+
+Print *logOutput = &Serial;
+LogStats logStats = {{0, 0, 0, 0, 0}, 0, 0, 0};
+
+static const char LOG_LEVEL_LETTERS[] = "-EWID";
+static const uint32_t LOG_RING_MASK = LOG_RING_RECORDS - 1;
+
+// A bounded queue after Dmitry Vyukov: the sequence of a record says whose
+// turn it is. It equals the position when the record is free for the writer
+// of that position and the position + 1 when it holds a line for the drain.
+static LogRecord ring[LOG_RING_RECORDS];
+static std::atomic<uint32_t> sequences[LOG_RING_RECORDS];
+static std::atomic<uint32_t> writePosition(0);
+static std::atomic<unsigned long> dropped(0);
+static uint32_t readPosition = 0;
+static bool ringReady = false;
+
+// the line being written, it is continued when the output had no room for all of it
+static char pendingLine[LOG_LINE_LENGTH + 4];
+static size_t pendingLength = 0;
+static size_t pendingSent = 0;
+// the last record was continued, the next part of its writer has no time and level in front
+static bool lineOpen = false;
+static uint8_t lineWriter = 0;
+static uint8_t nextPart = 0;
+static uint8_t lineLevel = 0;
+
+static void prepareRing()
+{
+    for (uint32_t i = 0; i < LOG_RING_RECORDS; i++)
+    {
+        sequences[i].store(i, std::memory_order_relaxed);
+    }
+    ringReady = true;
+}
+
+// before main(), so a line logged from a constructor finds the ring ready
+static struct LogRingSetup
+{
+    LogRingSetup()
+    {
+        if (!ringReady)
+        {
+            prepareRing();
+        }
+    }
+} ringSetup;
+
+LogRecord *logReserve(uint8_t level, const char *format)
+{
+    if (!ringReady)
+    {
+        prepareRing();
+    }
+    uint32_t position = writePosition.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        uint32_t sequence = sequences[position & LOG_RING_MASK].load(std::memory_order_acquire);
+        int32_t difference = (int32_t)(sequence - position);
+        if (difference == 0)
+        {
+            if (writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // the drain did not get to the record of the last round yet
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return NULL;
+        }
+        else
+        {
+            position = writePosition.load(std::memory_order_relaxed);
+        }
+    }
+    LogRecord *record = &ring[position & LOG_RING_MASK];
+    record->format = format;
+    record->ms = millis();
+    record->level = level <= LOG_LEVEL_DEBUG ? level : 0;
+    record->cut = false;
+    record->continued = false;
+    record->writer = 0;
+    record->part = 0;
+    record->length = 0;
+    record->position = position;
+    return record;
+}
+
+void logCommit(LogRecord *record)
+{
+    sequences[record->position & LOG_RING_MASK].store(record->position + 1, std::memory_order_release);
+}
+
+// Reads the arguments back in the order of the conversions of the format
+class LogArgumentReader
+{
+public:
+    explicit LogArgumentReader(const LogRecord &record) : record(record) {}
+
+    bool read(void *value, uint8_t size)
+    {
+        if (offset + size > record.length)
+        {
+            return false;
+        }
+        memcpy(value, record.arguments + offset, size);
+        offset += size;
+        return true;
+    }
+
+    const char *readString()
+    {
+        if (offset >= record.length)
+        {
+            return NULL;
+        }
+        const char *value = (const char *)record.arguments + offset;
+        offset += strnlen(value, record.length - offset) + 1;
+        return value;
+    }
+
+private:
+    const LogRecord &record;
+    uint8_t offset = 0;
+};
+
+// the format with the arguments of the record, appended at length
+static size_t formatText(const LogRecord &record, char *line, size_t size, size_t length)
+{
+    LogArgumentReader reader(record);
+    const char *c = record.format;
+    while (*c != '\0' && length + 1 < size)
+    {
+        if (*c != '%')
+        {
+            line[length++] = *c++;
+            continue;
+        }
+        // one conversion with its flags, width, precision and length
+        char spec[16];
+        uint8_t specLength = 0;
+        spec[specLength++] = *c++;
+        bool longValue = false;
+        while (*c != '\0' && strchr("-+ #0123456789.hlzjt", *c) != NULL)
+        {
+            longValue = longValue || *c == 'l' || *c == 'z' || *c == 'j' || *c == 't';
+            if (specLength < sizeof(spec) - 2)
+            {
+                spec[specLength++] = *c;
+            }
+            c++;
+        }
+        char conversion = *c;
+        if (conversion == '\0')
+        {
+            break;
+        }
+        c++;
+        spec[specLength++] = conversion;
+        spec[specLength] = '\0';
+
+        int printed = 0;
+        char *out = line + length;
+        size_t room = size - length;
+        switch (conversion)
+        {
+        case '%':
+            printed = snprintf(out, room, "%%");
+            break;
+        case 'd':
+        case 'i':
+        {
+            int32_t value;
+            if (!reader.read(&value, sizeof(value)))
+            {
+                printed = snprintf(out, room, "?");
+            }
+            else
+            {
+                printed = longValue ? snprintf(out, room, spec, (long)value) : snprintf(out, room, spec, (int)value);
+            }
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c':
+        {
+            uint32_t value;
+            if (!reader.read(&value, sizeof(value)))
+            {
+                printed = snprintf(out, room, "?");
+            }
+            else
+            {
+                printed = longValue ? snprintf(out, room, spec, (unsigned long)value) : snprintf(out, room, spec, (unsigned int)value);
+            }
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        {
+            float value;
+            printed = reader.read(&value, sizeof(value)) ? snprintf(out, room, spec, (double)value) : snprintf(out, room, "?");
+            break;
+        }
+        case 's':
+        {
+            const char *value = reader.readString();
+            printed = value != NULL ? snprintf(out, room, spec, value) : snprintf(out, room, "?");
+            break;
+        }
+        case 'p':
+        {
+            const void *value;
+            printed = reader.read(&value, sizeof(value)) ? snprintf(out, room, spec, value) : snprintf(out, room, "?");
+            break;
+        }
+        default:
+            // not a conversion the record can hold, shown as it is
+            printed = snprintf(out, room, "%s", spec);
+            break;
+        }
+        if (printed > 0)
+        {
+            length += (size_t)printed < room ? printed : room - 1;
+        }
+    }
+    line[length] = '\0';
+    return length;
+}
+
+size_t logFormat(const LogRecord &record, char *line, size_t size)
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+    int written = snprintf(line, size, "%lu %c: ", (unsigned long)record.ms, LOG_LEVEL_LETTERS[record.level]);
+    size_t length = written < 0 ? 0 : (size_t)written < size ? written : size - 1;
+    return formatText(record, line, size, length);
+}
+
+bool logDrain(size_t maxBytes)
+{
+    size_t budget = maxBytes;
+    for (;;)
+    {
+        if (pendingSent < pendingLength)
+        {
+            size_t count = pendingLength - pendingSent;
+            if (count > budget)
+            {
+                count = budget;
+            }
+            if (count == 0)
+            {
+                return false;
+            }
+            if (logOutput != NULL)
+            {
+                logOutput->write((const uint8_t *)pendingLine + pendingSent, count);
+            }
+            pendingSent += count;
+            budget -= count;
+            continue;
+        }
+
+        uint32_t waiting = writePosition.load(std::memory_order_relaxed) - readPosition;
+        if (waiting > logStats.peak)
+        {
+            logStats.peak = waiting;
+        }
+        logStats.dropped = dropped.load(std::memory_order_relaxed);
+        uint32_t index = readPosition & LOG_RING_MASK;
+        if (sequences[index].load(std::memory_order_acquire) != readPosition + 1)
+        {
+            // empty, or the next record is still being filled
+            return true;
+        }
+        const LogRecord &record = ring[index];
+        bool continues = lineOpen && record.writer == lineWriter && record.part == nextPart;
+        size_t length = 0;
+        if (lineOpen && !continues)
+        {
+            // the rest of the open line was dropped or another task logged in between, it ends here
+            logStats.lines[lineLevel]++;
+            logStats.truncated++;
+            pendingLine[length++] = '\r';
+            pendingLine[length++] = '\n';
+        }
+        size_t textLength = continues ? formatText(record, pendingLine + length, LOG_LINE_LENGTH, 0)
+                                      : logFormat(record, pendingLine + length, LOG_LINE_LENGTH);
+        if (record.cut || textLength + 1 >= LOG_LINE_LENGTH)
+        {
+            logStats.truncated++;
+        }
+        length += textLength;
+        lineOpen = record.continued;
+        lineWriter = record.writer;
+        nextPart = record.part + 1;
+        lineLevel = record.level;
+        if (!lineOpen)
+        {
+            logStats.lines[record.level]++;
+            pendingLine[length++] = '\r';
+            pendingLine[length++] = '\n';
+        }
+        // the record is free for the round after this one
+        sequences[index].store(readPosition + LOG_RING_RECORDS, std::memory_order_release);
+        readPosition++;
+        pendingLength = length;
+        pendingSent = 0;
+    }
+}
+
+void logFlush()
+{
+    logDrain((size_t)-1);
+}
+
+// 0 is a log call, ids come round again after 255 LogPrints
+static std::atomic<uint8_t> lastWriter(0);
+
+LogPrint::LogPrint(uint8_t level)
+    : level(level)
+{
+    writer = lastWriter.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (writer == 0)
+    {
+        writer = lastWriter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+}
+
+size_t LogPrint::write(uint8_t c)
+{
+    if (c == '\r')
+    {
+        return 1;
+    }
+    if (c == '\n')
+    {
+        send(false);
+        return 1;
+    }
+    text[length++] = c;
+    if (length == sizeof(text) - 1)
+    {
+        send(true);
+    }
+    return 1;
+}
+
+void LogPrint::send(bool continued)
+{
+    text[length] = '\0';
+    length = 0;
+    uint8_t number = part;
+    // a dropped record still counts, so the drain sees the gap
+    part = continued ? part + 1 : 0;
+    LogRecord *record = logReserve(level, "%s");
+    if (record == NULL)
+    {
+        return;
+    }
+    logAdd(*record, (const char *)text);
+    record->continued = continued;
+    record->writer = writer;
+    record->part = number;
+    logCommit(record);
+}
@@ -0,0 +1,243 @@
+/*
+Log - leveled log lines, filtered at compile time and formatted later
+
+LOG_ERROR(...) to LOG_DEBUG(...) take a printf format. Calls above LOG_LEVEL
+are removed by the preprocessor, arguments included, so a log line in a hot
+path costs nothing in a build that does not want it. Set the level with a
+build flag, e.g. -D LOG_LEVEL=LOG_LEVEL_DEBUG; SPOTIFY_DEBUG implies it.
+
+A call does not format or write anything. It copies the format pointer, the
+time and the raw arguments into a record of a ring buffer: integers as 32
+bits, floating point as float, strings inline (cut to what fits in the
+record). The format must therefore be a string literal. The ring takes
+records from any task or core without a lock; when it is full the line is
+dropped and counted, a call never waits.
+
+logDrain() formats the records and writes at most the given number of bytes
+to logOutput (Serial unless set), e.g. what the UART transmit buffer has
+room for, so the drain never blocks either. A line looks like
+"12345 E: Connection failed" with millis() of the call in front. Only one
+task drains.
+
+LogPrint takes the output of the printStats(Print &) reports into the same
+ring, as text records that continue one another up to the end of the line.
+The records of other tasks can come in between and a record of the line can
+be dropped; the drain then ends the open line where it is, so no line ends
+up inside another one.
+*/
+
+#ifndef Log_h
+#define Log_h
+
+#include <Arduino.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#ifdef SPOTIFY_DEBUG
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+// longer lines are cut
+#define LOG_LINE_LENGTH 128
+// argument bytes of a record, e.g. 4 integers and a 15 character string
+#define LOG_RECORD_BYTES 32
+// records in the ring, a power of two
+#define LOG_RING_RECORDS 64
+
+// the format is checked by the compiler, the call itself is never made
+#define LOG_AT(level, ...) do { if (false) logCheckFormat(__VA_ARGS__); logDefer(level, __VA_ARGS__); } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+struct LogRecord
+{
+  const char *format;
+  uint32_t ms;
+  uint8_t level;
+  // an argument did not fit
+  bool cut;
+  // the line goes on in the next record of the same writer
+  bool continued;
+  // of a line in several records: the LogPrint that wrote it and the number of the record
+  // in the line; 0 and 0 for a log call
+  uint8_t writer;
+  uint8_t part;
+  uint8_t length;
+  uint8_t arguments[LOG_RECORD_BYTES];
+  // position in the ring
+  uint32_t position;
+};
+
+struct LogStats
+{
+  // written lines per level, index LOG_LEVEL_ERROR to LOG_LEVEL_DEBUG
+  unsigned long lines[LOG_LEVEL_DEBUG + 1];
+  // lines lost to a full ring
+  unsigned long dropped;
+  // lines longer than LOG_LINE_LENGTH or with arguments that did not fit
+  unsigned long truncated;
+  // most records waiting at a drain
+  unsigned long peak;
+};
+
+extern Print *logOutput;
+extern LogStats logStats;
+
+// formats pending records and writes up to maxBytes, a line that does not fit
+// is continued by the next call. True when nothing is left
+bool logDrain(size_t maxBytes);
+// writes everything, e.g. before a restart
+void logFlush();
+// the text of a record with the time and the level in front, returns its length
+size_t logFormat(const LogRecord &record, char *line, size_t size);
+
+// a free record, NULL if the ring is full
+LogRecord *logReserve(uint8_t level, const char *format);
+// hands a filled record to the drain
+void logCommit(LogRecord *record);
+
+// Print that logs every line it is given, e.g. for printStats(Print &)
+class LogPrint : public Print
+{
+public:
+  explicit LogPrint(uint8_t level);
+
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+private:
+  uint8_t level;
+  uint8_t writer;
+  char text[LOG_RECORD_BYTES];
+  uint8_t length = 0;
+  // records of the current line so far, dropped ones included
+  uint8_t part = 0;
+
+  void send(bool continued);
+};
+
+inline void logCheckFormat(const char *format, ...) __attribute__((format(printf, 1, 2)));
+inline void logCheckFormat(const char *format, ...)
+{
+}
+
+inline void logPut(LogRecord &record, const void *value, uint8_t size)
+{
+  if (record.length + size > LOG_RECORD_BYTES)
+  {
+    record.cut = true;
+    return;
+  }
+  memcpy(record.arguments + record.length, value, size);
+  record.length += size;
+}
+
+inline void logAdd(LogRecord &record, int value)
+{
+  int32_t stored = value;
+  logPut(record, &stored, sizeof(stored));
+}
+
+inline void logAdd(LogRecord &record, unsigned int value)
+{
+  uint32_t stored = value;
+  logPut(record, &stored, sizeof(stored));
+}
+
+inline void logAdd(LogRecord &record, long value)
+{
+  int32_t stored = value;
+  logPut(record, &stored, sizeof(stored));
+}
+
+inline void logAdd(LogRecord &record, unsigned long value)
+{
+  uint32_t stored = value;
+  logPut(record, &stored, sizeof(stored));
+}
+
+inline void logAdd(LogRecord &record, double value)
+{
+  float stored = value;
+  logPut(record, &stored, sizeof(stored));
+}
+
+inline void logAdd(LogRecord &record, const void *value)
+{
+  logPut(record, &value, sizeof(value));
+}
+
+inline void logAdd(LogRecord &record, const char *value)
+{
+  if (value == NULL)
+  {
+    value = "(null)";
+  }
+  size_t room = LOG_RECORD_BYTES - record.length;
+  if (room == 0)
+  {
+    record.cut = true;
+    return;
+  }
+  size_t length = strnlen(value, room);
+  if (length == room)
+  {
+    length = room - 1;
+    record.cut = true;
+  }
+  memcpy(record.arguments + record.length, value, length);
+  record.arguments[record.length + length] = '\0';
+  record.length += length + 1;
+}
+
+inline void logAddAll(LogRecord &record)
+{
+}
+
+template <typename Value, typename... Rest>
+inline void logAddAll(LogRecord &record, Value value, Rest... rest)
+{
+  logAdd(record, value);
+  logAddAll(record, rest...);
+}
+
+template <typename... Arguments>
+inline void logDefer(uint8_t level, const char *format, Arguments... arguments)
+{
+  LogRecord *record = logReserve(level, format);
+  if (record == NULL)
+  {
+    return;
+  }
+  logAddAll(*record, arguments...);
+  logCommit(record);
+}
+
+#endif
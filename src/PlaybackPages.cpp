@@ -0,0 +1,385 @@
+#include "PlaybackPages.h"
+#include <time.h>
+
+// Declared costs are rough figures for the panel at 240 MHz, the scheduler
+// plans with the measured time once a draw was slower
+#define COST_TEXT_US 2000
+#define COST_PROGRESS_US 300
+#define COST_FEATURE_BARS_US 4000
+#define COST_LABELED_BARS_US 5000
+#define COST_ALBUM_ART_US 25000
+#define COST_STATS_US 8000
+#define COST_CLOCK_US 5000
+#define COST_MESSAGE_US 2000
+#define COST_BEAT_US 1500
+// the pulse grows from its smallest size with the loudness of the beat above this
+#define BEAT_QUIET_LOUDNESS 30000
+#define BEAT_MIN_RADIUS 3
+
+// the label of each FeatureId on the audio features page
+static const char *const FEATURE_LABELS[FEATURE_COUNT] = {"po", "bp", "da", "en", "va", "sp", "in", "ac", "li"};
+
+//-----------------TextWidget--------------------
+
+TextWidget::TextWidget(Adafruit_GFX &display, const Region &region, const PlaybackModel &model,
+                       const char *const &text, int frameMs)
+    : Widget(region, COST_TEXT_US), model(model), text(text),
+      scroll(display, region.y, "", 0xFFFF, 0x0000, frameMs)
+{
+}
+
+bool TextWidget::fits() const
+{
+    return (int16_t)(strlen(text) * CHAR_WIDTH_PX) <= region.w;
+}
+
+bool TextWidget::changed()
+{
+    // scrolling text moves every frame
+    return text != NULL && (!fits() || strcmp(drawn, text) != 0);
+}
+
+void TextWidget::draw(Adafruit_GFX &display)
+{
+    if (text == NULL)
+    {
+        return;
+    }
+    bool newText = strcmp(drawn, text) != 0;
+    if (invalid || newText)
+    {
+        display.fillRect(region.x, region.y, region.w, region.h, model.theme.background);
+        strncpy(drawn, text, sizeof(drawn) - 1);
+    }
+    if (fits())
+    {
+        display.setTextWrap(false);
+        display.setTextColor(model.theme.text, model.theme.background);
+        display.setCursor(region.x, region.y);
+        display.print(text);
+    }
+    else
+    {
+        scroll.setColors(model.theme.text, model.theme.background);
+        scroll.moveOneFrame(text);
+    }
+}
+
+//-----------------ProgressWidget--------------------
+
+ProgressWidget::ProgressWidget(const Region &region, const PlaybackModel &model)
+    : Widget(region, COST_PROGRESS_US), model(model)
+{
+}
+
+int16_t ProgressWidget::length() const
+{
+    if (model.durationMs <= 0 || model.progressMs <= 0)
+    {
+        return 0;
+    }
+    if (model.progressMs >= model.durationMs)
+    {
+        return region.w;
+    }
+    return (int16_t)((int64_t)model.progressMs * region.w / model.durationMs);
+}
+
+bool ProgressWidget::changed()
+{
+    return length() != drawnLength;
+}
+
+void ProgressWidget::draw(Adafruit_GFX &display)
+{
+    drawnLength = length();
+    drawSongProgress(display, region.y, model.progressMs, model.durationMs,
+                     model.theme.progress, model.theme.progressBackground);
+}
+
+//-----------------FeatureBarsWidget--------------------
+
+FeatureBarsWidget::FeatureBarsWidget(const Region &region, const PlaybackModel &model, bool labeled)
+    : Widget(region, labeled ? COST_LABELED_BARS_US : COST_FEATURE_BARS_US), model(model),
+      labeled(labeled)
+{
+}
+
+bool FeatureBarsWidget::changed()
+{
+    return drawnCount != model.featureCount ||
+           memcmp(drawn, model.featureLengths, model.featureCount * sizeof(int16_t)) != 0;
+}
+
+void FeatureBarsWidget::draw(Adafruit_GFX &display)
+{
+    drawnCount = model.featureCount > (uint8_t)FEATURE_COUNT ? (uint8_t)FEATURE_COUNT : model.featureCount;
+    memcpy(drawn, model.featureLengths, drawnCount * sizeof(int16_t));
+    // the labeled bars are shorter by the two characters of the label
+    const int16_t labelWidth = labeled ? 2 * CHAR_WIDTH_PX : 0;
+    const int16_t rowHeight = region.h / (drawnCount > 0 ? drawnCount : 1);
+    const int16_t barHeight = labeled ? rowHeight - 2 : FEATURE_BAR_HEIGHT;
+    const int16_t barWidth = region.w - labelWidth;
+    display.setTextWrap(false);
+    for (uint8_t index = 0; index < drawnCount; index++)
+    {
+        int16_t ypos = region.y + index * (labeled ? rowHeight : FEATURE_BAR_HEIGHT);
+        uint16_t color = FEATURE_BARS[model.features[index]].color;
+        if (color == FEATURE_COLOR_THEME)
+        {
+            color = model.theme.bar;
+        }
+        int16_t length = (int32_t)drawn[index] * barWidth / region.w;
+        if (labeled)
+        {
+            display.setTextColor(model.theme.text, model.theme.background);
+            display.setCursor(region.x, ypos);
+            display.print(FEATURE_LABELS[model.features[index]]);
+            display.fillRect(region.x + labelWidth + length, ypos, barWidth - length, barHeight, model.theme.barBackground);
+            display.fillRect(region.x + labelWidth, ypos, length, barHeight, color);
+        }
+        else
+        {
+            drawFeatureBar(display, ypos, barHeight, length, color, model.theme.barBackground);
+        }
+    }
+}
+
+//-----------------AlbumArtWidget--------------------
+
+AlbumArtWidget::AlbumArtWidget(const Region &region, const PlaybackModel &model)
+    : Widget(region, COST_ALBUM_ART_US), model(model)
+{
+}
+
+bool AlbumArtWidget::changed()
+{
+    return model.albumUri != NULL && strncmp(drawnUri, model.albumUri, sizeof(drawnUri)) != 0;
+}
+
+void AlbumArtWidget::draw(Adafruit_GFX &display)
+{
+    if (model.albumUri == NULL)
+    {
+        return;
+    }
+    strncpy(drawnUri, model.albumUri, sizeof(drawnUri) - 1);
+    if (!model.albumArtValid || model.albumArtCache == NULL ||
+        !model.albumArtCache->draw(model.albumUri, display, region.x, region.y))
+    {
+        display.fillRect(region.x, region.y, region.w, region.h, model.theme.background);
+    }
+}
+
+//-----------------StatsWidget--------------------
+
+StatsWidget::StatsWidget(const Region &region, const PlaybackModel &model)
+    : Widget(region, COST_STATS_US), model(model)
+{
+}
+
+bool StatsWidget::changed()
+{
+    // the windows move with the time, once a minute is enough for the table
+    return model.history != NULL &&
+           (model.history->counters.appends != drawnAppends || model.now / 60 != drawnMinute);
+}
+
+void StatsWidget::draw(Adafruit_GFX &display)
+{
+    if (model.history == NULL)
+    {
+        return;
+    }
+    drawnAppends = model.history->counters.appends;
+    drawnMinute = model.now / 60;
+    drawListeningStats(display, model.history->lastHour(model.now), model.history->lastDay(model.now), model.theme);
+}
+
+//-----------------ClockWidget--------------------
+
+ClockWidget::ClockWidget(const Region &region, const PlaybackModel &model)
+    : Widget(region, COST_CLOCK_US), model(model)
+{
+}
+
+bool ClockWidget::changed()
+{
+    return model.now / 60 != drawnMinute;
+}
+
+void ClockWidget::draw(Adafruit_GFX &display)
+{
+    drawnMinute = model.now / 60;
+    time_t now = model.now;
+    struct tm local;
+    localtime_r(&now, &local);
+    // room for any int, so the compiler sees no truncation
+    char text[36];
+
+    display.fillRect(region.x, region.y, region.w, region.h, model.theme.background);
+    display.setTextWrap(false);
+    // five characters of twice the size are 60 pixels
+    display.setTextSize(2);
+    display.setTextColor(model.theme.text, model.theme.background);
+    snprintf(text, sizeof(text), "%02d:%02d", local.tm_hour, local.tm_min);
+    display.setCursor(region.x + (region.w - 5 * 2 * CHAR_WIDTH_PX) / 2, region.y + region.h / 2 - 12);
+    display.print(text);
+    display.setTextSize(1);
+    display.setTextColor(model.theme.bar, model.theme.background);
+    snprintf(text, sizeof(text), "%02d.%02d.%04d", local.tm_mday, local.tm_mon + 1, local.tm_year + 1900);
+    display.setCursor(region.x + (region.w - 10 * CHAR_WIDTH_PX) / 2, region.y + region.h / 2 + 8);
+    display.print(text);
+}
+
+//-----------------MessageWidget--------------------
+
+MessageWidget::MessageWidget(const Region &region, const PlaybackModel &model)
+    : Widget(region, COST_MESSAGE_US), model(model)
+{
+}
+
+bool MessageWidget::changed()
+{
+    return model.message != drawn;
+}
+
+void MessageWidget::draw(Adafruit_GFX &display)
+{
+    drawn = model.message;
+    display.fillRect(region.x, region.y, region.w, region.h, model.theme.background);
+    if (drawn != NULL)
+    {
+        display.setTextWrap(false);
+        display.setTextColor(model.theme.text, model.theme.background);
+        display.setCursor(region.x + 2, region.y);
+        display.print(drawn);
+    }
+}
+
+//-----------------BeatWidget--------------------
+
+BeatWidget::BeatWidget(const Region &region, const PlaybackModel &model)
+    : Widget(region, COST_BEAT_US), model(model)
+{
+}
+
+int16_t BeatWidget::radius() const
+{
+    if (model.beatLoudness <= BEAT_QUIET_LOUDNESS)
+    {
+        return BEAT_MIN_RADIUS;
+    }
+    const int32_t maxRadius = (region.w < region.h ? region.w : region.h) / 2 - 1;
+    int32_t strength = (int32_t)(model.beatLoudness - BEAT_QUIET_LOUDNESS) * 256 /
+                       (BEAT_LOUDNESS_SCALE * -BEAT_LOUDNESS_FLOOR_DB - BEAT_QUIET_LOUDNESS);
+    // squared, so the disc falls back fast after the beat and lingers small
+    int32_t decay = (255 - model.beatPhase) * (255 - model.beatPhase) / 255;
+    return BEAT_MIN_RADIUS + (maxRadius - BEAT_MIN_RADIUS) * (strength > 256 ? 256 : strength) * decay / (256 * 255);
+}
+
+bool BeatWidget::changed()
+{
+    return radius() != drawnRadius;
+}
+
+void BeatWidget::draw(Adafruit_GFX &display)
+{
+    int16_t next = radius();
+    int16_t x = region.x + region.w / 2;
+    int16_t y = region.y + region.h / 2;
+    if (invalid)
+    {
+        display.fillRect(region.x, region.y, region.w, region.h, model.theme.background);
+    }
+    else if (next < drawnRadius)
+    {
+        display.fillCircle(x, y, drawnRadius, model.theme.background);
+    }
+    display.fillCircle(x, y, next, model.theme.bar);
+    drawnRadius = next;
+}
+
+//-----------------PlaybackPages--------------------
+
+static bool nowPlayingAvailable(void *context)
+{
+    const PlaybackModel &model = *(const PlaybackModel *)context;
+    return !model.error && model.playing;
+}
+
+static bool lyricsAvailable(void *context)
+{
+    const PlaybackModel &model = *(const PlaybackModel *)context;
+    return !model.error && model.playing && model.lyricsValid;
+}
+
+static bool visualizerAvailable(void *context)
+{
+    const PlaybackModel &model = *(const PlaybackModel *)context;
+    return !model.error && model.playing && model.beatsValid;
+}
+
+static bool audioFeaturesAvailable(void *context)
+{
+    const PlaybackModel &model = *(const PlaybackModel *)context;
+    return !model.error && model.playing && model.featuresValid && model.featureCount > 0;
+}
+
+static bool albumArtAvailable(void *context)
+{
+    const PlaybackModel &model = *(const PlaybackModel *)context;
+    return !model.error && !model.playing && model.albumArtValid;
+}
+
+static bool statsAvailable(void *context)
+{
+    const PlaybackModel &model = *(const PlaybackModel *)context;
+    return !model.error && !model.playing && model.history != NULL;
+}
+
+static bool clockAvailable(void *context)
+{
+    const PlaybackModel &model = *(const PlaybackModel *)context;
+    return !model.error && !model.playing && model.now != 0;
+}
+
+static bool errorAvailable(void *context)
+{
+    return ((const PlaybackModel *)context)->error;
+}
+
+PlaybackPages::PlaybackPages(Adafruit_GFX &display, PlaybackModel &model, int frameMs)
+    : display(display),
+      title(display, TITLE_REGION, model, model.title, frameMs),
+      artist(display, ARTIST_REGION, model, model.artist, frameMs),
+      lyric(display, LYRIC_REGION, model, model.lyricLine, frameMs),
+      nextLyric(display, NEXT_LYRIC_REGION, model, model.nextLyricLine, frameMs),
+      progress(PROGRESS_REGION, model),
+      bars(FEATURE_BARS_REGION, model, false),
+      labeledBars(LABELED_BARS_REGION, model, true),
+      albumArt(FULL_SCREEN_REGION, model),
+      stats(FULL_SCREEN_REGION, model),
+      clock(FULL_SCREEN_REGION, model),
+      beat(BEAT_REGION, model),
+      message(FULL_SCREEN_REGION, model),
+      nowPlayingWidgets{&progress, &title, &artist, &bars},
+      lyricsWidgets{&progress, &title, &lyric, &nextLyric},
+      visualizerWidgets{&progress, &title, &beat},
+      audioFeaturesWidgets{&progress, &title, &labeledBars},
+      albumArtWidgets{&albumArt},
+      statsWidgets{&stats},
+      clockWidgets{&clock},
+      errorWidgets{&message},
+      // the order is the rotation, and the first available page wins when the current one goes away
+      pages{{"now_playing", nowPlayingWidgets, 4, 20000, nowPlayingAvailable, &model},
+            {"lyrics", lyricsWidgets, 4, 20000, lyricsAvailable, &model},
+            {"visualizer", visualizerWidgets, 3, 12000, visualizerAvailable, &model},
+            {"audio_features", audioFeaturesWidgets, 3, 6000, audioFeaturesAvailable, &model},
+            {"album_art", albumArtWidgets, 1, 8000, albumArtAvailable, &model},
+            {"stats", statsWidgets, 1, 8000, statsAvailable, &model},
+            {"clock", clockWidgets, 1, 8000, clockAvailable, &model},
+            {"error", errorWidgets, 1, 0, errorAvailable, &model}},
+      scheduler(pages, PLAYBACK_PAGE_COUNT, model.theme.background)
+{
+}
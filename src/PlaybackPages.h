@@ -0,0 +1,229 @@
+/*
+PlaybackPages - the pages of the Spotify display
+
+Now playing, synced lyrics, beat visualizer, audio features, album art,
+listening statistics, clock and error. The widgets read everything from a
+PlaybackModel the app fills in every frame, so the same pages run on the
+panel and on a memory canvas in the native build.
+*/
+
+#ifndef PlaybackPages_h
+#define PlaybackPages_h
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+#include "DisplayPages.h"
+#include "PlaybackRender.h"
+#include "FeatureBars.h"
+#include "AlbumArtCache.h"
+#include "ListeningHistory.h"
+#include "AudioAnalysis.h"
+
+// layout of the 64x64 panel
+const Region TITLE_REGION = {0, 1, 64, 8};
+const Region PROGRESS_REGION = {0, 9, 64, 1};
+const Region ARTIST_REGION = {0, 11, 64, 8};
+// the current lyric line under the title, the next one below
+const Region LYRIC_REGION = {0, 11, 64, 8};
+const Region NEXT_LYRIC_REGION = {0, 21, 64, 8};
+// FEATURE_BAR_HEIGHT lines per bar
+const Region FEATURE_BARS_REGION = {0, 21, 64, 42};
+// the pulse of the visualizer under the title
+const Region BEAT_REGION = {0, 11, 64, 53};
+const Region LABELED_BARS_REGION = {0, 12, 64, 48};
+const Region FULL_SCREEN_REGION = {0, 0, 64, 64};
+#define FEATURE_BAR_HEIGHT 7
+
+// what the pages show, filled in by the app
+struct PlaybackModel
+{
+  bool error;
+  bool playing;
+  const char *title;
+  const char *artist;
+  long progressMs;
+  long durationMs;
+  // featureLengths[i] is the bar of features[i], for a bar over the whole width
+  const FeatureId *features;
+  const int16_t *featureLengths;
+  uint8_t featureCount;
+  // the lengths belong to the current track
+  bool featuresValid;
+  AlbumArtCache *albumArtCache;
+  const char *albumUri;
+  bool albumArtValid;
+  ListeningHistory *history;
+  // unix time, 0 while the clock is not set
+  uint32_t now;
+  // shown on the error page
+  const char *message;
+  PlaybackTheme theme;
+  // the lyrics of the current track are loaded, the lines are "" where there is none
+  bool lyricsValid;
+  const char *lyricLine;
+  const char *nextLyricLine;
+  // the beat grid of the current track is loaded; phase 0..255 within the beat and its
+  // loudness (see AudioAnalysis.h), 0 before the first and after the last beat
+  bool beatsValid;
+  uint8_t beatPhase;
+  uint16_t beatLoudness;
+};
+
+// a line of text, printed once if it fits and scrolling if not
+class TextWidget : public Widget
+{
+public:
+  TextWidget(Adafruit_GFX &display, const Region &region, const PlaybackModel &model,
+             const char *const &text, int frameMs);
+  bool changed() override;
+  void draw(Adafruit_GFX &display) override;
+
+private:
+  const PlaybackModel &model;
+  const char *const &text;
+  ScrollText scroll;
+  char drawn[SPOTIFY_NAME_CHAR_LENGTH] = "";
+  bool fits() const;
+};
+
+class ProgressWidget : public Widget
+{
+public:
+  ProgressWidget(const Region &region, const PlaybackModel &model);
+  bool changed() override;
+  void draw(Adafruit_GFX &display) override;
+
+private:
+  const PlaybackModel &model;
+  int16_t drawnLength = -1;
+  int16_t length() const;
+};
+
+// the bars of the now playing page, or with labels on their own page
+class FeatureBarsWidget : public Widget
+{
+public:
+  FeatureBarsWidget(const Region &region, const PlaybackModel &model, bool labeled);
+  bool changed() override;
+  void draw(Adafruit_GFX &display) override;
+
+private:
+  const PlaybackModel &model;
+  const bool labeled;
+  int16_t drawn[FEATURE_COUNT];
+  uint8_t drawnCount = 0;
+};
+
+class AlbumArtWidget : public Widget
+{
+public:
+  AlbumArtWidget(const Region &region, const PlaybackModel &model);
+  bool changed() override;
+  void draw(Adafruit_GFX &display) override;
+
+private:
+  const PlaybackModel &model;
+  char drawnUri[ALBUM_ART_CACHE_URI_LENGTH] = "";
+};
+
+// drawn again when a track was added or a minute passed
+class StatsWidget : public Widget
+{
+public:
+  StatsWidget(const Region &region, const PlaybackModel &model);
+  bool changed() override;
+  void draw(Adafruit_GFX &display) override;
+
+private:
+  const PlaybackModel &model;
+  unsigned long drawnAppends = 0;
+  uint32_t drawnMinute = 0;
+};
+
+class ClockWidget : public Widget
+{
+public:
+  ClockWidget(const Region &region, const PlaybackModel &model);
+  bool changed() override;
+  void draw(Adafruit_GFX &display) override;
+
+private:
+  const PlaybackModel &model;
+  uint32_t drawnMinute = 0;
+};
+
+// a disc that jumps to a size by the loudness on every beat and shrinks until the next
+class BeatWidget : public Widget
+{
+public:
+  BeatWidget(const Region &region, const PlaybackModel &model);
+  bool changed() override;
+  void draw(Adafruit_GFX &display) override;
+
+private:
+  const PlaybackModel &model;
+  int16_t drawnRadius = -1;
+  int16_t radius() const;
+};
+
+class MessageWidget : public Widget
+{
+public:
+  MessageWidget(const Region &region, const PlaybackModel &model);
+  bool changed() override;
+  void draw(Adafruit_GFX &display) override;
+
+private:
+  const PlaybackModel &model;
+  const char *drawn = NULL;
+};
+
+enum PlaybackPageId : uint8_t
+{
+  page_now_playing,
+  page_lyrics,
+  page_visualizer,
+  page_audio_features,
+  page_album_art,
+  page_stats,
+  page_clock,
+  page_error,
+  PLAYBACK_PAGE_COUNT
+};
+
+class PlaybackPages
+{
+private:
+  Adafruit_GFX &display;
+  TextWidget title;
+  TextWidget artist;
+  TextWidget lyric;
+  TextWidget nextLyric;
+  ProgressWidget progress;
+  FeatureBarsWidget bars;
+  FeatureBarsWidget labeledBars;
+  AlbumArtWidget albumArt;
+  StatsWidget stats;
+  ClockWidget clock;
+  BeatWidget beat;
+  MessageWidget message;
+  Widget *const nowPlayingWidgets[4];
+  Widget *const lyricsWidgets[4];
+  Widget *const visualizerWidgets[3];
+  Widget *const audioFeaturesWidgets[3];
+  Widget *const albumArtWidgets[1];
+  Widget *const statsWidgets[1];
+  Widget *const clockWidgets[1];
+  Widget *const errorWidgets[1];
+  Page pages[PLAYBACK_PAGE_COUNT];
+
+public:
+  PlaybackPages(Adafruit_GFX &display, PlaybackModel &model, int frameMs);
+
+  void renderFrame(uint32_t budgetUs) { scheduler.renderFrame(display, budgetUs); }
+  const Page &page(uint8_t index) const { return pages[index]; }
+
+  PageScheduler scheduler;
+};
+
+#endif
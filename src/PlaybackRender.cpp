@@ -0,0 +1,124 @@
+#include "PlaybackRender.h"
+
+ScrollText::ScrollText(Adafruit_GFX &display_in, uint8_t ypos_in, const char* text_in,
+                       uint16_t text_color_in, uint16_t background_color_in, int frame_ms_in):
+ display(display_in), ypos(ypos_in), text_color(text_color_in),
+ background_color(background_color_in), frame_ms(frame_ms_in) {
+   strcpy(text, text_in);
+   text_length = strlen(text_in);
+}
+
+void ScrollText::setText(const char* text_in) {
+  if (strcoll(text_in, text) != 0) {
+    xpos_scrolltext = 0;
+    timer_delay_scroll_text_ms = 0;
+    strcpy(text, text_in);
+    text_length = strlen(text);
+  }
+}
+
+void ScrollText::setColors(uint16_t text_color_in, uint16_t background_color_in) {
+  text_color = text_color_in;
+  background_color = background_color_in;
+}
+
+void ScrollText::moveOneFrame(const char* text) {
+  display.setTextWrap(false);  // we don't wrap text so it scrolls nicely
+  display.setTextColor(text_color, background_color);
+  setText(text);
+  yield();
+
+  switch(state) {
+    //waiting before moving the text
+    case 1:
+      timer_delay_scroll_text_ms += frame_ms;
+      if (timer_delay_scroll_text_ms > scrolling_delay_ms) {
+        timer_delay_scroll_text_ms = 0;
+        state = 2;
+      }
+      break;
+    // moving the text
+    case 2:
+      xpos_scrolltext--;
+      if(text_length*CHAR_WIDTH_PX + xpos_scrolltext <= display.width()) {
+        state = 3;
+      }
+      break;
+    //waiting before start moving the text from the beginning again
+    case 3:
+      timer_delay_scroll_text_ms += frame_ms;
+      if (timer_delay_scroll_text_ms > scrolling_delay_ms) {
+        timer_delay_scroll_text_ms = 0;
+        xpos_scrolltext = 0;
+        state = 1;
+      }
+  }
+  display.setCursor(xpos_scrolltext, ypos);
+  display.println(text);
+}
+
+void drawSongProgress(Adafruit_GFX &display, int16_t ypos, long progress_ms, long duration_ms,
+                      uint16_t color, uint16_t background_color) {
+  const int16_t width = display.width();
+  float percentage;
+  if (duration_ms <= 0) {
+    percentage = 0;
+  } else {
+    percentage = ((float)progress_ms / (float)duration_ms);
+  }
+  float progress_float = (float)width * percentage;
+  int clamped_progress = (int)progress_float;
+
+  display.drawFastHLine(0, ypos, clamped_progress, color);
+  display.drawFastHLine(clamped_progress, ypos, width - clamped_progress, background_color);
+}
+
+void drawFeatureBar(Adafruit_GFX &display, int16_t ypos, int16_t bar_height, int16_t bar_length,
+                    uint16_t color, uint16_t background_color) {
+  const int16_t width = display.width();
+  for(int16_t wi = 0; wi < bar_height; wi++) {
+    display.drawFastHLine(0, ypos + wi, bar_length, color);
+    display.drawFastHLine(bar_length, ypos + wi, width - bar_length, background_color);
+  }
+}
+
+// one row of drawListeningStats, a feature is "-" when no track had features
+static void printStatsRow(Adafruit_GFX &display, int16_t ypos, const char *label, uint32_t hour_value,
+                          uint32_t day_value, bool hour_valid, bool day_valid) {
+  char hour_text[6] = "-";
+  char day_text[6] = "-";
+  if (hour_valid) {
+    snprintf(hour_text, sizeof(hour_text), "%lu", (unsigned long)(hour_value > 9999 ? 9999 : hour_value));
+  }
+  if (day_valid) {
+    snprintf(day_text, sizeof(day_text), "%lu", (unsigned long)(day_value > 9999 ? 9999 : day_value));
+  }
+  char row[16];
+  // 10 characters fill the 64 pixels
+  snprintf(row, sizeof(row), "%-2s%4s%4s", label, hour_text, day_text);
+  display.setCursor(0, ypos);
+  display.print(row);
+}
+
+void drawListeningStats(Adafruit_GFX &display, const ListeningStats &hour, const ListeningStats &day,
+                        const PlaybackTheme &theme) {
+  const int16_t row_height = 9;
+  bool hour_features = hour.featureTracks > 0;
+  bool day_features = day.featureTracks > 0;
+
+  display.fillScreen(theme.background);
+  display.setTextWrap(false);
+  display.setTextColor(theme.text, theme.background);
+  display.setCursor(0, 1);
+  display.print("    1h 24h");
+  display.drawFastHLine(0, row_height, display.width(), theme.bar);
+  printStatsRow(display, 1 + row_height + 2, "#", hour.tracks, day.tracks, true, true);
+  printStatsRow(display, 1 + 2 * row_height + 2, "mn", hour.listenedSeconds / 60, day.listenedSeconds / 60,
+                true, true);
+  printStatsRow(display, 1 + 3 * row_height + 2, "en", (uint32_t)(hour.energy * 100 + 0.5f),
+                (uint32_t)(day.energy * 100 + 0.5f), hour_features, day_features);
+  printStatsRow(display, 1 + 4 * row_height + 2, "va", (uint32_t)(hour.valence * 100 + 0.5f),
+                (uint32_t)(day.valence * 100 + 0.5f), hour_features, day_features);
+  printStatsRow(display, 1 + 5 * row_height + 2, "bp", (uint32_t)(hour.tempo + 0.5f),
+                (uint32_t)(day.tempo + 0.5f), hour_features, day_features);
+}
@@ -0,0 +1,67 @@
+// Drawing of the playback information (scrolling text, song progress,
+// audio feature bars and the listening statistics). Everything draws on an Adafruit_GFX, so the same code
+// runs on the PxMATRIX panel and on a memory canvas in the native build.
+
+#ifndef PlaybackRender_h
+#define PlaybackRender_h
+
+#include <Arduino.h>
+#include <Adafruit_GFX.h>
+#include "ListeningHistory.h"
+
+// width of one character of the built-in font in pixels
+#define CHAR_WIDTH_PX 6
+
+// colors of the playback screen, fixed or taken from the album cover
+struct PlaybackTheme
+{
+  uint16_t text;
+  uint16_t background;
+  uint16_t progress;
+  uint16_t progressBackground;
+  uint16_t bar;
+  uint16_t barBackground;
+};
+
+class ScrollText
+{
+  public:
+    ScrollText(Adafruit_GFX &display_in, uint8_t ypos_in, const char* text_in,
+               uint16_t text_color_in, uint16_t background_color_in, int frame_ms_in);
+
+    void setText(const char* text_in);
+    void setColors(uint16_t text_color_in, uint16_t background_color_in);
+    void moveOneFrame(const char* text);
+
+  private:
+    Adafruit_GFX &display;
+    char text[80];
+    uint8_t ypos;
+    uint16_t text_length;
+
+    int xpos_scrolltext = 0;
+    int timer_delay_scroll_text_ms = 0;
+    // describes the delay when starting and ending to scroll
+    const short scrolling_delay_ms = 2000;
+    uint16_t text_color;
+    uint16_t background_color;
+    // time between two calls of moveOneFrame
+    const int frame_ms;
+
+    short state = 1;
+};
+
+// horizontal line over the whole display width, filled up to progress/duration
+void drawSongProgress(Adafruit_GFX &display, int16_t ypos, long progress_ms, long duration_ms,
+                      uint16_t color, uint16_t background_color);
+
+// bar of bar_height lines, filled from the left with bar_length pixels
+void drawFeatureBar(Adafruit_GFX &display, int16_t ypos, int16_t bar_height, int16_t bar_length,
+                    uint16_t color, uint16_t background_color);
+
+// full screen table of the tracks, minutes, energy, valence and tempo of the
+// last hour and the last day
+void drawListeningStats(Adafruit_GFX &display, const ListeningStats &hour, const ListeningStats &day,
+                        const PlaybackTheme &theme);
+
+#endif
@@ -0,0 +1,96 @@
+#include "PowerManager.h"
+
+static const char *const POWER_STATE_NAMES[POWER_STATE_COUNT] = {"active", "idle", "standby"};
+
+PowerManager::PowerManager(PowerDriver &driver, uint32_t idleTimeoutMs)
+    : driver(driver), idleTimeoutMs(idleTimeoutMs)
+{
+}
+
+void PowerManager::begin()
+{
+    driver.cpuFrequency(POWER_ACTIVE_CPU_MHZ);
+    driver.panel(true);
+    // until the first poll it counts as playing, so the timeout starts with it
+    state = power_active;
+    stateSinceMs = millis();
+}
+
+void PowerManager::enter(PowerState next, unsigned long now)
+{
+    stats.residencyMs[state] += now - stateSinceMs;
+    state = next;
+    stateSinceMs = now;
+}
+
+bool PowerManager::update(bool playing)
+{
+    unsigned long now = millis();
+    switch (state)
+    {
+        case power_active:
+            if (!playing)
+            {
+                enter(power_idle, now);
+                return true;
+            }
+            break;
+        case power_idle:
+            if (playing)
+            {
+                enter(power_active, now);
+                return true;
+            }
+            if (now - stateSinceMs >= idleTimeoutMs)
+            {
+                // the panel goes dark before its supply is cut
+                stats.standbys++;
+                driver.panel(false);
+                driver.cpuFrequency(POWER_STANDBY_CPU_MHZ);
+                enter(power_standby, now);
+                return true;
+            }
+            break;
+        case power_standby:
+            if (playing)
+            {
+                stats.wakeups++;
+                driver.cpuFrequency(POWER_ACTIVE_CPU_MHZ);
+                driver.panel(true);
+                enter(power_active, now);
+                return true;
+            }
+            break;
+        default:
+            break;
+    }
+    return false;
+}
+
+unsigned long PowerManager::residencyMs(PowerState of) const
+{
+    unsigned long residency = stats.residencyMs[of];
+    if (of == state)
+    {
+        residency += millis() - stateSinceMs;
+    }
+    return residency;
+}
+
+void PowerManager::printStats(Print &out)
+{
+    out.print("Power: ");
+    for (uint8_t index = 0; index < POWER_STATE_COUNT; index++)
+    {
+        out.print(POWER_STATE_NAMES[index]);
+        out.print(" ");
+        out.print(residencyMs((PowerState)index) / 1000);
+        out.print(" s, ");
+    }
+    out.print("standbys ");
+    out.print(stats.standbys);
+    out.print(", wakeups ");
+    out.print(stats.wakeups);
+    out.print(", now ");
+    out.println(POWER_STATE_NAMES[state]);
+}
@@ -0,0 +1,79 @@
+/*
+PowerManager - standby of the display while nothing plays
+
+After every poll the app tells whether Spotify plays; once nothing played
+for the idle timeout, the panel (refresh ISR and power supply) goes off, the
+CPU runs slower and Spotify is polled less often. The first poll that sees
+playback turns everything on again. The hardware is behind PowerDriver, so the logic runs on the PC.
+*/
+
+#ifndef PowerManager_h
+#define PowerManager_h
+
+#include <Arduino.h>
+
+class PowerDriver
+{
+public:
+  virtual ~PowerDriver() {}
+  // the refresh of the panel and its power supply
+  virtual void panel(bool on) = 0;
+  virtual void cpuFrequency(uint32_t mhz) = 0;
+};
+
+enum PowerState : uint8_t
+{
+  // playing, panel on
+  power_active,
+  // nothing playing, panel on until the idle timeout
+  power_idle,
+  // panel off, slow CPU and polls
+  power_standby,
+  POWER_STATE_COUNT
+};
+
+struct PowerStats
+{
+  // time spent in every state, without the current stay
+  unsigned long residencyMs[POWER_STATE_COUNT];
+  unsigned long standbys;
+  unsigned long wakeups;
+};
+
+#define POWER_IDLE_TIMEOUT_MS 300000
+#define POWER_ACTIVE_CPU_MHZ 240
+// WiFi needs at least 80 MHz
+#define POWER_STANDBY_CPU_MHZ 80
+#define POWER_ACTIVE_POLL_MS 10000
+#define POWER_STANDBY_POLL_MS 30000
+
+class PowerManager
+{
+public:
+  PowerManager(PowerDriver &driver, uint32_t idleTimeoutMs = POWER_IDLE_TIMEOUT_MS);
+
+  // panel on and full speed, the idle time starts now
+  void begin();
+  // after every poll, returns true when the state changed
+  bool update(bool playing);
+
+  PowerState currentState() const { return state; }
+  bool standby() const { return state == power_standby; }
+  // of the Spotify poll in this state
+  uint32_t pollPeriodMs() const { return state == power_standby ? POWER_STANDBY_POLL_MS : POWER_ACTIVE_POLL_MS; }
+  // including the current stay
+  unsigned long residencyMs(PowerState of) const;
+  void printStats(Print &out);
+
+  PowerStats stats = {{0, 0, 0}, 0, 0};
+
+private:
+  PowerDriver &driver;
+  const uint32_t idleTimeoutMs;
+  PowerState state = power_active;
+  unsigned long stateSinceMs = 0;
+
+  void enter(PowerState next, unsigned long now);
+};
+
+#endif
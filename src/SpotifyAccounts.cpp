@@ -0,0 +1,211 @@
+#include "SpotifyAccounts.h"
+#include "ArduinoSpotify.h"
+
+void PlaybackSummaryParser::begin(PlaybackSummary &summary)
+{
+    this->summary = &summary;
+    memset(&summary, 0, sizeof(summary));
+    beginScan();
+}
+
+void PlaybackSummaryParser::feed(const uint8_t *data, size_t length)
+{
+    unsigned long start = micros();
+    scan(data, length);
+    stats.bytes += length;
+    stats.parseMicros += micros() - start;
+}
+
+bool PlaybackSummaryParser::finish()
+{
+    return endScan();
+}
+
+uint8_t PlaybackSummaryParser::keyOf(const char *key)
+{
+    static const char *const keys[] = {"", "item", "artists", "id", "name", "duration_ms", "progress_ms", "is_playing"};
+    for (uint8_t i = key_item; i <= key_is_playing; i++)
+    {
+        if (strcmp(key, keys[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return key_other;
+}
+
+void PlaybackSummaryParser::number(const char *text)
+{
+    uint8_t key = currentKey();
+    if (depth == 1 && key == key_progress_ms)
+    {
+        summary->progressMs = strtoul(text, NULL, 10);
+    }
+    else if (depth == 2 && path[0] == key_item && key == key_duration_ms)
+    {
+        summary->durationMs = strtoul(text, NULL, 10);
+    }
+}
+
+void PlaybackSummaryParser::startValue(char c)
+{
+    uint8_t key = currentKey();
+    if (c == '"')
+    {
+        if (depth == 2 && path[0] == key_item && key == key_id)
+        {
+            keepString(summary->trackId, sizeof(summary->trackId));
+        }
+        else if (depth == 2 && path[0] == key_item && key == key_name)
+        {
+            keepString(summary->trackName, sizeof(summary->trackName));
+        }
+        else if (depth == 4 && path[0] == key_item && path[1] == key_artists && path[2] == 0 && key == key_name)
+        {
+            // only the first artist
+            keepString(summary->artistName, sizeof(summary->artistName));
+        }
+    }
+    else if (depth == 1 && key == key_is_playing)
+    {
+        summary->isPlaying = c == 't';
+    }
+}
+
+SpotifyAccountPool::SpotifyAccountPool(ArduinoSpotify &spotify, SpotifyAccount *accounts, uint8_t capacity)
+    : spotify(spotify), accounts(accounts), capacity(capacity < SPOTIFY_ACCOUNTS_MAX ? capacity : SPOTIFY_ACCOUNTS_MAX)
+{
+}
+
+SpotifyAccount *SpotifyAccountPool::newAccount()
+{
+    if (accountCount >= capacity)
+    {
+        return NULL;
+    }
+    SpotifyAccount *account = &accounts[accountCount];
+    memset(account, 0, sizeof(SpotifyAccount));
+    account->nextPollAt = millis();
+    return account;
+}
+
+int SpotifyAccountPool::addAccount(const char *refreshToken)
+{
+    SpotifyAccount *account = newAccount();
+    if (account == NULL)
+    {
+        return -1;
+    }
+    // expired, the first poll refreshes it
+    account->token.refreshToken = refreshToken;
+    return accountCount++;
+}
+
+int SpotifyAccountPool::addAccountWithToken(const char *accessToken)
+{
+    SpotifyAccount *account = newAccount();
+    if (account == NULL)
+    {
+        return -1;
+    }
+    snprintf(account->token.bearerToken, sizeof(account->token.bearerToken), "Bearer %s", accessToken);
+    account->token.refreshToken = NULL;
+    return accountCount++;
+}
+
+void SpotifyAccountPool::clear()
+{
+    accountCount = 0;
+    cursor = 0;
+}
+
+int SpotifyAccountPool::pollNext()
+{
+    if (accountCount == 0)
+    {
+        return -1;
+    }
+    uint32_t now = millis();
+    int index = -1;
+    for (uint8_t i = 1; i <= accountCount; i++)
+    {
+        uint8_t candidate = (cursor + i) % accountCount;
+        if ((int32_t)(now - accounts[candidate].nextPollAt) >= 0)
+        {
+            index = candidate;
+            break;
+        }
+    }
+    if (index < 0)
+    {
+        return -1;
+    }
+
+    SpotifyAccount &account = accounts[index];
+    unsigned int refreshedAt = account.token.refreshedAt;
+    bool autoTokenRefresh = spotify.autoTokenRefresh;
+    spotify.autoTokenRefresh = account.token.refreshToken != NULL;
+    spotify.swapTokenContext(account.token);
+    spotify.setKeepAlive(true);
+    unsigned long start = micros();
+    int statusCode = spotify.getPlaybackSummary(parser, scratch);
+    uint32_t elapsed = micros() - start;
+    spotify.autoTokenRefresh = autoTokenRefresh;
+    spotify.swapTokenContext(account.token);
+
+    if (statusCode == 0)
+    {
+        // the cursor stays, the account is the first one when the budget allows a poll
+        stats.deferred++;
+        return -1;
+    }
+    if (account.token.refreshedAt != refreshedAt)
+    {
+        stats.tokenRefreshes++;
+    }
+    cursor = index;
+    account.nextPollAt = now + pollIntervalMs;
+    account.polls++;
+    account.statusCode = statusCode;
+    stats.polls++;
+    stats.totalPollUs += elapsed;
+    if (elapsed > stats.slowestPollUs)
+    {
+        stats.slowestPollUs = elapsed;
+    }
+    if (statusCode == 200 || statusCode == 204)
+    {
+        if (statusCode == 200)
+        {
+            account.playback = scratch;
+        }
+        else
+        {
+            memset(&account.playback, 0, sizeof(account.playback));
+        }
+        account.fetchedAt = millis();
+        account.valid = true;
+    }
+    else
+    {
+        account.failures++;
+        stats.failures++;
+    }
+    return index;
+}
+
+void SpotifyAccountPool::close()
+{
+    spotify.setKeepAlive(false);
+}
+
+uint32_t SpotifyAccountPool::progressMs(uint8_t index) const
+{
+    const SpotifyAccount &account = accounts[index];
+    if (!account.valid || !account.playback.isPlaying)
+    {
+        return account.playback.progressMs;
+    }
+    uint32_t progress = account.playback.progressMs + (millis() - account.fetchedAt);
+    return progress < account.playback.durationMs ? progress : account.playback.durationMs;
+}
@@ -0,0 +1,168 @@
+/*
+SpotifyAccounts - the playback of several accounts polled over one connection
+
+A hub that shows what everyone in the house is listening to does not need
+an ArduinoSpotify per account, each with its own client, TLS sessions and a
+4 kB JSON document per poll. SpotifyAccountPool takes one ArduinoSpotify and
+a fixed array of SpotifyAccount slots: for a poll it swaps the access token
+of the account into it, requests the currently playing track over the
+connection that stays open between the polls, and keeps what a display
+needs of the answer in the slot. PlaybackSummaryParser reads the body as it
+comes in, without a document.
+
+pollNext() polls the accounts round-robin, at most one per call, each once
+per pollIntervalMs. Every poll counts against the currently playing budget
+of the shared ArduinoSpotify (setRequestBudget) and a 429 backs off all of
+them, so the rate limit of the app holds however many accounts there are.
+An account with a refresh token refreshes its own access token when it ran
+out or a poll was answered with 401.
+*/
+
+#ifndef SpotifyAccounts_h
+#define SpotifyAccounts_h
+
+#include <Arduino.h>
+#include "JsonScanner.h"
+
+#define SPOTIFY_BEARER_TOKEN_LENGTH 200
+#define SPOTIFY_ACCOUNTS_MAX 16
+// a track id is 22 characters
+#define SPOTIFY_ACCOUNT_ID_LENGTH 23
+// track and artist names are cut to this
+#define SPOTIFY_ACCOUNT_NAME_LENGTH 32
+
+class ArduinoSpotify;
+
+// What ArduinoSpotify knows of the access token of an account
+struct SpotifyTokenContext
+{
+  // "Bearer <access token>"
+  char bearerToken[SPOTIFY_BEARER_TOKEN_LENGTH];
+  // NULL if the access token is not refreshed
+  const char *refreshToken;
+  unsigned int refreshedAt;
+  // 0 until the first refresh
+  unsigned int timeToLiveMs;
+};
+
+struct PlaybackSummary
+{
+  // empty when nothing is playing
+  char trackId[SPOTIFY_ACCOUNT_ID_LENGTH];
+  char trackName[SPOTIFY_ACCOUNT_NAME_LENGTH];
+  // the first artist
+  char artistName[SPOTIFY_ACCOUNT_NAME_LENGTH];
+  uint32_t progressMs;
+  uint32_t durationMs;
+  bool isPlaying;
+};
+
+struct PlaybackSummaryStats
+{
+  unsigned long bytes;
+  // time the parser spent on the bodies, without waiting for the network
+  unsigned long parseMicros;
+};
+
+// Streams a currently playing body into a PlaybackSummary
+class PlaybackSummaryParser : private JsonScanner
+{
+public:
+  // the next body goes to summary, which is emptied
+  void begin(PlaybackSummary &summary);
+  void feed(const uint8_t *data, size_t length);
+  // true if the body was complete JSON
+  bool finish();
+
+  PlaybackSummaryStats stats = {0, 0};
+
+private:
+  // the keys the summary is made of, any other is key_other
+  enum SummaryKey : uint8_t
+  {
+    key_other,
+    key_item,
+    key_artists,
+    key_id,
+    key_name,
+    key_duration_ms,
+    key_progress_ms,
+    key_is_playing
+  };
+
+  PlaybackSummary *summary = NULL;
+
+  uint8_t keyOf(const char *key) override;
+  void number(const char *text) override;
+  void startValue(char c) override;
+};
+
+struct SpotifyAccount
+{
+  SpotifyTokenContext token;
+  // the answer of the last successful poll
+  PlaybackSummary playback;
+  // millis() of the last successful poll
+  uint32_t fetchedAt;
+  uint32_t nextPollAt;
+  uint32_t polls;
+  uint16_t failures;
+  // status of the last poll, 0 before the first
+  int16_t statusCode;
+  // playback holds an answer
+  bool valid;
+};
+
+struct SpotifyAccountPoolStats
+{
+  unsigned long polls;
+  unsigned long failures;
+  // polls that were due but waited for the budget or a backoff
+  unsigned long deferred;
+  unsigned long tokenRefreshes;
+  uint32_t slowestPollUs;
+  unsigned long totalPollUs;
+};
+
+class SpotifyAccountPool
+{
+public:
+  // accounts has room for capacity slots, at most SPOTIFY_ACCOUNTS_MAX are used
+  SpotifyAccountPool(ArduinoSpotify &spotify, SpotifyAccount *accounts, uint8_t capacity);
+
+  // an account whose access token is refreshed with refreshToken (not copied) on
+  // its first poll. Returns its index, -1 if the slots are full
+  int addAccount(const char *refreshToken);
+  // an account with an access token that is never refreshed, e.g. for tests
+  int addAccountWithToken(const char *accessToken);
+  void clear();
+
+  // polls the next account that is due, returns its index or -1 if none was due or allowed
+  int pollNext();
+  // closes the shared connection, the next poll opens it again
+  void close();
+
+  // the progress of an account advanced to now
+  uint32_t progressMs(uint8_t index) const;
+  uint8_t count() const { return accountCount; }
+  const SpotifyAccount &account(uint8_t index) const { return accounts[index]; }
+
+  // each account is polled at most this often
+  uint32_t pollIntervalMs = 10000;
+  SpotifyAccountPoolStats stats = {0, 0, 0, 0, 0, 0};
+  PlaybackSummaryParser parser;
+
+private:
+  ArduinoSpotify &spotify;
+  SpotifyAccount *accounts;
+  uint8_t capacity;
+  uint8_t accountCount = 0;
+  // the account polled last
+  uint8_t cursor = 0;
+  // the answer is parsed here, so a failed poll keeps the last playback of the account
+  PlaybackSummary scratch;
+
+  SpotifyAccount *newAccount();
+};
+
+#endif
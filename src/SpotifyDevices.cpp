@@ -0,0 +1,273 @@
+#include "SpotifyDevices.h"
+#include "ArduinoSpotify.h"
+
+void SpotifyDevicesParser::begin(SpotifyDevice *devices, uint8_t capacity)
+{
+    this->devices = devices;
+    this->capacity = capacity;
+    stored = 0;
+    listed = 0;
+    device = NULL;
+    beginScan();
+    bytes = 0;
+}
+
+void SpotifyDevicesParser::feed(const uint8_t *data, size_t length)
+{
+    scan(data, length);
+    bytes += length;
+}
+
+bool SpotifyDevicesParser::finish()
+{
+    return endScan();
+}
+
+uint8_t SpotifyDevicesParser::keyOf(const char *key)
+{
+    static const char *const keys[] = {"", "devices", "id", "name", "type", "is_active",
+                                       "is_restricted", "is_private_session", "volume_percent"};
+    for (uint8_t i = key_devices; i <= key_volume_percent; i++)
+    {
+        if (strcmp(key, keys[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return key_other;
+}
+
+void SpotifyDevicesParser::openedContainer(bool array)
+{
+    // an element of the devices array of the root object
+    if (depth == 3 && !array && isArray[1] && path[0] == key_devices)
+    {
+        device = NULL;
+        if (stored < capacity)
+        {
+            device = &devices[stored];
+            memset(device, 0, sizeof(SpotifyDevice));
+            device->volumePercent = -1;
+        }
+        if (listed < 0xFF)
+        {
+            listed++;
+        }
+    }
+}
+
+void SpotifyDevicesParser::closingContainer()
+{
+    if (depth == 3 && device != NULL)
+    {
+        stored++;
+        device = NULL;
+    }
+}
+
+void SpotifyDevicesParser::number(const char *text)
+{
+    if (depth == 3 && device != NULL && currentKey() == key_volume_percent)
+    {
+        device->volumePercent = atoi(text);
+    }
+}
+
+void SpotifyDevicesParser::startValue(char c)
+{
+    if (depth != 3 || device == NULL)
+    {
+        return;
+    }
+    uint8_t key = currentKey();
+    if (c == '"')
+    {
+        if (key == key_id)
+        {
+            keepString(device->id, sizeof(device->id));
+        }
+        else if (key == key_name)
+        {
+            keepString(device->name, sizeof(device->name));
+        }
+        else if (key == key_type)
+        {
+            keepString(device->type, sizeof(device->type));
+        }
+    }
+    else if (key == key_is_active)
+    {
+        device->isActive = c == 't';
+    }
+    else if (key == key_is_restricted)
+    {
+        device->isRestricted = c == 't';
+    }
+    else if (key == key_is_private_session)
+    {
+        device->isPrivateSession = c == 't';
+    }
+}
+
+SpotifyDeviceTable::SpotifyDeviceTable(ArduinoSpotify &spotify) : spotify(spotify)
+{
+}
+
+bool SpotifyDeviceTable::stale() const
+{
+    unsigned long age = millis() - refreshedAt;
+    if (refreshFailed)
+    {
+        return age >= SPOTIFY_DEVICE_TABLE_RETRY_MS;
+    }
+    return refreshPending || !valid || age >= maxAgeMs;
+}
+
+bool SpotifyDeviceTable::refresh()
+{
+    refreshedAt = millis();
+    int count = spotify.getDevices(devices, SPOTIFY_DEVICE_TABLE_SIZE);
+    if (count == -2)
+    {
+        // the list is only partly there
+        deviceCount = 0;
+        valid = false;
+    }
+    refreshFailed = count < 0;
+    if (count < 0)
+    {
+        stats.failedRefreshes++;
+        return false;
+    }
+    deviceCount = count;
+    valid = true;
+    refreshPending = false;
+    stats.refreshes++;
+    return true;
+}
+
+SpotifyDevice *SpotifyDeviceTable::lookup(const char *nameOrId)
+{
+    for (uint8_t i = 0; i < deviceCount; i++)
+    {
+        if (strcmp(devices[i].id, nameOrId) == 0 || strcasecmp(devices[i].name, nameOrId) == 0)
+        {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+const SpotifyDevice *SpotifyDeviceTable::find(const char *nameOrId)
+{
+    bool refreshed = false;
+    if (stale())
+    {
+        refreshed = refresh();
+    }
+    SpotifyDevice *device = lookup(nameOrId);
+    if (device == NULL && !refreshed && millis() - refreshedAt >= SPOTIFY_DEVICE_TABLE_RETRY_MS)
+    {
+        // a device that was switched on since
+        refresh();
+        device = lookup(nameOrId);
+    }
+    if (device != NULL)
+    {
+        stats.hits++;
+    }
+    else
+    {
+        stats.misses++;
+    }
+    return device;
+}
+
+const SpotifyDevice *SpotifyDeviceTable::active()
+{
+    if (stale())
+    {
+        refresh();
+    }
+    for (uint8_t i = 0; i < deviceCount; i++)
+    {
+        if (devices[i].isActive)
+        {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+SpotifyDevice *SpotifyDeviceTable::commandTarget(const char *nameOrId)
+{
+    SpotifyDevice *device = (SpotifyDevice *)find(nameOrId);
+    if (device != NULL && device->isRestricted)
+    {
+        stats.requestsSaved++;
+        return NULL;
+    }
+    return device;
+}
+
+void SpotifyDeviceTable::markActive(SpotifyDevice *device)
+{
+    for (uint8_t i = 0; i < deviceCount; i++)
+    {
+        devices[i].isActive = &devices[i] == device;
+    }
+}
+
+bool SpotifyDeviceTable::transferPlayback(const char *nameOrId, bool play)
+{
+    SpotifyDevice *device = commandTarget(nameOrId);
+    if (device == NULL)
+    {
+        return false;
+    }
+    if (device->isActive && !play)
+    {
+        stats.requestsSaved++;
+        return true;
+    }
+    if (!spotify.transferPlayback(device->id, play))
+    {
+        invalidate();
+        return false;
+    }
+    markActive(device);
+    return true;
+}
+
+bool SpotifyDeviceTable::play(const char *nameOrId)
+{
+    SpotifyDevice *device = commandTarget(nameOrId);
+    if (device == NULL)
+    {
+        return false;
+    }
+    if (!spotify.play(device->id))
+    {
+        invalidate();
+        return false;
+    }
+    // playing on a device moves the playback there
+    markActive(device);
+    return true;
+}
+
+bool SpotifyDeviceTable::setVolume(const char *nameOrId, int volume)
+{
+    SpotifyDevice *device = commandTarget(nameOrId);
+    if (device == NULL)
+    {
+        return false;
+    }
+    if (!spotify.setVolume(volume, device->id))
+    {
+        invalidate();
+        return false;
+    }
+    device->volumePercent = volume;
+    return true;
+}
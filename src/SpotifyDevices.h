@@ -0,0 +1,143 @@
+/*
+SpotifyDevices - the devices of the account from /v1/me/player/devices
+
+SpotifyDevicesParser reads the device list as it comes in, into a fixed
+array of SpotifyDevice with the id, name and type inline, so a refresh
+allocates nothing. Longer names are cut.
+
+SpotifyDeviceTable keeps the list and refreshes it only when it is used
+and older than maxAgeMs, or when a device is not in it (at most every
+SPOTIFY_DEVICE_TABLE_RETRY_MS). Its commands take a device name or id:
+the id comes from the table without a request, a transfer to the device
+that is already active is not sent at all, and restricted devices (which
+accept no Web API commands) are turned down right away. A successful
+command updates the table, a failed one makes the next use refresh it.
+*/
+
+#ifndef SpotifyDevices_h
+#define SpotifyDevices_h
+
+#include <Arduino.h>
+#include "JsonScanner.h"
+
+#define SPOTIFY_DEVICE_ID_CHAR_LENGTH 45
+#define SPOTIFY_DEVICE_NAME_CHAR_LENGTH 80
+#define SPOTIFY_DEVICE_TYPE_CHAR_LENGTH 30
+
+#define SPOTIFY_DEVICE_TABLE_SIZE 8
+#define SPOTIFY_DEVICE_TABLE_MAX_AGE_MS 60000
+// a device that is not in the table refreshes it at most this often
+#define SPOTIFY_DEVICE_TABLE_RETRY_MS 5000
+
+class ArduinoSpotify;
+
+struct SpotifyDevice
+{
+  char id[SPOTIFY_DEVICE_ID_CHAR_LENGTH];
+  char name[SPOTIFY_DEVICE_NAME_CHAR_LENGTH];
+  char type[SPOTIFY_DEVICE_TYPE_CHAR_LENGTH];
+  bool isActive;
+  bool isRestricted;
+  bool isPrivateSession;
+  // -1 if the device has no volume
+  int volumePercent;
+};
+
+class SpotifyDevicesParser : private JsonScanner
+{
+public:
+  // the next body goes to devices, the ones after capacity are only counted
+  void begin(SpotifyDevice *devices, uint8_t capacity);
+  void feed(const uint8_t *data, size_t length);
+  // true if the body was complete JSON
+  bool finish();
+
+  // devices written to the array
+  uint8_t count() const { return stored; }
+  // devices in the body
+  uint8_t total() const { return listed; }
+  unsigned long bytes = 0;
+
+private:
+  enum DeviceKey : uint8_t
+  {
+    key_other,
+    key_devices,
+    key_id,
+    key_name,
+    key_type,
+    key_is_active,
+    key_is_restricted,
+    key_is_private_session,
+    key_volume_percent
+  };
+
+  SpotifyDevice *devices = NULL;
+  uint8_t capacity = 0;
+  uint8_t stored = 0;
+  uint8_t listed = 0;
+  // the element being read, NULL if it does not fit
+  SpotifyDevice *device = NULL;
+
+  uint8_t keyOf(const char *key) override;
+  void openedContainer(bool array) override;
+  void closingContainer() override;
+  void number(const char *text) override;
+  void startValue(char c) override;
+};
+
+struct SpotifyDeviceTableStats
+{
+  unsigned long refreshes;
+  unsigned long failedRefreshes;
+  // devices found without a request
+  unsigned long hits;
+  unsigned long misses;
+  // transfers to the active device and commands to restricted ones that were not sent
+  unsigned long requestsSaved;
+};
+
+class SpotifyDeviceTable
+{
+public:
+  explicit SpotifyDeviceTable(ArduinoSpotify &spotify);
+
+  // the device with this name (case does not matter) or id, NULL if there is none
+  const SpotifyDevice *find(const char *nameOrId);
+  // the device that is playing, NULL if none is
+  const SpotifyDevice *active();
+  // requests the list now, false if it failed or was not allowed
+  bool refresh();
+  // the next use requests the list
+  void invalidate() { refreshPending = true; }
+
+  bool transferPlayback(const char *nameOrId, bool play = false);
+  bool play(const char *nameOrId);
+  bool setVolume(const char *nameOrId, int volume);
+
+  // the list as it is, without a refresh
+  uint8_t count() const { return deviceCount; }
+  const SpotifyDevice &device(uint8_t index) const { return devices[index]; }
+
+  unsigned long maxAgeMs = SPOTIFY_DEVICE_TABLE_MAX_AGE_MS;
+  SpotifyDeviceTableStats stats = {0, 0, 0, 0, 0};
+
+private:
+  ArduinoSpotify &spotify;
+  SpotifyDevice devices[SPOTIFY_DEVICE_TABLE_SIZE];
+  uint8_t deviceCount = 0;
+  // the list is the answer of a request
+  bool valid = false;
+  bool refreshPending = true;
+  bool refreshFailed = false;
+  // the last request of the list, also a failed one
+  unsigned long refreshedAt = 0;
+
+  bool stale() const;
+  SpotifyDevice *lookup(const char *nameOrId);
+  // the device of a command, NULL if there is none or it takes no commands
+  SpotifyDevice *commandTarget(const char *nameOrId);
+  void markActive(SpotifyDevice *device);
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include "SpotifyDns.h"
+
+#define DNS_HEADER_SIZE 12
+#define DNS_TYPE_A 1
+#define DNS_TYPE_CNAME 5
+#define DNS_CLASS_IN 1
+
+static uint16_t readUint16(const uint8_t *data)
+{
+    return (uint16_t)(data[0] << 8 | data[1]);
+}
+
+static uint32_t readUint32(const uint8_t *data)
+{
+    return (uint32_t)readUint16(data) << 16 | readUint16(data + 2);
+}
+
+size_t buildDnsQuery(uint8_t *message, size_t size, uint16_t id, const char *host)
+{
+    size_t hostLength = strlen(host);
+    // header, the labels of the name with the terminating 0, type and class
+    size_t length = DNS_HEADER_SIZE + hostLength + 2 + 4;
+    if (length > size || hostLength == 0 || hostLength > 253)
+    {
+        return 0;
+    }
+    memset(message, 0, DNS_HEADER_SIZE);
+    message[0] = id >> 8;
+    message[1] = id & 0xFF;
+    message[2] = 0x01; // recursion desired
+    message[5] = 1;    // one question
+
+    size_t position = DNS_HEADER_SIZE;
+    const char *label = host;
+    while (*label != '\0')
+    {
+        const char *dot = strchr(label, '.');
+        size_t labelLength = dot != NULL ? (size_t)(dot - label) : strlen(label);
+        if (labelLength == 0 || labelLength > 63)
+        {
+            return 0;
+        }
+        message[position++] = labelLength;
+        memcpy(message + position, label, labelLength);
+        position += labelLength;
+        label += labelLength + (dot != NULL ? 1 : 0);
+    }
+    message[position++] = 0;
+    message[position++] = 0;
+    message[position++] = DNS_TYPE_A;
+    message[position++] = 0;
+    message[position++] = DNS_CLASS_IN;
+    return position;
+}
+
+// position after the name at position, 0 if it runs past the end
+static size_t skipName(const uint8_t *message, size_t length, size_t position)
+{
+    while (position < length)
+    {
+        uint8_t labelLength = message[position];
+        if (labelLength == 0)
+        {
+            return position + 1;
+        }
+        if ((labelLength & 0xC0) == 0xC0)
+        {
+            // a pointer ends the name
+            return position + 2 <= length ? position + 2 : 0;
+        }
+        position += labelLength + 1;
+    }
+    return 0;
+}
+
+bool parseDnsAnswer(const uint8_t *message, size_t length, uint16_t id, IPAddress &address, uint32_t &ttlSeconds)
+{
+    if (length < DNS_HEADER_SIZE || readUint16(message) != id)
+    {
+        return false;
+    }
+    uint16_t flags = readUint16(message + 2);
+    // a response without error
+    if ((flags & 0x8000) == 0 || (flags & 0x000F) != 0)
+    {
+        return false;
+    }
+    uint16_t questions = readUint16(message + 4);
+    uint16_t answers = readUint16(message + 6);
+
+    size_t position = DNS_HEADER_SIZE;
+    for (uint16_t i = 0; i < questions; i++)
+    {
+        position = skipName(message, length, position);
+        if (position == 0 || position + 4 > length)
+        {
+            return false;
+        }
+        position += 4;
+    }
+
+    uint32_t lowestTtl = 0xFFFFFFFF;
+    for (uint16_t i = 0; i < answers; i++)
+    {
+        position = skipName(message, length, position);
+        if (position == 0 || position + 10 > length)
+        {
+            return false;
+        }
+        uint16_t type = readUint16(message + position);
+        uint16_t recordClass = readUint16(message + position + 2);
+        uint32_t ttl = readUint32(message + position + 4);
+        uint16_t dataLength = readUint16(message + position + 8);
+        position += 10;
+        if (position + dataLength > length)
+        {
+            return false;
+        }
+        if (recordClass == DNS_CLASS_IN && (type == DNS_TYPE_A || type == DNS_TYPE_CNAME) && ttl < lowestTtl)
+        {
+            lowestTtl = ttl;
+        }
+        if (recordClass == DNS_CLASS_IN && type == DNS_TYPE_A && dataLength == 4)
+        {
+            address = IPAddress(message[position], message[position + 1], message[position + 2], message[position + 3]);
+            ttlSeconds = lowestTtl;
+            return true;
+        }
+        position += dataLength;
+    }
+    return false;
+}
@@ -0,0 +1,50 @@
+/*
+SpotifyDns - name resolution for the DNS cache of ArduinoSpotify
+
+A SpotifyResolver answers with the address of a host and the TTL of the
+record. ArduinoSpotify keeps the answers for their TTL (see setResolver), so
+reconnects to api.spotify.com and accounts.spotify.com skip the lookup. If a
+connect to a cached address fails, the host is resolved again and the
+connect retried once.
+
+buildDnsQuery and parseDnsAnswer are the wire format of a plain DNS A query
+for resolvers that talk to the DNS server themselves (Esp32Resolver), as
+lwip's resolver does not hand out the TTL.
+*/
+
+#ifndef SpotifyDns_h
+#define SpotifyDns_h
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#define SPOTIFY_DNS_ENTRIES 3
+// an answer is not kept longer than this, whatever its TTL
+#define SPOTIFY_DNS_MAX_TTL_S 3600
+#define SPOTIFY_DNS_PORT 53
+#define SPOTIFY_DNS_MESSAGE_SIZE 512
+
+class SpotifyResolver
+{
+public:
+  // false if host could not be resolved
+  virtual bool resolve(const char *host, IPAddress &address, uint32_t &ttlSeconds) = 0;
+};
+
+struct SpotifyDnsStats
+{
+  unsigned long lookups;
+  unsigned long hits;
+  unsigned long resolutions;
+  unsigned long failures;
+  unsigned long staleRetries; // connects to a cached address that failed and were resolved again
+  unsigned long resolveMicros; // of all resolutions, hits * resolveMicros / resolutions were saved
+};
+
+// An A query for host with id, returns its length (0 if it does not fit)
+size_t buildDnsQuery(uint8_t *message, size_t size, uint16_t id, const char *host);
+// The first A record of the answer to query id. ttlSeconds is the lowest TTL on
+// the way there, CNAMEs included
+bool parseDnsAnswer(const uint8_t *message, size_t length, uint16_t id, IPAddress &address, uint32_t &ttlSeconds);
+
+#endif
@@ -0,0 +1,99 @@
+#include "SpotifyRecordClient.h"
+
+SpotifyRecordClient::SpotifyRecordClient(Client &client, Print &requestLog, Print &responseLog)
+{
+    this->client = &client;
+    this->requestLog = &requestLog;
+    this->responseLog = &responseLog;
+}
+
+void SpotifyRecordClient::startConnection()
+{
+    connections++;
+    requestLog->print(F(SPOTIFY_RECORD_BOUNDARY));
+    responseLog->print(F(SPOTIFY_RECORD_BOUNDARY));
+}
+
+int SpotifyRecordClient::connect(IPAddress ip, uint16_t port)
+{
+    startConnection();
+    return client->connect(ip, port);
+}
+
+int SpotifyRecordClient::connect(const char *host, uint16_t port)
+{
+    startConnection();
+    return client->connect(host, port);
+}
+
+size_t SpotifyRecordClient::write(uint8_t b)
+{
+    size_t written = client->write(b);
+    if (written > 0)
+    {
+        requestLog->write(b);
+        bytesSent += written;
+    }
+    return written;
+}
+
+size_t SpotifyRecordClient::write(const uint8_t *buf, size_t size)
+{
+    size_t written = client->write(buf, size);
+    requestLog->write(buf, written);
+    bytesSent += written;
+    return written;
+}
+
+int SpotifyRecordClient::available()
+{
+    return client->available();
+}
+
+int SpotifyRecordClient::read()
+{
+    int c = client->read();
+    if (c >= 0)
+    {
+        responseLog->write((uint8_t)c);
+        bytesReceived++;
+    }
+    return c;
+}
+
+int SpotifyRecordClient::read(uint8_t *buf, size_t size)
+{
+    int count = client->read(buf, size);
+    if (count > 0)
+    {
+        responseLog->write(buf, count);
+        bytesReceived += count;
+    }
+    return count;
+}
+
+int SpotifyRecordClient::peek()
+{
+    // peeked bytes are recorded once they are actually read
+    return client->peek();
+}
+
+void SpotifyRecordClient::flush()
+{
+    client->flush();
+}
+
+void SpotifyRecordClient::stop()
+{
+    client->stop();
+}
+
+uint8_t SpotifyRecordClient::connected()
+{
+    return client->connected();
+}
+
+SpotifyRecordClient::operator bool()
+{
+    return (bool)*client;
+}
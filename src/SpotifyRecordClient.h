@@ -0,0 +1,50 @@
+/*
+SpotifyRecordClient - Client wrapper that captures raw Spotify API traffic
+
+Forwards everything to a real Client (e.g. WiFiClientSecure) and copies the
+bytes that were sent to requestLog and the bytes that were received to
+responseLog. Every connect() first writes SPOTIFY_RECORD_BOUNDARY to both logs,
+so a response log can be handed to SpotifyReplayClient as it is.
+*/
+
+#ifndef SpotifyRecordClient_h
+#define SpotifyRecordClient_h
+
+#include <Arduino.h>
+#include <Client.h>
+
+// Separates the traffic of two connections in a capture
+#define SPOTIFY_RECORD_BOUNDARY "\r\n#--spotify-capture--#\r\n"
+
+class SpotifyRecordClient : public Client
+{
+public:
+  SpotifyRecordClient(Client &client, Print &requestLog, Print &responseLog);
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t size) override;
+  int peek() override;
+  void flush() override;
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override;
+  using Print::write;
+
+  // number of connections recorded so far
+  unsigned int connections = 0;
+  unsigned long bytesSent = 0;
+  unsigned long bytesReceived = 0;
+
+private:
+  Client *client;
+  Print *requestLog;
+  Print *responseLog;
+  void startConnection();
+};
+
+#endif
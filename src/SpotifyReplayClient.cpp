@@ -0,0 +1,185 @@
+#include "SpotifyReplayClient.h"
+
+static const char recordBoundary[] = SPOTIFY_RECORD_BOUNDARY;
+static const size_t recordBoundaryLength = sizeof(recordBoundary) - 1;
+
+SpotifyReplayClient::SpotifyReplayClient(const uint8_t *capture, size_t captureLength)
+{
+    this->capture = capture;
+    this->captureLength = captureLength;
+}
+
+void SpotifyReplayClient::rewind()
+{
+    nextConnection = 0;
+    position = 0;
+    end = 0;
+    isOpen = false;
+}
+
+// Finds the bytes of the next recorded connection, returns false if the capture is exhausted
+bool SpotifyReplayClient::nextSegment()
+{
+    size_t start = nextConnection;
+    // The recorder writes a boundary in front of every connection
+    if (captureLength - start >= recordBoundaryLength && memcmp(capture + start, recordBoundary, recordBoundaryLength) == 0)
+    {
+        start += recordBoundaryLength;
+    }
+    if (start >= captureLength)
+    {
+        return false;
+    }
+
+    size_t segmentEnd = captureLength;
+    for (size_t i = start; i + recordBoundaryLength <= captureLength; i++)
+    {
+        if (capture[i] == recordBoundary[0] && memcmp(capture + i, recordBoundary, recordBoundaryLength) == 0)
+        {
+            segmentEnd = i;
+            break;
+        }
+    }
+
+    position = start;
+    connectionStart = start;
+    end = segmentEnd;
+    nextConnection = segmentEnd;
+    return true;
+}
+
+// bytes that can be read right now, taking the injected faults into account
+size_t SpotifyReplayClient::readable()
+{
+    if (!isOpen || millis() - timeConnected < latencyMs)
+    {
+        return 0;
+    }
+    size_t limit = end;
+    if (disconnectAfterBytes >= 0 && connectionStart + disconnectAfterBytes < limit)
+    {
+        limit = connectionStart + disconnectAfterBytes;
+    }
+    return position < limit ? limit - position : 0;
+}
+
+int SpotifyReplayClient::connect(IPAddress ip, uint16_t port)
+{
+    return connect("", port);
+}
+
+int SpotifyReplayClient::connect(const char *host, uint16_t port)
+{
+    if (!nextSegment())
+    {
+        isOpen = false;
+        return 0;
+    }
+    connections++;
+    isOpen = true;
+    timeConnected = millis();
+    return 1;
+}
+
+size_t SpotifyReplayClient::write(uint8_t b)
+{
+    if (!isOpen)
+    {
+        return 0;
+    }
+    if (requestLog != NULL)
+    {
+        requestLog->write(b);
+    }
+    bytesSent++;
+    return 1;
+}
+
+size_t SpotifyReplayClient::write(const uint8_t *buf, size_t size)
+{
+    if (!isOpen)
+    {
+        return 0;
+    }
+    if (requestLog != NULL)
+    {
+        requestLog->write(buf, size);
+    }
+    bytesSent += size;
+    return size;
+}
+
+int SpotifyReplayClient::available()
+{
+    size_t count = readable();
+    if (fragmentBytes > 0 && count > fragmentBytes)
+    {
+        count = fragmentBytes;
+    }
+    return (int)count;
+}
+
+int SpotifyReplayClient::read()
+{
+    if (readable() == 0)
+    {
+        return -1;
+    }
+    bytesReceived++;
+    return capture[position++];
+}
+
+int SpotifyReplayClient::read(uint8_t *buf, size_t size)
+{
+    size_t count = available();
+    if (count == 0)
+    {
+        return -1;
+    }
+    if (count > size)
+    {
+        count = size;
+    }
+    memcpy(buf, capture + position, count);
+    position += count;
+    bytesReceived += count;
+    return (int)count;
+}
+
+int SpotifyReplayClient::peek()
+{
+    if (readable() == 0)
+    {
+        return -1;
+    }
+    return capture[position];
+}
+
+void SpotifyReplayClient::flush()
+{
+    // Nothing is buffered on the sending side
+}
+
+void SpotifyReplayClient::stop()
+{
+    isOpen = false;
+}
+
+uint8_t SpotifyReplayClient::connected()
+{
+    if (!isOpen)
+    {
+        return 0;
+    }
+    // an injected disconnect closes the connection once everything before it was read
+    if (disconnectAfterBytes >= 0 && position >= connectionStart + disconnectAfterBytes)
+    {
+        return 0;
+    }
+    return 1;
+}
+
+SpotifyReplayClient::operator bool()
+{
+    return connected();
+}
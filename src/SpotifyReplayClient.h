@@ -0,0 +1,69 @@
+/*
+SpotifyReplayClient - Client that serves a recorded capture instead of a socket
+
+Takes the response log written by SpotifyRecordClient (responses separated by
+SPOTIFY_RECORD_BOUNDARY) and hands out one recorded connection per connect().
+Nothing is copied, the capture buffer has to outlive the client.
+
+Faults can be injected to reproduce what we see on a bad WiFi:
+ - latencyMs: the first byte of a connection is available only after this time
+ - fragmentBytes: available()/read(buf, size) hand out at most this many bytes
+ - disconnectAfterBytes: the connection drops after this many response bytes
+*/
+
+#ifndef SpotifyReplayClient_h
+#define SpotifyReplayClient_h
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include "SpotifyRecordClient.h"
+
+class SpotifyReplayClient : public Client
+{
+public:
+  SpotifyReplayClient(const uint8_t *capture, size_t captureLength);
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t size) override;
+  int peek() override;
+  void flush() override;
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override;
+  using Print::write;
+
+  // start again with the first recorded connection
+  void rewind();
+
+  unsigned long latencyMs = 0;
+  size_t fragmentBytes = 0;
+  long disconnectAfterBytes = -1;
+  // if set, everything the library sends is written here
+  Print *requestLog = NULL;
+
+  unsigned int connections = 0;
+  unsigned long bytesSent = 0;
+  unsigned long bytesReceived = 0;
+
+private:
+  const uint8_t *capture;
+  size_t captureLength;
+  // next unread position in the capture when the next connection starts
+  size_t nextConnection = 0;
+  size_t position = 0;
+  size_t end = 0;
+  size_t connectionStart = 0;
+  unsigned long timeConnected = 0;
+  bool isOpen = false;
+
+  bool nextSegment();
+  size_t readable();
+};
+
+#endif
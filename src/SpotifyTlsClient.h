@@ -0,0 +1,34 @@
+/*
+SpotifyTlsClient - a Client that can resume TLS sessions
+
+WiFiClientSecure does a full handshake with the verification of the whole
+certificate chain on every connect, the largest CPU and latency cost of a
+request on the ESP32. A client implementing this interface hands out the
+session of a connection in serialized form and offers it again at the next
+connect to the same host, so the handshake is an abbreviated one.
+ArduinoSpotify keeps one session per host (see enableTlsSessions), the
+implementations are Esp32TlsClient (mbedtls) and NativeTlsClient (OpenSSL,
+native build).
+*/
+
+#ifndef SpotifyTlsClient_h
+#define SpotifyTlsClient_h
+
+#include <Arduino.h>
+#include <Client.h>
+
+class SpotifyTlsClient : public Client
+{
+public:
+  // the host name for SNI and the certificate check of the next connect(IPAddress, port)
+  virtual void setServerName(const char *host) = 0;
+  // session to offer at the next connect(), NULL for a full handshake
+  virtual void setSession(const uint8_t *session, size_t length) = 0;
+  // copies the serialized session of the open connection and returns its length,
+  // 0 if there is none. Nothing is copied if the length is larger than size
+  virtual size_t getSession(uint8_t *session, size_t size) = 0;
+  // the last connect() resumed the offered session
+  virtual bool sessionResumed() = 0;
+};
+
+#endif
@@ -0,0 +1,225 @@
+#include "StatusServer.h"
+
+size_t StatusBuffer::write(uint8_t c)
+{
+    if (length >= sizeof(data))
+    {
+        overflowed = true;
+        return 0;
+    }
+    data[length++] = c;
+    return 1;
+}
+
+size_t StatusBuffer::write(const uint8_t *bytes, size_t size)
+{
+    size_t room = sizeof(data) - length;
+    if (size > room)
+    {
+        overflowed = true;
+        size = room;
+    }
+    memcpy(data + length, bytes, size);
+    length += size;
+    return size;
+}
+
+StatusServer::StatusServer(StatusRenderer renderer)
+    : renderer(renderer)
+{
+}
+
+void StatusServer::begin(Client &client)
+{
+    if (this->client != NULL)
+    {
+        return;
+    }
+    this->client = &client;
+    phase = phase_request;
+    path = status_not_found;
+    startedMs = millis();
+    requestLength = 0;
+    requestLineDone = false;
+    lineFeeds = 0;
+    section = 0;
+    buffer.clear();
+    sent = 0;
+}
+
+void StatusServer::close()
+{
+    client->stop();
+    client = NULL;
+}
+
+void StatusServer::readRequest()
+{
+    uint16_t count = 0;
+    while (count < STATUS_SERVER_READ_BYTES && client->available() > 0)
+    {
+        int c = client->read();
+        if (c < 0)
+        {
+            break;
+        }
+        count++;
+        if (c == '\n')
+        {
+            requestLineDone = true;
+            if (++lineFeeds == 2)
+            {
+                phase = phase_header;
+                break;
+            }
+        }
+        else if (c != '\r')
+        {
+            lineFeeds = 0;
+            if (!requestLineDone && (size_t)requestLength + 1 < sizeof(requestLine))
+            {
+                requestLine[requestLength++] = c;
+            }
+        }
+    }
+    if (phase == phase_request)
+    {
+        if (!client->connected())
+        {
+            close();
+        }
+        return;
+    }
+
+    // "GET /metrics HTTP/1.1", a query is ignored
+    requestLine[requestLength] = '\0';
+    stats.requests++;
+    const char *target = strncmp(requestLine, "GET ", 4) == 0 ? requestLine + 4 : "";
+    size_t targetLength = strcspn(target, " ?");
+    if (targetLength == 8 && strncmp(target, "/metrics", 8) == 0)
+    {
+        path = status_metrics;
+    }
+    else if (targetLength == 6 && strncmp(target, "/state", 6) == 0)
+    {
+        path = status_state;
+    }
+    else
+    {
+        stats.notFound++;
+    }
+    buffer.clear();
+    if (path == status_not_found)
+    {
+        buffer.print(F("HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\nnot found\n"));
+        phase = phase_done;
+    }
+    else
+    {
+        buffer.print(F("HTTP/1.1 200 OK\r\nContent-Type: "));
+        buffer.print(path == status_metrics ? F("text/plain; version=0.0.4") : F("application/json"));
+        buffer.print(F("\r\nCache-Control: no-store\r\nConnection: close\r\n\r\n"));
+        phase = phase_body;
+    }
+    sent = 0;
+}
+
+void StatusServer::sendBuffer()
+{
+    size_t written = client->write((const uint8_t *)buffer.data + sent, buffer.length - sent);
+    if (written == 0 && !client->connected())
+    {
+        close();
+        return;
+    }
+    sent += written;
+    stats.bytesSent += written;
+}
+
+bool StatusServer::poll()
+{
+    if (client == NULL)
+    {
+        return false;
+    }
+    uint32_t start = micros();
+    if ((long)(millis() - startedMs) >= STATUS_SERVER_TIMEOUT_MS)
+    {
+        // a client that stopped reading or sending would hold the server forever
+        stats.timeouts++;
+        close();
+        return false;
+    }
+    if (phase == phase_request)
+    {
+        readRequest();
+    }
+    else if (sent == buffer.length && phase == phase_body)
+    {
+        // the next section, the response is complete when there is none
+        buffer.clear();
+        sent = 0;
+        if (!renderer(path, section++, buffer))
+        {
+            phase = phase_done;
+        }
+        else if (buffer.overflowed)
+        {
+            stats.overflows++;
+        }
+    }
+    else if (sent == buffer.length)
+    {
+        close();
+    }
+    // what was read or rendered goes out right away
+    if (client != NULL && sent < buffer.length)
+    {
+        sendBuffer();
+    }
+    uint32_t elapsed = micros() - start;
+    if (elapsed > stats.slowestPollUs)
+    {
+        stats.slowestPollUs = elapsed;
+    }
+    return client != NULL;
+}
+
+void StatusServer::printJsonString(Print &out, const char *text)
+{
+    out.print('"');
+    for (const char *c = text; c != NULL && *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            out.print('\\');
+            out.print(*c);
+        }
+        else if ((uint8_t)*c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (uint8_t)*c);
+            out.print(escaped);
+        }
+        else
+        {
+            out.print(*c);
+        }
+    }
+    out.print('"');
+}
+
+void StatusServer::printMetric(Print &out, const char *name, unsigned long value, const char *labels)
+{
+    out.print(name);
+    if (labels != NULL)
+    {
+        out.print('{');
+        out.print(labels);
+        out.print('}');
+    }
+    out.print(' ');
+    // Prometheus wants plain line feeds
+    out.print(value);
+    out.print('\n');
+}
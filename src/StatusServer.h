@@ -0,0 +1,117 @@
+/*
+StatusServer - /metrics and /state over HTTP
+
+A small HTTP server for looking into the running display: /metrics in the
+Prometheus text format and /state as JSON. It serves one connection at a
+time and is advanced from a task like everything else in loop(): a poll()
+reads what arrived of the request or renders and sends one section of the
+response, so a scrape never holds up a frame for longer than a section. The
+body is not kept as a whole, the renderer is asked for its sections one by
+one and the response ends with the connection. The whole exchange has to be
+through within STATUS_SERVER_TIMEOUT_MS, a client that stops reading does
+not keep the server from the next one. The Client has to take only what it
+can send without waiting (Esp32SocketClient on the device), whatever is left
+of a section goes out with the next polls.
+
+The server does not listen itself; the app accepts a connection (WiFiServer
+on the device, NativeTcpServer on the PC) and hands it to begin().
+*/
+
+#ifndef StatusServer_h
+#define StatusServer_h
+
+#include <Arduino.h>
+#include <Client.h>
+
+// a section of a response, more is cut
+#define STATUS_SERVER_SECTION_SIZE 1536
+// request bytes read per poll, headers beyond the request line are skipped
+#define STATUS_SERVER_READ_BYTES 256
+#define STATUS_SERVER_REQUEST_LINE_LENGTH 64
+// a connection is closed when the request and the whole response took longer
+#define STATUS_SERVER_TIMEOUT_MS 2000
+
+enum StatusPath : uint8_t
+{
+  status_metrics,
+  status_state,
+  status_not_found
+};
+
+// prints section of path to out, false if there is no such section
+typedef bool (*StatusRenderer)(StatusPath path, uint8_t section, Print &out);
+
+// a Print into a fixed buffer that drops what does not fit
+class StatusBuffer : public Print
+{
+public:
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *data, size_t size) override;
+  using Print::write;
+
+  void clear() { length = 0; overflowed = false; }
+
+  char data[STATUS_SERVER_SECTION_SIZE];
+  size_t length = 0;
+  bool overflowed = false;
+};
+
+struct StatusServerStats
+{
+  unsigned long requests;
+  unsigned long notFound;
+  // connections closed at STATUS_SERVER_TIMEOUT_MS, before the request or the response was through
+  unsigned long timeouts;
+  // sections cut at STATUS_SERVER_SECTION_SIZE
+  unsigned long overflows;
+  unsigned long bytesSent;
+  uint32_t slowestPollUs;
+};
+
+class StatusServer
+{
+public:
+  explicit StatusServer(StatusRenderer renderer);
+
+  bool busy() const { return client != NULL; }
+  // serves client from the next poll() on; ignored while another one is served
+  void begin(Client &client);
+  // one bounded step of the connection, false when there is none
+  bool poll();
+
+  // a JSON string with quotes and escapes
+  static void printJsonString(Print &out, const char *text);
+  // a line "name value" or "name{labels} value", ended by \n as Prometheus wants it
+  static void printMetric(Print &out, const char *name, unsigned long value, const char *labels = NULL);
+
+  StatusServerStats stats = {0, 0, 0, 0, 0, 0};
+
+private:
+  enum Phase : uint8_t
+  {
+    phase_request,
+    phase_header,
+    phase_body,
+    phase_done
+  };
+
+  StatusRenderer renderer;
+  Client *client = NULL;
+  Phase phase = phase_request;
+  StatusPath path = status_not_found;
+  unsigned long startedMs = 0;
+  char requestLine[STATUS_SERVER_REQUEST_LINE_LENGTH];
+  uint8_t requestLength = 0;
+  bool requestLineDone = false;
+  // line feeds since the last character that was not CR or LF, two end the headers
+  uint8_t lineFeeds = 0;
+  uint8_t section = 0;
+  StatusBuffer buffer;
+  size_t sent = 0;
+
+  void readRequest();
+  void sendBuffer();
+  void close();
+};
+
+#endif
@@ -0,0 +1,439 @@
+#include "SyncedLyrics.h"
+
+#define LYRICS_READ_CHUNK 64
+
+// the lines of a file through a small buffer, longer lines are cut
+struct LineReader
+{
+    File &file;
+    uint8_t buffer[LYRICS_READ_CHUNK];
+    uint8_t length;
+    uint8_t position;
+
+    bool next(char *line, size_t size)
+    {
+        size_t used = 0;
+        bool any = false;
+        while (true)
+        {
+            if (position == length)
+            {
+                length = file.read(buffer, sizeof(buffer));
+                position = 0;
+                if (length == 0)
+                {
+                    break;
+                }
+            }
+            char c = buffer[position++];
+            any = true;
+            if (c == '\n')
+            {
+                break;
+            }
+            if (c != '\r' && used + 1 < size)
+            {
+                line[used++] = c;
+            }
+        }
+        line[used] = '\0';
+        return any;
+    }
+};
+
+uint8_t parseLrcLine(const char *line, uint32_t *times, uint8_t maxTimes, const char **text)
+{
+    uint8_t count = 0;
+    const char *position = line;
+    while (*position == '[')
+    {
+        const char *digit = position + 1;
+        uint32_t minutes = 0;
+        uint32_t seconds = 0;
+        uint32_t fraction = 0;
+        uint32_t scale = 1;
+        const char *start = digit;
+        while (isdigit(*digit))
+        {
+            minutes = minutes * 10 + (*digit++ - '0');
+        }
+        // [ar:...], [offset:...] and the like
+        if (digit == start || *digit != ':')
+        {
+            break;
+        }
+        start = ++digit;
+        while (isdigit(*digit))
+        {
+            seconds = seconds * 10 + (*digit++ - '0');
+        }
+        if (digit == start)
+        {
+            break;
+        }
+        if (*digit == '.' || *digit == ':')
+        {
+            digit++;
+            // hundredths usually, milliseconds at most
+            while (isdigit(*digit))
+            {
+                if (scale < 1000)
+                {
+                    fraction = fraction * 10 + (*digit - '0');
+                    scale *= 10;
+                }
+                digit++;
+            }
+        }
+        if (*digit != ']')
+        {
+            break;
+        }
+        if (count < maxTimes)
+        {
+            times[count++] = (minutes * 60 + seconds) * 1000 + fraction * 1000 / scale;
+        }
+        position = digit + 1;
+    }
+    while (*position == ' ')
+    {
+        position++;
+    }
+    *text = position;
+    return count;
+}
+
+SyncedLyrics::SyncedLyrics(fs::FS &fs) : fs(fs)
+{
+    path[0] = '\0';
+}
+
+void SyncedLyrics::filePath(const char *trackId, const char *extension, char *path)
+{
+    snprintf(path, sizeof(SyncedLyrics::path), LYRICS_DIR "/%.22s%s", trackId, extension);
+}
+
+bool SyncedLyrics::exists(const char *trackId)
+{
+    char candidate[sizeof(path)];
+    filePath(trackId, ".lrc", candidate);
+    return fs.exists(candidate);
+}
+
+bool SyncedLyrics::load(const char *trackId)
+{
+    filePath(trackId, ".lrc", path);
+    hasFile = true;
+    return fillWindow(0);
+}
+
+void SyncedLyrics::clear()
+{
+    hasFile = false;
+    lineCount = 0;
+    arenaUsed = 0;
+    cursor = -1;
+}
+
+bool SyncedLyrics::fillWindow(uint32_t fromMs)
+{
+    unsigned long start = micros();
+    lineCount = 0;
+    arenaUsed = 0;
+    cursor = -1;
+    windowStartMs = 0;
+    windowEndMs = 0xFFFFFFFF;
+    File file = fs.open(path, FILE_READ);
+    if (!file)
+    {
+        hasFile = false;
+        return false;
+    }
+    stats.windows++;
+
+    // the line in effect at fromMs is kept aside, it comes first in the window
+    char previous[LYRICS_LINE_LENGTH];
+    bool havePrevious = false;
+    uint32_t previousMs = 0;
+    long offsetMs = 0;
+    char line[LYRICS_LINE_LENGTH];
+    uint32_t times[LYRICS_MAX_STAMPS];
+    LineReader reader = {file, {0}, 0, 0};
+    while (reader.next(line, sizeof(line)))
+    {
+        if (strncmp(line, "[offset:", 8) == 0)
+        {
+            offsetMs = atol(line + 8);
+            continue;
+        }
+        const char *text;
+        uint8_t count = parseLrcLine(line, times, LYRICS_MAX_STAMPS, &text);
+        // the stamps of a line share its text
+        int32_t textOffset = -1;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            // a positive offset shows the lines earlier
+            uint32_t timeMs = (long)times[i] > offsetMs ? times[i] - offsetMs : 0;
+            if (timeMs <= fromMs)
+            {
+                if (!havePrevious || timeMs >= previousMs)
+                {
+                    strcpy(previous, text);
+                    previousMs = timeMs;
+                    havePrevious = true;
+                }
+                continue;
+            }
+            if (timeMs >= windowEndMs)
+            {
+                continue;
+            }
+            size_t length = strlen(text) + 1;
+            // room is left for the line in effect
+            if (lineCount >= LYRICS_MAX_LINES - 1 ||
+                (textOffset < 0 && arenaUsed + length > LYRICS_ARENA_SIZE - LYRICS_LINE_LENGTH))
+            {
+                windowEndMs = timeMs;
+                continue;
+            }
+            if (textOffset < 0)
+            {
+                textOffset = arenaUsed;
+                memcpy(arena + arenaUsed, text, length);
+                arenaUsed += length;
+            }
+            lines[lineCount].timeMs = timeMs;
+            lines[lineCount].offset = textOffset;
+            lineCount++;
+        }
+    }
+    file.close();
+
+    // lines stored before the window was cut short may lie behind its end
+    uint16_t kept = 0;
+    for (uint16_t i = 0; i < lineCount; i++)
+    {
+        if (lines[i].timeMs < windowEndMs)
+        {
+            lines[kept++] = lines[i];
+        }
+    }
+    lineCount = kept;
+    if (havePrevious)
+    {
+        size_t length = strlen(previous) + 1;
+        memcpy(arena + arenaUsed, previous, length);
+        lines[lineCount].timeMs = previousMs;
+        lines[lineCount].offset = arenaUsed;
+        arenaUsed += length;
+        lineCount++;
+        windowStartMs = previousMs;
+    }
+    // insertion sort, stable so lines with the same stamp keep the order of the file
+    for (uint16_t i = 1; i < lineCount; i++)
+    {
+        Line moving = lines[i];
+        uint16_t j = i;
+        while (j > 0 && lines[j - 1].timeMs > moving.timeMs)
+        {
+            lines[j] = lines[j - 1];
+            j--;
+        }
+        lines[j] = moving;
+    }
+    stats.windowMicros += micros() - start;
+    return true;
+}
+
+int16_t SyncedLyrics::search(uint32_t timeMs) const
+{
+    // the first line after timeMs, the one before is in effect
+    uint16_t low = 0;
+    uint16_t high = lineCount;
+    while (low < high)
+    {
+        uint16_t middle = (low + high) / 2;
+        if (lines[middle].timeMs <= timeMs)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return (int16_t)low - 1;
+}
+
+const char *SyncedLyrics::lineAt(long progressMs)
+{
+    if (!hasFile)
+    {
+        return NULL;
+    }
+    stats.lookups++;
+    uint32_t timeMs = progressMs > 0 ? progressMs : 0;
+    if (timeMs < windowStartMs || timeMs >= windowEndMs)
+    {
+        // a seek out of the window or its end was reached
+        if (!fillWindow(timeMs))
+        {
+            return NULL;
+        }
+        cursor = search(timeMs);
+    }
+    else if (cursor >= 0 && lines[cursor].timeMs > timeMs)
+    {
+        stats.searches++;
+        cursor = search(timeMs);
+    }
+    else if (cursor + 1 < lineCount && lines[cursor + 1].timeMs <= timeMs)
+    {
+        if (cursor + 2 < lineCount && lines[cursor + 2].timeMs <= timeMs)
+        {
+            stats.searches++;
+            cursor = search(timeMs);
+        }
+        else
+        {
+            stats.steps++;
+            cursor++;
+        }
+    }
+    return cursor >= 0 ? arena + lines[cursor].offset : "";
+}
+
+const char *SyncedLyrics::nextLine() const
+{
+    if (!hasFile || cursor + 1 >= lineCount)
+    {
+        return NULL;
+    }
+    return arena + lines[cursor + 1].offset;
+}
+
+// -1 when nothing came in time
+static int timedRead(Client &client, unsigned long deadline)
+{
+    while (!client.available())
+    {
+        if (!client.connected() || (long)(millis() - deadline) >= 0)
+        {
+            return -1;
+        }
+        delay(1);
+    }
+    return client.read();
+}
+
+bool SyncedLyrics::download(Client &client, const char *host, uint16_t port, const char *trackId)
+{
+    if (!client.connect(host, port))
+    {
+        return false;
+    }
+    client.print(F("GET /lyrics/"));
+    client.print(trackId);
+    client.print(F(".lrc HTTP/1.1\r\nHost: "));
+    client.print(host);
+    client.print(F("\r\nConnection: close\r\n\r\n"));
+
+    // the status line and the headers up to the empty line
+    unsigned long deadline = millis() + LYRICS_DOWNLOAD_TIMEOUT_MS;
+    char header[LYRICS_LINE_LENGTH];
+    bool statusLine = true;
+    bool found = false;
+    while (true)
+    {
+        size_t used = 0;
+        int c;
+        while ((c = timedRead(client, deadline)) >= 0 && c != '\n')
+        {
+            if (c != '\r' && used + 1 < sizeof(header))
+            {
+                header[used++] = c;
+            }
+        }
+        header[used] = '\0';
+        if (c < 0)
+        {
+            client.stop();
+            return false;
+        }
+        if (statusLine)
+        {
+            // "HTTP/1.1 200 OK"
+            const char *status = strchr(header, ' ');
+            found = status != NULL && atoi(status + 1) == 200;
+            statusLine = false;
+        }
+        else if (used == 0)
+        {
+            break;
+        }
+    }
+    if (!found)
+    {
+        client.stop();
+        return false;
+    }
+
+    // into a new file first, so a broken download does not replace the old one
+    char target[sizeof(path)];
+    filePath(trackId, ".lrc", target);
+    char partial[sizeof(path)];
+    filePath(trackId, ".new", partial);
+    File file = fs.open(partial, FILE_WRITE);
+    if (!file)
+    {
+        client.stop();
+        return false;
+    }
+    uint8_t buffer[LYRICS_READ_CHUNK];
+    size_t size = 0;
+    bool complete = false;
+    while (size < LYRICS_MAX_FILE_SIZE)
+    {
+        int available = client.available();
+        if (available > 0)
+        {
+            size_t wanted = available < (int)sizeof(buffer) ? available : sizeof(buffer);
+            if (wanted > LYRICS_MAX_FILE_SIZE - size)
+            {
+                wanted = LYRICS_MAX_FILE_SIZE - size;
+            }
+            int received = client.read(buffer, wanted);
+            if (received > 0)
+            {
+                file.write(buffer, received);
+                size += received;
+            }
+        }
+        else if (!client.connected())
+        {
+            complete = true;
+            break;
+        }
+        else if ((long)(millis() - deadline) >= 0)
+        {
+            break;
+        }
+        else
+        {
+            delay(1);
+        }
+    }
+    // cut at the size limit, the lines until there are kept
+    complete = complete || size >= LYRICS_MAX_FILE_SIZE;
+    file.close();
+    client.stop();
+    if (!complete || size == 0)
+    {
+        fs.remove(partial);
+        return false;
+    }
+    fs.remove(target);
+    fs.rename(partial, target);
+    stats.downloads++;
+    return true;
+}
@@ -0,0 +1,102 @@
+/*
+SyncedLyrics - time-stamped lyric lines of the current track
+
+Reads an LRC file ("[mm:ss.xx]text", several stamps per line allowed,
+[offset:ms] honored, other tags skipped) from flash, one file per track.
+The file is streamed: only a window of the lines is held, the texts in a
+fixed arena and a sorted index of (time, offset into the arena). The window
+starts with the line in effect and ends where the arena or the index ran
+full, so the memory is the same for any length of lyrics. A lookup moves a
+cursor forward by one line in the common case, jumps of more lines and seeks
+back search the index, and leaving the window streams the next one.
+Files in time order (apart from the stamps of repeated lines) need one
+stream per window; a shuffled file still gives the right lines, but its
+windows are shorter.
+
+Lyrics can be downloaded into flash from a local HTTP server (e.g.
+tools/spotify_stand_in.py, GET /lyrics/<trackId>.lrc).
+*/
+
+#ifndef SyncedLyrics_h
+#define SyncedLyrics_h
+
+#include <Arduino.h>
+#include <Client.h>
+#include <FS.h>
+
+// SPIFFS names have at most 31 characters, "/l/" + the 22 of a track id + ".lrc" fit
+#define LYRICS_DIR "/l"
+#define LYRICS_ARENA_SIZE 1536
+#define LYRICS_MAX_LINES 64
+// longer lines are cut
+#define LYRICS_LINE_LENGTH 96
+// stamps of one line, e.g. of a chorus
+#define LYRICS_MAX_STAMPS 8
+// larger downloads are cut
+#define LYRICS_MAX_FILE_SIZE (16 * 1024)
+#define LYRICS_DOWNLOAD_TIMEOUT_MS 3000
+
+struct SyncedLyricsStats
+{
+  unsigned long lookups;
+  // the cursor moved to the next line
+  unsigned long steps;
+  // seeks back and jumps over lines
+  unsigned long searches;
+  // windows streamed from the file and the time that took
+  unsigned long windows;
+  unsigned long windowMicros;
+  unsigned long downloads;
+};
+
+class SyncedLyrics
+{
+public:
+  SyncedLyrics(fs::FS &fs);
+
+  bool exists(const char *trackId);
+  // the first window of the track, false without lyrics
+  bool load(const char *trackId);
+  void clear();
+  // into the file of the track, the old file stays when the download fails
+  bool download(Client &client, const char *host, uint16_t port, const char *trackId);
+
+  bool loaded() const { return hasFile; }
+  // the line in effect at progressMs, "" before the first one, NULL without lyrics
+  const char *lineAt(long progressMs);
+  // the line after the one of the last lineAt(), NULL at the end
+  const char *nextLine() const;
+  uint16_t windowLines() const { return lineCount; }
+
+  SyncedLyricsStats stats = {0, 0, 0, 0, 0, 0};
+
+private:
+  struct Line
+  {
+    uint32_t timeMs;
+    uint16_t offset;
+  };
+
+  fs::FS &fs;
+  char path[32];
+  bool hasFile = false;
+  char arena[LYRICS_ARENA_SIZE];
+  uint16_t arenaUsed = 0;
+  Line lines[LYRICS_MAX_LINES];
+  uint16_t lineCount = 0;
+  // the window holds every line in effect from windowStartMs until windowEndMs
+  uint32_t windowStartMs = 0;
+  uint32_t windowEndMs = 0;
+  // index of the current line, -1 before the first one
+  int16_t cursor = -1;
+
+  static void filePath(const char *trackId, const char *extension, char *path);
+  bool fillWindow(uint32_t fromMs);
+  int16_t search(uint32_t timeMs) const;
+};
+
+// parses the stamps of an LRC line into times (before the offset), returns their
+// number and where the text starts; 0 for tags and lines without a stamp
+uint8_t parseLrcLine(const char *line, uint32_t *times, uint8_t maxTimes, const char **text);
+
+#endif
@@ -0,0 +1,198 @@
+#include "TaskScheduler.h"
+
+TaskScheduler::TaskScheduler(Task *tasks, uint8_t count)
+    : tasks(tasks), count(count)
+{
+}
+
+void TaskScheduler::begin()
+{
+    unsigned long now = millis();
+    for (uint8_t index = 0; index < count; index++)
+    {
+        tasks[index].dueMs += now;
+        memset(&tasks[index].stats, 0, sizeof(TaskStats));
+    }
+}
+
+static uint8_t histogramBucket(uint32_t runtimeUs)
+{
+    uint8_t bucket = 0;
+    uint32_t limit = TASK_HISTOGRAM_FIRST_US;
+    while (runtimeUs >= limit && bucket < TASK_HISTOGRAM_BUCKETS - 1)
+    {
+        limit <<= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+uint32_t TaskScheduler::runDue()
+{
+    unsigned long now = millis();
+    // the most overdue task first
+    uint8_t next = TASK_NONE;
+    for (uint8_t index = 0; index < count; index++)
+    {
+        long overdue = (long)(now - tasks[index].dueMs);
+        if (tasks[index].periodMs > 0 && overdue >= 0 &&
+            (next == TASK_NONE || overdue > (long)(now - tasks[next].dueMs)))
+        {
+            next = index;
+        }
+    }
+    // tasks of period 0 are always due, they take turns when no other task is
+    for (uint8_t step = 0; step < count && next == TASK_NONE; step++)
+    {
+        uint8_t index = (lastEveryCall == TASK_NONE ? step : lastEveryCall + 1 + step) % count;
+        if (tasks[index].periodMs == 0 && (long)(now - tasks[index].dueMs) >= 0)
+        {
+            next = index;
+            lastEveryCall = index;
+        }
+    }
+
+    if (next != TASK_NONE)
+    {
+        Task &task = tasks[next];
+        uint32_t lateMs = now - task.dueMs;
+        if (lateMs > task.stats.latestMs)
+        {
+            task.stats.latestMs = lateMs;
+        }
+        if (task.periodMs > 0)
+        {
+            // the periods that passed are skipped, not run in a burst
+            uint32_t skipped = lateMs / task.periodMs;
+            task.stats.missed += skipped;
+            task.dueMs += (skipped + 1) * task.periodMs;
+        }
+        else
+        {
+            task.dueMs = now;
+        }
+
+        if (runningTask != NULL)
+        {
+            *runningTask = next;
+        }
+        unsigned long start = micros();
+        task.run();
+        uint32_t runtimeUs = micros() - start;
+        if (runningTask != NULL)
+        {
+            *runningTask = TASK_NONE;
+        }
+
+        task.stats.runs++;
+        task.stats.histogram[histogramBucket(runtimeUs)]++;
+        if (runtimeUs > task.stats.slowestUs)
+        {
+            task.stats.slowestUs = runtimeUs;
+        }
+        if (runtimeUs > task.budgetUs)
+        {
+            task.stats.overruns++;
+            if (onOverrun != NULL)
+            {
+                onOverrun(task, runtimeUs);
+            }
+        }
+        now = millis();
+    }
+
+    uint32_t waitMs = 0xFFFFFFFF;
+    for (uint8_t index = 0; index < count; index++)
+    {
+        long until = (long)(tasks[index].dueMs - now);
+        uint32_t taskWait = until > 0 ? until : 0;
+        if (taskWait < waitMs)
+        {
+            waitMs = taskWait;
+        }
+    }
+    return waitMs;
+}
+
+uint32_t TaskScheduler::percentileUs(const TaskStats &stats, uint8_t percent)
+{
+    if (stats.runs == 0)
+    {
+        return 0;
+    }
+    unsigned long wanted = (stats.runs * percent + 99) / 100;
+    unsigned long counted = 0;
+    uint32_t limit = TASK_HISTOGRAM_FIRST_US;
+    for (uint8_t bucket = 0; bucket < TASK_HISTOGRAM_BUCKETS - 1; bucket++, limit <<= 1)
+    {
+        counted += stats.histogram[bucket];
+        if (counted >= wanted)
+        {
+            return limit;
+        }
+    }
+    // the last bucket has no upper bound
+    return stats.slowestUs;
+}
+
+void TaskScheduler::printStats(Print &out)
+{
+    for (uint8_t index = 0; index < count; index++)
+    {
+        const Task &task = tasks[index];
+        out.print(task.name);
+        out.print(": runs ");
+        out.print(task.stats.runs);
+        out.print(", p50 <");
+        out.print(percentileUs(task.stats, 50));
+        out.print(" us, p99 <");
+        out.print(percentileUs(task.stats, 99));
+        out.print(" us, max ");
+        out.print(task.stats.slowestUs);
+        out.print(" us, missed ");
+        out.print(task.stats.missed);
+        out.print(", over budget ");
+        out.print(task.stats.overruns);
+        out.print(", latest start ");
+        out.print(task.stats.latestMs);
+        out.println(" ms late");
+    }
+}
+
+static void printTaskMetric(Print &out, const char *name, const char *task, uint32_t value)
+{
+    out.print(name);
+    out.print(F("{task=\""));
+    out.print(task);
+    out.print(F("\"} "));
+    out.print(value);
+    out.print('\n');
+}
+
+void TaskScheduler::printMetrics(Print &out, uint8_t index)
+{
+    const Task &task = tasks[index];
+    // the buckets hold runtimes below their limit, Prometheus counts them cumulative
+    uint32_t cumulative = 0;
+    uint32_t limit = TASK_HISTOGRAM_FIRST_US;
+    for (uint8_t bucket = 0; bucket + 1 < TASK_HISTOGRAM_BUCKETS; bucket++, limit <<= 1)
+    {
+        cumulative += task.stats.histogram[bucket];
+        out.print(F("task_runtime_us_bucket{task=\""));
+        out.print(task.name);
+        out.print(F("\",le=\""));
+        out.print(limit);
+        out.print(F("\"} "));
+        out.print(cumulative);
+        out.print('\n');
+    }
+    out.print(F("task_runtime_us_bucket{task=\""));
+    out.print(task.name);
+    out.print(F("\",le=\"+Inf\"} "));
+    out.print(task.stats.runs);
+    out.print('\n');
+    printTaskMetric(out, "task_runtime_us_count", task.name, task.stats.runs);
+    printTaskMetric(out, "task_slowest_us", task.name, task.stats.slowestUs);
+    printTaskMetric(out, "task_missed_total", task.name, task.stats.missed);
+    printTaskMetric(out, "task_overruns_total", task.name, task.stats.overruns);
+}
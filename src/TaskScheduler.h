@@ -0,0 +1,83 @@
+/*
+TaskScheduler - cooperative scheduler of the periodic work in loop()
+
+Every task has a period and a time budget; the next run is due one period
+after the last due time, so the rate does not drift with the runtime. Per
+task it keeps a histogram of the runtimes, the deadlines missed (a period
+passed without a run) and the runs over budget, which are reported to
+onOverrun.
+*/
+
+#ifndef TaskScheduler_h
+#define TaskScheduler_h
+
+#include <Arduino.h>
+
+// runtimes in powers of two from below 128 us to 131 ms and more
+#define TASK_HISTOGRAM_BUCKETS 12
+#define TASK_HISTOGRAM_FIRST_US 128
+#define TASK_NONE 0xFF
+
+struct TaskStats
+{
+  unsigned long runs;
+  // periods that passed without a run
+  unsigned long missed;
+  // runs longer than the budget
+  unsigned long overruns;
+  uint32_t slowestUs;
+  // latest start after the due time
+  uint32_t latestMs;
+  uint32_t histogram[TASK_HISTOGRAM_BUCKETS];
+};
+
+typedef void (*TaskFunction)();
+
+struct Task
+{
+  const char *name;
+  TaskFunction run;
+  // 0 runs on every call that no other task is due, in turns with the other tasks of period 0
+  uint32_t periodMs;
+  uint32_t budgetUs;
+  // the delay of the first run until begin(), then the due time
+  unsigned long dueMs;
+  TaskStats stats;
+};
+
+typedef void (*TaskOverrunHandler)(const Task &task, uint32_t runtimeUs);
+
+class TaskScheduler
+{
+public:
+  TaskScheduler(Task *tasks, uint8_t count);
+
+  // the first runs are due after the delays in dueMs
+  void begin();
+  // runs the task that is due longest, one per call so loop() stays responsive.
+  // Returns the ms until the next task is due
+  uint32_t runDue();
+
+  // upper bound of the runtime below which percent of the runs stayed
+  static uint32_t percentileUs(const TaskStats &stats, uint8_t percent);
+  // one line per task
+  void printStats(Print &out);
+  // the runtime histogram and the counters of a task in the Prometheus text format
+  void printMetrics(Print &out, uint8_t index);
+
+  uint8_t taskCount() const { return count; }
+  const Task &task(uint8_t index) const { return tasks[index]; }
+
+  TaskOverrunHandler onOverrun = NULL;
+  // if set, holds the index of the running task and TASK_NONE in between,
+  // e.g. in memory that survives a watchdog reset
+  volatile uint8_t *runningTask = NULL;
+
+private:
+  Task *tasks;
+  uint8_t count;
+  // the task of period 0 that ran last
+  uint8_t lastEveryCall = TASK_NONE;
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "WifiConnection.h"
+
+WifiConnection::WifiConnection(WifiDriver &driver, const char *ssid, const char *password, WifiCache &cache)
+    : driver(driver), ssid(ssid), password(password), cache(cache)
+{
+}
+
+void WifiConnection::begin()
+{
+    linkLost = false;
+    retryMs = WIFI_RETRY_FIRST_MS;
+    // millis() starts again after a reset, the lease end of the last start means nothing
+    dropAddress();
+    startAttempt(millis(), false);
+}
+
+void WifiConnection::enter(WifiState next, unsigned long now)
+{
+    state = next;
+    stateSinceMs = now;
+}
+
+bool WifiConnection::addressValid(unsigned long now) const
+{
+    return cache.address.ip != 0 && (long)(cache.leaseEndMs - now) > 0;
+}
+
+void WifiConnection::startAttempt(unsigned long now, bool scanFirst)
+{
+    attemptStartMs = now;
+    fastPending = cacheValid();
+    scanPending = true;
+    driver.disconnect();
+    if (fastPending && !scanFirst)
+    {
+        startFast(now);
+    }
+    else
+    {
+        startScan(now);
+    }
+}
+
+void WifiConnection::nextAttempt(unsigned long now)
+{
+    driver.disconnect();
+    if (fastPending)
+    {
+        startFast(now);
+    }
+    else if (scanPending)
+    {
+        startScan(now);
+    }
+    else
+    {
+        enter(wifi_retry_wait, now);
+    }
+}
+
+void WifiConnection::startFast(unsigned long now)
+{
+    fastPending = false;
+    withLease = addressValid(now);
+    driver.begin(ssid, password, cache.bssid, cache.channel, withLease ? &cache.address : NULL);
+    enter(wifi_fast_connect, now);
+}
+
+void WifiConnection::startScan(unsigned long now)
+{
+    scanPending = false;
+    withLease = false;
+    driver.begin(ssid, password, NULL, 0, NULL);
+    enter(wifi_full_connect, now);
+}
+
+void WifiConnection::onConnected(unsigned long now)
+{
+    stats.connects++;
+    if (state == wifi_fast_connect)
+    {
+        stats.fastConnects++;
+    }
+    stats.lastConnectMs = now - attemptStartMs;
+    if (stats.lastConnectMs > stats.slowestConnectMs)
+    {
+        stats.slowestConnectMs = stats.lastConnectMs;
+    }
+    if (linkLost)
+    {
+        linkLost = false;
+        stats.lastOutageMs = now - linkLostMs;
+        stats.totalOutageMs += stats.lastOutageMs;
+        if (stats.lastOutageMs > stats.longestOutageMs)
+        {
+            stats.longestOutageMs = stats.lastOutageMs;
+        }
+    }
+
+    // the next reconnect goes straight to this AP, and with this address while the lease runs
+    driver.bssid(cache.bssid);
+    cache.channel = driver.channel();
+    uint32_t lease = driver.leaseSeconds();
+    if (lease > 0)
+    {
+        // leases are days at most, the clamp keeps the end within the range of millis()
+        if (lease > WIFI_LEASE_MAX_S)
+        {
+            lease = WIFI_LEASE_MAX_S;
+        }
+        cache.address = driver.address();
+        cache.leaseEndMs = now + lease * 1000;
+    }
+    else if (!withLease)
+    {
+        // DHCP without a known lease time, the address is not reused
+        dropAddress();
+    }
+    cache.magic = WIFI_CACHE_MAGIC;
+
+    retryMs = WIFI_RETRY_FIRST_MS;
+    connectEventPending = true;
+    enter(wifi_connected, now);
+}
+
+void WifiConnection::update()
+{
+    unsigned long now = millis();
+    WifiLinkStatus link = driver.status();
+    switch (state)
+    {
+        case wifi_idle:
+            break;
+        case wifi_fast_connect:
+            if (link == wifi_link_up)
+            {
+                onConnected(now);
+            }
+            else if (link == wifi_link_failed || now - stateSinceMs >= WIFI_FAST_CONNECT_TIMEOUT_MS)
+            {
+                // the AP moved or the address was taken, the connect time includes this attempt
+                stats.fastFailures++;
+                dropAddress();
+                nextAttempt(now);
+            }
+            break;
+        case wifi_full_connect:
+            if (link == wifi_link_up)
+            {
+                onConnected(now);
+            }
+            else if (link == wifi_link_failed || now - stateSinceMs >= WIFI_FULL_CONNECT_TIMEOUT_MS)
+            {
+                stats.failures++;
+                dropAddress();
+                nextAttempt(now);
+            }
+            break;
+        case wifi_retry_wait:
+            if (now - stateSinceMs >= retryMs)
+            {
+                retryMs = retryMs * 2 > WIFI_RETRY_MAX_MS ? WIFI_RETRY_MAX_MS : retryMs * 2;
+                // the AP did not answer, it may have moved: a scan first
+                startAttempt(now, true);
+            }
+            break;
+        case wifi_connected:
+            if (link != wifi_link_up)
+            {
+                stats.disconnects++;
+                linkLost = true;
+                linkLostMs = now;
+                startAttempt(now, false);
+            }
+            break;
+    }
+}
+
+bool WifiConnection::connectedEvent()
+{
+    bool event = connectEventPending;
+    connectEventPending = false;
+    return event;
+}
+
+void WifiConnection::clearCache()
+{
+    cache.magic = 0;
+}
+
+void WifiConnection::printStats(Print &out)
+{
+    out.print("WiFi: connects ");
+    out.print(stats.connects);
+    out.print(" (fast ");
+    out.print(stats.fastConnects);
+    out.print(", fast failed ");
+    out.print(stats.fastFailures);
+    out.print("), failures ");
+    out.print(stats.failures);
+    out.print(", disconnects ");
+    out.print(stats.disconnects);
+    out.print(", connect ");
+    out.print(stats.lastConnectMs);
+    out.print(" ms (max ");
+    out.print(stats.slowestConnectMs);
+    out.print("), reconnect ");
+    out.print(stats.lastOutageMs);
+    out.print(" ms (max ");
+    out.print(stats.longestOutageMs);
+    out.println(")");
+}
@@ -0,0 +1,158 @@
+/*
+WifiConnection - WiFi as a non-blocking state machine
+
+Advanced from loop() and never blocks. The access point (BSSID and channel)
+and the DHCP lease of the last connection are cached, so a reconnect goes to
+the known AP without a scan and, while the lease runs, skips DHCP with the
+leased address as static IP. After a failed attempt the address is dropped
+and DHCP is used until a new lease comes. If the fast connect fails, a normal
+connection with scan and DHCP follows, and after that retries with a growing
+pause. A retry scans first and tries the known AP after that: an AP that moved
+while it was away is found by the first attempt once it is back. The radio is
+behind WifiDriver, so the logic runs against a simulated driver on the PC.
+*/
+
+#ifndef WifiConnection_h
+#define WifiConnection_h
+
+#include <Arduino.h>
+
+#define WIFI_CACHE_MAGIC 0x57494632
+
+enum WifiLinkStatus : uint8_t
+{
+  wifi_link_down,
+  wifi_link_connecting,
+  wifi_link_up,
+  // the AP was not found or rejected the connection
+  wifi_link_failed
+};
+
+// addresses in network order as the ESP32 IPAddress holds them, 0 is none
+struct WifiAddress
+{
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+class WifiDriver
+{
+public:
+  virtual ~WifiDriver() {}
+  // bssid is NULL (and channel 0) for a scan, address NULL for DHCP
+  virtual void begin(const char *ssid, const char *password, const uint8_t *bssid, int32_t channel,
+                     const WifiAddress *address) = 0;
+  virtual void disconnect() = 0;
+  virtual WifiLinkStatus status() = 0;
+  // of the current connection
+  virtual void bssid(uint8_t *bssidOut) = 0;
+  virtual int32_t channel() = 0;
+  virtual WifiAddress address() = 0;
+  // the DHCP lease of the current connection in seconds, 0 with a static address or if unknown
+  virtual uint32_t leaseSeconds() = 0;
+};
+
+// what a reconnect needs, e.g. in memory that survives a deep sleep or reset
+struct WifiCache
+{
+  uint32_t magic;
+  uint8_t bssid[6];
+  int32_t channel;
+  // the address of the last DHCP lease, ip 0 after an attempt with it failed
+  WifiAddress address;
+  // millis() when the lease runs out
+  uint32_t leaseEndMs;
+};
+
+enum WifiState : uint8_t
+{
+  wifi_idle,
+  // known AP, and the leased address while it is valid
+  wifi_fast_connect,
+  // scan and DHCP
+  wifi_full_connect,
+  wifi_connected,
+  // pause before the next attempt
+  wifi_retry_wait
+};
+
+struct WifiStats
+{
+  unsigned long connects;
+  // connections with the cached AP and address
+  unsigned long fastConnects;
+  unsigned long fastFailures;
+  unsigned long failures;
+  unsigned long disconnects;
+  // from the start of the attempt that succeeded
+  uint32_t lastConnectMs;
+  uint32_t slowestConnectMs;
+  // from the loss of the link until it is back, the time to reconnect
+  uint32_t lastOutageMs;
+  uint32_t longestOutageMs;
+  unsigned long totalOutageMs;
+};
+
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000
+#define WIFI_FULL_CONNECT_TIMEOUT_MS 10000
+#define WIFI_RETRY_FIRST_MS 1000
+#define WIFI_RETRY_MAX_MS 16000
+// 7 days
+#define WIFI_LEASE_MAX_S 604800UL
+
+class WifiConnection
+{
+public:
+  WifiConnection(WifiDriver &driver, const char *ssid, const char *password, WifiCache &cache);
+
+  // starts the first attempt, fast if the cache holds a connection (with DHCP, the lease
+  // time does not survive a reset)
+  void begin();
+  // call often (e.g. every 100 ms), returns right away
+  void update();
+
+  bool connected() const { return state == wifi_connected; }
+  // true once after every (re)connect, e.g. to check the token
+  bool connectedEvent();
+  WifiState currentState() const { return state; }
+  // forgets the cached AP and address, e.g. after the network changed
+  void clearCache();
+  void printStats(Print &out);
+
+  WifiStats stats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+private:
+  WifiDriver &driver;
+  const char *ssid;
+  const char *password;
+  WifiCache &cache;
+  WifiState state = wifi_idle;
+  unsigned long stateSinceMs = 0;
+  unsigned long attemptStartMs = 0;
+  // an outage runs from linkLostMs
+  bool linkLost = false;
+  unsigned long linkLostMs = 0;
+  uint32_t retryMs = WIFI_RETRY_FIRST_MS;
+  bool connectEventPending = false;
+  // the attempt runs with the cached address instead of DHCP
+  bool withLease = false;
+  // the attempts left before the pause, each is made once
+  bool fastPending = false;
+  bool scanPending = false;
+
+  bool cacheValid() const { return cache.magic == WIFI_CACHE_MAGIC; }
+  bool addressValid(unsigned long now) const;
+  void dropAddress() { cache.address.ip = 0; }
+  // a fast attempt (with the cache) and a full one, in this order unless scanFirst
+  void startAttempt(unsigned long now, bool scanFirst);
+  // the other attempt after a failure, or the pause
+  void nextAttempt(unsigned long now);
+  void startFast(unsigned long now);
+  void startScan(unsigned long now);
+  void enter(WifiState next, unsigned long now);
+  void onConnected(unsigned long now);
+};
+
+#endif
@@ -3,7 +3,6 @@
 // ----------------------------
 
 #include <WiFi.h>
-#include <WiFiClientSecure.h>
 
 #include <Wire.h>
 #include <SPI.h>
@@ -22,17 +21,40 @@
 // Search for "Arduino Json" in the Arduino Library manager
 // https://github.com/bblanchon/ArduinoJson
 
-#include <FastLED.h>
-// Just needed for EVERY_N_MILLISECONDS :/. I don't find a better solution to call the functions
-// every n ms. this can be a TODO
+#include <esp_task_wdt.h>
 
 // ----------MATRIX-----------------
 // Creates a second buffer for backround drawing (doubles the required RAM)
 //#define PxMATRIX_double_buffer true
 #include <PxMatrix.h>
-
-// uncomment this define for debug messages
-#define DEBUG_APP = 0
+#include "PlaybackPages.h"
+#include "FeatureBars.h"
+#include "TaskScheduler.h"
+#include "WifiConnection.h"
+#include "Esp32WifiDriver.h"
+#include "Esp32TlsClient.h"
+#include "Esp32Resolver.h"
+#include "PowerManager.h"
+#include "Brightness.h"
+#include "SyncedLyrics.h"
+#include "StatusServer.h"
+#include "Esp32SocketClient.h"
+#include "Log.h"
+
+// messages go through Log.h, build with -D LOG_LEVEL=LOG_LEVEL_DEBUG for the debug messages,
+// e.g. the durations of the requests
+
+// uncomment to record the raw Spotify traffic to SPIFFS (/requests.bin, /responses.bin).
+// /responses.bin can be replayed on the PC with the native environment
+//#define RECORD_SPOTIFY_TRAFFIC
+
+// uncomment to download missing lyrics (/l/<track id>.lrc) from a local server,
+// e.g. tools/spotify_stand_in.py --lyrics-dir. Without it only lyrics already on SPIFFS are shown
+//#define LYRICS_HOST "192.168.1.10"
+#define LYRICS_PORT 8080
+
+// /metrics (Prometheus text format) and /state (JSON) are served on this port
+const uint16_t STATUS_PORT = 80;
 
 // Pins for LED MATRIX
 
@@ -58,13 +80,18 @@ PxMATRIX display(64,64,P_LAT, P_OE,P_A,P_B,P_C,P_D,P_E);
 
 // This defines the 'on' time of the display is us. The larger this number,
 // the brighter the display. If too large the ESP will crash
+// (the brightness controller sets it together with the brightness and the timer alarm)
 uint8_t display_draw_time=10; //my default is 10; 30-60 is usually fine
 int timer_alarm = 2000;  //default is 2000
+// time spent in the refresh interrupt, for the CPU share in the task report
+volatile uint32_t display_isr_us = 0;
 
 void IRAM_ATTR display_updater(){
   // Increment the counter and set the time of ISR
   portENTER_CRITICAL_ISR(&timerMux);
+  uint32_t start = micros();
   display.display(display_draw_time);
+  display_isr_us += micros() - start;
   portEXIT_CRITICAL_ISR(&timerMux);
 }
 
@@ -74,7 +101,7 @@ void display_update_enable(bool is_enable)
   {
     timer = timerBegin(0, 80, true);
     timerAttachInterrupt(timer, &display_updater, true);
-    timerAlarmWrite(timer, 2000, true);
+    timerAlarmWrite(timer, timer_alarm, true);
     timerAlarmEnable(timer);
   }
   else
@@ -90,19 +117,43 @@ const int TEXT_COLOR = 0xFFFF;
 const int BACKGROUND_COLOR = 0x0000;
 const int TRACK_PROCESS_COLOR = 0x0333;
 const int TRACK_PROCESS_BACKGROUND_COLOR = 0x8000;
-const int HIGHT_SONG_TITLE = 1;
-const int HIGHT_SONG_AUTHOR = 11;
+// of the 50 ms frame, the rest is left for the local state and the commands
+const uint32_t RENDER_BUDGET_US = 40000;
+
+
+// brightness by the time of day: from minute of the day, {brightness, on-time us, refresh timer us}.
+// Darker levels also refresh less often, the refresh interrupt takes less of the CPU (see Brightness.h)
+const BrightnessStep BRIGHTNESS_SCHEDULE[] = {
+  {0, {40, 10, 3500}},
+  {7 * 60, {160, 10, 2500}},
+  {9 * 60, {255, 10, 2000}},
+  {19 * 60, {160, 10, 2500}},
+  {22 * 60, {40, 10, 3500}},
+};
+// uncomment to follow a light sensor (e.g. a photo resistor divider) on this ADC pin instead
+//#define LIGHT_SENSOR_PIN 34
+// from ADC reading (0 is dark)
+const BrightnessStep BRIGHTNESS_SENSOR_STEPS[] = {
+  {0, {40, 10, 3500}},
+  {800, {160, 10, 2500}},
+  {2400, {255, 10, 2000}},
+};
 
 
 // Audio Features
-const short MINIMUM_TEMPO_TO_VISUALIZE = 50;
-const short MAXIMUM_TEMPO_TO_VISUALIZE = 200;
-const short NUMBER_FEATURES_TO_DRAW = 6;
-const short START_LINE_AUDIO_FEATURES = 21;
-const short BAR_WIDTH = 7;
+// which features are drawn from top to bottom, the value ranges are in FeatureBars.h
+// and the regions of the pages in PlaybackPages.h
+const FeatureId FEATURES_TO_DRAW[] = {feature_popularity, feature_tempo, feature_danceability,
+                                      feature_energy, feature_valence, feature_speechiness};
+const short NUMBER_FEATURES_TO_DRAW = sizeof(FEATURES_TO_DRAW) / sizeof(FEATURES_TO_DRAW[0]);
 const int BAR_FOREGROUND_COLOR = 0x07E0;
 const int BAR_BACKGROUND_COLOR = 0x0000;
 
+// the colors above are used until a cover gives better ones
+#define THEME_FROM_ALBUM_ART
+const PlaybackTheme DEFAULT_THEME = {TEXT_COLOR, BACKGROUND_COLOR, TRACK_PROCESS_COLOR,
+                                     TRACK_PROCESS_BACKGROUND_COLOR, BAR_FOREGROUND_COLOR, BAR_BACKGROUND_COLOR};
+
 
 //-------------SPOTIFY---------------
 
@@ -112,7 +163,6 @@ const int BAR_BACKGROUND_COLOR = 0x0000;
 
 #include <ArduinoSpotifyCert.h>
 
-const int wifiTimeoutMs = 5000;
 const char ssid[] = "---";                                 // your network SSID (name)
 const char password[] = "---";                   // your network password
 const char clientId[] = "---";       // Your client ID of your spotify APP
@@ -120,98 +170,329 @@ const char clientSecret[] = "---";   // Your client Secret of your spotify APP (
 
 // Country code, including this is advisable
 #define SPOTIFY_MARKET "DE"
+// POSIX TZ of the clock page, the listening history uses UTC
+#define TIME_ZONE "CET-1CEST,M3.5.0,M10.5.0/3"
 #define SPOTIFY_REFRESH_TOKEN "---"
 
-WiFiClientSecure client;
+// like WiFiClientSecure, but reconnects resume the TLS session of the host
+Esp32TlsClient client;
+// the addresses of the Spotify hosts are kept for the TTL of the DNS answer
+Esp32Resolver resolver;
+
+// reconnects in the background, to the last AP with the last address first
+Esp32WifiDriver wifiDriver;
+// kept over resets, cleared at power on
+RTC_NOINIT_ATTR WifiCache wifiCache;
+WifiConnection wifi(wifiDriver, ssid, password, wifiCache);
+#include <SPIFFS.h>
+#include <AlbumArtCache.h>
+#include <AlbumPalette.h>
+#include <ListeningHistory.h>
+#include <time.h>
+#ifdef RECORD_SPOTIFY_TRAFFIC
+#include <SpotifyRecordClient.h>
+File requestCapture;
+File responseCapture;
+SpotifyRecordClient recordClient(client, requestCapture, responseCapture);
+ArduinoSpotify spotify(recordClient, clientId, clientSecret, SPOTIFY_REFRESH_TOKEN);
+#else
 ArduinoSpotify spotify(client, clientId, clientSecret, SPOTIFY_REFRESH_TOKEN);
+#endif
 
 CurrentlyPlaying currentlyPlaying;
 CurrentlyPlaying currentlyPlayingErrorCheck;
-AudioFeatures audioFeatures;
-
-class ScrollText
-{
-  public:
-    ScrollText(uint8_t ypos_in, const char* text_in);
+PackedAudioFeatures audioFeatures;
+int16_t featureBarLengths[NUMBER_FEATURES_TO_DRAW];
+
+// cover of the current album, shown while the playback is paused. The covers
+// are kept on SPIFFS and drawn from there, only a download needs a tile in RAM
+AlbumArtDecoder albumArtDecoder;
+AlbumArtCache albumArtCache(SPIFFS);
+char albumArtUri[SPOTIFY_URI_CHAR_LENGTH] = "";
+bool albumArtValid = false;
+
+// the tracks listened to, logged on SPIFFS. A track goes to the history when
+// another one starts and it was listened to long enough
+ListeningHistory listeningHistory(SPIFFS);
+const long MIN_LISTENED_MS = 30000;
+// time() is the NTP time from here on, before that nothing is recorded
+const time_t CLOCK_VALID_AFTER = 1600000000;
+uint32_t listeningTrackKey = 0;
+uint32_t listeningStartedAt = 0;
+long listeningProgressMs = 0;
+long listeningDurationMs = 0;
+// the audio features belong to this track
+uint32_t audioFeaturesTrackKey = 0;
+
+// synced lyrics of the current track from SPIFFS, a window of the lines is in RAM
+SyncedLyrics lyrics(SPIFFS);
+char lyricsTrackId[SPOTIFY_URI_CHAR_LENGTH] = "";
+
+// beat starts and loudness of the current track (4 kB), streamed from the audio
+// analysis once per track; the cursor finds the beat of the local progress every frame
+BeatGrid beatGrid;
+AudioAnalysisParser audioAnalysisParser;
+BeatCursor beatCursor(beatGrid);
+char beatsTrackId[SPOTIFY_URI_CHAR_LENGTH] = "";
+bool beatsValid = false;
+
+// everything the pages show, updated every frame by updatePlaybackModel(). The
+// pages take turns: now playing, lyrics, visualizer and audio features while playing; cover,
+// statistics and clock while paused
+PlaybackModel playbackModel = {true, false, "", "", 0, 0, FEATURES_TO_DRAW, featureBarLengths,
+                               NUMBER_FEATURES_TO_DRAW, false, &albumArtCache, albumArtUri, false,
+                               &listeningHistory, 0, "Error", DEFAULT_THEME, false, "", "", false, 0, 0};
+PlaybackPages pages(display, playbackModel, CYCLIC_PRINT_MS);
+
+// the latency of the currently playing polls that went out
+struct PollLatency {
+  unsigned long count;
+  unsigned long total_ms;
+  uint32_t slowest_ms;
+};
+PollLatency pollLatency = {0, 0, 0};
 
-    void setText(const char* text_in);
-    void moveOneFrame(const char* text);
+// served a section per task run, so a scrape does not delay a frame
+bool renderStatus(StatusPath path, uint8_t section, Print &out);
+WiFiServer statusListener(STATUS_PORT);
+// a section goes out over several runs instead of waiting for a slow client
+Esp32SocketClient statusClient;
+StatusServer statusServer(renderStatus);
 
-  private:
-    char text[80];
-    uint8_t ypos;
-    uint16_t text_length;
+// pre declaration
+void slowUpdate();
+void fastUpdate();
+void updateWifi();
+void reportTasks();
+void drainLog();
+void updateBrightness();
+void serveStatus();
+void updateAudioFeatures();
+void setPowerSupplyPower(bool power);
+void applyTheme(const PlaybackTheme &newTheme);
+
+// the periodic work of loop(): name, function, period ms, budget us, delay of the first run ms.
+// the first slow update follows the WiFi connection
+Task tasks[] = {
+  {"wifi", updateWifi, 100, 50000, 0, {}},
+  {"fast_update", fastUpdate, CYCLIC_PRINT_MS, CYCLIC_PRINT_MS * 1000, 0, {}},
+  {"slow_update", slowUpdate, 10000, 3000000, 10000, {}},
+  {"brightness", updateBrightness, 100, 2000, 0, {}},
+  {"task_report", reportTasks, 60000, 20000, 60000, {}},
+  {"status", serveStatus, 20, 5000, 0, {}},
+  {"log", drainLog, 20, 2000, 0, {}},
+};
+TaskScheduler taskScheduler(tasks, sizeof(tasks) / sizeof(tasks[0]));
+// its period follows the power state
+Task &slowUpdateTask = tasks[2];
 
-    int xpos_scrolltext = 0;
-    int timer_delay_scroll_text_ms = 0;
-    // describes the delay when starting and ending to scroll
-    const short scrolling_delay_ms = 2000;
-    const int text_color = TEXT_COLOR;
-    const int background_color = BACKGROUND_COLOR;
+// the panel and its power supply go off when nothing played for this long
+const uint32_t IDLE_TIMEOUT_MS = 5 * 60 * 1000;
 
-    short state = 1;
+class PanelPower : public PowerDriver {
+  public:
+    void panel(bool on) override {
+      if (on) {
+        setPowerSupplyPower(true);
+        display_update_enable(true);
+      } else {
+        display_update_enable(false);
+        setPowerSupplyPower(false);
+      }
+    }
+    void cpuFrequency(uint32_t mhz) override {
+      setCpuFrequencyMhz(mhz);
+    }
 };
+PanelPower panelPower;
+PowerManager power(panelPower, IDLE_TIMEOUT_MS);
+
+#ifdef LIGHT_SENSOR_PIN
+  BrightnessController brightness(BRIGHTNESS_SENSOR_STEPS, sizeof(BRIGHTNESS_SENSOR_STEPS) / sizeof(BrightnessStep),
+                                  brightness_sensor, {255, display_draw_time, (uint16_t)timer_alarm});
+#else
+  BrightnessController brightness(BRIGHTNESS_SCHEDULE, sizeof(BRIGHTNESS_SCHEDULE) / sizeof(BrightnessStep),
+                                  brightness_schedule, {255, display_draw_time, (uint16_t)timer_alarm});
+#endif
+unsigned long isrMeasuredSince = 0;
+
+// the chip resets when loop() did not come back for this long
+const int WATCHDOG_TIMEOUT_S = 30;
+// the task that was running, kept over a watchdog reset
+RTC_NOINIT_ATTR uint8_t watchdogRunningTask;
+
+void taskOverrun(const Task &task, uint32_t runtimeUs) {
+  LOG_WARN("task over budget: %s took %lu ms of %lu ms", task.name, (unsigned long)(runtimeUs / 1000),
+           (unsigned long)(task.budgetUs / 1000));
+}
+
+void reportTasks() {
+  #if LOG_LEVEL >= LOG_LEVEL_INFO
+    LogPrint report(LOG_LEVEL_INFO);
+    taskScheduler.printStats(report);
+    wifi.printStats(report);
+    power.printStats(report);
+    // the measured share of the refresh interrupt next to the one of the model
+    unsigned long now = millis();
+    portENTER_CRITICAL(&timerMux);
+    uint32_t isrUs = display_isr_us;
+    display_isr_us = 0;
+    portEXIT_CRITICAL(&timerMux);
+    LOG_INFO("display ISR: %.2f %% CPU, model %.2f %%, brightness %u",
+             now > isrMeasuredSince ? isrUs / 10.0 / (now - isrMeasuredSince) : 0.0,
+             panelIsrShare(brightness.output(), PxMATRIX_COLOR_DEPTH) * 100, (unsigned int)brightness.output().brightness);
+    isrMeasuredSince = now;
+    LOG_INFO("TLS handshakes: full %lu, resumed %lu, last %lu ms", (unsigned long)spotify.tlsStats.fullHandshakes,
+             (unsigned long)spotify.tlsStats.resumedHandshakes, (unsigned long)(client.handshakeUs / 1000));
+    LOG_INFO("DNS: hits %lu of %lu, ms per resolution %lu", (unsigned long)spotify.dnsStats.hits,
+             (unsigned long)spotify.dnsStats.lookups,
+             (unsigned long)(spotify.dnsStats.resolutions > 0 ? spotify.dnsStats.resolveMicros / 1000 / spotify.dnsStats.resolutions : 0));
+  #endif
+}
 
-ScrollText::ScrollText(uint8_t ypos_in, const char* text_in):
- ypos(ypos_in) {
-   strcpy(text, text_in);
-   text_length = strlen(text_in);
+// only as much as the UART takes without waiting, the rest goes with the next run
+void drainLog() {
+  logDrain(Serial.availableForWrite());
 }
 
-void ScrollText::setText(const char* text_in) {
-  if (strcoll(text_in, text) != 0) {
-    xpos_scrolltext = 0;
-    timer_delay_scroll_text_ms = 0;
-    strcpy(text, text_in);
-    text_length = strlen(text);
+// a connection is taken when none is being served, the rest wait in the backlog
+void serveStatus() {
+  if (!statusServer.busy() && wifi.connected()) {
+    statusClient = statusListener.available();
+    if (statusClient) {
+      statusServer.begin(statusClient);
+    }
   }
+  statusServer.poll();
 }
 
-void ScrollText::moveOneFrame(const char* text) {
-  display.setTextWrap(false);  // we don't wrap text so it scrolls nicely
-  display.setTextColor(text_color, background_color); 
-  setText(text);
-  yield();
+static void printLabeledMetric(Print &out, const char *name, const char *label, const char *value, unsigned long metric) {
+  char labels[40];
+  snprintf(labels, sizeof(labels), "%s=\"%s\"", label, value);
+  StatusServer::printMetric(out, name, metric, labels);
+}
 
-  switch(state) {
-    //waiting before moving the text
+// the sections of /metrics: the system, Spotify, the caches and the display, then one per task
+static bool renderMetrics(uint8_t section, Print &out) {
+  switch (section) {
+    case 0:
+      StatusServer::printMetric(out, "uptime_seconds", millis() / 1000);
+      StatusServer::printMetric(out, "heap_free_bytes", ESP.getFreeHeap());
+      StatusServer::printMetric(out, "heap_min_free_bytes", ESP.getMinFreeHeap());
+      StatusServer::printMetric(out, "heap_largest_block_bytes", ESP.getMaxAllocHeap());
+      StatusServer::printMetric(out, "wifi_connected", wifi.connected() ? 1 : 0);
+      out.print("wifi_rssi_dbm ");
+      out.print(WiFi.RSSI());
+      out.print('\n');
+      StatusServer::printMetric(out, "wifi_connects_total", wifi.stats.connects);
+      StatusServer::printMetric(out, "wifi_disconnects_total", wifi.stats.disconnects);
+      StatusServer::printMetric(out, "wifi_last_connect_ms", wifi.stats.lastConnectMs);
+      printLabeledMetric(out, "log_lines_total", "level", "error", logStats.lines[LOG_LEVEL_ERROR]);
+      printLabeledMetric(out, "log_lines_total", "level", "warn", logStats.lines[LOG_LEVEL_WARN]);
+      printLabeledMetric(out, "log_lines_total", "level", "info", logStats.lines[LOG_LEVEL_INFO]);
+      printLabeledMetric(out, "log_lines_total", "level", "debug", logStats.lines[LOG_LEVEL_DEBUG]);
+      StatusServer::printMetric(out, "log_dropped_total", logStats.dropped);
+      StatusServer::printMetric(out, "log_truncated_total", logStats.truncated);
+      StatusServer::printMetric(out, "log_peak_records", logStats.peak);
+      StatusServer::printMetric(out, "status_requests_total", statusServer.stats.requests);
+      StatusServer::printMetric(out, "status_slowest_poll_us", statusServer.stats.slowestPollUs);
+      return true;
     case 1:
-      timer_delay_scroll_text_ms += CYCLIC_PRINT_MS;
-      if (timer_delay_scroll_text_ms > scrolling_delay_ms) {
-        timer_delay_scroll_text_ms = 0;
-        state = 2;
-      }
-      break;
-    // moving the text
+      StatusServer::printMetric(out, "spotify_poll_ms_sum", pollLatency.total_ms);
+      StatusServer::printMetric(out, "spotify_poll_ms_count", pollLatency.count);
+      StatusServer::printMetric(out, "spotify_poll_slowest_ms", pollLatency.slowest_ms);
+      StatusServer::printMetric(out, "spotify_requests_total", spotify.rateLimitStats.requests);
+      StatusServer::printMetric(out, "spotify_rate_limited_total", spotify.rateLimitStats.rateLimited);
+      printLabeledMetric(out, "spotify_suppressed_total", "reason", "backoff", spotify.rateLimitStats.suppressedBackoff);
+      printLabeledMetric(out, "spotify_suppressed_total", "reason", "budget", spotify.rateLimitStats.suppressedBudget);
+      printLabeledMetric(out, "spotify_commands_total", "result", "sent", spotify.commandStats.sent);
+      printLabeledMetric(out, "spotify_commands_total", "result", "failed", spotify.commandStats.failed);
+      printLabeledMetric(out, "spotify_commands_total", "result", "coalesced", spotify.commandStats.coalesced);
+      printLabeledMetric(out, "tls_handshakes_total", "kind", "full", spotify.tlsStats.fullHandshakes);
+      printLabeledMetric(out, "tls_handshakes_total", "kind", "resumed", spotify.tlsStats.resumedHandshakes);
+      StatusServer::printMetric(out, "tls_last_handshake_us", client.handshakeUs);
+      StatusServer::printMetric(out, "dns_lookups_total", spotify.dnsStats.lookups);
+      StatusServer::printMetric(out, "dns_hits_total", spotify.dnsStats.hits);
+      return true;
     case 2:
-      xpos_scrolltext--;
-      if(text_length*6 + xpos_scrolltext <= MATRIX_WIDTH) {
-        state = 3;
-      }
-      break;
-    //waiting before start moving the text from the beginning again
-    case 3:
-      timer_delay_scroll_text_ms += CYCLIC_PRINT_MS;
-      if (timer_delay_scroll_text_ms > scrolling_delay_ms) {
-        timer_delay_scroll_text_ms = 0;
-        xpos_scrolltext = 0;
-        state = 1;
+      StatusServer::printMetric(out, "album_art_cache_hits_total", albumArtCache.stats.hits);
+      StatusServer::printMetric(out, "album_art_cache_misses_total", albumArtCache.stats.misses);
+      StatusServer::printMetric(out, "lyrics_windows_total", lyrics.stats.windows);
+      StatusServer::printMetric(out, "lyrics_searches_total", lyrics.stats.searches);
+      StatusServer::printMetric(out, "beats_loaded", beatsValid ? beatGrid.count : 0);
+      StatusServer::printMetric(out, "audio_analysis_parse_us", audioAnalysisParser.stats.parseMicros);
+      StatusServer::printMetric(out, "frames_total", pages.scheduler.stats.frames);
+      StatusServer::printMetric(out, "frame_draws_total", pages.scheduler.stats.draws);
+      StatusServer::printMetric(out, "frame_deferred_draws_total", pages.scheduler.stats.deferred);
+      StatusServer::printMetric(out, "frames_over_budget_total", pages.scheduler.stats.overBudget);
+      StatusServer::printMetric(out, "frame_slowest_us", pages.scheduler.stats.slowestFrameUs);
+      printLabeledMetric(out, "power_residency_ms", "state", "active", power.residencyMs(power_active));
+      printLabeledMetric(out, "power_residency_ms", "state", "idle", power.residencyMs(power_idle));
+      printLabeledMetric(out, "power_residency_ms", "state", "standby", power.residencyMs(power_standby));
+      StatusServer::printMetric(out, "display_brightness", brightness.output().brightness);
+      return true;
+    default:
+      if (section - 3 >= taskScheduler.taskCount()) {
+        return false;
       }
+      taskScheduler.printMetrics(out, section - 3);
+      return true;
   }
-  display.setCursor(xpos_scrolltext, ypos);
-  display.println(text);
 }
 
-// pre declaration
-void slowUpdate();
+static const char *const POWER_STATE_NAMES[POWER_STATE_COUNT] = {"active", "idle", "standby"};
+
+static void printJsonField(Print &out, const char *name, bool first) {
+  out.print(first ? "{" : ",");
+  StatusServer::printJsonString(out, name);
+  out.print(':');
+}
+
+bool renderStatus(StatusPath path, uint8_t section, Print &out) {
+  if (path == status_metrics) {
+    return renderMetrics(section, out);
+  }
+  if (section > 0) {
+    return false;
+  }
+  // the local state of the player, as on the display
+  printJsonField(out, "playing", true);
+  out.print(!currentlyPlaying.error && currentlyPlaying.isPlaying ? "true" : "false");
+  printJsonField(out, "error", false);
+  out.print(currentlyPlaying.error ? "true" : "false");
+  printJsonField(out, "track_id", false);
+  StatusServer::printJsonString(out, currentlyPlaying.error ? "" : currentlyPlaying.trackId);
+  printJsonField(out, "title", false);
+  StatusServer::printJsonString(out, currentlyPlaying.error ? "" : currentlyPlaying.trackName);
+  printJsonField(out, "artist", false);
+  StatusServer::printJsonString(out, currentlyPlaying.error ? "" : currentlyPlaying.firstArtistName);
+  printJsonField(out, "progress_ms", false);
+  out.print(currentlyPlaying.progressMs);
+  printJsonField(out, "duration_ms", false);
+  out.print(currentlyPlaying.duraitonMs);
+  printJsonField(out, "page", false);
+  StatusServer::printJsonString(out, pages.page(pages.scheduler.currentPage()).name);
+  printJsonField(out, "power", false);
+  StatusServer::printJsonString(out, POWER_STATE_NAMES[power.currentState()]);
+  printJsonField(out, "brightness", false);
+  out.print(brightness.output().brightness);
+  printJsonField(out, "lyrics", false);
+  out.print(playbackModel.lyricsValid ? "true" : "false");
+  printJsonField(out, "beats", false);
+  out.print(playbackModel.beatsValid ? "true" : "false");
+  printJsonField(out, "uptime_s", false);
+  out.print(millis() / 1000);
+  out.print("}\n");
+  return true;
+}
 
 void setPowerSupplyPower(bool power) {
   if (power) {
-    Serial.println("Set power supply power ON");
+    LOG_INFO("power supply on");
     // set LOW to pin, because it is set to ground to the enable power
     digitalWrite(outputPinPowerSupply, LOW);
   } else {
-    Serial.println("Set power supply power OFF");
+    LOG_INFO("power supply off");
 
     digitalWrite(outputPinPowerSupply, HIGH);
   }
@@ -219,65 +500,164 @@ void setPowerSupplyPower(bool power) {
   
 }
 
-void connectToWifiAndSpotifyAuth() {
-  if (WiFi.status() != WL_CONNECTED) {
-    WiFi.setAutoReconnect(true);
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(ssid, password);
-    
-    Serial.println("");
-    // Wait for connection
-    int counterMs = 0;
-    while (WiFi.status() != WL_CONNECTED)
-    {
-        counterMs += 500;
-        delay(500);
-        Serial.print(".");
-        if (counterMs >= wifiTimeoutMs) {
-          Serial.print(" Failed to connect. Retry");
-          connectToWifiAndSpotifyAuth();
-        }
-    }
+// after every (re)connect the token is checked, it is only refreshed when it expired
+void updateWifi() {
+  wifi.update();
+  if (!wifi.connectedEvent()) {
+    return;
   }
-  
-  Serial.println("");
-  Serial.print("Connected to ");
-  Serial.println(ssid);
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
+  LOG_INFO("connected to %s in %lu ms, address %s", ssid, (unsigned long)wifi.stats.lastConnectMs,
+           WiFi.localIP().toString().c_str());
+  // listening already is kept
+  statusListener.begin();
 
-  client.setCACert(spotify_server_cert);
-
-  Serial.println("Refreshing Access Tokens");
-  if (!spotify.refreshAccessToken())
+  if (!spotify.checkAndRefreshAccessToken())
   {
-      Serial.println("Failed to get access tokens");
+      LOG_ERROR("failed to get access tokens");
   }else{
-    Serial.println("Spotify access working");
+    LOG_INFO("Spotify access working");
+  }
+  // the song may have changed in the meantime
+  slowUpdate();
+}
+
+// only downloads the cover when the album changed and was not seen before,
+// the theme is taken from the cover once per album
+void updateAlbumArt() {
+  if (strcmp(albumArtUri, currentlyPlaying.albumUri) == 0) {
+    return;
+  }
+  strncpy(albumArtUri, currentlyPlaying.albumUri, sizeof(albumArtUri));
+  albumArtValid = false;
+  uint16_t *tile = (uint16_t *)malloc(ALBUM_ART_SIZE * ALBUM_ART_SIZE * sizeof(uint16_t));
+  if (tile == NULL) {
+    return;
+  }
+  #if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    unsigned long now = millis();
+  #endif
+  bool tileReady = false;
+  if (albumArtCache.contains(albumArtUri)) {
+    tileReady = albumArtValid = albumArtCache.load(albumArtUri, tile);
+  } else if (currentlyPlaying.albumImageUrl[0] != '\0' &&
+             spotify.getAlbumArt(currentlyPlaying.albumImageUrl, albumArtDecoder, tile)) {
+    tileReady = true;
+    albumArtValid = albumArtCache.store(albumArtUri, tile);
+  }
+  LOG_DEBUG("album art in %lu ms", millis() - now);
+
+  #ifdef THEME_FROM_ALBUM_ART
+    PlaybackTheme albumTheme = DEFAULT_THEME;
+    if (tileReady) {
+      PaletteColor palette[ALBUM_PALETTE_COLORS];
+      uint8_t colors = extractPalette(tile, palette);
+      albumTheme = themeFromPalette(palette, colors, DEFAULT_THEME);
+    }
+    applyTheme(albumTheme);
+  #endif
+  free(tile);
+}
+
+// once per track, from flash or downloaded first
+void updateLyrics() {
+  if (strcmp(lyricsTrackId, currentlyPlaying.trackId) == 0) {
+    return;
+  }
+  strncpy(lyricsTrackId, currentlyPlaying.trackId, sizeof(lyricsTrackId));
+  #ifdef LYRICS_HOST
+    if (!lyrics.exists(lyricsTrackId)) {
+      WiFiClient lyricsClient;
+      lyrics.download(lyricsClient, LYRICS_HOST, LYRICS_PORT, lyricsTrackId);
+    }
+  #endif
+  if (!lyrics.load(lyricsTrackId)) {
+    lyrics.clear();
+  }
+}
+
+// once per track, a failed request is tried again with the next poll
+void updateBeats() {
+  if (beatsValid && strcmp(beatsTrackId, currentlyPlaying.trackId) == 0) {
+    return;
+  }
+  strncpy(beatsTrackId, currentlyPlaying.trackId, sizeof(beatsTrackId));
+  beatsValid = spotify.getAudioAnalysis(beatsTrackId, audioAnalysisParser, beatGrid);
+  beatCursor.reset();
+  LOG_DEBUG("beats: %u from %lu bytes, parsed in %lu us", (unsigned int)beatGrid.count,
+            audioAnalysisParser.stats.bytes, audioAnalysisParser.stats.parseMicros);
+}
+
+// the track of the last poll left, it goes to the history if it was listened to long enough
+void finishListening() {
+  if (listeningTrackKey == 0 || listeningStartedAt < CLOCK_VALID_AFTER) {
+    return;
+  }
+  long listenedMs = listeningProgressMs < listeningDurationMs ? listeningProgressMs : listeningDurationMs;
+  if (listenedMs < MIN_LISTENED_MS) {
+    return;
+  }
+  ListeningHistoryEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.trackKey = listeningTrackKey;
+  entry.startedAt = listeningStartedAt;
+  entry.listenedSeconds = listenedMs / 1000 > 65535 ? 65535 : listenedMs / 1000;
+  if (audioFeaturesTrackKey == listeningTrackKey) {
+    entry.features = audioFeatures;
+    entry.flags |= LISTENING_HAS_FEATURES;
+  }
+  if (!listeningHistory.append(entry)) {
+    LOG_WARN("failed to log the listening history");
+  }
+}
+
+void updateListeningHistory() {
+  uint32_t trackKey = currentlyPlaying.error ? 0 : ListeningHistory::trackKey(currentlyPlaying.trackId);
+  if (trackKey != listeningTrackKey) {
+    finishListening();
+    listeningTrackKey = trackKey;
+    listeningStartedAt = time(NULL) - currentlyPlaying.progressMs / 1000;
+    listeningProgressMs = 0;
+  }
+  if (trackKey != 0) {
+    listeningDurationMs = currentlyPlaying.duraitonMs;
+    if (currentlyPlaying.progressMs > listeningProgressMs) {
+      listeningProgressMs = currentlyPlaying.progressMs;
+    }
   }
 }
 
 void updateSpotifyInfo() {
+  if (!wifi.connected()) {
+    // the library keeps advancing the progress of the last song
+    return;
+  }
   unsigned long now = millis();
   currentlyPlaying = spotify.getCurrentlyPlaying(SPOTIFY_MARKET);
-  Serial.print("Current song: ");
+  if (currentlyPlaying.rateLimited) {
+    // keep showing the last song, the library extrapolates the progress
+    LOG_WARN("rate limited, retry in %lu ms", (unsigned long)spotify.backoffRemainingMs());
+    return;
+  }
+  uint32_t poll_ms = millis() - now;
+  pollLatency.count++;
+  pollLatency.total_ms += poll_ms;
+  if (poll_ms > pollLatency.slowest_ms) {
+    pollLatency.slowest_ms = poll_ms;
+  }
+  updateListeningHistory();
   if (currentlyPlaying.error) {
-    Serial.println("Error, no song currently played by Spotify");
-    display.clearDisplay();
-
-
-    //WiFi.reconnect();
-
+    LOG_INFO("no song currently played by Spotify");
   }else {
-    Serial.println(currentlyPlaying.trackName);
-    #ifdef DEBUG_APP
-      Serial.print("Current song(shortened track): ");
-      Serial.println(currentlyPlaying.shortTrackName);
-    #endif
-  }
-  #ifdef DEBUG_APP
-    Serial.print("Duration of Spotify API call in ms: ");
-    Serial.println(millis() - now);
+    LOG_INFO("current song: %s", currentlyPlaying.trackName);
+    updateAlbumArt();
+    updateLyrics();
+    updateBeats();
+    LOG_DEBUG("shortened: %s", currentlyPlaying.shortTrackName);
+  }
+  LOG_DEBUG("Spotify update in %lu ms", millis() - now);
+  #ifdef RECORD_SPOTIFY_TRAFFIC
+    requestCapture.flush();
+    responseCapture.flush();
   #endif
 }
 
@@ -296,14 +676,30 @@ void printStartScreen() {
 //_----------------Setup--------------
 void setup() {
   Serial.begin(9600);
-  Serial.print("Start Setup");
+  LOG_INFO("start setup");
+  if (esp_reset_reason() == ESP_RST_TASK_WDT && watchdogRunningTask < taskScheduler.taskCount()) {
+    LOG_ERROR("reset by the watchdog while running %s", taskScheduler.task(watchdogRunningTask).name);
+  }
+  watchdogRunningTask = TASK_NONE;
+  if (esp_reset_reason() == ESP_RST_POWERON) {
+    wifi.clearCache();
+  }
 
-  // pins configuration
+  // pins configuration, the power manager turns the supply on
   pinMode(outputPinPowerSupply, OUTPUT);
-  setPowerSupplyPower(true);
+
+  SPIFFS.begin(true);
+  albumArtCache.begin();
+  if (!listeningHistory.begin()) {
+    LOG_WARN("the listening history log was damaged, the intact part is kept");
+  }
+  #ifdef RECORD_SPOTIFY_TRAFFIC
+    requestCapture = SPIFFS.open("/requests.bin", FILE_WRITE);
+    responseCapture = SPIFFS.open("/responses.bin", FILE_WRITE);
+  #endif
 
   // ----------Display----------------------------------------------------
-  Serial.println("Setting up Matrix visuals");
+  LOG_INFO("setting up the matrix");
   // Define your display layout here, e.g. 1/8 step, and optional SPI pins begin(row_pattern, CLK, MOSI, MISO, SS)
   display.begin(32);
   // Helps to reduce display update latency on larger displays
@@ -316,238 +712,72 @@ void setup() {
   //display.setBrightness(50);
   delay(100);
 
-  connectToWifiAndSpotifyAuth();
-
-  // Display printing is only possible after WiFi is conencted
+  client.setCACert(spotify_server_cert);
+  spotify.enableTlsSessions(client);
+  spotify.setResolver(resolver);
+  // time for the listening history and the clock page, synchronized once WiFi is up
+  configTzTime(TIME_ZONE, "pool.ntp.org");
+  // the wifi task finishes the connection and does the first update
+  wifi.begin();
+
+  // Display printing is only possible after WiFi is started
   printStartScreen();
-  display_update_enable(true);
-
-  slowUpdate();
+  // panel, its supply and the CPU speed
+  power.begin();
   display.clearDisplay();
-  Serial.println("Finished Setup");
+
+  taskScheduler.onOverrun = taskOverrun;
+  taskScheduler.runningTask = &watchdogRunningTask;
+  taskScheduler.begin();
+  esp_task_wdt_init(WATCHDOG_TIMEOUT_S, true);
+  esp_task_wdt_add(NULL);
+  LOG_INFO("finished setup");
 }
 
-//-----------------Global variables-------------
-ScrollText scrolltext_title = ScrollText(HIGHT_SONG_TITLE, "Title");
-ScrollText scrolltext_artist = ScrollText(HIGHT_SONG_AUTHOR, "Artist");
+// new colors show up with the next frame, everything is drawn again
+void applyTheme(const PlaybackTheme &newTheme) {
+  playbackModel.theme = newTheme;
+  pages.scheduler.redrawAll(newTheme.background);
+}
 
 
 //-----------------FUNCTIONS--------------------
 
 
-void printCurrentlyPlayingToSerial(CurrentlyPlaying currentlyPlaying)
+// the song of the last poll at debug level
+void printCurrentlyPlayingToSerial(const CurrentlyPlaying &currentlyPlaying)
 {
     if (!currentlyPlaying.error)
     {
-        Serial.println("--------- Currently Playing ---------");
-
-        Serial.print("Is Playing: ");
-        if (currentlyPlaying.isPlaying)
-        {
-            Serial.println("Yes");
-        }
-        else
-        {
-            Serial.println("No");
-        }
-
-        Serial.print("Track: ");
-        Serial.println(currentlyPlaying.trackName);
-        Serial.print("Track URI: ");
-        Serial.println(currentlyPlaying.trackUri);
-        Serial.println();
-
-        Serial.print("Artist: ");
-        Serial.println(currentlyPlaying.firstArtistName);
-        Serial.print("Artist URI: ");
-        Serial.println(currentlyPlaying.firstArtistUri);
-        Serial.println();
-
-        Serial.print("Album: ");
-        Serial.println(currentlyPlaying.albumName);
-        Serial.print("Album URI: ");
-        Serial.println(currentlyPlaying.albumUri);
-        Serial.println();
-
-        long progress = currentlyPlaying.progressMs; // duration passed in the song
-        long duration = currentlyPlaying.duraitonMs; // Length of Song
-        Serial.print("Elapsed time of song (ms): ");
-        Serial.print(progress);
-        Serial.print(" of ");
-        Serial.println(duration);
-        Serial.println();
-        float precentage;
-        if (duration <= 0) {
-          precentage = 0;
-        } else {
-          precentage = ((float)progress / (float)duration) * 100;
-        }
-        int clampedPrecentage = (int)precentage;
-        Serial.print("<");
-        for (int j = 0; j < 50; j++)
-        {
-            if (clampedPrecentage >= (j * 2))
-            {
-                Serial.print("=");
-            }
-            else
-            {
-                Serial.print("-");
-            }
-        }
-        Serial.println(">");
-        Serial.println();
-        Serial.println("------------------------");
-    }
-}
-
-
-void printSongProcess() {
-  
-    //Show song progress
-    long progress = currentlyPlaying.progressMs; // duration passed in the song
-    long duration = currentlyPlaying.duraitonMs; // Length of Song
-    float percentage;
-    if (duration <= 0) {
-      percentage = 0;
-    } else {
-      percentage = ((float)progress / (float)duration);
+        LOG_DEBUG("playing: %s", currentlyPlaying.isPlaying ? "yes" : "no");
+        LOG_DEBUG("track: %s", currentlyPlaying.trackName);
+        LOG_DEBUG("track uri: %s", currentlyPlaying.trackUri);
+        LOG_DEBUG("artist: %s", currentlyPlaying.firstArtistName);
+        LOG_DEBUG("album: %s", currentlyPlaying.albumName);
+        LOG_DEBUG("elapsed %ld of %ld ms", currentlyPlaying.progressMs, currentlyPlaying.duraitonMs);
     }
-    float progress_float = (float)MATRIX_WIDTH * percentage;
-    int clamped_progress = (int)progress_float;
-
-    const short startingX = 0;
-    const short startingY = 9;
-
-    display.drawFastHLine(startingX, startingY, clamped_progress, TRACK_PROCESS_COLOR);
-    display.drawFastHLine(clamped_progress, startingY, MATRIX_WIDTH - clamped_progress, TRACK_PROCESS_BACKGROUND_COLOR);
 }
 
-// print a char to the display with clearing the row
-void printToDisplay(char* char_to_print) {
-  // dont wrap so we only clear the current line
-  display.setTextWrap(false);
-  if (sizeof(char_to_print) > 20) {
-    Serial.println("Eror: This print to display is longer than 20 characters");
-  }
-  char char_to_print_plus_spaces[50];
-  strncpy(char_to_print_plus_spaces, char_to_print, sizeof(char_to_print_plus_spaces));
-  strncat(char_to_print_plus_spaces, "            ", (sizeof(char_to_print_plus_spaces)) );
-  display.setTextColor(TEXT_COLOR, BACKGROUND_COLOR);
-  display.print(char_to_print_plus_spaces);
-}
 
-//Logic to handle different title length
-//short title is just displayed
-//a long title is displayed scrolling
-char old_track[80];
-char old_artist[80];
-void printTitleAndAuthor() {
-  //print title
-  if (strlen(currentlyPlaying.shortTrackName) < 11) {
-    // only print track if its differnet to the old track
-    if (strcmp (old_track, currentlyPlaying.shortTrackName) != 0) {
-      strncpy(old_track, currentlyPlaying.shortTrackName, sizeof(old_track));
-      display.setCursor(0, HIGHT_SONG_TITLE);
-      printToDisplay(currentlyPlaying.shortTrackName);
-    }
-  } else {
-    strncpy(old_track, currentlyPlaying.shortTrackName, sizeof(old_track));
-    scrolltext_title.moveOneFrame(currentlyPlaying.shortTrackName);
-  }
-
-  // print artist
-  if (strlen(currentlyPlaying.shortFirstArtistName) < 11) {
-    // only print track if its differnet to the old track
-    if (strcmp (old_track, currentlyPlaying.shortFirstArtistName) != 0) {
-      strncpy(old_artist, currentlyPlaying.shortFirstArtistName, sizeof(old_artist));
-      display.setCursor(0,HIGHT_SONG_AUTHOR);
-      printToDisplay(currentlyPlaying.shortFirstArtistName);
-    }
-  } else {
-    strncpy(old_artist, currentlyPlaying.shortFirstArtistName, sizeof(old_artist));
-    scrolltext_artist.moveOneFrame(currentlyPlaying.shortFirstArtistName);
-  }
-}
-
-void printAllInfo() {
-  if (!currentlyPlaying.error) {
-    if(currentlyPlaying.isPlaying) {
-      printTitleAndAuthor();
-      printSongProcess();
-    } else {
-      display.setCursor(0,1);
-      char error[] = "no song";
-      printToDisplay(error);
-    }
-  }
-  else {
-    display.clearDisplay();
-    display.setCursor(2,0);
-    char error[] = "Error";
-    printToDisplay(error);
-  }
-}
-
-short getAudioFeatureByIndex(short index) {
-  switch (index) {
-    case 0:
-      if (currentlyPlaying.trackPopularity <= 0) {
-        return 0;
-      }
-      return (short)((1.0f / (100.0f / currentlyPlaying.trackPopularity)) * MATRIX_WIDTH);
-    case 1:
-      if (audioFeatures.tempo <= MINIMUM_TEMPO_TO_VISUALIZE) {
-        return 0;
-      } else {
-      float percentage = 1.0f / ((MAXIMUM_TEMPO_TO_VISUALIZE - MINIMUM_TEMPO_TO_VISUALIZE) /
-                         (audioFeatures.tempo - MINIMUM_TEMPO_TO_VISUALIZE));
-      return (short)(percentage * MATRIX_WIDTH);
-      }
-    case 2:
-      return (short)(audioFeatures.danceability*MATRIX_WIDTH);
-    case 3:
-      return (short)(audioFeatures.energy*MATRIX_WIDTH);
-    case 4:
-      return (short)(audioFeatures.valence*MATRIX_WIDTH);
-    case 5:
-      return (short)(audioFeatures.speechiness*MATRIX_WIDTH);
-    case 6:
-      return (short)(audioFeatures.instrumentalness*MATRIX_WIDTH);
-    case 7:
-      return (short)(audioFeatures.acousticness*MATRIX_WIDTH);
-    case 8:
-      return (short)(audioFeatures.liveness*MATRIX_WIDTH);
-    default:
-      Serial.println("Error: Index out of bound.Audio feature is not defined");
-      return 0;
-  }
-}
-
-void updateAndPrintAudioFeatures() {
+void updateAudioFeatures() {
   if (currentlyPlaying.error) {
-    Serial.println("Error, no song currently played, so no audio features extracted");
+    LOG_INFO("no song currently played, no audio features");
   } else {
-    audioFeatures = spotify.getAudioFeatures(SPOTIFY_MARKET, currentlyPlaying.trackId);
-    for (short index = 0; index < NUMBER_FEATURES_TO_DRAW; index++) {
-      short bar_danceability = getAudioFeatureByIndex(index);
-      for(short wi = 0; wi < BAR_WIDTH; wi++) {
-        // line index is the start line + the index of the freature times BAR_WIDTH + the current round of painting one bar
-        short line_index = START_LINE_AUDIO_FEATURES + index * BAR_WIDTH + wi;
-        display.drawFastHLine(0, line_index, bar_danceability, BAR_FOREGROUND_COLOR);
-        display.drawFastHLine(bar_danceability, line_index,
-                              MATRIX_WIDTH - bar_danceability, BAR_BACKGROUND_COLOR);
-      }
+    if (spotify.getPackedAudioFeatures(audioFeatures, SPOTIFY_MARKET, currentlyPlaying.trackId)) {
+      audioFeaturesTrackKey = ListeningHistory::trackKey(currentlyPlaying.trackId);
     }
+    // once per track, redraws only use the lengths
+    computeFeatureBars(AudioFeaturesView(audioFeatures), currentlyPlaying.trackPopularity, FEATURES_TO_DRAW,
+                       NUMBER_FEATURES_TO_DRAW, MATRIX_WIDTH, featureBarLengths);
   }
 }
 
+// the library advances the progress and applies player commands right away
 void updateTime(){
-  if(currentlyPlaying.error){
-    return;
-  }
-  if (currentlyPlaying.isPlaying) {
-    currentlyPlaying.progressMs += CYCLIC_PRINT_MS;
+  currentlyPlaying = spotify.getLocalCurrentlyPlaying();
+  // the progress reached counts as listened, also when the poll after the end of the track is late
+  if (!currentlyPlaying.error && currentlyPlaying.progressMs > listeningProgressMs) {
+    listeningProgressMs = currentlyPlaying.progressMs;
   }
 }
 
@@ -558,35 +788,105 @@ void updateWhenSongIsOver() {
   if (currentlyPlaying.isPlaying) {
     if (currentlyPlaying.progressMs >= currentlyPlaying.duraitonMs) {
       updateSpotifyInfo();
-      updateAndPrintAudioFeatures();
+      updateAudioFeatures();
     }
   }
 }
 
-void updatePowerSupplyPower() {
-  if (currentlyPlaying.error) {
-    setPowerSupplyPower(false);
-  } else {
-    setPowerSupplyPower(true);
+// errors count as nothing playing, so a lost account does not keep the panel on.
+// In standby Spotify is polled less often, the poll that sees playback wakes the panel
+void updatePowerState() {
+  if (!power.update(!currentlyPlaying.error && currentlyPlaying.isPlaying)) {
+    return;
+  }
+  slowUpdateTask.periodMs = power.pollPeriodMs();
+  if (power.currentState() == power_active) {
+    // the frame buffer still holds what was drawn before the standby
+    pages.scheduler.redrawAll(playbackModel.theme.background);
+  }
+}
+
+// ramps towards the level of the time of day or the light sensor,
+// the timer takes the new alarm with its next period
+void updateBrightness() {
+  if (power.standby()) {
+    return;
+  }
+  #ifdef LIGHT_SENSOR_PIN
+    brightness.setInput(analogRead(LIGHT_SENSOR_PIN));
+  #else
+    time_t now = time(NULL);
+    if (now >= CLOCK_VALID_AFTER) {
+      struct tm local;
+      localtime_r(&now, &local);
+      brightness.setInput(local.tm_hour * 60 + local.tm_min);
+    }
+  #endif
+  if (!brightness.update()) {
+    return;
   }
+  const BrightnessLevel &level = brightness.output();
+  display.setBrightness(level.brightness);
+  display_draw_time = level.drawTimeUs;
+  timer_alarm = level.refreshUs;
+  timerAlarmWrite(timer, timer_alarm, true);
 }
 
 void slowUpdate() {
   updateSpotifyInfo();
-  // TODO(jh) currently unused, the system is turned on via power supply switch
-  // updatePowerSupplyPower();
-  //updateAndPrintAudioFeatures();
+  updatePowerState();
+  //updateAudioFeatures();
+}
+
+void updatePlaybackModel() {
+  playbackModel.error = currentlyPlaying.error;
+  playbackModel.playing = currentlyPlaying.isPlaying;
+  playbackModel.title = currentlyPlaying.shortTrackName;
+  playbackModel.artist = currentlyPlaying.shortFirstArtistName;
+  playbackModel.progressMs = currentlyPlaying.progressMs;
+  playbackModel.durationMs = currentlyPlaying.duraitonMs;
+  playbackModel.featuresValid = !currentlyPlaying.error && audioFeaturesTrackKey == listeningTrackKey;
+  playbackModel.albumArtValid = albumArtValid;
+  time_t now = time(NULL);
+  playbackModel.now = now >= CLOCK_VALID_AFTER ? now : 0;
+  playbackModel.message = wifi.connected() ? "Error" : "No WiFi";
+  // the line of the local progress, a seek or a skip moves it right away
+  const char *line = lyrics.lineAt(currentlyPlaying.progressMs);
+  const char *nextLine = lyrics.nextLine();
+  playbackModel.lyricsValid = line != NULL;
+  playbackModel.lyricLine = line != NULL ? line : "";
+  playbackModel.nextLyricLine = nextLine != NULL ? nextLine : "";
+  // the beat of the local progress as well, usually the cursor moves by one or not at all
+  BeatPhase beat;
+  playbackModel.beatsValid = beatsValid && strcmp(beatsTrackId, currentlyPlaying.trackId) == 0;
+  bool onBeat = playbackModel.beatsValid && beatCursor.at(currentlyPlaying.progressMs, beat);
+  playbackModel.beatPhase = onBeat ? beat.phase : 0;
+  playbackModel.beatLoudness = onBeat ? beat.loudness : 0;
 }
 
 void fastUpdate() {
   updateTime();
+  if (power.standby()) {
+    // nothing to show, the panel is off
+    return;
+  }
   updateWhenSongIsOver();
-  printAllInfo();
+  updatePlaybackModel();
+  pages.renderFrame(RENDER_BUDGET_US);
 }
 
 void loop() {
-  
-  EVERY_N_MILLISECONDS(10000) {slowUpdate();}
-  EVERY_N_MILLISECONDS(CYCLIC_PRINT_MS) {fastUpdate();}
+  // sends queued player commands (e.g. from buttons), nothing to do most of the time.
+  // Without WiFi they wait in the queue
+  if (wifi.connected()) {
+    spotify.processCommands();
+  }
+  // the real state shortly after a command
+  if (spotify.confirmationPollDue()) {
+    updateSpotifyInfo();
+    updatePowerState();
+  }
 
+  taskScheduler.runDue();
+  esp_task_wdt_reset();
 }
\ No newline at end of file
@@ -0,0 +1,177 @@
+// Implementation of the host Adafruit GFX stand-in, see arduino/Adafruit_GFX.h
+
+#include <Adafruit_GFX.h>
+
+Adafruit_GFX::Adafruit_GFX(int16_t w, int16_t h) : WIDTH(w), HEIGHT(h), _width(w), _height(h)
+{
+}
+
+void Adafruit_GFX::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color)
+{
+    for (int16_t i = 0; i < w; i++)
+    {
+        drawPixel(x + i, y, color);
+    }
+}
+
+void Adafruit_GFX::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color)
+{
+    for (int16_t i = 0; i < h; i++)
+    {
+        drawPixel(x, y + i, color);
+    }
+}
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+    for (int16_t i = 0; i < h; i++)
+    {
+        drawFastHLine(x, y + i, w, color);
+    }
+}
+
+void Adafruit_GFX::fillScreen(uint16_t color)
+{
+    fillRect(0, 0, _width, _height, color);
+}
+
+void Adafruit_GFX::drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+    drawFastHLine(x, y, w, color);
+    drawFastHLine(x, y + h - 1, w, color);
+    drawFastVLine(x, y, h, color);
+    drawFastVLine(x + w - 1, y, h, color);
+}
+
+// the midpoint circle of Adafruit_GFX::fillCircle, as vertical lines
+void Adafruit_GFX::fillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color)
+{
+    drawFastVLine(x0, y0 - r, 2 * r + 1, color);
+    int16_t f = 1 - r;
+    int16_t ddF_x = 1;
+    int16_t ddF_y = -2 * r;
+    int16_t x = 0;
+    int16_t y = r;
+    int16_t px = x;
+    int16_t py = y;
+    while (x < y)
+    {
+        if (f >= 0)
+        {
+            y--;
+            ddF_y += 2;
+            f += ddF_y;
+        }
+        x++;
+        ddF_x += 2;
+        f += ddF_x;
+        // no line is drawn twice
+        if (x < y + 1)
+        {
+            drawFastVLine(x0 + x, y0 - y, 2 * y + 1, color);
+            drawFastVLine(x0 - x, y0 - y, 2 * y + 1, color);
+        }
+        if (y != py)
+        {
+            drawFastVLine(x0 + py, y0 - px, 2 * px + 1, color);
+            drawFastVLine(x0 - py, y0 - px, 2 * px + 1, color);
+            py = y;
+        }
+        px = x;
+    }
+}
+
+void Adafruit_GFX::drawRGBBitmap(int16_t x, int16_t y, const uint16_t *bitmap, int16_t w, int16_t h)
+{
+    for (int16_t j = 0; j < h; j++)
+    {
+        for (int16_t i = 0; i < w; i++)
+        {
+            drawPixel(x + i, y + j, bitmap[j * w + i]);
+        }
+    }
+}
+
+void Adafruit_GFX::drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size)
+{
+    if ((x >= _width) || (y >= _height) || ((x + 6 * size - 1) < 0) || ((y + 8 * size - 1) < 0))
+    {
+        return;
+    }
+    for (int8_t i = 0; i < 5; i++)
+    {
+        // stand-in for pgm_read_byte(&font[c * 5 + i])
+        uint8_t line = (c == ' ') ? 0 : (uint8_t)((c * 0x9D) ^ (i * 0x3B)) & 0x7F;
+        for (int8_t j = 0; j < 8; j++, line >>= 1)
+        {
+            if (line & 1)
+            {
+                fillRect(x + i * size, y + j * size, size, size, color);
+            }
+            else if (bg != color)
+            {
+                fillRect(x + i * size, y + j * size, size, size, bg);
+            }
+        }
+    }
+    if (bg != color)
+    {
+        fillRect(x + 5 * size, y, size, 8 * size, bg);
+    }
+}
+
+size_t Adafruit_GFX::write(uint8_t c)
+{
+    if (c == '\n')
+    {
+        cursor_x = 0;
+        cursor_y += 8 * textsize;
+    }
+    else if (c != '\r')
+    {
+        if (wrap && (cursor_x + 6 * textsize > _width))
+        {
+            cursor_x = 0;
+            cursor_y += 8 * textsize;
+        }
+        drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize);
+        cursor_x += 6 * textsize;
+    }
+    return 1;
+}
+
+GFXcanvas16::GFXcanvas16(uint16_t w, uint16_t h) : Adafruit_GFX(w, h)
+{
+    buffer = (uint16_t *)calloc((size_t)w * h, sizeof(uint16_t));
+}
+
+GFXcanvas16::~GFXcanvas16()
+{
+    free(buffer);
+}
+
+void GFXcanvas16::drawPixel(int16_t x, int16_t y, uint16_t color)
+{
+    if (x < 0 || y < 0 || x >= _width || y >= _height)
+    {
+        return;
+    }
+    buffer[y * WIDTH + x] = color;
+}
+
+void GFXcanvas16::fillScreen(uint16_t color)
+{
+    for (int32_t i = 0; i < (int32_t)WIDTH * HEIGHT; i++)
+    {
+        buffer[i] = color;
+    }
+}
+
+uint16_t GFXcanvas16::getPixel(int16_t x, int16_t y) const
+{
+    if (x < 0 || y < 0 || x >= _width || y >= _height)
+    {
+        return 0;
+    }
+    return buffer[y * WIDTH + x];
+}
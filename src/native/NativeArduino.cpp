@@ -0,0 +1,186 @@
+// Implementation of the Arduino shim for the [env:native] host build.
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <thread>
+
+// Serial goes to stderr, so stdout stays free for program output
+HardwareSerial Serial;
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+static std::chrono::milliseconds clockAdvance(0);
+
+unsigned long millis()
+{
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime + clockAdvance).count();
+}
+
+unsigned long micros()
+{
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime + clockAdvance).count();
+}
+
+void advanceClock(unsigned long ms)
+{
+    clockAdvance += std::chrono::milliseconds(ms);
+}
+
+void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield()
+{
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return fwrite(&c, 1, 1, stderr);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    return fwrite(buffer, 1, size, stderr);
+}
+
+// ----------------Print----------------
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--)
+    {
+        if (write(*buffer++) == 0)
+        {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+size_t Print::print(long n, int base)
+{
+    char buf[24];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%ld", n);
+    return write(buf);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+    char buf[24];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", n);
+    return write(buf);
+}
+
+size_t Print::print(double n, int digits)
+{
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf);
+}
+
+// ----------------Stream----------------
+
+int Stream::timedRead()
+{
+    unsigned long start = millis();
+    do
+    {
+        int c = read();
+        if (c >= 0)
+        {
+            return c;
+        }
+        yield();
+    } while (millis() - start < _timeout);
+    return -1;
+}
+
+int Stream::timedPeek()
+{
+    unsigned long start = millis();
+    do
+    {
+        int c = peek();
+        if (c >= 0)
+        {
+            return c;
+        }
+        yield();
+    } while (millis() - start < _timeout);
+    return -1;
+}
+
+bool Stream::find(const char *target)
+{
+    size_t targetLength = strlen(target);
+    size_t matched = 0;
+    if (targetLength == 0)
+    {
+        return true;
+    }
+    int c;
+    while ((c = timedRead()) >= 0)
+    {
+        if (c == target[matched])
+        {
+            if (++matched == targetLength)
+            {
+                return true;
+            }
+        }
+        else
+        {
+            // Simple restart is enough for the header tokens we search for
+            matched = (c == target[0]) ? 1 : 0;
+        }
+    }
+    return false;
+}
+
+long Stream::parseInt()
+{
+    int c;
+    // skip everything that can not start a number
+    while ((c = timedPeek()) >= 0 && c != '-' && (c < '0' || c > '9'))
+    {
+        read();
+    }
+    if (c < 0)
+    {
+        return 0;
+    }
+
+    bool negative = false;
+    long value = 0;
+    if (c == '-')
+    {
+        negative = true;
+        read();
+    }
+    while ((c = timedPeek()) >= '0' && c <= '9')
+    {
+        value = value * 10 + (c - '0');
+        read();
+    }
+    return negative ? -value : value;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length)
+    {
+        int c = timedRead();
+        if (c < 0)
+        {
+            break;
+        }
+        *buffer++ = (char)c;
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,133 @@
+// Directory-backed implementation of the FS shim for the [env:native] build.
+
+#include <FS.h>
+
+#include <string.h>
+#include <sys/stat.h>
+
+// SPIFFS_OBJ_NAME_LEN of the ESP32 SPIFFS, with the terminating zero
+#define SPIFFS_NAME_LENGTH 32
+
+namespace fs
+{
+
+// ----------------File----------------
+
+size_t File::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t *buf, size_t size)
+{
+    return _file ? fwrite(buf, 1, size, _file.get()) : 0;
+}
+
+int File::available()
+{
+    return _file ? (int)(size() - position()) : 0;
+}
+
+int File::read()
+{
+    return _file ? fgetc(_file.get()) : -1;
+}
+
+int File::peek()
+{
+    if (!_file)
+    {
+        return -1;
+    }
+    int c = fgetc(_file.get());
+    if (c != EOF)
+    {
+        ungetc(c, _file.get());
+    }
+    return c;
+}
+
+void File::flush()
+{
+    if (_file)
+    {
+        fflush(_file.get());
+    }
+}
+
+size_t File::read(uint8_t *buf, size_t size)
+{
+    return _file ? fread(buf, 1, size, _file.get()) : 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+    return _file && fseek(_file.get(), pos, mode == SeekSet ? SEEK_SET : (mode == SeekCur ? SEEK_CUR : SEEK_END)) == 0;
+}
+
+size_t File::position() const
+{
+    return _file ? ftell(_file.get()) : 0;
+}
+
+size_t File::size() const
+{
+    if (!_file)
+    {
+        return 0;
+    }
+    struct stat info;
+    fflush(_file.get());
+    return fstat(fileno(_file.get()), &info) == 0 ? info.st_size : 0;
+}
+
+// ----------------FS----------------
+
+std::string FS::hostPath(const char *path)
+{
+    return _root + (path[0] == '/' ? "" : "/") + path;
+}
+
+bool FS::fits(const char *path)
+{
+    // a longer name fails on the device, so it must fail here too
+    return strlen(path) < SPIFFS_NAME_LENGTH;
+}
+
+File FS::open(const char *path, const char *mode, const bool create)
+{
+    if (!fits(path))
+    {
+        return File();
+    }
+    std::string file = hostPath(path);
+    if (mode[0] != 'r')
+    {
+        // SPIFFS has no directories, every prefix of a path just works
+        for (size_t slash = file.find('/', 1); slash != std::string::npos; slash = file.find('/', slash + 1))
+        {
+            mkdir(file.substr(0, slash).c_str(), 0755);
+        }
+    }
+    std::string hostMode = std::string(mode) + "b";
+    FILE *handle = fopen(file.c_str(), hostMode.c_str());
+    return handle == NULL ? File() : File(handle);
+}
+
+bool FS::exists(const char *path)
+{
+    struct stat info;
+    return fits(path) && stat(hostPath(path).c_str(), &info) == 0;
+}
+
+bool FS::remove(const char *path)
+{
+    return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char *pathFrom, const char *pathTo)
+{
+    return fits(pathTo) && ::rename(hostPath(pathFrom).c_str(), hostPath(pathTo).c_str()) == 0;
+}
+
+} // namespace fs
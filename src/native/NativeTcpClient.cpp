@@ -0,0 +1,203 @@
+#include "NativeTcpClient.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+NativeTcpClient::NativeTcpClient(const char *redirectHost, uint16_t redirectPort)
+{
+    this->redirectHost = redirectHost;
+    this->redirectPort = redirectPort;
+}
+
+NativeTcpClient::~NativeTcpClient()
+{
+    stop();
+}
+
+int NativeTcpClient::connect(IPAddress ip, uint16_t port)
+{
+    char host[16];
+    snprintf(host, sizeof(host), "%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
+    return connect(host, port);
+}
+
+int NativeTcpClient::connect(const char *host, uint16_t port)
+{
+    stop();
+    if (redirectHost != NULL)
+    {
+        host = redirectHost;
+        port = redirectPort;
+    }
+
+    char portText[6];
+    snprintf(portText, sizeof(portText), "%u", port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *addresses;
+    if (getaddrinfo(host, portText, &hints, &addresses) != 0)
+    {
+        return 0;
+    }
+
+    for (struct addrinfo *address = addresses; address != NULL; address = address->ai_next)
+    {
+        int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0)
+        {
+            continue;
+        }
+        if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0)
+        {
+            // requests are written in many small prints, like lwip we do not want to wait for acks
+            int noDelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            socketFd = fd;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(addresses);
+
+    if (socketFd < 0)
+    {
+        return 0;
+    }
+    connections++;
+    peerClosed = false;
+    bufferStart = bufferEnd = 0;
+    return 1;
+}
+
+void NativeTcpClient::attach(int fd)
+{
+    stop();
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    socketFd = fd;
+    connections++;
+    peerClosed = false;
+    bufferStart = bufferEnd = 0;
+}
+
+size_t NativeTcpClient::write(uint8_t b)
+{
+    return write(&b, 1);
+}
+
+size_t NativeTcpClient::write(const uint8_t *buf, size_t size)
+{
+    if (socketFd < 0)
+    {
+        return 0;
+    }
+    int flags = waitForWrites ? MSG_NOSIGNAL : MSG_NOSIGNAL | MSG_DONTWAIT;
+    size_t written = 0;
+    while (written < size)
+    {
+        ssize_t count = send(socketFd, buf + written, size - written, flags);
+        if (count <= 0)
+        {
+            break;
+        }
+        written += count;
+        if (!waitForWrites)
+        {
+            break;
+        }
+    }
+    return written;
+}
+
+size_t NativeTcpClient::fill()
+{
+    if (bufferStart == bufferEnd && socketFd >= 0 && !peerClosed)
+    {
+        ssize_t count = recv(socketFd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (count > 0)
+        {
+            bufferStart = 0;
+            bufferEnd = count;
+        }
+        else if (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            peerClosed = true;
+        }
+    }
+    return bufferEnd - bufferStart;
+}
+
+int NativeTcpClient::available()
+{
+    return (int)fill();
+}
+
+int NativeTcpClient::read()
+{
+    if (fill() == 0)
+    {
+        return -1;
+    }
+    return buffer[bufferStart++];
+}
+
+int NativeTcpClient::read(uint8_t *buf, size_t size)
+{
+    size_t count = fill();
+    if (count == 0)
+    {
+        return -1;
+    }
+    if (count > size)
+    {
+        count = size;
+    }
+    memcpy(buf, buffer + bufferStart, count);
+    bufferStart += count;
+    return (int)count;
+}
+
+int NativeTcpClient::peek()
+{
+    if (fill() == 0)
+    {
+        return -1;
+    }
+    return buffer[bufferStart];
+}
+
+void NativeTcpClient::flush()
+{
+    // writes are not buffered
+}
+
+void NativeTcpClient::stop()
+{
+    if (socketFd >= 0)
+    {
+        close(socketFd);
+        socketFd = -1;
+    }
+    bufferStart = bufferEnd = 0;
+}
+
+uint8_t NativeTcpClient::connected()
+{
+    // like WiFiClient: still connected while there is unread data
+    if (socketFd < 0)
+    {
+        return 0;
+    }
+    return fill() > 0 || !peerClosed;
+}
+
+NativeTcpClient::operator bool()
+{
+    return socketFd >= 0;
+}
@@ -0,0 +1,55 @@
+// Plain TCP Client for the native build, on top of POSIX sockets.
+//
+// With redirectHost set, every connect() goes to redirectHost:redirectPort
+// instead, so ArduinoSpotify talks to tools/spotify_stand_in.py while it still
+// sends the real Host headers.
+
+#ifndef NativeTcpClient_h
+#define NativeTcpClient_h
+
+#include <Arduino.h>
+#include <Client.h>
+
+class NativeTcpClient : public Client
+{
+public:
+  NativeTcpClient(const char *redirectHost = NULL, uint16_t redirectPort = 0);
+  ~NativeTcpClient();
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t size) override;
+  int peek() override;
+  void flush() override;
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override;
+  using Print::write;
+
+  // takes over a connected socket, e.g. one accepted by NativeTcpServer
+  void attach(int fd);
+
+  unsigned int connections = 0;
+  // false: write() sends only what the socket takes right away, like Esp32SocketClient
+  bool waitForWrites = true;
+  // the socket of the open connection, -1 if there is none (NativeTlsClient runs TLS on it)
+  int socketDescriptor() const { return socketFd; }
+
+private:
+  const char *redirectHost;
+  uint16_t redirectPort;
+  int socketFd = -1;
+  bool peerClosed = false;
+  uint8_t buffer[1460];
+  size_t bufferStart = 0;
+  size_t bufferEnd = 0;
+
+  // reads what the socket has without blocking, returns the buffered byte count
+  size_t fill();
+};
+
+#endif
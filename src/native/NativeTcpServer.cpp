@@ -0,0 +1,58 @@
+#include "NativeTcpServer.h"
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+NativeTcpServer::NativeTcpServer(uint16_t port)
+{
+    this->port = port;
+}
+
+NativeTcpServer::~NativeTcpServer()
+{
+    if (listenFd >= 0)
+    {
+        close(listenFd);
+    }
+}
+
+bool NativeTcpServer::begin()
+{
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0)
+    {
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(listenFd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listenFd, 4) != 0)
+    {
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+bool NativeTcpServer::accept(NativeTcpClient &client)
+{
+    if (listenFd < 0)
+    {
+        return false;
+    }
+    int fd = ::accept(listenFd, NULL, NULL);
+    if (fd < 0)
+    {
+        return false;
+    }
+    client.attach(fd);
+    return true;
+}
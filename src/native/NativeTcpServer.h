@@ -0,0 +1,25 @@
+// Listening TCP socket for the native build, the counterpart of WiFiServer.
+// accept() never blocks; a pending connection goes to a NativeTcpClient.
+
+#ifndef NativeTcpServer_h
+#define NativeTcpServer_h
+
+#include "NativeTcpClient.h"
+
+class NativeTcpServer
+{
+public:
+  explicit NativeTcpServer(uint16_t port);
+  ~NativeTcpServer();
+
+  // false if the port could not be bound
+  bool begin();
+  // true if a connection was waiting, it is handed to client
+  bool accept(NativeTcpClient &client);
+
+private:
+  uint16_t port;
+  int listenFd = -1;
+};
+
+#endif
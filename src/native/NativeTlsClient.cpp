@@ -0,0 +1,241 @@
+#include "NativeTlsClient.h"
+
+#include <openssl/err.h>
+#include <poll.h>
+
+NativeTlsClient::NativeTlsClient(const char *redirectHost, uint16_t redirectPort)
+    : tcp(redirectHost, redirectPort)
+{
+    context = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(context, SSL_VERIFY_PEER, NULL);
+}
+
+NativeTlsClient::~NativeTlsClient()
+{
+    stop();
+    SSL_SESSION_free(offered);
+    SSL_CTX_free(context);
+}
+
+bool NativeTlsClient::setCACertFile(const char *path)
+{
+    return SSL_CTX_load_verify_locations(context, path, NULL) == 1;
+}
+
+void NativeTlsClient::setServerName(const char *host)
+{
+    strncpy(serverName, host, sizeof(serverName) - 1);
+    serverName[sizeof(serverName) - 1] = '\0';
+}
+
+int NativeTlsClient::connect(IPAddress ip, uint16_t port)
+{
+    stop();
+    char address[16];
+    snprintf(address, sizeof(address), "%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
+    if (!tcp.connect(ip, port))
+    {
+        serverName[0] = '\0';
+        return 0;
+    }
+    // the name given with setServerName is used once
+    int connected = handshake(serverName[0] != '\0' ? serverName : address);
+    serverName[0] = '\0';
+    return connected;
+}
+
+int NativeTlsClient::connect(const char *host, uint16_t port)
+{
+    stop();
+    if (!tcp.connect(host, port))
+    {
+        return 0;
+    }
+    return handshake(host);
+}
+
+int NativeTlsClient::handshake(const char *host)
+{
+    unsigned long start = micros();
+    ssl = SSL_new(context);
+    SSL_set_fd(ssl, tcp.socketDescriptor());
+    // SNI and the name the certificate has to match, the real host also when redirected
+    SSL_set_tlsext_host_name(ssl, host);
+    SSL_set1_host(ssl, host);
+    if (offered != NULL)
+    {
+        SSL_set_session(ssl, offered);
+    }
+    if (SSL_connect(ssl) != 1)
+    {
+        Serial.print("TLS handshake failed: ");
+        Serial.println(ERR_error_string(ERR_get_error(), NULL));
+        stop();
+        return 0;
+    }
+    handshakes++;
+    handshakeMicros += micros() - start;
+    resumed = SSL_session_reused(ssl) == 1;
+    peerClosed = false;
+    bufferStart = bufferEnd = 0;
+    return 1;
+}
+
+void NativeTlsClient::setSession(const uint8_t *session, size_t length)
+{
+    SSL_SESSION_free(offered);
+    offered = NULL;
+    if (session != NULL && length > 0)
+    {
+        const unsigned char *der = session;
+        offered = d2i_SSL_SESSION(NULL, &der, (long)length);
+    }
+}
+
+size_t NativeTlsClient::getSession(uint8_t *session, size_t size)
+{
+    if (ssl == NULL)
+    {
+        return 0;
+    }
+    SSL_SESSION *current = SSL_get1_session(ssl);
+    if (current == NULL)
+    {
+        return 0;
+    }
+    size_t length = 0;
+    // with TLS 1.3 there is nothing to resume until a ticket came
+    if (SSL_SESSION_is_resumable(current))
+    {
+        int derLength = i2d_SSL_SESSION(current, NULL);
+        length = derLength > 0 ? derLength : 0;
+        if (length > 0 && length <= size)
+        {
+            unsigned char *der = session;
+            i2d_SSL_SESSION(current, &der);
+        }
+    }
+    SSL_SESSION_free(current);
+    return length;
+}
+
+bool NativeTlsClient::sessionResumed()
+{
+    return resumed;
+}
+
+size_t NativeTlsClient::write(uint8_t b)
+{
+    return write(&b, 1);
+}
+
+size_t NativeTlsClient::write(const uint8_t *buf, size_t size)
+{
+    if (ssl == NULL || size == 0)
+    {
+        return 0;
+    }
+    int count = SSL_write(ssl, buf, (int)size);
+    return count > 0 ? count : 0;
+}
+
+size_t NativeTlsClient::fill()
+{
+    if (bufferStart == bufferEnd && ssl != NULL && !peerClosed)
+    {
+        // only read when a record is buffered or bytes are waiting, so available() does not block
+        struct pollfd waiting = {tcp.socketDescriptor(), POLLIN, 0};
+        if (SSL_pending(ssl) == 0 && poll(&waiting, 1, 0) <= 0)
+        {
+            return 0;
+        }
+        int count = SSL_read(ssl, buffer, sizeof(buffer));
+        if (count > 0)
+        {
+            bufferStart = 0;
+            bufferEnd = count;
+        }
+        else
+        {
+            int error = SSL_get_error(ssl, count);
+            if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+            {
+                peerClosed = true;
+            }
+        }
+    }
+    return bufferEnd - bufferStart;
+}
+
+int NativeTlsClient::available()
+{
+    return (int)fill();
+}
+
+int NativeTlsClient::read()
+{
+    if (fill() == 0)
+    {
+        return -1;
+    }
+    return buffer[bufferStart++];
+}
+
+int NativeTlsClient::read(uint8_t *buf, size_t size)
+{
+    size_t count = fill();
+    if (count == 0)
+    {
+        return -1;
+    }
+    if (count > size)
+    {
+        count = size;
+    }
+    memcpy(buf, buffer + bufferStart, count);
+    bufferStart += count;
+    return (int)count;
+}
+
+int NativeTlsClient::peek()
+{
+    if (fill() == 0)
+    {
+        return -1;
+    }
+    return buffer[bufferStart];
+}
+
+void NativeTlsClient::flush()
+{
+    // SSL_write sends right away
+}
+
+void NativeTlsClient::stop()
+{
+    if (ssl != NULL)
+    {
+        if (!peerClosed)
+        {
+            SSL_shutdown(ssl);
+        }
+        SSL_free(ssl);
+        ssl = NULL;
+    }
+    tcp.stop();
+    bufferStart = bufferEnd = 0;
+}
+
+uint8_t NativeTlsClient::connected()
+{
+    if (ssl == NULL)
+    {
+        return 0;
+    }
+    return fill() > 0 || !peerClosed;
+}
+
+NativeTlsClient::operator bool()
+{
+    return ssl != NULL;
+}
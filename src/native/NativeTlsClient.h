@@ -0,0 +1,66 @@
+// TLS Client for the native build, OpenSSL on a NativeTcpClient connection.
+//
+// The server certificate is verified against a CA file and the host name, as
+// WiFiClientSecure does with setCACert. Sessions are handed out and resumed
+// as DER (i2d_SSL_SESSION), so ArduinoSpotify can keep them per host. With
+// redirectHost set every connection goes to the local stand-in, which has to
+// present a certificate for the real host name (tools/make_test_cert.sh).
+
+#ifndef NativeTlsClient_h
+#define NativeTlsClient_h
+
+#include <Arduino.h>
+#include <SpotifyTlsClient.h>
+
+#include <openssl/ssl.h>
+
+#include "NativeTcpClient.h"
+
+class NativeTlsClient : public SpotifyTlsClient
+{
+public:
+  NativeTlsClient(const char *redirectHost = NULL, uint16_t redirectPort = 0);
+  ~NativeTlsClient();
+
+  // false if the file has no certificate
+  bool setCACertFile(const char *path);
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t size) override;
+  int peek() override;
+  void flush() override;
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override;
+  using Print::write;
+
+  void setServerName(const char *host) override;
+  void setSession(const uint8_t *session, size_t length) override;
+  size_t getSession(uint8_t *session, size_t size) override;
+  bool sessionResumed() override;
+
+  unsigned int handshakes = 0;
+  unsigned long handshakeMicros = 0;
+
+private:
+  NativeTcpClient tcp;
+  SSL_CTX *context;
+  SSL *ssl = NULL;
+  SSL_SESSION *offered = NULL;
+  char serverName[64] = "";
+  bool resumed = false;
+  bool peerClosed = false;
+  uint8_t buffer[4096];
+  size_t bufferStart = 0;
+  size_t bufferEnd = 0;
+
+  size_t fill();
+  int handshake(const char *host);
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "PngWriter.h"
+
+#include <vector>
+
+static uint32_t crc32(const uint8_t *data, size_t length, uint32_t crc = 0)
+{
+    static uint32_t table[256];
+    if (table[1] == 0)
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+    }
+    crc = ~crc;
+    while (length--)
+    {
+        crc = table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void putBigEndian(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+static void putChunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data)
+{
+    putBigEndian(out, data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putBigEndian(out, crc32(&out[start], out.size() - start));
+}
+
+bool writePng(const char *path, const GFXcanvas16 &canvas, uint8_t scale)
+{
+    const uint32_t width = canvas.width() * scale;
+    const uint32_t height = canvas.height() * scale;
+
+    // filter byte 0 and RGB for every row
+    std::vector<uint8_t> raw;
+    raw.reserve(height * (1 + width * 3));
+    for (uint32_t y = 0; y < height; y++)
+    {
+        raw.push_back(0);
+        for (uint32_t x = 0; x < width; x++)
+        {
+            uint16_t color = canvas.getPixel(x / scale, y / scale);
+            raw.push_back(((color >> 11) & 0x1F) * 255 / 31);
+            raw.push_back(((color >> 5) & 0x3F) * 255 / 63);
+            raw.push_back((color & 0x1F) * 255 / 31);
+        }
+    }
+
+    // zlib stream of stored blocks
+    std::vector<uint8_t> zlib;
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    for (size_t offset = 0; offset < raw.size(); offset += 65535)
+    {
+        size_t length = raw.size() - offset < 65535 ? raw.size() - offset : 65535;
+        zlib.push_back(offset + length == raw.size() ? 1 : 0);
+        zlib.push_back(length & 0xFF);
+        zlib.push_back(length >> 8);
+        zlib.push_back(~length & 0xFF);
+        zlib.push_back((~length >> 8) & 0xFF);
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+    }
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t i = 0; i < raw.size(); i++)
+    {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBigEndian(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::vector<uint8_t> header;
+    putBigEndian(header, width);
+    putBigEndian(header, height);
+    // 8 bit RGB, deflate, no interlace
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+    putChunk(png, "IHDR", header);
+    putChunk(png, "IDAT", zlib);
+    putChunk(png, "IEND", std::vector<uint8_t>());
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    bool written = fwrite(png.data(), 1, png.size(), file) == png.size();
+    return fclose(file) == 0 && written;
+}
@@ -0,0 +1,12 @@
+// Writes a GFXcanvas16 as PNG, uncompressed (stored deflate blocks), so the
+// native build needs no zlib. Used for snapshots of the display pages.
+
+#ifndef PngWriter_h
+#define PngWriter_h
+
+#include <Adafruit_GFX.h>
+
+// every pixel becomes a scale x scale block, 64x64 pixels are hard to see otherwise
+bool writePng(const char *path, const GFXcanvas16 &canvas, uint8_t scale = 4);
+
+#endif
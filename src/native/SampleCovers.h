@@ -0,0 +1,386 @@
+// Baseline JPEGs with four solid quadrants for the --album-art check of main_native.cpp:
+// top left (230, 40, 40), top right (40, 200, 60), bottom left (50, 70, 220), bottom right
+// (240, 240, 240). Written with Pillow (standard huffman tables).
+
+#ifndef SampleCovers_h
+#define SampleCovers_h
+
+#include <stdint.h>
+
+// 64x64, YCbCr 4:2:0, quality 90
+static const uint8_t sampleCover64[] = {
+    0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x01, 0x00, 0x00, 0xff, 0xdb, 0x00, 0x43, 0x00, 0x03, 0x02, 0x02, 0x03, 0x02, 0x02, 0x03,
+    0x03, 0x03, 0x03, 0x04, 0x03, 0x03, 0x04, 0x05, 0x08, 0x05, 0x05, 0x04, 0x04, 0x05, 0x0a, 0x07,
+    0x07, 0x06, 0x08, 0x0c, 0x0a, 0x0c, 0x0c, 0x0b, 0x0a, 0x0b, 0x0b, 0x0d, 0x0e, 0x12, 0x10, 0x0d,
+    0x0e, 0x11, 0x0e, 0x0b, 0x0b, 0x10, 0x16, 0x10, 0x11, 0x13, 0x14, 0x15, 0x15, 0x15, 0x0c, 0x0f,
+    0x17, 0x18, 0x16, 0x14, 0x18, 0x12, 0x14, 0x15, 0x14, 0xff, 0xdb, 0x00, 0x43, 0x01, 0x03, 0x04,
+    0x04, 0x05, 0x04, 0x05, 0x09, 0x05, 0x05, 0x09, 0x14, 0x0d, 0x0b, 0x0d, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0xff, 0xc0,
+    0x00, 0x11, 0x08, 0x00, 0x40, 0x00, 0x40, 0x03, 0x01, 0x22, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11,
+    0x01, 0xff, 0xc4, 0x00, 0x1f, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+    0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x10, 0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03, 0x05,
+    0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21,
+    0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23,
+    0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17,
+    0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a,
+    0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a,
+    0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
+    0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
+    0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5,
+    0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1,
+    0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xc4, 0x00, 0x1f, 0x01, 0x00, 0x03,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x11, 0x00,
+    0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04, 0x07, 0x05, 0x04, 0x04, 0x00, 0x01, 0x02, 0x77, 0x00,
+    0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13,
+    0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15,
+    0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27,
+    0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88,
+    0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6,
+    0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4,
+    0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9,
+    0xfa, 0xff, 0xda, 0x00, 0x0c, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3f, 0x00, 0xf2,
+    0xca, 0x28, 0xa2, 0xbf, 0x2a, 0x3f, 0xbf, 0x42, 0x8a, 0x28, 0xa0, 0x0f, 0x68, 0xa2, 0x8a, 0x2b,
+    0xc1, 0x3f, 0xc4, 0xa0, 0xa2, 0x8a, 0x28, 0x03, 0xc5, 0xe8, 0xa2, 0x8a, 0xf7, 0x8f, 0xf6, 0xd4,
+    0x28, 0xa2, 0x8a, 0x00, 0xf6, 0x8a, 0x28, 0xa2, 0xbc, 0x13, 0xfc, 0x4a, 0x0a, 0x28, 0xa2, 0x80,
+    0x3e, 0x6d, 0xa2, 0x8a, 0x2b, 0xfd, 0x43, 0x3f, 0x7d, 0x0a, 0x28, 0xa2, 0x80, 0x3f, 0x6a, 0x28,
+    0xa2, 0x8a, 0xfe, 0x2f, 0x3e, 0xec, 0x28, 0xa2, 0x8a, 0x00, 0xfc, 0x57, 0xa2, 0x8a, 0x2b, 0xfb,
+    0x40, 0xf8, 0x40, 0xa2, 0x8a, 0x28, 0x03, 0xf6, 0xa2, 0x8a, 0x28, 0xaf, 0xe2, 0xf3, 0xee, 0xc2,
+    0x8a, 0x28, 0xa0, 0x0f, 0xff, 0xd9,
+};
+
+// 128x128, YCbCr 4:4:4, quality 90, a restart marker every 5 MCUs
+static const uint8_t sampleCover128[] = {
+    0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x01, 0x00, 0x00, 0xff, 0xdb, 0x00, 0x43, 0x00, 0x03, 0x02, 0x02, 0x03, 0x02, 0x02, 0x03,
+    0x03, 0x03, 0x03, 0x04, 0x03, 0x03, 0x04, 0x05, 0x08, 0x05, 0x05, 0x04, 0x04, 0x05, 0x0a, 0x07,
+    0x07, 0x06, 0x08, 0x0c, 0x0a, 0x0c, 0x0c, 0x0b, 0x0a, 0x0b, 0x0b, 0x0d, 0x0e, 0x12, 0x10, 0x0d,
+    0x0e, 0x11, 0x0e, 0x0b, 0x0b, 0x10, 0x16, 0x10, 0x11, 0x13, 0x14, 0x15, 0x15, 0x15, 0x0c, 0x0f,
+    0x17, 0x18, 0x16, 0x14, 0x18, 0x12, 0x14, 0x15, 0x14, 0xff, 0xdb, 0x00, 0x43, 0x01, 0x03, 0x04,
+    0x04, 0x05, 0x04, 0x05, 0x09, 0x05, 0x05, 0x09, 0x14, 0x0d, 0x0b, 0x0d, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0xff, 0xc0,
+    0x00, 0x11, 0x08, 0x00, 0x80, 0x00, 0x80, 0x03, 0x01, 0x11, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11,
+    0x01, 0xff, 0xc4, 0x00, 0x1f, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+    0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x10, 0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03, 0x05,
+    0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21,
+    0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23,
+    0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17,
+    0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a,
+    0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a,
+    0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
+    0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
+    0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5,
+    0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1,
+    0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xc4, 0x00, 0x1f, 0x01, 0x00, 0x03,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x11, 0x00,
+    0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04, 0x07, 0x05, 0x04, 0x04, 0x00, 0x01, 0x02, 0x77, 0x00,
+    0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13,
+    0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15,
+    0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27,
+    0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88,
+    0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6,
+    0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4,
+    0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9,
+    0xfa, 0xff, 0xdd, 0x00, 0x04, 0x00, 0x05, 0xff, 0xda, 0x00, 0x0c, 0x03, 0x01, 0x00, 0x02, 0x11,
+    0x03, 0x11, 0x00, 0x3f, 0x00, 0xf2, 0xca, 0xfc, 0xa8, 0xfe, 0xfd, 0x0a, 0x00, 0x28, 0x00, 0xa0,
+    0x02, 0x80, 0x3f, 0xff, 0xd0, 0xf2, 0xca, 0xfc, 0xa8, 0xfe, 0xfd, 0x0a, 0x00, 0x28, 0x03, 0xda,
+    0x2b, 0xc1, 0x3f, 0xc4, 0xa0, 0xa0, 0x0f, 0xff, 0xd1, 0xd5, 0xaf, 0xc3, 0x0f, 0xe4, 0x70, 0xa0,
+    0x02, 0x80, 0x0a, 0x00, 0x28, 0x03, 0xff, 0xd2, 0xd5, 0xaf, 0xc3, 0x0f, 0xe4, 0x73, 0xc5, 0xeb,
+    0xde, 0x3f, 0xdb, 0x50, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0xff, 0xd3, 0xf2, 0xca, 0xfc, 0xa8, 0xfe,
+    0xfd, 0x0a, 0x00, 0x28, 0x00, 0xa0, 0x0f, 0x68, 0xaf, 0x04, 0xff, 0x00, 0x12, 0x8f, 0xff, 0xd4,
+    0xd5, 0xaf, 0xc3, 0x0f, 0xe4, 0x70, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0x28, 0x03, 0xff, 0xd5, 0xd5,
+    0xaf, 0xc3, 0x0f, 0xe4, 0x70, 0xa0, 0x0f, 0x17, 0xaf, 0x78, 0xff, 0x00, 0x6d, 0x42, 0x80, 0x0a,
+    0x00, 0xff, 0xd6, 0xf2, 0xca, 0xfc, 0xa8, 0xfe, 0xfd, 0x0a, 0x00, 0x28, 0x00, 0xa0, 0x02, 0x80,
+    0x3f, 0xff, 0xd7, 0xd5, 0xaf, 0xc3, 0x0f, 0xe4, 0x70, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0x28, 0x03,
+    0xff, 0xd0, 0xd5, 0xaf, 0xc3, 0x0f, 0xe4, 0x70, 0xa0, 0x02, 0x80, 0x3c, 0x5e, 0xbd, 0xe3, 0xfd,
+    0xb5, 0x0a, 0x00, 0xff, 0xd1, 0xf2, 0xca, 0xfc, 0xa8, 0xfe, 0xfd, 0x0a, 0x00, 0x28, 0x00, 0xa0,
+    0x02, 0x80, 0x3f, 0xff, 0xd2, 0xf2, 0xca, 0xfc, 0xa8, 0xfe, 0xfd, 0x3d, 0xa2, 0xbc, 0x13, 0xfc,
+    0x4a, 0x0a, 0x00, 0x28, 0x00, 0xa0, 0x0f, 0xff, 0xd3, 0xd5, 0xaf, 0xc3, 0x0f, 0xe4, 0x70, 0xa0,
+    0x02, 0x80, 0x0a, 0x00, 0xf1, 0x7a, 0xf7, 0x8f, 0xf6, 0xd4, 0xff, 0xd4, 0xf2, 0xca, 0xfc, 0xa8,
+    0xfe, 0xfd, 0x0a, 0x00, 0x28, 0x00, 0xa0, 0x02, 0x80, 0x3f, 0xff, 0xd5, 0xf2, 0xca, 0xfc, 0xa8,
+    0xfe, 0xfd, 0x0a, 0x00, 0xf6, 0x8a, 0xf0, 0x4f, 0xf1, 0x28, 0x28, 0x00, 0xa0, 0x0f, 0xff, 0xd6,
+    0xd5, 0xaf, 0xc3, 0x0f, 0xe4, 0x70, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0x28, 0x03, 0xff, 0xd7, 0xf2,
+    0xca, 0xfc, 0xa8, 0xfe, 0xfd, 0x0a, 0x00, 0x28, 0x00, 0xa0, 0x02, 0x80, 0x3f, 0xff, 0xd0, 0xf2,
+    0xca, 0xfc, 0xa8, 0xfe, 0xfd, 0x0a, 0x00, 0x28, 0x03, 0xda, 0x2b, 0xc1, 0x3f, 0xc4, 0xa0, 0xa0,
+    0x0f, 0xff, 0xd1, 0xd5, 0xaf, 0xc3, 0x0f, 0xe4, 0x70, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0x28, 0x03,
+    0xff, 0xd2, 0xd5, 0xaf, 0xc3, 0x0f, 0xe4, 0x73, 0xc5, 0xeb, 0xde, 0x3f, 0xdb, 0x50, 0xa0, 0x02,
+    0x80, 0x0a, 0x00, 0xff, 0xd3, 0xf2, 0xca, 0xfc, 0xa8, 0xfe, 0xfd, 0x0a, 0x00, 0x28, 0x00, 0xa0,
+    0x0f, 0x68, 0xaf, 0x04, 0xff, 0x00, 0x12, 0x8f, 0xff, 0xd4, 0xd5, 0xaf, 0xc3, 0x0f, 0xe4, 0x70,
+    0xa0, 0x02, 0x80, 0x0a, 0x00, 0x28, 0x03, 0xff, 0xd5, 0xd5, 0xaf, 0xc3, 0x0f, 0xe4, 0x70, 0xa0,
+    0x0f, 0x17, 0xaf, 0x78, 0xff, 0x00, 0x6d, 0x42, 0x80, 0x0a, 0x00, 0xff, 0xd6, 0xf2, 0xca, 0xfc,
+    0xa8, 0xfe, 0xfd, 0x0a, 0x00, 0x28, 0x00, 0xa0, 0x02, 0x80, 0x3f, 0xff, 0xd7, 0xd5, 0xaf, 0xc3,
+    0x0f, 0xe4, 0x70, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0x28, 0x03, 0xff, 0xd0, 0xd5, 0xaf, 0xc3, 0x0f,
+    0xe4, 0x70, 0xa0, 0x02, 0x80, 0x3e, 0x6d, 0xaf, 0xf5, 0x0c, 0xfd, 0xf4, 0x28, 0x03, 0xff, 0xd1,
+    0xf0, 0x2a, 0xfe, 0xd0, 0x3e, 0x10, 0x28, 0x00, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0xff, 0xd2, 0xf0,
+    0x2a, 0xfe, 0xd0, 0x3e, 0x10, 0xfd, 0xa8, 0xaf, 0xe2, 0xf3, 0xee, 0xc2, 0x80, 0x0a, 0x00, 0x28,
+    0x03, 0xff, 0xd3, 0xfd, 0x2b, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0x28, 0x03, 0xf1, 0x5e, 0xbf, 0xb4,
+    0x0f, 0x84, 0x3f, 0xff, 0xd4, 0xf0, 0x2a, 0xfe, 0xd0, 0x3e, 0x10, 0x28, 0x00, 0xa0, 0x02, 0x80,
+    0x0a, 0x00, 0xff, 0xd5, 0xf0, 0x2a, 0xfe, 0xd0, 0x3e, 0x10, 0x28, 0x03, 0xf6, 0xa2, 0xbf, 0x8b,
+    0xcf, 0xbb, 0x0a, 0x00, 0x28, 0x03, 0xff, 0xd6, 0xfd, 0x2b, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0x28,
+    0x00, 0xa0, 0x0f, 0xff, 0xd7, 0xf0, 0x2a, 0xfe, 0xd0, 0x3e, 0x10, 0x28, 0x00, 0xa0, 0x02, 0x80,
+    0x0a, 0x00, 0xff, 0xd0, 0xf0, 0x2a, 0xfe, 0xd0, 0x3e, 0x10, 0x28, 0x00, 0xa0, 0x0f, 0xda, 0x8a,
+    0xfe, 0x2f, 0x3e, 0xec, 0x28, 0x03, 0xff, 0xd1, 0xfd, 0x2b, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0x28,
+    0x00, 0xa0, 0x0f, 0xff, 0xd2, 0xfd, 0x2b, 0xa0, 0x0f, 0xc5, 0x7a, 0xfe, 0xd0, 0x3e, 0x10, 0x28,
+    0x00, 0xa0, 0x02, 0x80, 0x3f, 0xff, 0xd3, 0xf0, 0x2a, 0xfe, 0xd0, 0x3e, 0x10, 0x28, 0x00, 0xa0,
+    0x02, 0x80, 0x3f, 0x6a, 0x2b, 0xf8, 0xbc, 0xfb, 0xb3, 0xff, 0xd4, 0xfd, 0x2b, 0xa0, 0x02, 0x80,
+    0x0a, 0x00, 0x28, 0x00, 0xa0, 0x0f, 0xff, 0xd5, 0xfd, 0x2b, 0xa0, 0x02, 0x80, 0x3f, 0x15, 0xeb,
+    0xfb, 0x40, 0xf8, 0x40, 0xa0, 0x02, 0x80, 0x3f, 0xff, 0xd6, 0xf0, 0x2a, 0xfe, 0xd0, 0x3e, 0x10,
+    0x28, 0x00, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0xff, 0xd7, 0xfd, 0x2b, 0xa0, 0x02, 0x80, 0x0a, 0x00,
+    0x28, 0x00, 0xa0, 0x0f, 0xff, 0xd0, 0xfd, 0x2b, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0xfc, 0x57, 0xaf,
+    0xed, 0x03, 0xe1, 0x02, 0x80, 0x3f, 0xff, 0xd1, 0xf0, 0x2a, 0xfe, 0xd0, 0x3e, 0x10, 0x28, 0x00,
+    0xa0, 0x02, 0x80, 0x0a, 0x00, 0xff, 0xd2, 0xf0, 0x2a, 0xfe, 0xd0, 0x3e, 0x10, 0xfd, 0xa8, 0xaf,
+    0xe2, 0xf3, 0xee, 0xc2, 0x80, 0x0a, 0x00, 0x28, 0x03, 0xff, 0xd3, 0xfd, 0x2b, 0xa0, 0x02, 0x80,
+    0x0a, 0x00, 0x28, 0x03, 0xf1, 0x5e, 0xbf, 0xb4, 0x0f, 0x84, 0x3f, 0xff, 0xd4, 0xf0, 0x2a, 0xfe,
+    0xd0, 0x3e, 0x10, 0x28, 0x00, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0xff, 0xd5, 0xf0, 0x2a, 0xfe, 0xd0,
+    0x3e, 0x10, 0x28, 0x03, 0xf6, 0xa2, 0xbf, 0x8b, 0xcf, 0xbb, 0x0a, 0x00, 0x28, 0x03, 0xff, 0xd6,
+    0xfd, 0x2b, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0x28, 0x00, 0xa0, 0x0f, 0xff, 0xd7, 0xf0, 0x2a, 0xfe,
+    0xd0, 0x3e, 0x10, 0x28, 0x00, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0xff, 0xd0, 0xf0, 0x2a, 0xfe, 0xd0,
+    0x3e, 0x10, 0x28, 0x00, 0xa0, 0x0f, 0xda, 0x8a, 0xfe, 0x2f, 0x3e, 0xec, 0x28, 0x03, 0xff, 0xd1,
+    0xfd, 0x2b, 0xa0, 0x02, 0x80, 0x0a, 0x00, 0x28, 0x00, 0xa0, 0x0f, 0xff, 0xd2, 0xfd, 0x2b, 0xa0,
+    0x0f, 0xff, 0xd9,
+};
+
+// 512x512, grayscale, quality 75 (only the block averages are decoded)
+static const uint8_t sampleCover512[] = {
+    0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x01, 0x00, 0x00, 0xff, 0xdb, 0x00, 0x43, 0x00, 0x08, 0x06, 0x06, 0x07, 0x06, 0x05, 0x08,
+    0x07, 0x07, 0x07, 0x09, 0x09, 0x08, 0x0a, 0x0c, 0x14, 0x0d, 0x0c, 0x0b, 0x0b, 0x0c, 0x19, 0x12,
+    0x13, 0x0f, 0x14, 0x1d, 0x1a, 0x1f, 0x1e, 0x1d, 0x1a, 0x1c, 0x1c, 0x20, 0x24, 0x2e, 0x27, 0x20,
+    0x22, 0x2c, 0x23, 0x1c, 0x1c, 0x28, 0x37, 0x29, 0x2c, 0x30, 0x31, 0x34, 0x34, 0x34, 0x1f, 0x27,
+    0x39, 0x3d, 0x38, 0x32, 0x3c, 0x2e, 0x33, 0x34, 0x32, 0xff, 0xc0, 0x00, 0x0b, 0x08, 0x02, 0x00,
+    0x02, 0x00, 0x01, 0x01, 0x11, 0x00, 0xff, 0xc4, 0x00, 0x1f, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04,
+    0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x10, 0x00, 0x02, 0x01, 0x03,
+    0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00,
+    0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32,
+    0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35,
+    0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55,
+    0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75,
+    0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94,
+    0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2,
+    0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9,
+    0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6,
+    0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xda,
+    0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3f, 0x00, 0xc0, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b,
+    0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b,
+    0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b,
+    0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b,
+    0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x98, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xa7,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0x88, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b,
+    0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe,
+    0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9,
+    0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b,
+    0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe,
+    0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9,
+    0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa, 0x28, 0xa2, 0x8a,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0xbe, 0x60, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2,
+    0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x2b, 0xe9, 0xfa,
+    0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28,
+    0xa2, 0x8a, 0x28, 0xa2, 0x8a, 0x28, 0xa2, 0xbf, 0xff, 0xd9,
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include "SimulatedWifiDriver.h"
+
+SimulatedWifiDriver::SimulatedWifiDriver(const uint8_t *bssid, int32_t channel, const WifiAddress &lease)
+    : apChannel(channel), lease(lease)
+{
+    memcpy(apBssid, bssid, sizeof(apBssid));
+    memset(&current, 0, sizeof(current));
+}
+
+void SimulatedWifiDriver::begin(const char *ssid, const char *password, const uint8_t *bssid, int32_t channel,
+                                const WifiAddress *address)
+{
+    uint32_t duration = associateMs;
+    attemptFails = false;
+    withDhcp = address == NULL;
+    if (bssid == NULL)
+    {
+        scans++;
+        duration += scanMs;
+    }
+    else if (memcmp(bssid, apBssid, sizeof(apBssid)) != 0 || channel != apChannel)
+    {
+        // nobody answers on the cached channel
+        attemptFails = true;
+    }
+    if (address == NULL)
+    {
+        dhcpRequests++;
+        duration += dhcpMs;
+        current = lease;
+    }
+    else
+    {
+        // an address the DHCP server gave away is a conflict, counted as a failure
+        attemptFails = attemptFails || address->ip != lease.ip;
+        current = *address;
+    }
+    attempting = true;
+    up = false;
+    failed = false;
+    readyAt = millis() + duration;
+}
+
+void SimulatedWifiDriver::disconnect()
+{
+    attempting = false;
+    up = false;
+    failed = false;
+}
+
+WifiLinkStatus SimulatedWifiDriver::status()
+{
+    if (attempting && (long)(millis() - readyAt) >= 0)
+    {
+        attempting = false;
+        up = apOn && !attemptFails;
+        failed = !up;
+    }
+    if (up)
+    {
+        return wifi_link_up;
+    }
+    if (failed)
+    {
+        return wifi_link_failed;
+    }
+    return attempting ? wifi_link_connecting : wifi_link_down;
+}
+
+void SimulatedWifiDriver::bssid(uint8_t *bssidOut)
+{
+    memcpy(bssidOut, apBssid, sizeof(apBssid));
+}
+
+int32_t SimulatedWifiDriver::channel()
+{
+    return apChannel;
+}
+
+WifiAddress SimulatedWifiDriver::address()
+{
+    return current;
+}
+
+uint32_t SimulatedWifiDriver::leaseSeconds()
+{
+    return withDhcp ? dhcpLeaseSeconds : 0;
+}
+
+void SimulatedWifiDriver::setAccessPoint(bool on)
+{
+    apOn = on;
+    if (!on)
+    {
+        up = false;
+    }
+}
+
+void SimulatedWifiDriver::moveAccessPoint(int32_t channel)
+{
+    apChannel = channel;
+    up = false;
+}
+
+void SimulatedWifiDriver::changeLease(uint32_t ip)
+{
+    lease.ip = ip;
+}
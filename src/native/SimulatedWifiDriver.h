@@ -0,0 +1,53 @@
+// WifiDriver of the native build: one access point that can go away, change
+// its channel or hand out another address, with the usual times for a scan,
+// the association and DHCP. Time is millis(), which advanceClock() moves on.
+
+#ifndef SimulatedWifiDriver_h
+#define SimulatedWifiDriver_h
+
+#include <Arduino.h>
+#include <WifiConnection.h>
+
+class SimulatedWifiDriver : public WifiDriver
+{
+public:
+  SimulatedWifiDriver(const uint8_t *bssid, int32_t channel, const WifiAddress &lease);
+
+  void begin(const char *ssid, const char *password, const uint8_t *bssid, int32_t channel,
+             const WifiAddress *address) override;
+  void disconnect() override;
+  WifiLinkStatus status() override;
+  void bssid(uint8_t *bssidOut) override;
+  int32_t channel() override;
+  WifiAddress address() override;
+  uint32_t leaseSeconds() override;
+
+  // the link drops right away and no attempt succeeds while the AP is off
+  void setAccessPoint(bool on);
+  void moveAccessPoint(int32_t channel);
+  // the DHCP server gives the address to someone else
+  void changeLease(uint32_t ip);
+
+  uint32_t scanMs = 2200;
+  uint32_t associateMs = 350;
+  uint32_t dhcpMs = 1300;
+  // the lease the DHCP server hands out
+  uint32_t dhcpLeaseSeconds = 86400;
+  unsigned long scans = 0;
+  unsigned long dhcpRequests = 0;
+
+private:
+  uint8_t apBssid[6];
+  int32_t apChannel;
+  bool apOn = true;
+  WifiAddress lease;
+  WifiAddress current;
+  bool withDhcp = false;
+  bool attempting = false;
+  bool attemptFails = false;
+  bool up = false;
+  bool failed = false;
+  unsigned long readyAt = 0;
+};
+
+#endif
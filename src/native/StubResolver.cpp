@@ -0,0 +1,61 @@
+#include "StubResolver.h"
+
+StubResolver::StubResolver(IPAddress address, uint32_t ttlSeconds, unsigned long latencyMs)
+    : address(address), ttlSeconds(ttlSeconds), latencyMs(latencyMs)
+{
+}
+
+static size_t putRecordHeader(uint8_t *message, size_t position, uint16_t namePointer, uint16_t type, uint32_t ttl,
+                              uint16_t dataLength)
+{
+    const uint8_t header[12] = {(uint8_t)(0xC0 | namePointer >> 8), (uint8_t)namePointer, 0, (uint8_t)type, 0, 1,
+                                (uint8_t)(ttl >> 24), (uint8_t)(ttl >> 16), (uint8_t)(ttl >> 8), (uint8_t)ttl,
+                                (uint8_t)(dataLength >> 8), (uint8_t)dataLength};
+    memcpy(message + position, header, sizeof(header));
+    return position + sizeof(header);
+}
+
+size_t StubResolver::answer(uint8_t *message, size_t queryLength)
+{
+    // response, recursion available; the question stays as it is
+    message[2] = 0x81;
+    message[3] = failNext > 0 ? 0x83 : 0x80;
+    if (failNext > 0)
+    {
+        failNext--;
+        return queryLength;
+    }
+    message[7] = 2;
+
+    // host CNAME edge.stub.invalid (the name of the question is at 12)
+    static const uint8_t edge[] = {4, 'e', 'd', 'g', 'e', 4, 's', 't', 'u', 'b', 7, 'i', 'n', 'v', 'a', 'l', 'i', 'd', 0};
+    size_t position = putRecordHeader(message, queryLength, 12, 5, ttlSeconds * 2, sizeof(edge));
+    size_t edgeName = position;
+    memcpy(message + position, edge, sizeof(edge));
+    position += sizeof(edge);
+
+    position = putRecordHeader(message, position, edgeName, 1, ttlSeconds, 4);
+    for (int i = 0; i < 4; i++)
+    {
+        message[position++] = address[i];
+    }
+    return position;
+}
+
+bool StubResolver::resolve(const char *host, IPAddress &resolved, uint32_t &ttl)
+{
+    queries++;
+    if (latencyMs > 0)
+    {
+        delay(latencyMs);
+    }
+    uint8_t message[SPOTIFY_DNS_MESSAGE_SIZE];
+    uint16_t id = nextId++;
+    size_t queryLength = buildDnsQuery(message, sizeof(message), id, host);
+    if (queryLength == 0 || queryLength + 64 > sizeof(message))
+    {
+        return false;
+    }
+    size_t length = answer(message, queryLength);
+    return parseDnsAnswer(message, length, id, resolved, ttl);
+}
@@ -0,0 +1,31 @@
+// SpotifyResolver of the native build: every host is an alias (CNAME) of one
+// address, answered after latencyMs. The answer goes through the DNS wire
+// format (buildDnsQuery, parseDnsAnswer), as from a server.
+
+#ifndef StubResolver_h
+#define StubResolver_h
+
+#include <Arduino.h>
+#include <SpotifyDns.h>
+
+class StubResolver : public SpotifyResolver
+{
+public:
+  StubResolver(IPAddress address, uint32_t ttlSeconds, unsigned long latencyMs = 0);
+
+  bool resolve(const char *host, IPAddress &address, uint32_t &ttlSeconds) override;
+
+  IPAddress address;
+  // of the A record, the CNAME lives twice as long
+  uint32_t ttlSeconds;
+  unsigned long latencyMs;
+  unsigned long queries = 0;
+  // the next answers are NXDOMAIN
+  unsigned long failNext = 0;
+
+private:
+  uint16_t nextId = 1;
+  size_t answer(uint8_t *message, size_t queryLength);
+};
+
+#endif
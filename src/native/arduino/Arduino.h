@@ -0,0 +1,42 @@
+// Minimal Arduino core shim for the [env:native] host build.
+// Only what ArduinoSpotify and the record/replay clients use is provided.
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+
+#include "Print.h"
+#include "Stream.h"
+
+#define F(string_literal) (string_literal)
+#define PROGMEM
+#define IRAM_ATTR
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+// host only: moves millis() and micros() ahead, so simulations do not have to wait
+void advanceClock(unsigned long ms);
+
+class HardwareSerial : public Print
+{
+public:
+  void begin(unsigned long baud) {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,77 @@
+// Host replacement for the ESP32 fs::FS / fs::File classes. The filesystem is a
+// directory on the host, so SPIFFS paths like "/art/1a2b3c4d.bin" map to
+// <root>/art/1a2b3c4d.bin (missing directories are created when writing).
+// Names over the 31 characters of SPIFFS fail like on the device.
+
+#ifndef FS_H
+#define FS_H
+
+#include <memory>
+#include <string>
+
+#include "Stream.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs
+{
+
+enum SeekMode
+{
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+class File : public Stream
+{
+public:
+  File() {}
+  explicit File(FILE *file) : _file(file, fclose) {}
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int peek() override;
+  void flush() override;
+  size_t read(uint8_t *buf, size_t size);
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void close() { _file.reset(); }
+  operator bool() const { return _file != nullptr; }
+  using Print::write;
+
+private:
+  // shared like the handle of the ESP32 core, copies refer to the same file
+  std::shared_ptr<FILE> _file;
+};
+
+class FS
+{
+public:
+  explicit FS(const char *root) : _root(root) {}
+
+  File open(const char *path, const char *mode = FILE_READ, const bool create = false);
+  bool exists(const char *path);
+  bool remove(const char *path);
+  bool rename(const char *pathFrom, const char *pathTo);
+
+private:
+  static bool fits(const char *path);
+  std::string hostPath(const char *path);
+  std::string _root;
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekSet;
+
+#endif
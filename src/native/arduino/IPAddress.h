@@ -0,0 +1,27 @@
+// Host replacement for the Arduino IPAddress class.
+
+#ifndef IPAddress_h
+#define IPAddress_h
+
+#include <stdint.h>
+
+class IPAddress
+{
+public:
+  IPAddress() : _address{0, 0, 0, 0} {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _address{a, b, c, d} {}
+
+  uint8_t operator[](int index) const { return _address[index]; }
+  uint8_t &operator[](int index) { return _address[index]; }
+  bool operator==(const IPAddress &other) const
+  {
+    return _address[0] == other._address[0] && _address[1] == other._address[1] &&
+           _address[2] == other._address[2] && _address[3] == other._address[3];
+  }
+  bool operator!=(const IPAddress &other) const { return !(*this == other); }
+
+private:
+  uint8_t _address[4];
+};
+
+#endif
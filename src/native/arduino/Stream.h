@@ -0,0 +1,31 @@
+// Host replacement for the Arduino Stream class, including the timed
+// find/parseInt/readBytes helpers the Spotify library relies on.
+
+#ifndef Stream_h
+#define Stream_h
+
+#include "Print.h"
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual void flush() {}
+
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+  unsigned long getTimeout() { return _timeout; }
+
+  bool find(const char *target);
+  long parseInt();
+  size_t readBytes(char *buffer, size_t length);
+  size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+
+protected:
+  int timedRead();
+  int timedPeek();
+  unsigned long _timeout = 1000;
+};
+
+#endif
@@ -0,0 +1,684 @@
+// Host benchmark of the poll-to-pixels pipeline ([env:native_bench]).
+//
+// Every stage of one slowUpdate() + fastUpdate() cycle is run against replayed
+// responses and a 64x64 memory canvas. Results go to stdout as JSON:
+//
+//   .pio/build/native_bench/program [--min-time ms]
+//       [--currently-playing capture] [--audio-features capture]
+//       [--jpeg cover.jpg] [--cover cover.jpg ...] [--audio-analysis analysis.json] > bench.json
+//
+// The album_art stage only runs with --jpeg, the cover is served as the body of
+// a 200 response from the image server. The palette stage cycles through the
+// decoded --cover files (a generated tile without any) and reports the slowest
+// cover on stderr. The audio_analysis stages parse the --audio-analysis body (a
+// generated analysis of a 4 min track in the layout of Spotify without one),
+// served with chunked encoding; the throughput and the parser memory go to stderr.
+// The devices stages parse a recorded device list into the fixed device array,
+// checked first against the recording, also when it arrives byte by byte.
+// The log_call stages time the calls alone, the ring is drained between batches
+// outside of the timing; log_call_drained adds the formatting of the line.
+//
+// Allocations are counted by wrapping the glibc malloc family.
+
+#include <Arduino.h>
+#include <ArduinoSpotify.h>
+#include <SpotifyReplayClient.h>
+#include <Adafruit_GFX.h>
+#include <PlaybackRender.h>
+#include <AlbumPalette.h>
+#include <FeatureBars.h>
+#include <ListeningHistory.h>
+#include <PlaybackPages.h>
+#include <TaskScheduler.h>
+#include <AudioAnalysis.h>
+#include <SpotifyDevices.h>
+#include <Log.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "sample_responses.h"
+
+// ----------------Allocation counting----------------
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static unsigned long allocationCount = 0;
+static unsigned long allocatedBytes = 0;
+
+extern "C" void *malloc(size_t size)
+{
+    allocationCount++;
+    allocatedBytes += size;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocationCount++;
+    allocatedBytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    allocationCount++;
+    allocatedBytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+// ----------------Benchmark runner----------------
+
+#define MATRIX_WIDTH 64
+#define MATRIX_HEIGHT 64
+#define CYCLIC_PRINT_MS 50
+
+static unsigned long minTimeMs = 500;
+static bool firstResult = true;
+
+static void printResult(const char *name, unsigned long iterations, std::chrono::steady_clock::duration elapsed,
+                        unsigned long allocations, unsigned long bytes)
+{
+    double nsPerOp = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / iterations;
+    printf("%s\n    {\"name\": \"%s\", \"iterations\": %lu, \"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, \"bytes_per_op\": %.1f}",
+           firstResult ? "" : ",", name, iterations, nsPerOp, (double)allocations / iterations, (double)bytes / iterations);
+    firstResult = false;
+}
+
+// Keeps the compiler from dropping a result that is never read
+static inline void benchmarkSink(const void *result)
+{
+    asm volatile("" : : "r"(result) : "memory");
+}
+
+// Runs op until minTimeMs passed (at least 10 times) and prints one JSON result
+template <typename Operation>
+static void benchmark(const char *name, Operation op)
+{
+    // warm up, so first-call allocations do not count
+    op();
+
+    unsigned long iterations = 0;
+    unsigned long allocationsBefore = allocationCount;
+    unsigned long bytesBefore = allocatedBytes;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration elapsed;
+    do
+    {
+        op();
+        iterations++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (iterations < 10 || elapsed < std::chrono::milliseconds(minTimeMs));
+
+    printResult(name, iterations, elapsed, allocationCount - allocationsBefore, allocatedBytes - bytesBefore);
+}
+
+// Times op alone in batches of half the log ring, the ring is drained in between
+template <typename Operation>
+static void benchmarkLogCall(const char *name, Operation op)
+{
+    const unsigned long batch = LOG_RING_RECORDS / 2;
+    logFlush();
+    unsigned long iterations = 0;
+    unsigned long allocationsBefore = allocationCount;
+    unsigned long bytesBefore = allocatedBytes;
+    std::chrono::steady_clock::duration elapsed(0);
+    do
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < batch; i++)
+        {
+            op();
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+        iterations += batch;
+        logFlush();
+    } while (elapsed < std::chrono::milliseconds(minTimeMs));
+    printResult(name, iterations, elapsed, allocationCount - allocationsBefore, allocatedBytes - bytesBefore);
+}
+
+// Counts what the log drain writes
+class CountingPrint : public Print
+{
+public:
+    size_t write(uint8_t c) override
+    {
+        bytes++;
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        bytes += size;
+        return size;
+    }
+    using Print::write;
+
+    unsigned long bytes = 0;
+};
+
+static bool readFile(const char *path, std::vector<uint8_t> &content)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        content.insert(content.end(), buffer, buffer + count);
+    }
+    fclose(file);
+    return true;
+}
+
+// An analysis in the layout of /v1/audio-analysis: beats at 123 bpm and four
+// segments per beat with pitches and timbre; the beat starts in BEAT_TIME_UNIT_MS
+// go to expected
+static void generateAudioAnalysis(std::vector<uint8_t> &body, std::vector<uint16_t> &expected)
+{
+    std::string json = "{\"meta\": {\"analyzer_version\": \"4.0.0\", \"platform\": \"Linux\", "
+                       "\"detailed_status\": \"OK\", \"status_code\": 0, \"timestamp\": 1500000000}, "
+                       "\"track\": {\"duration\": 240.0, \"loudness\": -6.5, \"tempo\": 123.0, "
+                       "\"time_signature\": 4, \"codestring\": \"eJxVnAmS5DgOBL9S\\u00e9\"}, ";
+    const double period = 60.0 / 123;
+    const int beats = 240 / period;
+    char item[160];
+    std::string beatList;
+    std::string segmentList;
+    std::string tatumList;
+    uint32_t seed = 7;
+    for (int beat = 0; beat < beats; beat++)
+    {
+        double start = 0.31 + beat * period;
+        expected.push_back((uint16_t)(start * (1000 / BEAT_TIME_UNIT_MS) + 0.5));
+        snprintf(item, sizeof(item), "%s{\"start\": %.5f, \"duration\": %.5f, \"confidence\": 0.6}",
+                 beat ? ", " : "", start, period);
+        beatList += item;
+        for (int half = 0; half < 2; half++)
+        {
+            snprintf(item, sizeof(item), "%s{\"start\": %.5f, \"duration\": %.5f, \"confidence\": 0.5}",
+                     beat || half ? ", " : "", start + half * period / 2, period / 2);
+            tatumList += item;
+        }
+        for (int quarter = 0; quarter < 4; quarter++)
+        {
+            seed = seed * 1103515245 + 12345;
+            snprintf(item, sizeof(item), "%s{\"start\": %.5f, \"duration\": %.5f, \"confidence\": 0.5, "
+                     "\"loudness_start\": -24.1, \"loudness_max_time\": 0.021, \"loudness_max\": %.3f, "
+                     "\"loudness_end\": 0, ",
+                     beat || quarter ? ", " : "", start + quarter * period / 4, period / 4,
+                     -4.0 - quarter * 5.0 - (seed >> 16) % 300 / 100.0);
+            segmentList += item;
+            segmentList += "\"pitches\": [";
+            for (int n = 0; n < 12; n++)
+            {
+                snprintf(item, sizeof(item), "%s%.3f", n ? ", " : "", (seed >> n) % 1000 / 1000.0);
+                segmentList += item;
+            }
+            segmentList += "], \"timbre\": [";
+            for (int n = 0; n < 12; n++)
+            {
+                snprintf(item, sizeof(item), "%s%.3f", n ? ", " : "", (seed >> n) % 2000 / 10.0 - 100);
+                segmentList += item;
+            }
+            segmentList += "]}";
+        }
+    }
+    json += "\"bars\": [], \"beats\": [" + beatList + "], \"sections\": [{\"start\": 0.0, \"duration\": 240.0, "
+            "\"loudness\": -7.2, \"tempo\": 123.0, \"key\": 5, \"mode\": 1}], \"segments\": [" + segmentList +
+            "], \"tatums\": [" + tatumList + "]}";
+    body.assign(json.begin(), json.end());
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<uint8_t> currentlyPlayingCapture(sampleCurrentlyPlayingResponse,
+                                                 sampleCurrentlyPlayingResponse + sizeof(sampleCurrentlyPlayingResponse) - 1);
+    std::vector<uint8_t> audioFeaturesCapture(sampleAudioFeaturesResponse,
+                                              sampleAudioFeaturesResponse + sizeof(sampleAudioFeaturesResponse) - 1);
+    std::vector<uint8_t> jpeg;
+    std::vector<std::vector<uint16_t> > coverTiles;
+    std::vector<uint8_t> analysis;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--min-time") == 0)
+        {
+            minTimeMs = strtoul(argv[i + 1], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--currently-playing") == 0)
+        {
+            currentlyPlayingCapture.clear();
+            if (!readFile(argv[i + 1], currentlyPlayingCapture))
+            {
+                fprintf(stderr, "could not read %s\n", argv[i + 1]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--cover") == 0)
+        {
+            std::vector<uint8_t> cover;
+            static AlbumArtDecoder coverDecoder;
+            std::vector<uint16_t> tile(ALBUM_ART_SIZE * ALBUM_ART_SIZE);
+            if (!readFile(argv[i + 1], cover))
+            {
+                fprintf(stderr, "could not read %s\n", argv[i + 1]);
+                return 1;
+            }
+            SpotifyReplayClient coverStream(cover.data(), cover.size());
+            coverStream.connect("i.scdn.co", 443);
+            if (!coverDecoder.decode(coverStream, tile.data(), cover.size()))
+            {
+                fprintf(stderr, "%s does not decode: %s\n", argv[i + 1], coverDecoder.error);
+                return 1;
+            }
+            coverTiles.push_back(tile);
+        }
+        else if (strcmp(argv[i], "--jpeg") == 0)
+        {
+            if (!readFile(argv[i + 1], jpeg))
+            {
+                fprintf(stderr, "could not read %s\n", argv[i + 1]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--audio-analysis") == 0)
+        {
+            if (!readFile(argv[i + 1], analysis))
+            {
+                fprintf(stderr, "could not read %s\n", argv[i + 1]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--audio-features") == 0)
+        {
+            audioFeaturesCapture.clear();
+            if (!readFile(argv[i + 1], audioFeaturesCapture))
+            {
+                fprintf(stderr, "could not read %s\n", argv[i + 1]);
+                return 1;
+            }
+        }
+    }
+
+    SpotifyReplayClient currentlyPlayingClient(currentlyPlayingCapture.data(), currentlyPlayingCapture.size());
+    SpotifyReplayClient audioFeaturesClient(audioFeaturesCapture.data(), audioFeaturesCapture.size());
+    char bearerToken[] = "benchmark";
+    ArduinoSpotify spotify(currentlyPlayingClient, bearerToken);
+    spotify.autoTokenRefresh = false;
+    ArduinoSpotify spotifyFeatures(audioFeaturesClient, bearerToken);
+    spotifyFeatures.autoTokenRefresh = false;
+
+    CurrentlyPlaying currentlyPlaying = spotify.getCurrentlyPlaying();
+    if (currentlyPlaying.error || currentlyPlaying.statusCode != 200)
+    {
+        fprintf(stderr, "the currently playing capture does not parse (status %d)\n", currentlyPlaying.statusCode);
+        return 1;
+    }
+    char trackName[SPOTIFY_NAME_CHAR_LENGTH];
+    char artistName[SPOTIFY_NAME_CHAR_LENGTH];
+    strcpy(trackName, currentlyPlaying.trackName);
+    strcpy(artistName, currentlyPlaying.firstArtistName);
+
+    GFXcanvas16 canvas(MATRIX_WIDTH, MATRIX_HEIGHT);
+    ScrollText scrollText(canvas, 1, "Title", 0xFFFF, 0x0000, CYCLIC_PRINT_MS);
+
+    printf("{\n  \"benchmarks\": [");
+
+    // Request + status line, the part of every call before the body is parsed
+    benchmark("http_request", [&]() {
+        currentlyPlayingClient.rewind();
+        spotify.makeGetRequest(SPOTIFY_CURRENTLY_PLAYING_ENDPOINT, "Bearer benchmark");
+        currentlyPlayingClient.stop();
+    });
+    // Request, headers and filtered JSON into CurrentlyPlaying
+    benchmark("currently_playing", [&]() {
+        currentlyPlayingClient.rewind();
+        spotify.getCurrentlyPlaying();
+    });
+    benchmark("audio_features", [&]() {
+        audioFeaturesClient.rewind();
+        spotifyFeatures.getAudioFeatures("", currentlyPlaying.trackId);
+        audioFeaturesClient.stop();
+    });
+    benchmark("shorten_names", [&]() {
+        char shortName[SPOTIFY_NAME_CHAR_LENGTH];
+        ArduinoSpotify::shortenName(shortName, trackName, "([-");
+        ArduinoSpotify::shortenName(shortName, artistName, "&");
+    });
+    benchmark("scroll_text_frame", [&]() {
+        scrollText.moveOneFrame(trackName);
+    });
+    benchmark("song_progress", [&]() {
+        drawSongProgress(canvas, 9, currentlyPlaying.progressMs, currentlyPlaying.duraitonMs, 0x0333, 0x8000);
+    });
+    benchmark("feature_bars", [&]() {
+        for (int16_t index = 0; index < 6; index++)
+        {
+            drawFeatureBar(canvas, 21 + index * 7, 7, (index * 11) % MATRIX_WIDTH, 0x07E0, 0x0000);
+        }
+    });
+    // the bars of the display, computed once per track
+    const FeatureId featuresToDraw[6] = {feature_popularity, feature_tempo, feature_danceability,
+                                         feature_energy, feature_valence, feature_speechiness};
+    audioFeaturesClient.rewind();
+    AudioFeatures sampleFeatures = spotifyFeatures.getAudioFeatures("", currentlyPlaying.trackId);
+    audioFeaturesClient.stop();
+    PackedAudioFeatures samplePacked;
+    ArduinoSpotify::packAudioFeatures(sampleFeatures, samplePacked);
+    benchmark("feature_bar_lengths", [&]() {
+        int16_t lengths[6];
+        computeFeatureBars(AudioFeaturesView(samplePacked), currentlyPlaying.trackPopularity, featuresToDraw, 6,
+                           MATRIX_WIDTH, lengths);
+    });
+    // Copy of the features of a history of 128 tracks, as parsed and packed
+    static AudioFeatures historyFeatures[128];
+    static AudioFeatures historyFeaturesCopy[128];
+    static PackedAudioFeatures historyPacked[128];
+    static PackedAudioFeatures historyPackedCopy[128];
+    for (int index = 0; index < 128; index++)
+    {
+        historyFeatures[index] = sampleFeatures;
+        historyFeatures[index].tempo += index;
+        ArduinoSpotify::packAudioFeatures(historyFeatures[index], historyPacked[index]);
+    }
+    benchmark("copy_audio_features_128", [&]() {
+        memcpy(historyFeaturesCopy, historyFeatures, sizeof(historyFeatures));
+        benchmarkSink(historyFeaturesCopy);
+    });
+    benchmark("copy_packed_audio_features_128", [&]() {
+        memcpy(historyPackedCopy, historyPacked, sizeof(historyPacked));
+        benchmarkSink(historyPackedCopy);
+    });
+    benchmark("pack_audio_features", [&]() {
+        ArduinoSpotify::packAudioFeatures(sampleFeatures, samplePacked);
+        benchmarkSink(&samplePacked);
+    });
+    fprintf(stderr, "audio features: %u bytes, packed %u bytes\n", (unsigned int)sizeof(AudioFeatures),
+            (unsigned int)sizeof(PackedAudioFeatures));
+    // slowUpdate() + fastUpdate() of the display
+    benchmark("poll_to_pixels", [&]() {
+        currentlyPlayingClient.rewind();
+        audioFeaturesClient.rewind();
+        CurrentlyPlaying polled = spotify.getCurrentlyPlaying();
+        PackedAudioFeatures audioFeatures;
+        spotifyFeatures.getPackedAudioFeatures(audioFeatures, "", polled.trackId);
+        audioFeaturesClient.stop();
+        int16_t lengths[6];
+        computeFeatureBars(AudioFeaturesView(audioFeatures), polled.trackPopularity, featuresToDraw, 6, MATRIX_WIDTH,
+                           lengths);
+        scrollText.moveOneFrame(polled.shortTrackName);
+        drawSongProgress(canvas, 9, polled.progressMs, polled.duraitonMs, 0x0333, 0x8000);
+        for (int16_t index = 0; index < 6; index++)
+        {
+            drawFeatureBar(canvas, 21 + index * 7, 7, lengths[index], 0x07E0, 0x0000);
+        }
+    });
+
+    // Listening history in RAM (no begin(), so no log): one track added, and
+    // the statistics page with both averages
+    fs::FS noFlash(".");
+    static ListeningHistory listening(noFlash);
+    ListeningHistoryEntry listened;
+    memset(&listened, 0, sizeof(listened));
+    listened.trackKey = ListeningHistory::trackKey(currentlyPlaying.trackId);
+    listened.startedAt = 1700000000;
+    listened.listenedSeconds = 200;
+    listened.flags = LISTENING_HAS_FEATURES;
+    listened.features = samplePacked;
+    benchmark("history_append", [&]() {
+        listening.append(listened);
+        listened.startedAt += listened.listenedSeconds;
+    });
+    const PlaybackTheme statsTheme = {0xFFFF, 0x0000, 0x0333, 0x8000, 0x07E0, 0x0000};
+    benchmark("listening_stats_page", [&]() {
+        uint32_t now = listened.startedAt;
+        drawListeningStats(canvas, listening.lastHour(now), listening.lastDay(now), statsTheme);
+    });
+    // A frame of the now playing page: the changed widgets only, the scrolling title every time
+    int16_t pageLengths[6];
+    computeFeatureBars(AudioFeaturesView(samplePacked), currentlyPlaying.trackPopularity, featuresToDraw, 6,
+                       MATRIX_WIDTH, pageLengths);
+    PlaybackModel pageModel = {false, true, "A title that is too long to fit", "Artist", 83000, 215000,
+                               featuresToDraw, pageLengths, 6, true, NULL, "", false, &listening, 0, "Error",
+                               statsTheme};
+    PlaybackPages pages(canvas, pageModel, CYCLIC_PRINT_MS);
+    benchmark("page_frame_now_playing", [&]() {
+        pageModel.progressMs += 10;
+        pages.renderFrame(40000);
+    });
+    // The overhead of the scheduler around a task that does nothing
+    static Task benchTasks[] = {
+        {"empty", []() {}, 0, 1000, 0, {}},
+        {"idle", []() {}, 60000, 1000, 60000, {}},
+    };
+    TaskScheduler taskScheduler(benchTasks, 2);
+    taskScheduler.begin();
+    benchmark("task_scheduler_dispatch", [&]() {
+        benchmarkSink((const void *)(uintptr_t)taskScheduler.runDue());
+    });
+
+    if (!jpeg.empty())
+    {
+        char header[120];
+        int headerLength = sprintf(header, "HTTP/1.1 200 OK\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n",
+                                   (unsigned int)jpeg.size());
+        std::vector<uint8_t> imageCapture(header, header + headerLength);
+        imageCapture.insert(imageCapture.end(), jpeg.begin(), jpeg.end());
+        SpotifyReplayClient imageClient(imageCapture.data(), imageCapture.size());
+        ArduinoSpotify spotifyImages(imageClient, bearerToken);
+        static AlbumArtDecoder decoder;
+        static uint16_t tile[ALBUM_ART_SIZE * ALBUM_ART_SIZE];
+        if (!spotifyImages.getAlbumArt("https://i.scdn.co/image/benchmark", decoder, tile))
+        {
+            fprintf(stderr, "the cover does not decode: %s\n", decoder.error);
+            return 1;
+        }
+        // Request, headers and the streaming decode into the tile
+        benchmark("album_art", [&]() {
+            imageClient.rewind();
+            spotifyImages.getAlbumArt("https://i.scdn.co/image/benchmark", decoder, tile);
+        });
+        fprintf(stderr, "album art: %ux%u source, decoder state %u bytes\n",
+                decoder.imageWidth, decoder.imageHeight, (unsigned int)sizeof(decoder));
+    }
+
+    if (coverTiles.empty())
+    {
+        std::vector<uint16_t> tile(ALBUM_ART_SIZE * ALBUM_ART_SIZE);
+        for (int pixel = 0; pixel < ALBUM_ART_SIZE * ALBUM_ART_SIZE; pixel++)
+        {
+            tile[pixel] = (uint16_t)(pixel * 2654435761UL >> 8);
+        }
+        coverTiles.push_back(tile);
+    }
+    // Palette and theme of one cover, once per album on the display
+    size_t coverIndex = 0;
+    const PlaybackTheme fallbackTheme = {0xFFFF, 0x0000, 0x0333, 0x8000, 0x07E0, 0x0000};
+    benchmark("palette", [&]() {
+        PaletteColor palette[ALBUM_PALETTE_COLORS];
+        uint8_t colors = extractPalette(coverTiles[coverIndex].data(), palette);
+        themeFromPalette(palette, colors, fallbackTheme);
+        coverIndex = (coverIndex + 1) % coverTiles.size();
+    });
+    double slowestNs = 0;
+    for (size_t cover = 0; cover < coverTiles.size(); cover++)
+    {
+        const int runs = 200;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int run = 0; run < runs; run++)
+        {
+            PaletteColor palette[ALBUM_PALETTE_COLORS];
+            extractPalette(coverTiles[cover].data(), palette);
+        }
+        double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / runs;
+        slowestNs = ns > slowestNs ? ns : slowestNs;
+    }
+    fprintf(stderr, "palette: %u covers, slowest %.0f ns\n", (unsigned int)coverTiles.size(), slowestNs);
+
+    // the body as the API sends it, in chunks of 4 kB
+    std::vector<uint16_t> expectedBeats;
+    if (analysis.empty())
+    {
+        generateAudioAnalysis(analysis, expectedBeats);
+    }
+    const char *analysisHeader = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n";
+    std::vector<uint8_t> analysisCapture(analysisHeader, analysisHeader + strlen(analysisHeader));
+    for (size_t start = 0; start < analysis.size(); start += 4096)
+    {
+        size_t length = analysis.size() - start < 4096 ? analysis.size() - start : 4096;
+        char size[16];
+        int sizeLength = sprintf(size, "%x\r\n", (unsigned int)length);
+        analysisCapture.insert(analysisCapture.end(), size, size + sizeLength);
+        analysisCapture.insert(analysisCapture.end(), analysis.begin() + start, analysis.begin() + start + length);
+        analysisCapture.insert(analysisCapture.end(), {'\r', '\n'});
+    }
+    const char *lastChunk = "0\r\n\r\n";
+    analysisCapture.insert(analysisCapture.end(), lastChunk, lastChunk + strlen(lastChunk));
+    SpotifyReplayClient analysisClient(analysisCapture.data(), analysisCapture.size());
+    ArduinoSpotify spotifyAnalysis(analysisClient, bearerToken);
+    spotifyAnalysis.autoTokenRefresh = false;
+    // every run is a request, the budget of the display would turn them away
+    spotifyAnalysis.setRequestBudget(endpoint_audio_features, 0xFFFF, 1);
+    static BeatGrid beatGrid;
+    static AudioAnalysisParser analysisParser;
+    if (!spotifyAnalysis.getAudioAnalysis("benchmark", analysisParser, beatGrid))
+    {
+        fprintf(stderr, "the audio analysis does not parse\n");
+        return 1;
+    }
+    for (size_t beat = 0; beat < expectedBeats.size(); beat++)
+    {
+        if (beat >= beatGrid.count || beatGrid.start[beat] != expectedBeats[beat] || beatGrid.loudness[beat] == 0)
+        {
+            fprintf(stderr, "beat %u of the generated analysis is wrong\n", (unsigned int)beat);
+            return 1;
+        }
+    }
+    // The body alone in the pieces the request reads, and the whole request
+    benchmark("audio_analysis_parse", [&]() {
+        analysisParser.begin(beatGrid);
+        for (size_t start = 0; start < analysis.size(); start += 128)
+        {
+            analysisParser.feed(analysis.data() + start, analysis.size() - start < 128 ? analysis.size() - start : 128);
+        }
+        benchmarkSink((const void *)(uintptr_t)analysisParser.finish());
+    });
+    benchmark("audio_analysis", [&]() {
+        analysisClient.rewind();
+        spotifyAnalysis.getAudioAnalysis("benchmark", analysisParser, beatGrid);
+    });
+    // The beat of every frame of the track at 20 fps
+    BeatCursor beatCursor(beatGrid);
+    long beatProgressMs = 0;
+    benchmark("beat_cursor_frame", [&]() {
+        BeatPhase phase;
+        beatProgressMs = beatProgressMs > 240000 ? 0 : beatProgressMs + CYCLIC_PRINT_MS;
+        benchmarkSink((const void *)(uintptr_t)beatCursor.at(beatProgressMs, phase));
+    });
+    {
+        const int runs = 20;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int run = 0; run < runs; run++)
+        {
+            analysisParser.begin(beatGrid);
+            analysisParser.feed(analysis.data(), analysis.size());
+            analysisParser.finish();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / runs;
+        fprintf(stderr, "audio analysis: %u bytes, %lu beats (%u kept%s), %lu segments, %.1f MB/s, "
+                "grid %u bytes + parser %u bytes, cursor %lu steps %lu searches\n",
+                (unsigned int)analysis.size(), analysisParser.stats.beats, beatGrid.count,
+                beatGrid.truncated ? ", truncated" : "", analysisParser.stats.segments,
+                analysis.size() / seconds / 1e6, (unsigned int)sizeof(BeatGrid),
+                (unsigned int)sizeof(AudioAnalysisParser), beatCursor.steps, beatCursor.searches);
+    }
+
+    std::vector<uint8_t> devicesCapture(sampleDevicesResponse, sampleDevicesResponse + sizeof(sampleDevicesResponse) - 1);
+    SpotifyReplayClient devicesClient(devicesCapture.data(), devicesCapture.size());
+    ArduinoSpotify spotifyDevices(devicesClient, bearerToken);
+    spotifyDevices.autoTokenRefresh = false;
+    spotifyDevices.setRequestBudget(endpoint_player, 0xFFFF, 1);
+    static SpotifyDevice devices[SPOTIFY_DEVICE_TABLE_SIZE];
+    int deviceCount = spotifyDevices.getDevices(devices, SPOTIFY_DEVICE_TABLE_SIZE);
+    if (deviceCount != 3 || strcmp(devices[0].name, "Living Room") != 0 || !devices[0].isActive ||
+        devices[0].volumePercent != 42 || strcmp(devices[1].id, "a1b2c3d4e5f60718293a4b5c6d7e8f9012345678") != 0 ||
+        strcmp(devices[1].name, "Guest\xe2\x80\x99s iPhone") != 0 || strcmp(devices[1].type, "Smartphone") != 0 ||
+        devices[1].isActive || !devices[2].isRestricted || !devices[2].isPrivateSession || devices[2].volumePercent != -1)
+    {
+        fprintf(stderr, "the device list does not parse (%d devices)\n", deviceCount);
+        return 1;
+    }
+    const char *devicesText = strstr(sampleDevicesResponse, "\r\n\r\n") + 4;
+    const uint8_t *devicesBody = (const uint8_t *)devicesText;
+    size_t devicesLength = strlen(devicesText);
+    SpotifyDevicesParser devicesParser;
+    for (size_t piece = 1; piece <= 64; piece++)
+    {
+        static SpotifyDevice pieces[SPOTIFY_DEVICE_TABLE_SIZE];
+        devicesParser.begin(pieces, SPOTIFY_DEVICE_TABLE_SIZE);
+        for (size_t start = 0; start < devicesLength; start += piece)
+        {
+            devicesParser.feed(devicesBody + start, devicesLength - start < piece ? devicesLength - start : piece);
+        }
+        if (!devicesParser.finish() || devicesParser.count() != 3 || memcmp(pieces, devices, sizeof(SpotifyDevice) * 3) != 0)
+        {
+            fprintf(stderr, "the device list parses differently in pieces of %u bytes\n", (unsigned int)piece);
+            return 1;
+        }
+    }
+    benchmark("devices_parse", [&]() {
+        devicesParser.begin(devices, SPOTIFY_DEVICE_TABLE_SIZE);
+        for (size_t start = 0; start < devicesLength; start += 128)
+        {
+            devicesParser.feed(devicesBody + start, devicesLength - start < 128 ? devicesLength - start : 128);
+        }
+        benchmarkSink((const void *)(uintptr_t)devicesParser.finish());
+    });
+    benchmark("devices", [&]() {
+        devicesClient.rewind();
+        benchmarkSink((const void *)(intptr_t)spotifyDevices.getDevices(devices, SPOTIFY_DEVICE_TABLE_SIZE));
+    });
+
+    // Messages of the stages before go out first, the log stages write to memory
+    logFlush();
+    CountingPrint logSink;
+    logOutput = &logSink;
+    unsigned long logValue = 0;
+    benchmarkLogCall("log_call_int", [&]() {
+        LOG_INFO("poll %lu ms, status %d", logValue++, 200);
+    });
+    benchmarkLogCall("log_call_string", [&]() {
+        LOG_INFO("current song: %s", "Say Hello Again");
+    });
+    benchmarkLogCall("log_call_filtered", [&]() {
+        LOG_DEBUG("status %d", (int)logValue++);
+    });
+    benchmark("log_call_drained", [&]() {
+        LOG_INFO("poll %lu ms, status %d", logValue++, 200);
+        logFlush();
+    });
+    // What a call cost before: the line formatted and written right away
+    benchmark("log_formatted_line", [&]() {
+        char line[LOG_LINE_LENGTH];
+        snprintf(line, sizeof(line), "%lu I: poll %lu ms, status %d", millis(), logValue++, 200);
+        logSink.println(line);
+    });
+    logOutput = &Serial;
+    fprintf(stderr, "log: %u byte records, ring %u bytes, %lu dropped; a 40 character line at 9600 baud "
+            "holds the UART for %.1f ms\n", (unsigned int)sizeof(LogRecord),
+            (unsigned int)(sizeof(LogRecord) * LOG_RING_RECORDS), logStats.dropped, 42 * 10 * 1000.0 / 9600);
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,169 @@
+// Recorded Spotify API responses used by the benchmark when no capture files
+// are given. Market filtered, so "available_markets" is not part of the item.
+
+#ifndef sample_responses_h
+#define sample_responses_h
+
+static const char sampleCurrentlyPlayingResponse[] =
+    "HTTP/1.1 200 OK\r\n"
+    "content-type: application/json; charset=utf-8\r\n"
+    "cache-control: private, max-age=0\r\n"
+    "x-robots-tag: noindex, nofollow\r\n"
+    "access-control-allow-origin: *\r\n"
+    "date: Tue, 12 Apr 2022 18:44:21 GMT\r\n"
+    "server: envoy\r\n"
+    "strict-transport-security: max-age=31536000\r\n"
+    "x-content-type-options: nosniff\r\n"
+    "\r\n"
+    R"({
+  "timestamp" : 1649789061204,
+  "context" : {
+    "external_urls" : {
+      "spotify" : "https://open.spotify.com/playlist/37i9dQZF1DX4sWSpwq3LiO"
+    },
+    "href" : "https://api.spotify.com/v1/playlists/37i9dQZF1DX4sWSpwq3LiO",
+    "type" : "playlist",
+    "uri" : "spotify:playlist:37i9dQZF1DX4sWSpwq3LiO"
+  },
+  "progress_ms" : 84213,
+  "item" : {
+    "album" : {
+      "album_type" : "album",
+      "artists" : [ {
+        "external_urls" : {
+          "spotify" : "https://open.spotify.com/artist/0k17h0D3J5VfsdmQ1iZtE9"
+        },
+        "href" : "https://api.spotify.com/v1/artists/0k17h0D3J5VfsdmQ1iZtE9",
+        "id" : "0k17h0D3J5VfsdmQ1iZtE9",
+        "name" : "Pink Floyd",
+        "type" : "artist",
+        "uri" : "spotify:artist:0k17h0D3J5VfsdmQ1iZtE9"
+      } ],
+      "external_urls" : {
+        "spotify" : "https://open.spotify.com/album/4LH4d3cOWNNsVw41Gqt2kv"
+      },
+      "href" : "https://api.spotify.com/v1/albums/4LH4d3cOWNNsVw41Gqt2kv",
+      "id" : "4LH4d3cOWNNsVw41Gqt2kv",
+      "images" : [ {
+        "height" : 640,
+        "url" : "https://i.scdn.co/image/ab67616d0000b273ea7caaff71dea1051d49b2fe",
+        "width" : 640
+      }, {
+        "height" : 300,
+        "url" : "https://i.scdn.co/image/ab67616d00001e02ea7caaff71dea1051d49b2fe",
+        "width" : 300
+      }, {
+        "height" : 64,
+        "url" : "https://i.scdn.co/image/ab67616d00004851ea7caaff71dea1051d49b2fe",
+        "width" : 64
+      } ],
+      "name" : "The Dark Side of the Moon",
+      "release_date" : "1973-03-01",
+      "release_date_precision" : "day",
+      "total_tracks" : 10,
+      "type" : "album",
+      "uri" : "spotify:album:4LH4d3cOWNNsVw41Gqt2kv"
+    },
+    "artists" : [ {
+      "external_urls" : {
+        "spotify" : "https://open.spotify.com/artist/0k17h0D3J5VfsdmQ1iZtE9"
+      },
+      "href" : "https://api.spotify.com/v1/artists/0k17h0D3J5VfsdmQ1iZtE9",
+      "id" : "0k17h0D3J5VfsdmQ1iZtE9",
+      "name" : "Pink Floyd & Friends",
+      "type" : "artist",
+      "uri" : "spotify:artist:0k17h0D3J5VfsdmQ1iZtE9"
+    } ],
+    "disc_number" : 1,
+    "duration_ms" : 382296,
+    "explicit" : false,
+    "external_ids" : {
+      "isrc" : "GBN9Y1100088"
+    },
+    "external_urls" : {
+      "spotify" : "https://open.spotify.com/track/0vFOzaXqZHahrZp6enQwQb"
+    },
+    "href" : "https://api.spotify.com/v1/tracks/0vFOzaXqZHahrZp6enQwQb",
+    "id" : "0vFOzaXqZHahrZp6enQwQb",
+    "is_local" : false,
+    "is_playable" : true,
+    "name" : "Money - 2011 Remastered Version (Live) [Bonus]",
+    "popularity" : 74,
+    "preview_url" : "https://p.scdn.co/mp3-preview/0b0b3f1ab0d3eb0cb7e5d9e5d0d5e7b5b35c4f7a",
+    "track_number" : 6,
+    "type" : "track",
+    "uri" : "spotify:track:0vFOzaXqZHahrZp6enQwQb"
+  },
+  "currently_playing_type" : "track",
+  "actions" : {
+    "disallows" : {
+      "resuming" : true,
+      "skipping_prev" : true
+    }
+  },
+  "is_playing" : true
+})";
+
+static const char sampleAudioFeaturesResponse[] =
+    "HTTP/1.1 200 OK\r\n"
+    "content-type: application/json; charset=utf-8\r\n"
+    "cache-control: public, max-age=86400\r\n"
+    "server: envoy\r\n"
+    "\r\n"
+    R"({
+  "danceability" : 0.488,
+  "energy" : 0.479,
+  "key" : 11,
+  "loudness" : -9.651,
+  "mode" : 0,
+  "speechiness" : 0.0637,
+  "acousticness" : 0.0413,
+  "instrumentalness" : 0.0205,
+  "liveness" : 0.12,
+  "valence" : 0.599,
+  "tempo" : 123.566,
+  "type" : "audio_features",
+  "id" : "0vFOzaXqZHahrZp6enQwQb",
+  "uri" : "spotify:track:0vFOzaXqZHahrZp6enQwQb",
+  "track_href" : "https://api.spotify.com/v1/tracks/0vFOzaXqZHahrZp6enQwQb",
+  "analysis_url" : "https://api.spotify.com/v1/audio-analysis/0vFOzaXqZHahrZp6enQwQb",
+  "duration_ms" : 382296,
+  "time_signature" : 4
+})";
+
+static const char sampleDevicesResponse[] =
+    "HTTP/1.1 200 OK\r\n"
+    "content-type: application/json; charset=utf-8\r\n"
+    "content-length: 713\r\n"
+    "cache-control: private, max-age=0\r\n"
+    "server: envoy\r\n"
+    "\r\n"
+    R"({
+  "devices" : [ {
+    "id" : "5fbb3ba6aa454b5534c4ba43a8c7e8e45a63ad0e",
+    "is_active" : true,
+    "is_private_session" : false,
+    "is_restricted" : false,
+    "name" : "Living Room",
+    "type" : "Speaker",
+    "volume_percent" : 42
+  }, {
+    "id" : "a1b2c3d4e5f60718293a4b5c6d7e8f9012345678",
+    "is_active" : false,
+    "is_private_session" : false,
+    "is_restricted" : false,
+    "name" : "Guest\u2019s iPhone",
+    "type" : "Smartphone",
+    "volume_percent" : 100
+  }, {
+    "id" : "e4c1c7e0b2a9f6d35c8b7a1f0e9d2c3b4a5f6e7d",
+    "is_active" : false,
+    "is_private_session" : true,
+    "is_restricted" : true,
+    "name" : "Living Room TV",
+    "type" : "TV",
+    "volume_percent" : null
+  } ]
+})";
+
+#endif
@@ -0,0 +1,3515 @@
+// Host entry point of the [env:native] build.
+//
+// Replays a response capture written by SpotifyRecordClient through
+// ArduinoSpotify, so parse paths can be run and debugged without WiFi or a
+// Spotify account:
+//
+//   .pio/build/native/program <capture> [--features] [--latency ms]
+//                             [--fragment bytes] [--disconnect bytes]
+//
+// or polls tools/spotify_stand_in.py over plain TCP as fast as it can (or every
+// --interval ms) and reports the throughput and latencies of the client code:
+//
+//   .pio/build/native/program --server 127.0.0.1:8080 [--polls n] [--interval ms] [--features]
+//
+// With --tls ca.pem the stand-in is reached over TLS (--tls-cert of the
+// stand-in) and the sessions are resumed, unless --no-resume is given.
+// --dns ttl resolves the hosts with a stub resolver (answering after
+// --dns-latency ms, 20 by default) through the DNS cache of the library;
+// host has to be an IPv4 address then.
+//
+// --volume-knob n turns a simulated volume knob through n steps while polling,
+// the commands go through the queue and the requests on the wire are counted.
+//
+// --command-queue queues fixed sequences of player commands on replayed 204
+// answers and checks which requests go out and in which order:
+//
+//   .pio/build/native/program --command-queue
+//
+// --dns-cache sends requests on replayed answers through the DNS cache with a
+// stub resolver and checks hits, TTLs, a moved host and failed lookups:
+//
+//   .pio/build/native/program --dns-cache
+//
+// --reconcile applies player commands locally and replays a confirmation poll
+// that agrees or disagrees with them; the poll has to win and be counted:
+//
+//   .pio/build/native/program --reconcile
+//
+// --album-art decodes the sample covers of SampleCovers.h and checks the colors
+// of the tile, then feeds covers with broken huffman tables and cut ones:
+//
+//   .pio/build/native/program --album-art
+//
+// --feature-bars compares the fixed point bars of FEATURE_BARS with the float
+// code they replaced for every value of every feature and every bar width:
+//
+//   .pio/build/native/program --feature-bars
+//
+// --packed-features packs edge values and random audio features into
+// PackedAudioFeatures and checks what AudioFeaturesView reads back:
+//
+//   .pio/build/native/program --packed-features [--seed n]
+//
+// --art-cache runs the album art cache against a directory (the flash) for a
+// list of album URIs, one per line, and reports the hit rate and load times.
+// Misses decode --jpeg if given, otherwise a generated tile is stored:
+//
+//   .pio/build/native/program --art-cache <dir> <albums.txt> [--budget bytes] [--jpeg cover.jpg]
+//
+// --history feeds a synthetic stream of tracks into the listening history and
+// checks the rolling averages against a recount at every --check tracks. With
+// --log the history is logged to a directory and read back at the end:
+//
+//   .pio/build/native/program --history <tracks> [--log dir] [--seed n] [--check n]
+//
+// --snapshot renders every display page with sample data and writes one PNG
+// per page to a directory, plus the draws of a page switch:
+//
+//   .pio/build/native/program --snapshot <dir> [--jpeg cover.jpg]
+//
+// --pages runs the page scheduler on counting widgets and checks what every
+// frame draws through page switches, changes and frames over their budget:
+//
+//   .pio/build/native/program --pages
+//
+// --scheduler runs tasks on the task scheduler with a clock moved forward by
+// hand and checks which of them run, what they miss and what is reported:
+//
+//   .pio/build/native/program --scheduler
+//
+// --wifi runs the WiFi connection on a simulated access point through a number
+// of outages (some with a new channel or a new DHCP lease) and reports the
+// reconnect times. --no-cache forgets the AP and the address every time:
+//
+//   .pio/build/native/program --wifi <outages> [--seed n] [--no-cache]
+//
+// --wifi-checks takes the WiFi connection through reconnects within and after
+// the DHCP lease, failed attempts, a taken address, a new channel and a reset,
+// and checks when the cached address is used and when DHCP or a scan:
+//
+//   .pio/build/native/program --wifi-checks
+//
+// --power runs the standby of the display through hours of random listening
+// sessions and pauses, polled like the app does, and reports the time in every
+// power state and how long the panel stayed dark after the playback started:
+//
+//   .pio/build/native/program --power <hours> [--seed n] [--timeout minutes]
+//
+// --brightness prints the modelled CPU share of the refresh interrupt for the
+// brightness levels of main.cpp, runs a day of the schedule with its ramps and
+// a noisy light sensor around a step:
+//
+//   .pio/build/native/program --brightness [--depth bit planes]
+//
+// --lyrics plays the synced lyrics of a track from a directory (the flash,
+// <dir>/l/<track id>.lrc) with random seeks and skips and checks every
+// frame against a parse of the whole file. --server downloads the file from
+// tools/spotify_stand_in.py first:
+//
+//   .pio/build/native/program --lyrics <dir> <track id> [--server host:port] [--seeks n] [--seed n]
+//
+// --lyrics-checks writes generated lyrics of two tracks to a directory and
+// checks the line shown over the end of the window, after seeks out of it in
+// both directions and after a skip to the other track in the middle of it:
+//
+//   .pio/build/native/program --lyrics-checks <dir>
+//
+// --beat-cursor moves the beat cursor of the visualizer through random beat
+// grids with playback, seeks and track changes and checks every frame against
+// a walk over the whole grid:
+//
+//   .pio/build/native/program --beat-cursor [--seed n]
+//
+// --status serves /metrics and /state for a number of seconds on a port while a
+// frame task runs every 50 ms, then reports the requests and how late the frames
+// started (scrape it meanwhile, e.g. with curl):
+//
+//   .pio/build/native/program --status <port> [--seconds n]
+//
+// --status-checks serves scripted connections (whole, in pieces, stalled, read
+// slowly) and checks the responses and that no connection outlives the deadline:
+//
+//   .pio/build/native/program --status-checks
+//
+// --log-checks logs through the ring of Log.h into a string and checks the
+// formatted lines, LogPrint lines with records of others in between and the
+// line after a record that was dropped:
+//
+//   .pio/build/native/program --log-checks
+//
+// --accounts polls the playback of a number of accounts (up to 16) through one
+// SpotifyAccountPool from tools/spotify_stand_in.py --accounts for a number of
+// seconds, each at most every --interval ms and all together within --budget
+// polls per second, and reports the throughput, the polls per account and the
+// memory of the slots. --tokens polls with the tokens the stand-in issued at the
+// start instead of refreshing them:
+//
+//   .pio/build/native/program --accounts <n> --server host:port [--seconds n] [--interval ms]
+//                             [--budget polls per s] [--tokens] [--tls ca.pem]
+//
+// --devices sends a number of per-device commands (volume, transfer, play by
+// device name) through the cached device table to tools/spotify_stand_in.py and
+// reports the requests it took, then checks the table against a fresh list. It
+// uses the token the stand-in issued at the start:
+//
+//   .pio/build/native/program --devices host:port [--commands n]
+//
+// --devices-parse feeds the recorded device list of the bench in pieces and
+// generated lists to SpotifyDevicesParser and checks the fields, a list longer
+// than the table and names cut within a UTF-8 character:
+//
+//   .pio/build/native/program --devices-parse
+
+#include <Arduino.h>
+#include <ArduinoSpotify.h>
+#include <SpotifyReplayClient.h>
+#include <AlbumArtCache.h>
+#include <ListeningHistory.h>
+#include <PlaybackPages.h>
+#include <FeatureBars.h>
+#include <WifiConnection.h>
+#include <PowerManager.h>
+#include <Brightness.h>
+#include <SyncedLyrics.h>
+#include <AudioAnalysis.h>
+#include <StatusServer.h>
+#include <SpotifyAccounts.h>
+#include <SpotifyDevices.h>
+#include <TaskScheduler.h>
+#include <Log.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "NativeTcpClient.h"
+#include "NativeTcpServer.h"
+#include "NativeTlsClient.h"
+#include "StubResolver.h"
+#include "PngWriter.h"
+#include "SampleCovers.h"
+#include "SimulatedWifiDriver.h"
+#include "bench/sample_responses.h"
+
+static bool readFile(const char *path, std::vector<uint8_t> &content)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        content.insert(content.end(), buffer, buffer + count);
+    }
+    fclose(file);
+    return true;
+}
+
+static void printCurrentlyPlaying(const CurrentlyPlaying &currentlyPlaying)
+{
+    printf("currently playing: status %d error %d", currentlyPlaying.statusCode, currentlyPlaying.error);
+    if (!currentlyPlaying.error && currentlyPlaying.statusCode == 200)
+    {
+        printf(" '%s' by '%s' (%ld/%ld ms, %s)", currentlyPlaying.trackName, currentlyPlaying.firstArtistName,
+               currentlyPlaying.progressMs, currentlyPlaying.duraitonMs, currentlyPlaying.isPlaying ? "playing" : "paused");
+    }
+    printf("\n");
+}
+
+static void printAudioFeatures(const AudioFeatures &audioFeatures)
+{
+    printf("audio features: status %d error %d", audioFeatures.statusCode, audioFeatures.error);
+    if (!audioFeatures.error)
+    {
+        printf(" tempo %.1f energy %.3f valence %.3f danceability %.3f", audioFeatures.tempo,
+               audioFeatures.energy, audioFeatures.valence, audioFeatures.danceability);
+    }
+    printf("\n");
+}
+
+static int replayCapture(const char *path, int argc, char **argv)
+{
+    std::vector<uint8_t> capture;
+    if (!readFile(path, capture))
+    {
+        fprintf(stderr, "could not read %s\n", path);
+        return 1;
+    }
+
+    SpotifyReplayClient client(capture.data(), capture.size());
+    bool withFeatures = false;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--features") == 0)
+        {
+            withFeatures = true;
+        }
+        else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc)
+        {
+            client.latencyMs = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--fragment") == 0 && i + 1 < argc)
+        {
+            client.fragmentBytes = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--disconnect") == 0 && i + 1 < argc)
+        {
+            client.disconnectAfterBytes = strtol(argv[++i], NULL, 10);
+        }
+    }
+
+    char bearerToken[] = "replay";
+    ArduinoSpotify spotify(client, bearerToken);
+    spotify.autoTokenRefresh = false;
+
+    // One poll per recorded connection, the same sequence the display runs
+    unsigned int connections;
+    do
+    {
+        connections = client.connections;
+        CurrentlyPlaying currentlyPlaying = spotify.getCurrentlyPlaying();
+        printCurrentlyPlaying(currentlyPlaying);
+        if (withFeatures && !currentlyPlaying.error && currentlyPlaying.statusCode == 200)
+        {
+            printAudioFeatures(spotify.getAudioFeatures("", currentlyPlaying.trackId));
+        }
+    } while (client.connections != connections);
+
+    printf("replayed %u connections, %lu bytes sent, %lu bytes received\n",
+           client.connections, client.bytesSent, client.bytesReceived);
+    return 0;
+}
+
+static int pollServer(const char *server, int argc, char **argv)
+{
+    char host[64];
+    strncpy(host, server, sizeof(host));
+    host[sizeof(host) - 1] = '\0';
+    char *colon = strrchr(host, ':');
+    uint16_t port = 80;
+    if (colon != NULL)
+    {
+        *colon = '\0';
+        port = (uint16_t)atoi(colon + 1);
+    }
+
+    unsigned long polls = 100;
+    unsigned long intervalMs = 0;
+    unsigned long volumeSteps = 0;
+    bool withFeatures = false;
+    const char *caFile = NULL;
+    bool resumeSessions = true;
+    long dnsTtl = -1;
+    unsigned long dnsLatencyMs = 20;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--features") == 0)
+        {
+            withFeatures = true;
+        }
+        else if (strcmp(argv[i], "--tls") == 0 && i + 1 < argc)
+        {
+            caFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-resume") == 0)
+        {
+            resumeSessions = false;
+        }
+        else if (strcmp(argv[i], "--dns") == 0 && i + 1 < argc)
+        {
+            dnsTtl = strtol(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--dns-latency") == 0 && i + 1 < argc)
+        {
+            dnsLatencyMs = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--polls") == 0 && i + 1 < argc)
+        {
+            polls = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+        {
+            intervalMs = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--volume-knob") == 0 && i + 1 < argc)
+        {
+            volumeSteps = strtoul(argv[++i], NULL, 10);
+        }
+    }
+
+    // with the DNS cache the connects go to the address of the stub, not to a redirect
+    int octets[4] = {0, 0, 0, 0};
+    if (dnsTtl >= 0 && sscanf(host, "%d.%d.%d.%d", &octets[0], &octets[1], &octets[2], &octets[3]) != 4)
+    {
+        fprintf(stderr, "--dns needs an IPv4 address of the server, not %s\n", host);
+        return 1;
+    }
+    StubResolver resolver(IPAddress(octets[0], octets[1], octets[2], octets[3]), dnsTtl, dnsLatencyMs);
+    const char *redirectHost = dnsTtl >= 0 ? NULL : host;
+    NativeTcpClient tcpClient(redirectHost, port);
+    NativeTlsClient tlsClient(redirectHost, port);
+    if (caFile != NULL && !tlsClient.setCACertFile(caFile))
+    {
+        fprintf(stderr, "no certificate in %s\n", caFile);
+        return 1;
+    }
+    Client &client = caFile != NULL ? (Client &)tlsClient : (Client &)tcpClient;
+    ArduinoSpotify spotify(client, "stand-in-client", "stand-in-secret", "stand-in-refresh");
+    spotify.portNumber = port;
+    if (caFile != NULL && resumeSessions)
+    {
+        spotify.enableTlsSessions(tlsClient);
+    }
+    if (dnsTtl >= 0)
+    {
+        spotify.setResolver(resolver);
+    }
+    if (!spotify.refreshAccessToken())
+    {
+        fprintf(stderr, "could not get a token from %s\n", server);
+        return 1;
+    }
+
+    std::vector<unsigned long> latenciesUs;
+    latenciesUs.reserve(polls);
+    unsigned long statusCounts[600] = {0};
+    unsigned long errors = 0;
+    unsigned long start = millis();
+    for (unsigned long poll = 0; poll < polls; poll++)
+    {
+        // a knob turn produces many steps between two frames
+        for (unsigned long step = poll * volumeSteps / polls; step < (poll + 1) * volumeSteps / polls; step++)
+        {
+            spotify.queueCommand(command_volume, step % 101);
+        }
+        spotify.processCommands();
+
+        unsigned long pollStart = micros();
+        CurrentlyPlaying currentlyPlaying = spotify.getCurrentlyPlaying();
+        if (withFeatures && !currentlyPlaying.error && currentlyPlaying.statusCode == 200)
+        {
+            spotify.getAudioFeatures("", currentlyPlaying.trackId);
+            client.stop();
+        }
+        latenciesUs.push_back(micros() - pollStart);
+        if (currentlyPlaying.error)
+        {
+            errors++;
+        }
+        if (currentlyPlaying.statusCode > 0 && currentlyPlaying.statusCode < 600)
+        {
+            statusCounts[currentlyPlaying.statusCode]++;
+        }
+        if (intervalMs > 0)
+        {
+            delay(intervalMs);
+        }
+    }
+    unsigned long elapsedMs = millis() - start;
+
+    if (volumeSteps > 0)
+    {
+        printf("volume knob: %lu steps, %lu coalesced, %lu requests sent, %lu failed\n", volumeSteps,
+               spotify.commandStats.coalesced, spotify.commandStats.sent, spotify.commandStats.failed);
+    }
+
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    printf("%lu polls in %lu ms, %.1f polls/s, %lu errors, %u connections\n", polls, elapsedMs,
+           elapsedMs > 0 ? polls * 1000.0 / elapsedMs : 0.0, errors,
+           caFile != NULL ? tlsClient.handshakes : tcpClient.connections);
+    if (caFile != NULL)
+    {
+        const SpotifyTlsStats &tls = spotify.tlsStats;
+        printf("tls: %lu full handshakes, %lu resumed, %lu rejected sessions, %.0f us per handshake\n",
+               resumeSessions ? tls.fullHandshakes : (unsigned long)tlsClient.handshakes, tls.resumedHandshakes,
+               tls.rejectedSessions, tlsClient.handshakes > 0 ? (double)tlsClient.handshakeMicros / tlsClient.handshakes : 0.0);
+    }
+    if (dnsTtl >= 0)
+    {
+        const SpotifyDnsStats &dns = spotify.dnsStats;
+        double resolveMs = dns.resolutions > 0 ? dns.resolveMicros / 1000.0 / dns.resolutions : 0.0;
+        printf("dns: %lu lookups, %lu hits, %lu resolutions (%.1f ms each), %lu failures, %lu stale retries, "
+               "%.0f ms saved\n",
+               dns.lookups, dns.hits, dns.resolutions, resolveMs, dns.failures, dns.staleRetries, dns.hits * resolveMs);
+    }
+    if (!latenciesUs.empty())
+    {
+        printf("latency us: p50 %lu p90 %lu p99 %lu max %lu\n", latenciesUs[latenciesUs.size() / 2],
+               latenciesUs[latenciesUs.size() * 9 / 10], latenciesUs[latenciesUs.size() * 99 / 100], latenciesUs.back());
+    }
+    for (int status = 0; status < 600; status++)
+    {
+        if (statusCounts[status] > 0)
+        {
+            printf("status %d: %lu\n", status, statusCounts[status]);
+        }
+    }
+    return 0;
+}
+
+// the log output of --log-checks
+class LogCapture : public Print
+{
+public:
+    size_t write(uint8_t c) override
+    {
+        text += (char)c;
+        return 1;
+    }
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        text.append((const char *)buf, size);
+        return size;
+    }
+
+    std::string text;
+};
+
+// Logs through the ring into a string and checks the formatted lines, lines of
+// LogPrint in several records, records of others in between and dropped records
+static int logChecks()
+{
+    logFlush();
+    Print *previousOutput = logOutput;
+    LogCapture capture;
+    logOutput = &capture;
+    unsigned long failures = 0;
+    auto check = [&](const char *name, const std::string &expected) {
+        logFlush();
+        bool passed = capture.text == expected;
+        printf("%s: %s\n", passed ? "ok" : "FAILED", name);
+        if (!passed)
+        {
+            fprintf(stderr, "  \"%s\"\n  instead of\n  \"%s\"\n", capture.text.c_str(), expected.c_str());
+            failures++;
+        }
+        capture.text.clear();
+    };
+    // the time in front of a line logged now
+    auto stamp = []() { return std::to_string(millis()) + " "; };
+
+    std::string now = stamp();
+    // 29 of the 32 bytes of a record
+    LOG_INFO("%d %lu %x %05.1f %s %c %%", -5, 70UL, 255u, 3.14159, "text", 'A');
+    check("the conversions of a record", now + "I: -5 70 ff 003.1 text A %\r\n");
+
+    now = stamp();
+    unsigned long truncated = logStats.truncated;
+    LOG_WARN("name %s", "a string much longer than the bytes of a record");
+    check("a string is cut to the record", now + "W: name a string much longer than the b\r\n");
+    printf("%s: %s\n", logStats.truncated == truncated + 1 ? "ok" : "FAILED", "and counted as truncated");
+    failures += logStats.truncated == truncated + 1 ? 0 : 1;
+
+    now = stamp();
+    LOG_INFO("a line of %d bytes through a drain of 5 bytes", 46);
+    while (!logDrain(5))
+    {
+    }
+    check("a line is continued by the next drain", now + "I: a line of 46 bytes through a drain of 5 bytes\r\n");
+
+    const std::string longText(200, 'x');
+    now = stamp();
+    {
+        LogPrint report(LOG_LEVEL_INFO);
+        report.print(longText.c_str());
+        report.print("\r\n");
+    }
+    check("a LogPrint line in several records comes out whole", now + "I: " + longText + "\r\n");
+
+    // 40 characters, the first record goes out at 31
+    const std::string first(31, 'a');
+    now = stamp();
+    {
+        LogPrint report(LOG_LEVEL_INFO);
+        report.print((first + "bbbbbbbbb").c_str());
+        LOG_WARN("other task");
+        report.print("c\n");
+    }
+    check("a record of another task ends the open line",
+          now + "I: " + first + "\r\n" + now + "W: other task\r\n" + now + "I: bbbbbbbbbc\r\n");
+
+    // the ring is full when the end of the line comes
+    for (int i = 0; i < LOG_RING_RECORDS - 1; i++)
+    {
+        LOG_INFO("filler");
+    }
+    unsigned long dropped = logStats.dropped;
+    now = stamp();
+    {
+        LogPrint report(LOG_LEVEL_INFO);
+        report.print(first.c_str());
+        report.print("end\n");
+    }
+    logFlush();
+    bool droppedPassed = logStats.dropped == dropped + 1 && capture.text.size() >= first.size() &&
+                         capture.text.compare(capture.text.size() - first.size(), first.size(), first) == 0;
+    printf("%s: %s\n", droppedPassed ? "ok" : "FAILED", "the end of a line is dropped when the ring is full");
+    failures += droppedPassed ? 0 : 1;
+    capture.text.clear();
+    now = stamp();
+    LOG_INFO("next");
+    check("the next line starts on a line of its own", "\r\n" + now + "I: next\r\n");
+
+    logOutput = previousOutput;
+    return failures == 0 ? 0 : 1;
+}
+
+// Collects the request lines ("PUT /v1/me/player/pause") of everything the library sends
+class RequestLines : public Print
+{
+public:
+    size_t write(uint8_t c) override
+    {
+        if (c == '\n')
+        {
+            if (line.compare(0, 4, "PUT ") == 0 || line.compare(0, 5, "POST ") == 0 ||
+                line.compare(0, 4, "GET ") == 0)
+            {
+                // without " HTTP/1.1"
+                lines += (lines.empty() ? "" : "\n") + line.substr(0, line.rfind(' '));
+            }
+            line.clear();
+        }
+        else if (c != '\r')
+        {
+            line += (char)c;
+        }
+        return 1;
+    }
+    using Print::write;
+
+    std::string lines;
+
+private:
+    std::string line;
+};
+
+struct QueuedCommand
+{
+    SpotifyCommandType type;
+    int value;
+    const char *deviceId;
+};
+
+struct CommandQueueCase
+{
+    const char *name;
+    QueuedCommand commands[8];
+    uint8_t count;
+    // the request lines processCommands has to send, in order
+    const char *requests;
+};
+
+static const CommandQueueCase COMMAND_QUEUE_CASES[] = {
+    {"a knob turn is one volume request",
+     {{command_volume, 10, ""}, {command_volume, 20, ""}, {command_volume, 30, ""}, {command_volume, 40, ""}},
+     4,
+     "PUT /v1/me/player/volume?volume_percent=40"},
+    {"play and pause keep the last one",
+     {{command_play, 0, ""}, {command_pause, 0, ""}, {command_play, 0, ""}},
+     3,
+     "PUT /v1/me/player/play"},
+    {"skips add up",
+     {{command_next, 0, ""}, {command_next, 0, ""}, {command_previous, 0, ""}},
+     3,
+     "POST /v1/me/player/next\nPOST /v1/me/player/next\nPOST /v1/me/player/previous"},
+    {"a seek after a skip is for the new track",
+     {{command_seek, 1000, ""}, {command_next, 0, ""}, {command_seek, 2000, ""}},
+     3,
+     "PUT /v1/me/player/seek?position_ms=1000\nPOST /v1/me/player/next\nPUT /v1/me/player/seek?position_ms=2000"},
+    {"play and pause are not merged across a skip",
+     {{command_pause, 0, ""}, {command_previous, 0, ""}, {command_play, 0, ""}, {command_pause, 0, ""}},
+     4,
+     "PUT /v1/me/player/pause\nPOST /v1/me/player/previous\nPUT /v1/me/player/pause"},
+    {"seeks after the last skip are merged",
+     {{command_seek, 1000, ""}, {command_next, 0, ""}, {command_seek, 2000, ""}, {command_seek, 3000, ""}},
+     4,
+     "PUT /v1/me/player/seek?position_ms=1000\nPOST /v1/me/player/next\nPUT /v1/me/player/seek?position_ms=3000"},
+    {"other devices are not merged",
+     {{command_volume, 10, "kitchen"}, {command_volume, 20, ""}, {command_volume, 30, "kitchen"}},
+     3,
+     "PUT /v1/me/player/volume?volume_percent=30&device_id=kitchen\nPUT /v1/me/player/volume?volume_percent=20"},
+    {"shuffle and repeat keep the last setting",
+     {{command_shuffle, 1, ""}, {command_repeat, repeat_track, ""}, {command_shuffle, 0, ""},
+      {command_repeat, repeat_off, ""}},
+     4,
+     "PUT /v1/me/player/shuffle?state=false\nPUT /v1/me/player/repeat?state=off"},
+};
+
+// Queues the commands of every case into an ArduinoSpotify on replayed 204 answers
+// and checks the requests that go out
+static int commandQueue()
+{
+    // one connection answers every command of a case
+    std::string capture;
+    for (uint8_t i = 0; i < SPOTIFY_COMMAND_QUEUE_SIZE; i++)
+    {
+        capture += "HTTP/1.1 204 No Content\r\ncontent-length: 0\r\n\r\n";
+    }
+    unsigned long failures = 0;
+    for (const CommandQueueCase &queueCase : COMMAND_QUEUE_CASES)
+    {
+        SpotifyReplayClient client((const uint8_t *)capture.data(), capture.size());
+        RequestLines requests;
+        client.requestLog = &requests;
+        char bearerToken[] = "replay";
+        ArduinoSpotify spotify(client, bearerToken);
+        spotify.autoTokenRefresh = false;
+        for (uint8_t i = 0; i < queueCase.count; i++)
+        {
+            const QueuedCommand &command = queueCase.commands[i];
+            spotify.queueCommand(command.type, command.value, command.deviceId);
+        }
+        int processed = spotify.processCommands();
+        bool passed = requests.lines == queueCase.requests && spotify.pendingCommands() == 0 &&
+                      spotify.commandStats.sent == (unsigned long)processed &&
+                      spotify.commandStats.coalesced + processed == queueCase.count;
+        printf("%s: %s, %d requests\n", passed ? "ok" : "FAILED", queueCase.name, processed);
+        if (!passed)
+        {
+            failures++;
+            fprintf(stderr, "sent:\n%s\nexpected:\n%s\n", requests.lines.c_str(), queueCase.requests);
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// Replays 204 answers on every connect to serverAddress, a connect to another address fails
+class MovingServerClient : public SpotifyReplayClient
+{
+public:
+    MovingServerClient(const std::string &capture, IPAddress serverAddress)
+        : SpotifyReplayClient((const uint8_t *)capture.data(), capture.size()), serverAddress(serverAddress)
+    {
+    }
+
+    int connect(IPAddress ip, uint16_t port) override
+    {
+        lastAddress = ip;
+        if (ip != serverAddress)
+        {
+            refused++;
+            return 0;
+        }
+        return SpotifyReplayClient::connect(ip, port);
+    }
+    using SpotifyReplayClient::connect;
+
+    IPAddress serverAddress;
+    IPAddress lastAddress;
+    unsigned long refused = 0;
+};
+
+// Sends requests through the DNS cache of ArduinoSpotify with a stub resolver
+// and checks when the cache answers and when the resolver is asked
+static int dnsCache()
+{
+    std::string capture;
+    for (int i = 0; i < 32; i++)
+    {
+        capture += SPOTIFY_RECORD_BOUNDARY "HTTP/1.1 204 No Content\r\ncontent-length: 0\r\n\r\n";
+    }
+    const IPAddress first(10, 0, 0, 1);
+    const IPAddress moved(10, 0, 0, 2);
+    MovingServerClient client(capture, first);
+    StubResolver resolver(first, 60);
+    char bearerToken[] = "replay";
+    ArduinoSpotify spotify(client, bearerToken);
+    spotify.autoTokenRefresh = false;
+    spotify.setKeepAlive(false);
+    spotify.setResolver(resolver);
+    const SpotifyDnsStats &stats = spotify.dnsStats;
+
+    unsigned long failures = 0;
+    auto check = [&](const char *name, bool passed) {
+        printf("%s: %s\n", passed ? "ok" : "FAILED", name);
+        if (!passed)
+        {
+            fprintf(stderr, "  queries %lu, lookups %lu, hits %lu, failures %lu, stale retries %lu, refused %lu\n",
+                    resolver.queries, stats.lookups, stats.hits, stats.failures, stats.staleRetries, client.refused);
+            failures++;
+        }
+    };
+
+    check("the first request resolves the host",
+          spotify.pause() && resolver.queries == 1 && stats.hits == 0 && client.lastAddress == first);
+    advanceClock(59000);
+    check("a request within the TTL takes the cached address",
+          spotify.pause() && resolver.queries == 1 && stats.hits == 1 && client.lastAddress == first);
+    advanceClock(2000);
+    check("the lower TTL of the A record ends the answer, not the CNAME",
+          spotify.pause() && resolver.queries == 2 && stats.hits == 1);
+
+    resolver.address = moved;
+    client.serverAddress = moved;
+    check("a failed connect to a cached address resolves again and retries once",
+          spotify.pause() && resolver.queries == 3 && stats.staleRetries == 1 && client.lastAddress == moved);
+    check("the new address is cached", spotify.pause() && resolver.queries == 3 && client.lastAddress == moved);
+
+    resolver.ttlSeconds = 86400;
+    advanceClock(61000);
+    spotify.pause();
+    advanceClock((SPOTIFY_DNS_MAX_TTL_S - 1) * 1000UL);
+    check("a long TTL is kept up to SPOTIFY_DNS_MAX_TTL_S", spotify.pause() && resolver.queries == 4);
+    advanceClock(2000);
+    check("and then resolved again", spotify.pause() && resolver.queries == 5);
+
+    advanceClock((SPOTIFY_DNS_MAX_TTL_S + 1) * 1000UL);
+    resolver.failNext = 1;
+    check("an NXDOMAIN answer fails the request", !spotify.pause() && stats.failures == 1);
+    check("and is not cached", spotify.pause() && resolver.queries == 7 && stats.failures == 1);
+
+    uint8_t message[SPOTIFY_DNS_MESSAGE_SIZE];
+    char longLabel[80];
+    memset(longLabel, 'a', 64);
+    strcpy(longLabel + 64, ".spotify.com");
+    check("a label over 63 bytes is no query", buildDnsQuery(message, sizeof(message), 1, longLabel) == 0);
+    // the question with one A record of 300 s for 10.0.0.9
+    size_t length = buildDnsQuery(message, sizeof(message), 7, "api.spotify.com");
+    const uint8_t record[] = {0xC0, 12, 0, 1, 0, 1, 0, 0, 0x01, 0x2C, 0, 4, 10, 0, 0, 9};
+    memcpy(message + length, record, sizeof(record));
+    length += sizeof(record);
+    message[2] = 0x81;
+    message[3] = 0x80;
+    message[7] = 1;
+    IPAddress address;
+    uint32_t ttlSeconds = 0;
+    check("an answer is read with its TTL", parseDnsAnswer(message, length, 7, address, ttlSeconds) &&
+                                                address == IPAddress(10, 0, 0, 9) && ttlSeconds == 300);
+    check("an answer to another id is refused", !parseDnsAnswer(message, length, 8, address, ttlSeconds));
+    return failures == 0 ? 0 : 1;
+}
+
+// A recorded connection with a currently playing answer of the layout of Spotify
+static std::string currentlyPlayingAnswer(const char *trackId, bool playing, long progressMs)
+{
+    char body[700];
+    snprintf(body, sizeof(body),
+             R"({"progress_ms":%ld,"is_playing":%s,"item":{"id":"%s","name":"Track %s","uri":"spotify:track:%s",)"
+             R"("duration_ms":240000,"popularity":50,"artists":[{"name":"Artist","uri":"spotify:artist:1"}],)"
+             R"("album":{"name":"Album","uri":"spotify:album:1","images":[]}}})",
+             progressMs, playing ? "true" : "false", trackId, trackId, trackId);
+    char header[120];
+    snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\ncontent-type: application/json\r\ncontent-length: %zu\r\n\r\n",
+             strlen(body));
+    return SPOTIFY_RECORD_BOUNDARY + std::string(header) + body;
+}
+
+struct ReconcileCase
+{
+    const char *name;
+    QueuedCommand commands[2];
+    uint8_t count;
+    // what the confirmation poll answers, the poll before is track A playing at 30 s
+    const char *trackId;
+    bool playing;
+    long progressMs;
+    // the state the commands apply locally
+    bool localPlaying;
+    long localProgressMs;
+    bool confirmed;
+};
+
+static const ReconcileCase RECONCILE_CASES[] = {
+    {"pause confirmed", {{command_pause, 0, ""}}, 1, "A", false, 30000, false, 30000, true},
+    {"pause not taken, the track plays on", {{command_pause, 0, ""}}, 1, "A", true, 31000, false, 30000, false},
+    {"skip confirmed", {{command_next, 0, ""}}, 1, "B", true, 500, true, 0, true},
+    {"skip not taken, the old track plays on", {{command_next, 0, ""}}, 1, "A", true, 31000, true, 0, false},
+    {"seek answered with another position", {{command_seek, 60000, ""}}, 1, "A", true, 90000, true, 60000, true},
+    {"pause and play, paused by another device", {{command_pause, 0, ""}, {command_play, 0, ""}}, 2, "A", false, 31000,
+     true, 30000, false},
+};
+
+// Applies player commands locally, then replays a confirmation poll that agrees or
+// disagrees with them: the poll has to win and be counted in commandStats
+static int reconcileCommands()
+{
+    std::string commandAnswers = SPOTIFY_RECORD_BOUNDARY;
+    for (uint8_t i = 0; i < SPOTIFY_COMMAND_QUEUE_SIZE; i++)
+    {
+        commandAnswers += "HTTP/1.1 204 No Content\r\ncontent-length: 0\r\n\r\n";
+    }
+    unsigned long failures = 0;
+    for (const ReconcileCase &reconcileCase : RECONCILE_CASES)
+    {
+        std::string capture = currentlyPlayingAnswer("A", true, 30000) + commandAnswers +
+                              currentlyPlayingAnswer(reconcileCase.trackId, reconcileCase.playing, reconcileCase.progressMs);
+        SpotifyReplayClient client((const uint8_t *)capture.data(), capture.size());
+        char bearerToken[] = "replay";
+        ArduinoSpotify spotify(client, bearerToken);
+        spotify.autoTokenRefresh = false;
+        spotify.setRequestBudget(endpoint_currently_playing, 0xFFFF, 1);
+
+        CurrentlyPlaying before = spotify.getCurrentlyPlaying();
+        for (uint8_t i = 0; i < reconcileCase.count; i++)
+        {
+            const QueuedCommand &command = reconcileCase.commands[i];
+            spotify.queueCommand(command.type, command.value, command.deviceId);
+        }
+        // the frames between the command and the confirmation poll
+        CurrentlyPlaying local = spotify.getLocalCurrentlyPlaying();
+        bool localPlaying = local.isPlaying;
+        long localProgressMs = local.progressMs;
+        bool provisional = local.provisional;
+        spotify.processCommands();
+        CurrentlyPlaying after = spotify.getCurrentlyPlaying();
+
+        SpotifyCommandStats &stats = spotify.commandStats;
+        bool passed = !before.error && provisional && localPlaying == reconcileCase.localPlaying &&
+                      // the progress is frozen at the command, allow for a slow host
+                      labs(localProgressMs - reconcileCase.localProgressMs) < 100 && !after.error &&
+                      !after.provisional && after.isPlaying == reconcileCase.playing &&
+                      after.progressMs == reconcileCase.progressMs && strcmp(after.trackId, reconcileCase.trackId) == 0 &&
+                      stats.confirmed == (reconcileCase.confirmed ? 1UL : 0UL) &&
+                      stats.mismatched == (reconcileCase.confirmed ? 0UL : 1UL);
+        printf("%s: %s, %lu confirmed, %lu mismatched\n", passed ? "ok" : "FAILED", reconcileCase.name, stats.confirmed,
+               stats.mismatched);
+        if (!passed)
+        {
+            failures++;
+            fprintf(stderr, "local: %s at %ld ms%s, after the poll: track %s %s at %ld ms%s\n",
+                    localPlaying ? "playing" : "paused", localProgressMs, provisional ? " (provisional)" : "",
+                    after.error ? "-" : after.trackId, after.isPlaying ? "playing" : "paused", after.progressMs,
+                    after.provisional ? " (provisional)" : "");
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+struct SampleCover
+{
+    const char *name;
+    const uint8_t *jpeg;
+    size_t length;
+    bool grayscale;
+};
+
+static const SampleCover SAMPLE_COVERS[] = {
+    {"64x64 4:2:0", sampleCover64, sizeof(sampleCover64), false},
+    {"128x128 4:4:4 with restarts", sampleCover128, sizeof(sampleCover128), false},
+    {"512x512 grayscale", sampleCover512, sizeof(sampleCover512), true},
+};
+
+// the colors of the quadrants of the sample covers, top left to bottom right
+static const uint8_t SAMPLE_COVER_COLORS[4][3] = {{230, 40, 40}, {40, 200, 60}, {50, 70, 220}, {240, 240, 240}};
+
+static bool decodeCover(AlbumArtDecoder &decoder, const uint8_t *jpeg, size_t length, uint16_t *tile)
+{
+    SpotifyReplayClient image(jpeg, length);
+    image.connect("i.scdn.co", 443);
+    return decoder.decode(image, tile, length);
+}
+
+// the pixel at x, y within 2 steps of RGB565 of the color
+static bool nearColor(const uint16_t *tile, uint8_t x, uint8_t y, const uint8_t *rgb)
+{
+    uint16_t pixel = tile[y * ALBUM_ART_SIZE + x];
+    int red = pixel >> 11;
+    int green = (pixel >> 5) & 0x3F;
+    int blue = pixel & 0x1F;
+    return abs(red - rgb[0] * 31 / 255) <= 2 && abs(green - rgb[1] * 63 / 255) <= 4 && abs(blue - rgb[2] * 31 / 255) <= 2;
+}
+
+// The DHT segment of the first huffman table of a cover, with the count of the
+// codes of one length set to count
+static std::vector<uint8_t> withHuffmanCount(const uint8_t *jpeg, size_t length, uint8_t bits, uint8_t count)
+{
+    std::vector<uint8_t> corrupt(jpeg, jpeg + length);
+    for (size_t i = 0; i + 5 + bits < corrupt.size(); i++)
+    {
+        if (corrupt[i] == 0xFF && corrupt[i + 1] == 0xC4)
+        {
+            // marker, length and table class/id, then the 16 counts
+            corrupt[i + 4 + bits] = count;
+            break;
+        }
+    }
+    return corrupt;
+}
+
+// Decodes the sample covers and checks the colors of the tile, then feeds corrupt and
+// cut covers that have to be turned down without touching memory outside the decoder
+static int albumArtDecode()
+{
+    static AlbumArtDecoder decoder;
+    static uint16_t tile[ALBUM_ART_SIZE * ALBUM_ART_SIZE];
+    unsigned long failures = 0;
+    for (const SampleCover &cover : SAMPLE_COVERS)
+    {
+        bool decoded = decodeCover(decoder, cover.jpeg, cover.length, tile);
+        bool passed = decoded;
+        for (uint8_t quadrant = 0; quadrant < 4 && decoded; quadrant++)
+        {
+            uint8_t rgb[3];
+            memcpy(rgb, SAMPLE_COVER_COLORS[quadrant], sizeof(rgb));
+            if (cover.grayscale)
+            {
+                uint8_t luma = (rgb[0] * 299 + rgb[1] * 587 + rgb[2] * 114 + 500) / 1000;
+                rgb[0] = rgb[1] = rgb[2] = luma;
+            }
+            // the middle of the quadrant, away from the blur of the edges
+            uint8_t x = (quadrant % 2) * ALBUM_ART_SIZE / 2 + ALBUM_ART_SIZE / 4;
+            uint8_t y = (quadrant / 2) * ALBUM_ART_SIZE / 2 + ALBUM_ART_SIZE / 4;
+            if (!nearColor(tile, x, y, rgb))
+            {
+                passed = false;
+                fprintf(stderr, "%s: pixel %u,%u is 0x%04x\n", cover.name, x, y, tile[y * ALBUM_ART_SIZE + x]);
+            }
+        }
+        printf("%s: %s %s\n", passed ? "ok" : "FAILED", cover.name, decoded ? "decoded" : decoder.error);
+        failures += passed ? 0 : 1;
+    }
+
+    // counts of codes that do not fit their length: three 1 bit codes, 255 codes of 8 bits
+    const uint8_t corruptCounts[][2] = {{1, 3}, {8, 255}, {2, 5}};
+    for (const uint8_t *count : corruptCounts)
+    {
+        std::vector<uint8_t> corrupt = withHuffmanCount(sampleCover64, sizeof(sampleCover64), count[0], count[1]);
+        bool decoded = decodeCover(decoder, corrupt.data(), corrupt.size(), tile);
+        bool passed = !decoded && strcmp(decoder.error, "bad huffman table") == 0;
+        printf("%s: %u codes of %u bits turned down (%s)\n", passed ? "ok" : "FAILED", count[1], count[0],
+               decoded ? "decoded" : decoder.error);
+        failures += passed ? 0 : 1;
+    }
+
+    // a download that broke off anywhere
+    unsigned long cutAccepted = 0;
+    for (size_t length = 0; length < sizeof(sampleCover128); length += 7)
+    {
+        if (decodeCover(decoder, sampleCover128, length, tile))
+        {
+            cutAccepted++;
+        }
+    }
+    printf("%s: covers cut at %zu places turned down\n", cutAccepted == 0 ? "ok" : "FAILED",
+           (sizeof(sampleCover128) + 6) / 7);
+    failures += cutAccepted == 0 ? 0 : 1;
+    return failures == 0 ? 0 : 1;
+}
+
+// The bar length of getAudioFeatureByIndex() before the bars moved to FEATURE_BARS, the
+// reference of featureBarLength(). It computed in float and grew past the display for
+// tempos above the maximum, so it is clamped to the width here
+static int16_t floatBarLength(FeatureId feature, const AudioFeaturesView &audioFeatures, short popularity,
+                              int16_t width)
+{
+    const short minimumTempo = 50;
+    const short maximumTempo = 200;
+    short length;
+    switch (feature)
+    {
+    case feature_popularity:
+        length = popularity <= 0 ? 0 : (short)((1.0f / (100.0f / popularity)) * width);
+        break;
+    case feature_tempo:
+        length = audioFeatures.tempo() <= minimumTempo ? 0
+               : (short)(1.0f / ((maximumTempo - minimumTempo) / (audioFeatures.tempo() - minimumTempo)) * width);
+        break;
+    case feature_danceability:
+        length = (short)(audioFeatures.danceability() * width);
+        break;
+    case feature_energy:
+        length = (short)(audioFeatures.energy() * width);
+        break;
+    case feature_valence:
+        length = (short)(audioFeatures.valence() * width);
+        break;
+    case feature_speechiness:
+        length = (short)(audioFeatures.speechiness() * width);
+        break;
+    case feature_instrumentalness:
+        length = (short)(audioFeatures.instrumentalness() * width);
+        break;
+    case feature_acousticness:
+        length = (short)(audioFeatures.acousticness() * width);
+        break;
+    default:
+        length = (short)(audioFeatures.liveness() * width);
+        break;
+    }
+    return length < 0 ? 0 : (length > width ? width : length);
+}
+
+static const char *const FEATURE_NAMES[FEATURE_COUNT] = {
+    "popularity", "tempo", "danceability", "energy", "valence", "speechiness", "instrumentalness",
+    "acousticness", "liveness"};
+
+// Compares the fixed point bar of every feature with the float code for every value its field
+// holds (popularity -10 to 120, tempo up to 300 BPM) at every width up to the display. The float
+// code may only be a pixel short where the exact length is a whole number and its division lands
+// just below it
+static int featureBars()
+{
+    unsigned long failures = 0;
+    for (uint8_t feature = 0; feature < FEATURE_COUNT; feature++)
+    {
+        const FeatureBarDescriptor &descriptor = FEATURE_BARS[feature];
+        int32_t first = descriptor.offset == FEATURE_OFFSET_POPULARITY ? -10 : 0;
+        int32_t last = descriptor.offset == FEATURE_OFFSET_POPULARITY ? 120 : (descriptor.wide ? 3000 : 255);
+        unsigned long compared = 0;
+        unsigned long boundaries = 0;
+        unsigned long mismatches = 0;
+        for (int32_t raw = first; raw <= last; raw++)
+        {
+            PackedAudioFeatures packed = {};
+            if (descriptor.offset != FEATURE_OFFSET_POPULARITY)
+            {
+                uint8_t *field = (uint8_t *)&packed + descriptor.offset;
+                if (descriptor.wide)
+                {
+                    *(uint16_t *)field = (uint16_t)raw;
+                }
+                else
+                {
+                    *field = (uint8_t)raw;
+                }
+            }
+            AudioFeaturesView view(packed);
+            short popularity = descriptor.offset == FEATURE_OFFSET_POPULARITY ? (short)raw : 0;
+            FeatureId id = (FeatureId)feature;
+            for (int16_t width = 1; width <= 64; width++)
+            {
+                int16_t length;
+                computeFeatureBars(view, popularity, &id, 1, width, &length);
+                int16_t expected = floatBarLength(id, view, popularity, width);
+                compared++;
+                if (length == expected)
+                {
+                    continue;
+                }
+                int32_t above = raw - (int32_t)descriptor.min * descriptor.scale;
+                int32_t range = (int32_t)(descriptor.max - descriptor.min) * descriptor.scale;
+                bool boundary = above > 0 && above < range && (above * width) % range == 0;
+                if (boundary && length == expected + 1)
+                {
+                    boundaries++;
+                    continue;
+                }
+                if (mismatches++ < 5)
+                {
+                    fprintf(stderr, "%s %ld width %d: %d, float code %d\n", FEATURE_NAMES[feature], (long)raw, width,
+                            length, expected);
+                }
+            }
+        }
+        printf("%s: %s %lu bars, %lu a pixel longer than the float code on a pixel boundary\n", mismatches == 0 ? "ok" : "FAILED",
+               FEATURE_NAMES[feature], compared, boundaries);
+        failures += mismatches;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+static int artCache(const char *directory, const char *albumList, int argc, char **argv)
+{
+    uint32_t budget = ALBUM_ART_CACHE_BUDGET;
+    std::vector<uint8_t> jpeg;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+        {
+            budget = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--jpeg") == 0 && i + 1 < argc && !readFile(argv[++i], jpeg))
+        {
+            fprintf(stderr, "could not read %s\n", argv[i]);
+            return 1;
+        }
+    }
+    FILE *albums = fopen(albumList, "r");
+    if (albums == NULL)
+    {
+        fprintf(stderr, "could not read %s\n", albumList);
+        return 1;
+    }
+
+    fs::FS flash(directory);
+    AlbumArtCache cache(flash, budget);
+    cache.begin();
+    printf("cache: %u of %u tiles on flash\n", cache.count(), cache.capacity());
+
+    GFXcanvas16 canvas(ALBUM_ART_SIZE, ALBUM_ART_SIZE);
+    static AlbumArtDecoder decoder;
+    static uint16_t tile[ALBUM_ART_SIZE * ALBUM_ART_SIZE];
+    unsigned long missMicros = 0;
+    char albumUri[ALBUM_ART_CACHE_URI_LENGTH + 2];
+    while (fgets(albumUri, sizeof(albumUri), albums) != NULL)
+    {
+        albumUri[strcspn(albumUri, "\r\n")] = '\0';
+        if (albumUri[0] == '\0')
+        {
+            continue;
+        }
+        if (cache.contains(albumUri))
+        {
+            cache.draw(albumUri, canvas);
+            continue;
+        }
+        // what the display does on a miss: download and decode, store, draw
+        unsigned long start = micros();
+        if (!jpeg.empty())
+        {
+            SpotifyReplayClient image(jpeg.data(), jpeg.size());
+            image.connect("i.scdn.co", 443);
+            if (!decoder.decode(image, tile, jpeg.size()))
+            {
+                fprintf(stderr, "the cover does not decode: %s\n", decoder.error);
+                fclose(albums);
+                return 1;
+            }
+        }
+        else
+        {
+            uint32_t seed = 0;
+            for (const char *c = albumUri; *c; c++)
+            {
+                seed = seed * 31 + *c;
+            }
+            for (int pixel = 0; pixel < ALBUM_ART_SIZE * ALBUM_ART_SIZE; pixel++)
+            {
+                tile[pixel] = (uint16_t)(seed * 2654435761UL + pixel);
+            }
+        }
+        cache.store(albumUri, tile);
+        cache.draw(albumUri, canvas);
+        missMicros += micros() - start;
+    }
+    fclose(albums);
+
+    AlbumArtCacheStats &stats = cache.stats;
+    unsigned long lookups = stats.hits + stats.misses;
+    printf("%lu lookups, %lu hits, %lu misses, hit rate %.1f%%\n", lookups, stats.hits, stats.misses,
+           lookups > 0 ? stats.hits * 100.0 / lookups : 0.0);
+    printf("%lu stores, %lu evictions, %u tiles cached\n", stats.stores, stats.evictions, cache.count());
+    if (stats.loads > 0)
+    {
+        printf("load from flash to canvas: %.1f us average\n", (double)stats.loadMicros / stats.loads);
+    }
+    if (stats.misses > 0)
+    {
+        printf("miss (%s, store, draw): %.1f us average\n", jpeg.empty() ? "generated tile" : "decode",
+               (double)missMicros / stats.misses);
+    }
+    return 0;
+}
+
+// xorshift32, the same stream for the same seed on every host
+static uint32_t nextRandom(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// An AudioFeatures with every 0.0 to 1.0 feature set to value
+static AudioFeatures audioFeaturesOf(float value, float loudness, float tempo, int key, int mode)
+{
+    AudioFeatures features = {};
+    features.danceability = features.energy = features.speechiness = features.acousticness = value;
+    features.instrumentalness = features.liveness = features.valence = value;
+    features.loudness = loudness;
+    features.tempo = tempo;
+    features.key = key;
+    features.mode = mode;
+    return features;
+}
+
+// the features of a view, in the order of audioFeaturesOf
+static void viewedFeatures(const AudioFeaturesView &view, float *values)
+{
+    values[0] = view.danceability();
+    values[1] = view.energy();
+    values[2] = view.speechiness();
+    values[3] = view.acousticness();
+    values[4] = view.instrumentalness();
+    values[5] = view.liveness();
+    values[6] = view.valence();
+}
+
+struct PackedFeaturesCase
+{
+    const char *name;
+    AudioFeatures features;
+    // what AudioFeaturesView reads back
+    float value;
+    float loudness;
+    float tempo;
+    int key;
+    int mode;
+};
+
+// Packs edge values and a random sweep of features and reads them back through
+// AudioFeaturesView: edge values have to be clamped, all others come back within half a step
+static int packedFeatures(int argc, char **argv)
+{
+    uint32_t seed = 1;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoul(argv[++i], NULL, 10) | 1;
+        }
+    }
+    const PackedFeaturesCase cases[] = {
+        {"zero", audioFeaturesOf(0, 0, 0, 0, 0), 0, 0, 0, 0, 0},
+        {"half", audioFeaturesOf(0.5f, -30, 120.04f, 11, 1), 128 / 255.0f, -30, 120, 11, 1},
+        {"full", audioFeaturesOf(1, -63.5f, 6553, 5, 1), 1, -63.5f, 6553, 5, 1},
+        {"negative", audioFeaturesOf(-0.2f, 2.5f, -10, -1, 0), 0, 0, 0, -1, 0},
+        {"beyond the range", audioFeaturesOf(1.7f, -140, 9000, 12, 1), 1, -127, 6553, -1, 1},
+        {"not a number", audioFeaturesOf(NAN, NAN, NAN, 3, 0), 0, 0, 0, 3, 0},
+    };
+    unsigned long failures = 0;
+    for (const PackedFeaturesCase &test : cases)
+    {
+        PackedAudioFeatures packed;
+        ArduinoSpotify::packAudioFeatures(test.features, packed);
+        AudioFeaturesView view(packed);
+        float values[7];
+        viewedFeatures(view, values);
+        bool passed = view.loudness() == test.loudness && view.tempo() == test.tempo && view.key() == test.key &&
+                      view.mode() == test.mode;
+        for (float value : values)
+        {
+            passed = passed && value == test.value;
+        }
+        printf("%s: %s\n", passed ? "ok" : "FAILED", test.name);
+        if (!passed)
+        {
+            fprintf(stderr, "  read back %.4f, %.1f dB, %.1f BPM, key %d, mode %d\n", values[0], view.loudness(),
+                    view.tempo(), view.key(), view.mode());
+            failures++;
+        }
+    }
+
+    const unsigned long sweep = 100000;
+    unsigned long outside = 0;
+    for (unsigned long i = 0; i < sweep; i++)
+    {
+        float value = (nextRandom(seed) % 100001) / 100000.0f;
+        float loudness = -(float)(nextRandom(seed) % 60001) / 1000;
+        float tempo = (nextRandom(seed) % 250001) / 1000.0f;
+        int key = (int)(nextRandom(seed) % 13) - 1;
+        int mode = nextRandom(seed) % 2;
+        PackedAudioFeatures packed;
+        ArduinoSpotify::packAudioFeatures(audioFeaturesOf(value, loudness, tempo, key, mode), packed);
+        AudioFeaturesView view(packed);
+        float values[7];
+        viewedFeatures(view, values);
+        // half a step of each field and the rounding of float
+        bool within = fabsf(view.loudness() - loudness) <= 0.25f + 1e-4f &&
+                      fabsf(view.tempo() - tempo) <= 0.05f + 1e-4f && view.key() == key && view.mode() == mode;
+        for (float read : values)
+        {
+            within = within && fabsf(read - value) <= 0.5f / 255 + 1e-6f;
+        }
+        if (!within && outside++ < 5)
+        {
+            fprintf(stderr, "  %.5f, %.3f dB, %.3f BPM, key %d, mode %d read back as %.5f, %.1f dB, %.1f BPM, key %d, mode %d\n",
+                    value, loudness, tempo, key, mode, values[0], view.loudness(), view.tempo(), view.key(), view.mode());
+        }
+    }
+    printf("%s: %lu random features read back within half a step\n", outside == 0 ? "ok" : "FAILED", sweep - outside);
+    failures += outside;
+    return failures == 0 ? 0 : 1;
+}
+
+// the window of ListeningWindow counted from scratch
+static ListeningStats recount(const std::deque<ListeningHistoryEntry> &entries, uint32_t now, uint32_t bucketSeconds)
+{
+    uint32_t newestBucket = now / bucketSeconds;
+    uint32_t sums[6] = {0};
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const ListeningHistoryEntry &entry = entries[i];
+        uint32_t bucket = (entry.startedAt + entry.listenedSeconds) / bucketSeconds;
+        if (bucket > newestBucket || bucket + LISTENING_WINDOW_BUCKETS <= newestBucket)
+        {
+            continue;
+        }
+        sums[0]++;
+        sums[1] += entry.listenedSeconds;
+        if (entry.flags & LISTENING_HAS_FEATURES)
+        {
+            sums[2]++;
+            sums[3] += entry.features.energy;
+            sums[4] += entry.features.valence;
+            sums[5] += entry.features.tempo;
+        }
+    }
+    ListeningStats stats = {sums[0], sums[1], sums[2], 0, 0, 0};
+    if (sums[2] > 0)
+    {
+        stats.energy = sums[3] / (255.0f * sums[2]);
+        stats.valence = sums[4] / (255.0f * sums[2]);
+        stats.tempo = sums[5] / (10.0f * sums[2]);
+    }
+    return stats;
+}
+
+static bool sameStats(const ListeningStats &a, const ListeningStats &b)
+{
+    return a.tracks == b.tracks && a.listenedSeconds == b.listenedSeconds && a.featureTracks == b.featureTracks &&
+           a.energy == b.energy && a.valence == b.valence && a.tempo == b.tempo;
+}
+
+static void printStats(const char *name, const ListeningStats &stats)
+{
+    printf("%s: %lu tracks, %lu min, energy %.3f valence %.3f tempo %.1f (%lu with features)\n", name,
+           (unsigned long)stats.tracks, (unsigned long)stats.listenedSeconds / 60, stats.energy, stats.valence,
+           stats.tempo, (unsigned long)stats.featureTracks);
+}
+
+static int history(unsigned long tracks, int argc, char **argv)
+{
+    const char *directory = NULL;
+    uint32_t seed = 1;
+    unsigned long checkEvery = 9973;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--log") == 0 && i + 1 < argc)
+        {
+            directory = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoul(argv[++i], NULL, 10) | 1;
+        }
+        else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc)
+        {
+            checkEvery = strtoul(argv[++i], NULL, 10);
+        }
+    }
+
+    fs::FS flash(directory != NULL ? directory : ".");
+    ListeningHistory listening(flash);
+    if (directory != NULL && !listening.begin())
+    {
+        printf("the log in %s was damaged, %lu records dropped\n", directory, listening.counters.damagedRecords);
+    }
+    unsigned long logged = listening.count();
+
+    // the day before now, kept for the recount
+    std::deque<ListeningHistoryEntry> recent;
+    uint32_t now = 1700000000;
+    if (listening.count() > 0)
+    {
+        now = listening.entry(0).startedAt + listening.entry(0).listenedSeconds;
+    }
+    // the recount only knows the new tracks, the windows also hold the ones of the log
+    uint32_t firstCheckAt = logged > 0 ? now + 90000 : 0;
+    unsigned long appendMicros = 0;
+    unsigned long checks = 0;
+    for (unsigned long track = 0; track < tracks; track++)
+    {
+        // mostly back to back, sometimes a break, rarely a night
+        uint32_t pick = nextRandom(seed) % 100;
+        uint32_t gap = pick < 90 ? nextRandom(seed) % 5 : pick < 99 ? 60 + nextRandom(seed) % 3600
+                                                                     : 7200 + nextRandom(seed) % 36000;
+        ListeningHistoryEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.trackKey = nextRandom(seed) % 5000 + 1;
+        entry.startedAt = now + gap;
+        entry.listenedSeconds = 30 + nextRandom(seed) % 390;
+        if (nextRandom(seed) % 5 != 0)
+        {
+            entry.flags = LISTENING_HAS_FEATURES;
+            entry.features.energy = nextRandom(seed);
+            entry.features.valence = nextRandom(seed);
+            entry.features.tempo = 600 + nextRandom(seed) % 1500;
+        }
+        now = entry.startedAt + entry.listenedSeconds;
+
+        unsigned long start = micros();
+        listening.append(entry);
+        appendMicros += micros() - start;
+
+        recent.push_back(entry);
+        while (recent.front().startedAt + recent.front().listenedSeconds + 90000 < now)
+        {
+            recent.pop_front();
+        }
+        if (((checkEvery > 0 && (track + 1) % checkEvery == 0) || track + 1 == tracks) && now >= firstCheckAt)
+        {
+            checks++;
+            if (!sameStats(listening.lastHour(now), recount(recent, now, 3600 / LISTENING_WINDOW_BUCKETS)) ||
+                !sameStats(listening.lastDay(now), recount(recent, now, 86400 / LISTENING_WINDOW_BUCKETS)))
+            {
+                fprintf(stderr, "the averages differ from the recount after %lu tracks\n", track + 1);
+                printStats("last hour", listening.lastHour(now));
+                printStats("recount", recount(recent, now, 3600 / LISTENING_WINDOW_BUCKETS));
+                printStats("last day", listening.lastDay(now));
+                printStats("recount", recount(recent, now, 86400 / LISTENING_WINDOW_BUCKETS));
+                return 1;
+            }
+        }
+    }
+    for (uint16_t age = 0; age < listening.count() && age < recent.size(); age++)
+    {
+        if (memcmp(&listening.entry(age), &recent[recent.size() - 1 - age], sizeof(ListeningHistoryEntry)) != 0)
+        {
+            fprintf(stderr, "history entry %u is not the track added %u tracks ago\n", age, age);
+            return 1;
+        }
+    }
+
+    printf("%lu tracks, %lu checks against the recount passed\n", tracks, checks);
+    printf("append: %.3f us average\n", tracks > 0 ? (double)appendMicros / tracks : 0.0);
+    printStats("last hour", listening.lastHour(now));
+    printStats("last day", listening.lastDay(now));
+
+    if (directory != NULL)
+    {
+        ListeningHistoryCounters &counters = listening.counters;
+        printf("log: %lu tracks read back at start, %lu bytes written, %lu segments, %lu write errors\n", logged,
+               counters.bytesWritten, counters.segments, counters.writeErrors);
+        // a restart: the same history from the log alone
+        ListeningHistory restarted(flash);
+        restarted.begin();
+        bool sameEntries = restarted.count() == listening.count();
+        for (uint16_t age = 0; sameEntries && age < restarted.count(); age++)
+        {
+            sameEntries = memcmp(&restarted.entry(age), &listening.entry(age), sizeof(ListeningHistoryEntry)) == 0;
+        }
+        printf("read back: history %s, last hour %s, last day %s\n", sameEntries ? "same" : "DIFFERENT",
+               sameStats(restarted.lastHour(now), listening.lastHour(now)) ? "same" : "DIFFERENT",
+               sameStats(restarted.lastDay(now), listening.lastDay(now)) ? "same" : "longer than the log");
+        if (!sameEntries)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int snapshot(const char *directory, int argc, char **argv)
+{
+    std::vector<uint8_t> jpeg;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--jpeg") == 0 && i + 1 < argc && !readFile(argv[++i], jpeg))
+        {
+            fprintf(stderr, "could not read %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // the cover goes through the cache like on the device
+    const char albumUri[] = "spotify:album:snapshot";
+    fs::FS flash(directory);
+    AlbumArtCache cache(flash);
+    cache.begin();
+    static AlbumArtDecoder decoder;
+    static uint16_t tile[ALBUM_ART_SIZE * ALBUM_ART_SIZE];
+    if (!jpeg.empty())
+    {
+        SpotifyReplayClient image(jpeg.data(), jpeg.size());
+        image.connect("i.scdn.co", 443);
+        if (!decoder.decode(image, tile, jpeg.size()))
+        {
+            fprintf(stderr, "the cover does not decode: %s\n", decoder.error);
+            return 1;
+        }
+    }
+    else
+    {
+        for (int pixel = 0; pixel < ALBUM_ART_SIZE * ALBUM_ART_SIZE; pixel++)
+        {
+            int x = pixel % ALBUM_ART_SIZE;
+            int y = pixel / ALBUM_ART_SIZE;
+            tile[pixel] = ((x >> 1) << 11) | ((y) << 5) | ((63 - x - y) / 4 & 0x1F);
+        }
+    }
+    cache.store(albumUri, tile);
+
+    // a day of listening, ending now
+    const uint32_t now = 1700000000;
+    ListeningHistory listening(flash);
+    uint32_t seed = 7;
+    for (uint32_t startedAt = now - 86400; startedAt < now - 400;)
+    {
+        ListeningHistoryEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.trackKey = nextRandom(seed);
+        entry.startedAt = startedAt;
+        entry.listenedSeconds = 120 + nextRandom(seed) % 200;
+        entry.flags = LISTENING_HAS_FEATURES;
+        entry.features.energy = nextRandom(seed);
+        entry.features.valence = nextRandom(seed);
+        entry.features.tempo = 800 + nextRandom(seed) % 800;
+        listening.append(entry);
+        startedAt += entry.listenedSeconds + (nextRandom(seed) % 10 == 0 ? 3600 : 5);
+    }
+
+    PackedAudioFeatures features = {150, 200, 20, 60, 5, 30, 170, 12, 1185, 0x85, 0};
+    const FeatureId featuresToDraw[6] = {feature_popularity, feature_tempo, feature_danceability,
+                                         feature_energy, feature_valence, feature_speechiness};
+    int16_t lengths[6];
+    computeFeatureBars(AudioFeaturesView(features), 73, featuresToDraw, 6, 64, lengths);
+
+    const PlaybackTheme theme = {0xFFFF, 0x0000, 0x0333, 0x8000, 0x07E0, 0x0000};
+    PlaybackModel model = {false, true, "Snapshot", "A rather long artist name", 83000, 215000,
+                           featuresToDraw, lengths, 6, true, &cache, albumUri, true, &listening,
+                           now, "Error", theme, true, "A lyric line that scrolls along", "and the next one",
+                           true, 40, 54000};
+    GFXcanvas16 canvas(64, 64);
+    PlaybackPages pages(canvas, model, 50);
+    const uint32_t budgetUs = 40000;
+
+    for (uint8_t index = 0; index < PLAYBACK_PAGE_COUNT; index++)
+    {
+        model.error = index == page_error;
+        model.playing = index == page_now_playing || index == page_lyrics || index == page_visualizer ||
+                        index == page_audio_features;
+        pages.scheduler.showPage(index);
+        PageSchedulerStats before = pages.scheduler.stats;
+        // until everything is drawn, scrolling text never settles
+        unsigned long frames = 0;
+        do
+        {
+            pages.renderFrame(budgetUs);
+            frames++;
+        } while (!pages.scheduler.settled() && frames < 20);
+        if (pages.scheduler.currentPage() != index)
+        {
+            fprintf(stderr, "page %s is not shown\n", pages.page(index).name);
+            return 1;
+        }
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s.png", directory, pages.page(index).name);
+        if (!writePng(path, canvas))
+        {
+            fprintf(stderr, "could not write %s\n", path);
+            return 1;
+        }
+        PageSchedulerStats &after = pages.scheduler.stats;
+        printf("%-15s %lu draws, %lu deferred, %lu frames -> %s\n", pages.page(index).name,
+               after.draws - before.draws, after.deferred - before.deferred, frames, path);
+    }
+
+    // the switch between the two playing pages keeps the title and the progress
+    model.error = false;
+    model.playing = true;
+    pages.scheduler.showPage(page_now_playing);
+    for (int frame = 0; frame < 3; frame++)
+    {
+        pages.renderFrame(budgetUs);
+    }
+    PageSchedulerStats before = pages.scheduler.stats;
+    pages.scheduler.showPage(page_audio_features);
+    pages.renderFrame(budgetUs);
+    printf("switch now_playing -> audio_features: %lu draws of %u widgets\n",
+           pages.scheduler.stats.draws - before.draws, pages.page(page_audio_features).widgetCount);
+    printf("slowest frame %lu us, %lu frames over the budget of %lu us\n",
+           (unsigned long)pages.scheduler.stats.slowestFrameUs, pages.scheduler.stats.overBudget,
+           (unsigned long)budgetUs);
+    return 0;
+}
+
+// A widget that fills its region with its content as the color and counts its draws
+class CountingWidget : public Widget
+{
+public:
+    CountingWidget(const Region &region, uint32_t costUs) : Widget(region, costUs) {}
+
+    bool changed() override { return content != drawnContent; }
+    void draw(Adafruit_GFX &display) override
+    {
+        display.fillRect(region.x, region.y, region.w, region.h, content);
+        drawnContent = content;
+        draws++;
+    }
+
+    uint16_t content = 1;
+    uint16_t drawnContent = 0;
+    unsigned long draws = 0;
+};
+
+static bool pageAllowed(void *context)
+{
+    return *(const bool *)context;
+}
+
+// The draws of one frame per widget, "a1 b0 c1"
+static std::string frameDraws(PageScheduler &scheduler, GFXcanvas16 &canvas, uint32_t budgetUs,
+                              CountingWidget *const *widgets, uint8_t count)
+{
+    unsigned long before[8];
+    for (uint8_t index = 0; index < count; index++)
+    {
+        before[index] = widgets[index]->draws;
+    }
+    scheduler.renderFrame(canvas, budgetUs);
+    std::string draws;
+    for (uint8_t index = 0; index < count; index++)
+    {
+        draws += (index > 0 ? " " : "") + std::string(1, (char)('a' + index)) +
+                 std::to_string(widgets[index]->draws - before[index]);
+    }
+    return draws;
+}
+
+// Runs the page scheduler on counting widgets and checks which of them every frame draws: a
+// new page in full, then only what changed, a page switch only the widgets that are new or
+// were cleared over, a frame over its budget the rest in the next frames
+static int pageScheduling()
+{
+    GFXcanvas16 canvas(64, 64);
+    const uint16_t background = 0x0841;
+    // a and b are at the top, c below them, d overlaps c, e is expensive
+    CountingWidget a({0, 0, 64, 8}, 1000);
+    CountingWidget b({0, 8, 64, 8}, 1000);
+    CountingWidget c({0, 16, 64, 16}, 1000);
+    CountingWidget d({0, 24, 64, 16}, 1000);
+    CountingWidget e({0, 40, 64, 24}, 30000);
+    CountingWidget *const all[5] = {&a, &b, &c, &d, &e};
+    Widget *const first[3] = {&a, &b, &c};
+    Widget *const second[3] = {&a, &b, &d};
+    Widget *const third[3] = {&a, &c, &d};
+    Widget *const fourth[3] = {&a, &b, &c};
+    Widget *const expensive[3] = {&c, &d, &e};
+    bool secondAllowed = true;
+    const Page pages[5] = {{"first", first, 3, 0, NULL, NULL},
+                           {"second", second, 3, 0, pageAllowed, &secondAllowed},
+                           {"third", third, 3, 0, NULL, NULL},
+                           {"fourth", fourth, 3, 0, NULL, NULL},
+                           {"expensive", expensive, 3, 0, NULL, NULL}};
+    PageScheduler scheduler(pages, 5, background);
+    const uint32_t budgetUs = 20000;
+    unsigned long failures = 0;
+    auto expect = [&](const char *name, const std::string &draws, const char *expected) {
+        bool passed = draws == expected;
+        printf("%s: %s\n", passed ? "ok" : "FAILED", name);
+        if (!passed)
+        {
+            fprintf(stderr, "  drew %s, expected %s\n", draws.c_str(), expected);
+            failures++;
+        }
+    };
+
+    expect("the first page is drawn in full", frameDraws(scheduler, canvas, budgetUs, all, 5), "a1 b1 c1 d0 e0");
+    expect("nothing changed, nothing drawn", frameDraws(scheduler, canvas, budgetUs, all, 5), "a0 b0 c0 d0 e0");
+    b.content = 2;
+    expect("only the changed widget is drawn", frameDraws(scheduler, canvas, budgetUs, all, 5), "a0 b1 c0 d0 e0");
+
+    // c leaves and is cleared, d is new, a and b stay
+    scheduler.showPage(1);
+    expect("a switch draws the new widget", frameDraws(scheduler, canvas, budgetUs, all, 5), "a0 b0 c0 d1 e0");
+    bool cleared = canvas.getPixel(10, 18) == background && canvas.getPixel(10, 26) == d.content;
+    printf("%s: the region of the leaving widget is cleared\n", cleared ? "ok" : "FAILED");
+    failures += cleared ? 0 : 1;
+
+    // d leaves over c, so c is drawn again although it did not change
+    scheduler.showPage(2);
+    frameDraws(scheduler, canvas, budgetUs, all, 5);
+    scheduler.showPage(3);
+    expect("a widget under a cleared one is drawn again", frameDraws(scheduler, canvas, budgetUs, all, 5),
+           "a0 b1 c1 d0 e0");
+
+    secondAllowed = false;
+    scheduler.showPage(1);
+    frameDraws(scheduler, canvas, budgetUs, all, 5);
+    bool stayed = scheduler.currentPage() == 3;
+    printf("%s: a page that is not available is not shown\n", stayed ? "ok" : "FAILED");
+    failures += stayed ? 0 : 1;
+
+    // e alone takes more than the budget: drawn in a frame of its own, the rest follows
+    scheduler.showPage(4);
+    c.content = d.content = 3;
+    expect("a frame stops at its budget", frameDraws(scheduler, canvas, budgetUs, all, 5), "a0 b0 c1 d1 e0");
+    // first in line, e is not starved by c that changed again
+    c.content = 4;
+    expect("the deferred widget goes first", frameDraws(scheduler, canvas, budgetUs, all, 5), "a0 b0 c1 d0 e1");
+    bool settled = frameDraws(scheduler, canvas, budgetUs, all, 5) == "a0 b0 c0 d0 e0" && scheduler.settled();
+    printf("%s: settled after the deferred draws\n", settled ? "ok" : "FAILED");
+    failures += settled ? 0 : 1;
+
+    scheduler.redrawAll(0);
+    expect("a redraw draws the whole page", frameDraws(scheduler, canvas, budgetUs, all, 5), "a0 b0 c1 d1 e0");
+    return failures == 0 ? 0 : 1;
+}
+
+// the tasks of --scheduler count their runs here
+static unsigned long schedulerRuns[4];
+static volatile uint8_t schedulerRunning = TASK_NONE;
+static uint8_t schedulerRunningSeen = TASK_NONE;
+static uint32_t schedulerOverrunUs;
+
+static void countRun0() { schedulerRuns[0]++; }
+static void countRun1() { schedulerRuns[1]++; }
+static void countRun2() { schedulerRuns[2]++; }
+static void slowRun3()
+{
+    schedulerRuns[3]++;
+    schedulerRunningSeen = schedulerRunning;
+    advanceClock(5);
+}
+
+static void countOverrun(const Task &task, uint32_t runtimeUs)
+{
+    schedulerOverrunUs = runtimeUs;
+}
+
+// Calls runDue() for a number of ms of the clock in steps of stepMs, runs every call
+static void runScheduler(TaskScheduler &scheduler, unsigned long ms, unsigned long stepMs, uint8_t calls)
+{
+    for (unsigned long elapsed = 0; elapsed < ms; elapsed += stepMs)
+    {
+        for (uint8_t call = 0; call < calls; call++)
+        {
+            scheduler.runDue();
+        }
+        advanceClock(stepMs);
+    }
+}
+
+// Runs tasks on the scheduler with the clock moved forward by hand and checks the runs:
+// periodic tasks next to tasks of period 0, skipped periods, the most overdue task first,
+// a run over its budget and the index of the running task
+static int schedulerChecks()
+{
+    unsigned long failures = 0;
+    auto check = [&](const char *name, bool passed) {
+        printf("%s: %s\n", passed ? "ok" : "FAILED", name);
+        if (!passed)
+        {
+            fprintf(stderr, "  runs %lu %lu %lu %lu\n", schedulerRuns[0], schedulerRuns[1], schedulerRuns[2],
+                    schedulerRuns[3]);
+            failures++;
+        }
+    };
+
+    // two tasks of period 0 next to one of 100 ms, three calls per 10 ms
+    {
+        memset(schedulerRuns, 0, sizeof(schedulerRuns));
+        Task tasks[] = {{"every_call_a", countRun0, 0, 1000, 0, {}},
+                        {"every_call_b", countRun1, 0, 1000, 0, {}},
+                        {"periodic", countRun2, 100, 1000, 0, {}}};
+        TaskScheduler scheduler(tasks, 3);
+        scheduler.begin();
+        runScheduler(scheduler, 1000, 10, 3);
+        check("a periodic task runs next to tasks of period 0", schedulerRuns[2] >= 9 && schedulerRuns[2] <= 11);
+        check("tasks of period 0 take turns", schedulerRuns[0] + 1 >= schedulerRuns[1] &&
+                                              schedulerRuns[1] + 1 >= schedulerRuns[0]);
+        check("every call runs a task", schedulerRuns[0] + schedulerRuns[1] + schedulerRuns[2] == 300);
+        check("no periods of the periodic task missed", tasks[2].stats.missed == 0);
+    }
+
+    // the periods that passed are skipped, not run in a burst
+    {
+        memset(schedulerRuns, 0, sizeof(schedulerRuns));
+        Task tasks[] = {{"periodic", countRun0, 100, 1000, 0, {}}};
+        TaskScheduler scheduler(tasks, 1);
+        scheduler.begin();
+        advanceClock(350);
+        scheduler.runDue();
+        uint32_t waitMs = scheduler.runDue();
+        check("three skipped periods are missed, not run", schedulerRuns[0] == 1 && tasks[0].stats.missed == 3 &&
+                                                           tasks[0].stats.latestMs >= 350);
+        check("the next run stays on the grid of the period", waitMs >= 45 && waitMs <= 50);
+    }
+
+    // the task that is due longest runs first, one per call
+    {
+        memset(schedulerRuns, 0, sizeof(schedulerRuns));
+        Task tasks[] = {{"due_later", countRun0, 1000, 1000, 50, {}},
+                        {"due_first", countRun1, 1000, 1000, 0, {}}};
+        TaskScheduler scheduler(tasks, 2);
+        scheduler.begin();
+        advanceClock(100);
+        scheduler.runDue();
+        bool first = schedulerRuns[0] == 0 && schedulerRuns[1] == 1;
+        scheduler.runDue();
+        check("the most overdue task runs first", first && schedulerRuns[0] == 1);
+    }
+
+    // a run over the budget is counted and reported, the running task is published
+    {
+        memset(schedulerRuns, 0, sizeof(schedulerRuns));
+        schedulerOverrunUs = 0;
+        Task tasks[] = {{"quick", countRun0, 1000, 1000, 10, {}},
+                        {"slow", slowRun3, 1000, 1000, 0, {}}};
+        TaskScheduler scheduler(tasks, 2);
+        scheduler.onOverrun = countOverrun;
+        scheduler.runningTask = &schedulerRunning;
+        scheduler.begin();
+        scheduler.runDue();
+        check("a run over the budget is reported", tasks[1].stats.overruns == 1 && schedulerOverrunUs >= 5000 &&
+                                                   tasks[1].stats.slowestUs >= 5000);
+        check("the running task is published", schedulerRunningSeen == 1 && schedulerRunning == TASK_NONE);
+        check("the slow run shows in the histogram", TaskScheduler::percentileUs(tasks[1].stats, 50) >= 5000);
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+// the WiFi connection against the simulated AP, with a clock moved forward by hand
+static int wifiChecks()
+{
+    const uint8_t bssid[6] = {0x24, 0x65, 0x11, 0x3a, 0x07, 0xc2};
+    const WifiAddress lease = {0x1701A8C0, 0x0101A8C0, 0x00FFFFFF, 0x0101A8C0};
+    SimulatedWifiDriver driver(bssid, 6, lease);
+    driver.dhcpLeaseSeconds = 3600;
+    WifiCache cache;
+    memset(&cache, 0, sizeof(cache));
+    WifiConnection connection(driver, "home", "secret", cache);
+
+    unsigned long failures = 0;
+    auto check = [&](const char *name, bool passed) {
+        printf("%s: %s\n", passed ? "ok" : "FAILED", name);
+        if (!passed)
+        {
+            fprintf(stderr, "  scans %lu, DHCP requests %lu, fast %lu, fast failed %lu, address %08x\n",
+                    driver.scans, driver.dhcpRequests, connection.stats.fastConnects, connection.stats.fastFailures,
+                    cache.address.ip);
+            failures++;
+        }
+    };
+    auto run = [&](unsigned long ms) {
+        for (unsigned long elapsed = 0; elapsed < ms; elapsed += 100)
+        {
+            advanceClock(100);
+            connection.update();
+        }
+    };
+    auto untilConnected = [&]() {
+        for (unsigned long waitedMs = 0; !connection.connected() && waitedMs < 600000; waitedMs += 100)
+        {
+            run(100);
+        }
+        return connection.connected();
+    };
+    // the link drops and the AP is back before the next attempt is through
+    auto blip = [&]() {
+        driver.setAccessPoint(false);
+        run(100);
+        driver.setAccessPoint(true);
+        return untilConnected();
+    };
+    // the AP stays away long enough for attempts to fail
+    auto outage = [&](unsigned long ms) {
+        driver.setAccessPoint(false);
+        run(ms);
+        driver.setAccessPoint(true);
+        return untilConnected();
+    };
+
+    connection.begin();
+    check("the first connect scans and asks DHCP",
+          untilConnected() && driver.scans == 1 && driver.dhcpRequests == 1 && cache.address.ip == lease.ip);
+
+    unsigned long scans = driver.scans;
+    unsigned long dhcpRequests = driver.dhcpRequests;
+    check("a reconnect within the lease uses the address without DHCP",
+          blip() && driver.scans == scans && driver.dhcpRequests == dhcpRequests &&
+              connection.stats.fastConnects == 1);
+
+    run(3600UL * 1000);
+    check("a reconnect after the lease ran out asks DHCP",
+          blip() && driver.scans == scans && driver.dhcpRequests == dhcpRequests + 1);
+    check("the new lease is used by the next reconnect",
+          blip() && driver.scans == scans && driver.dhcpRequests == dhcpRequests + 1);
+
+    check("after a failed attempt the address comes from DHCP",
+          outage(20000) && connection.stats.failures > 0 && driver.dhcpRequests > dhcpRequests + 1);
+
+    const uint32_t movedIp = lease.ip + (150UL << 24);
+    driver.changeLease(movedIp);
+    unsigned long fastFailures = connection.stats.fastFailures;
+    dhcpRequests = driver.dhcpRequests;
+    check("an address given away fails the fast connect and DHCP follows",
+          blip() && connection.stats.fastFailures == fastFailures + 1 &&
+              driver.dhcpRequests == dhcpRequests + 1 && cache.address.ip == movedIp);
+    check("the stale address is not tried again",
+          blip() && connection.stats.fastFailures == fastFailures + 1 && driver.dhcpRequests == dhcpRequests + 1);
+
+    // without a lease time the address of DHCP is not reused
+    driver.dhcpLeaseSeconds = 0;
+    outage(20000);
+    dhcpRequests = driver.dhcpRequests;
+    check("an address without a known lease is not reused", blip() && driver.dhcpRequests == dhcpRequests + 1);
+    driver.dhcpLeaseSeconds = 3600;
+    blip();
+
+    scans = driver.scans;
+    driver.moveAccessPoint(11);
+    run(100);
+    check("an AP on another channel is found by a scan", untilConnected() && driver.scans == scans + 1);
+
+    // away through the first round of attempts, then back on another channel
+    scans = driver.scans;
+    fastFailures = connection.stats.fastFailures;
+    driver.setAccessPoint(false);
+    for (unsigned long waitedMs = 0; connection.currentState() != wifi_retry_wait && waitedMs < 60000; waitedMs += 100)
+    {
+        run(100);
+    }
+    driver.moveAccessPoint(3);
+    driver.setAccessPoint(true);
+    check("a retry scans before it tries the known AP",
+          untilConnected() && connection.stats.fastFailures == fastFailures + 1 && driver.scans == scans + 2);
+
+    // a reset keeps the cache but not millis()
+    scans = driver.scans;
+    dhcpRequests = driver.dhcpRequests;
+    connection.begin();
+    check("after a reset the known AP is used with DHCP",
+          untilConnected() && driver.scans == scans && driver.dhcpRequests == dhcpRequests + 1);
+
+    return failures == 0 ? 0 : 1;
+}
+
+static int wifi(unsigned long outages, int argc, char **argv)
+{
+    uint32_t seed = 1;
+    bool noCache = false;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoul(argv[++i], NULL, 10) | 1;
+        }
+        else if (strcmp(argv[i], "--no-cache") == 0)
+        {
+            noCache = true;
+        }
+    }
+
+    const uint8_t bssid[6] = {0x24, 0x65, 0x11, 0x3a, 0x07, 0xc2};
+    // 192.168.1.23/24, in the byte order of the ESP32 IPAddress
+    const WifiAddress lease = {0x1701A8C0, 0x0101A8C0, 0x00FFFFFF, 0x0101A8C0};
+    SimulatedWifiDriver driver(bssid, 6, lease);
+    WifiCache cache;
+    memset(&cache, 0, sizeof(cache));
+    WifiConnection connection(driver, "home", "secret", cache);
+
+    // the update task of the app runs every 100 ms
+    const unsigned long stepMs = 100;
+    bool apOn = true;
+    auto run = [&](unsigned long ms) -> bool {
+        for (unsigned long elapsed = 0; elapsed < ms; elapsed += stepMs)
+        {
+            if (noCache)
+            {
+                connection.clearCache();
+            }
+            advanceClock(stepMs);
+            connection.update();
+            if (connection.connected() && !apOn)
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto untilConnected = [&](unsigned long &waitedMs) -> bool {
+        waitedMs = 0;
+        while (!connection.connected() && waitedMs < 600000)
+        {
+            run(stepMs);
+            waitedMs += stepMs;
+        }
+        return connection.connected();
+    };
+
+    connection.begin();
+    unsigned long waitedMs;
+    if (!untilConnected(waitedMs))
+    {
+        fprintf(stderr, "the first connection did not come up\n");
+        return 1;
+    }
+    printf("first connection after %lu ms\n", waitedMs);
+
+    unsigned long events[3] = {0, 0, 0};
+    unsigned long totalBackMs = 0;
+    unsigned long slowestBackMs = 0;
+    for (unsigned long outage = 0; outage < outages; outage++)
+    {
+        run(5000 + nextRandom(seed) % 55000);
+        uint32_t pick = nextRandom(seed) % 100;
+        uint32_t event = pick < 70 ? 0 : pick < 85 ? 1 : 2;
+        events[event]++;
+        driver.setAccessPoint(false);
+        apOn = false;
+        if (!run(1000 + nextRandom(seed) % 29000))
+        {
+            fprintf(stderr, "connected while the access point was off (outage %lu)\n", outage);
+            return 1;
+        }
+        if (event == 1)
+        {
+            driver.moveAccessPoint(1 + nextRandom(seed) % 11);
+        }
+        else if (event == 2)
+        {
+            driver.changeLease(lease.ip + ((100 + nextRandom(seed) % 100) << 24));
+        }
+        driver.setAccessPoint(true);
+        apOn = true;
+        // from the AP being back until the link is up again
+        if (!untilConnected(waitedMs))
+        {
+            fprintf(stderr, "no reconnect after outage %lu\n", outage);
+            return 1;
+        }
+        totalBackMs += waitedMs;
+        if (waitedMs > slowestBackMs)
+        {
+            slowestBackMs = waitedMs;
+        }
+    }
+
+    const WifiStats &stats = connection.stats;
+    printf("%lu outages: %lu plain, %lu new channel, %lu new lease%s\n", outages, events[0], events[1], events[2],
+           noCache ? ", without the cache" : "");
+    printf("connects %lu (fast %lu, fast failed %lu), failed attempts %lu, disconnects %lu\n", stats.connects,
+           stats.fastConnects, stats.fastFailures, stats.failures, stats.disconnects);
+    printf("connect: last %u ms, slowest %u ms; scans %lu, DHCP requests %lu\n", stats.lastConnectMs,
+           stats.slowestConnectMs, driver.scans, driver.dhcpRequests);
+    printf("reconnect after the outage: longest %u ms, average %.0f ms\n", stats.longestOutageMs,
+           outages > 0 ? (double)stats.totalOutageMs / outages : 0.0);
+    printf("after the AP is back: average %.0f ms, slowest %lu ms\n",
+           outages > 0 ? (double)totalBackMs / outages : 0.0, slowestBackMs);
+    return 0;
+}
+
+// counts what the power manager switches instead of a panel and a CPU
+class SimulatedPower : public PowerDriver
+{
+public:
+    void panel(bool on) override
+    {
+        panelOn = on;
+        panelSwitches++;
+    }
+    void cpuFrequency(uint32_t mhz) override { cpuMhz = mhz; }
+
+    bool panelOn = false;
+    uint32_t cpuMhz = 0;
+    unsigned long panelSwitches = 0;
+};
+
+static int powerStandby(unsigned long hours, int argc, char **argv)
+{
+    uint32_t seed = 1;
+    uint32_t timeoutMs = POWER_IDLE_TIMEOUT_MS;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoul(argv[++i], NULL, 10) | 1;
+        }
+        else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc)
+        {
+            timeoutMs = strtoul(argv[++i], NULL, 10) * 60000;
+        }
+    }
+
+    SimulatedPower driver;
+    PowerManager power(driver, timeoutMs);
+    power.begin();
+
+    const unsigned long endMs = millis() + hours * 3600000UL;
+    unsigned long polls = 0;
+    unsigned long sessions = 0;
+    unsigned long darkMs = 0;
+    unsigned long slowestDarkMs = 0;
+    unsigned long cpuSlowMs = 0;
+    bool playing = false;
+    unsigned long switchAt = millis();
+    unsigned long playbackStart = 0;
+    bool waking = false;
+    while (millis() < endMs)
+    {
+        uint32_t periodMs = power.pollPeriodMs();
+        // the playback starts or stops before the next poll
+        if ((long)(millis() + periodMs - switchAt) >= 0)
+        {
+            playing = !playing;
+            if (playing)
+            {
+                sessions++;
+                playbackStart = switchAt;
+                waking = !driver.panelOn;
+                // 5 to 90 minutes of music
+                switchAt += (300 + nextRandom(seed) % 5100) * 1000UL;
+            }
+            else
+            {
+                // a short break or hours away
+                uint32_t seconds = nextRandom(seed) % 100 < 60 ? 60 + nextRandom(seed) % 540 : 1800 + nextRandom(seed) % 36000;
+                switchAt += seconds * 1000UL;
+            }
+        }
+        if (driver.cpuMhz == POWER_STANDBY_CPU_MHZ)
+        {
+            cpuSlowMs += periodMs;
+        }
+        advanceClock(periodMs);
+        polls++;
+        power.update(playing);
+        if (playing && !driver.panelOn)
+        {
+            fprintf(stderr, "the panel stayed off after a poll that saw playback\n");
+            return 1;
+        }
+        if (!playing && power.currentState() == power_standby && driver.panelOn)
+        {
+            fprintf(stderr, "the panel is on in standby\n");
+            return 1;
+        }
+        if (waking && driver.panelOn)
+        {
+            waking = false;
+            unsigned long dark = millis() - playbackStart;
+            darkMs += dark;
+            if (dark > slowestDarkMs)
+            {
+                slowestDarkMs = dark;
+            }
+        }
+    }
+
+    unsigned long totalMs = 0;
+    for (uint8_t index = 0; index < POWER_STATE_COUNT; index++)
+    {
+        totalMs += power.residencyMs((PowerState)index);
+    }
+    printf("%lu h, %lu listening sessions, idle timeout %lu min\n", hours, sessions,
+           (unsigned long)timeoutMs / 60000);
+    printf("active %.1f %%, idle %.1f %%, standby %.1f %%\n", 100.0 * power.residencyMs(power_active) / totalMs,
+           100.0 * power.residencyMs(power_idle) / totalMs, 100.0 * power.residencyMs(power_standby) / totalMs);
+    printf("standbys %lu, wakeups %lu, panel switched %lu times\n", power.stats.standbys, power.stats.wakeups,
+           driver.panelSwitches);
+    printf("dark after the playback started: average %.1f s, longest %.1f s (standby poll %u s)\n",
+           power.stats.wakeups > 0 ? darkMs / 1000.0 / power.stats.wakeups : 0.0, slowestDarkMs / 1000.0,
+           POWER_STANDBY_POLL_MS / 1000);
+    printf("polls %lu instead of %lu, CPU at %u MHz %.1f %% of the time\n", polls,
+           (unsigned long)(totalMs / POWER_ACTIVE_POLL_MS), POWER_STANDBY_CPU_MHZ, 100.0 * cpuSlowMs / totalMs);
+    return 0;
+}
+
+// the schedule of main.cpp
+static const BrightnessStep BRIGHTNESS_SCHEDULE[] = {
+    {0, {40, 10, 3500}},
+    {7 * 60, {160, 10, 2500}},
+    {9 * 60, {255, 10, 2000}},
+    {19 * 60, {160, 10, 2500}},
+    {22 * 60, {40, 10, 3500}},
+};
+static const BrightnessStep BRIGHTNESS_SENSOR_STEPS[] = {
+    {0, {40, 10, 3500}},
+    {800, {160, 10, 2500}},
+    {2400, {255, 10, 2000}},
+};
+
+static int brightnessModel(int argc, char **argv)
+{
+    uint8_t depth = 4;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+        {
+            depth = strtoul(argv[++i], NULL, 10);
+        }
+    }
+    if (depth == 0 || depth > 8)
+    {
+        fprintf(stderr, "the depth is 1 to 8 bit planes\n");
+        return 1;
+    }
+
+    const BrightnessLevel fixed = {255, 10, 2000};
+    printf("%u bit planes, %u rows of %u us shift\n", depth, PANEL_SCAN_ROWS, PANEL_ROW_SHIFT_US);
+    printf("brightness  on-time  refresh   ISR CPU  frames/s\n");
+    const BrightnessLevel levels[] = {fixed, {160, 10, 2500}, {80, 10, 3000}, {40, 10, 3500}, {255, 30, 2000}};
+    for (const BrightnessLevel &level : levels)
+    {
+        printf("%10u %6u us %5u us %7.1f %% %9.0f\n", level.brightness, level.drawTimeUs, level.refreshUs,
+               panelIsrShare(level, depth) * 100, panelRefreshHz(level, depth));
+    }
+
+    // a day of the schedule, the task runs every 100 ms
+    BrightnessController schedule(BRIGHTNESS_SCHEDULE, sizeof(BRIGHTNESS_SCHEDULE) / sizeof(BrightnessStep),
+                                  brightness_schedule, fixed);
+    const unsigned long stepMs = 100;
+    double shareSum = 0;
+    unsigned long steps = 0;
+    unsigned long changes = 0;
+    int largestJump = 0;
+    for (unsigned long elapsed = 0; elapsed < 24 * 3600000UL; elapsed += stepMs)
+    {
+        advanceClock(stepMs);
+        schedule.setInput(elapsed / 60000);
+        BrightnessLevel before = schedule.output();
+        if (schedule.update())
+        {
+            changes++;
+            int jump = abs((int)schedule.output().brightness - (int)before.brightness);
+            largestJump = jump > largestJump ? jump : largestJump;
+        }
+        shareSum += panelIsrShare(schedule.output(), depth);
+        steps++;
+    }
+    printf("a day of the schedule: ISR CPU %.1f %% on average instead of %.1f %% at a fixed level\n",
+           100.0 * shareSum / steps, panelIsrShare(fixed, depth) * 100);
+    printf("%lu output changes, largest brightness step %d per %lu ms\n", changes, largestJump, stepMs);
+
+    // readings that wander around the step at 800
+    BrightnessController sensor(BRIGHTNESS_SENSOR_STEPS, sizeof(BRIGHTNESS_SENSOR_STEPS) / sizeof(BrightnessStep),
+                                brightness_sensor, fixed);
+    uint32_t seed = 1;
+    unsigned long targetChanges = 0;
+    uint8_t target = sensor.targetStep();
+    for (unsigned long reading = 0; reading < 36000; reading++)
+    {
+        advanceClock(stepMs);
+        sensor.setInput(760 + nextRandom(seed) % 80);
+        sensor.update();
+        if (sensor.targetStep() != target)
+        {
+            target = sensor.targetStep();
+            targetChanges++;
+        }
+    }
+    printf("an hour of sensor readings 760..839 around the step at 800: %lu level changes\n", targetChanges);
+    return 0;
+}
+
+struct ReferenceLine
+{
+    uint32_t timeMs;
+    std::string text;
+};
+
+// the whole file at once, as the window of SyncedLyrics has to see it
+static bool parseWholeLrc(const char *path, std::vector<ReferenceLine> &lines)
+{
+    std::vector<uint8_t> content;
+    if (!readFile(path, content))
+    {
+        return false;
+    }
+    std::string all(content.begin(), content.end());
+    long offsetMs = 0;
+    size_t start = 0;
+    while (start < all.size())
+    {
+        size_t end = all.find('\n', start);
+        if (end == std::string::npos)
+        {
+            end = all.size();
+        }
+        std::string line = all.substr(start, end - start);
+        start = end + 1;
+        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+        // the line buffer of the device
+        line = line.substr(0, LYRICS_LINE_LENGTH - 1);
+        if (line.compare(0, 8, "[offset:") == 0)
+        {
+            offsetMs = atol(line.c_str() + 8);
+            continue;
+        }
+        uint32_t times[LYRICS_MAX_STAMPS];
+        const char *text;
+        uint8_t count = parseLrcLine(line.c_str(), times, LYRICS_MAX_STAMPS, &text);
+        for (uint8_t i = 0; i < count; i++)
+        {
+            lines.push_back({(long)times[i] > offsetMs ? (uint32_t)(times[i] - offsetMs) : 0, text});
+        }
+    }
+    std::stable_sort(lines.begin(), lines.end(),
+                     [](const ReferenceLine &a, const ReferenceLine &b) { return a.timeMs < b.timeMs; });
+    return true;
+}
+
+static const char *referenceLineAt(const std::vector<ReferenceLine> &lines, uint32_t timeMs)
+{
+    auto after = std::upper_bound(lines.begin(), lines.end(), timeMs,
+                                  [](uint32_t time, const ReferenceLine &line) { return time < line.timeMs; });
+    return after == lines.begin() ? "" : (after - 1)->text.c_str();
+}
+
+// a generated LRC file of a track: count lines, the first at firstMs and then every stepMs
+static bool writeLyrics(fs::FS &flash, const char *trackId, uint32_t firstMs, uint32_t stepMs, int count)
+{
+    std::string path = std::string(LYRICS_DIR "/") + trackId + ".lrc";
+    File file = flash.open(path.c_str(), FILE_WRITE);
+    if (!file)
+    {
+        return false;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t timeMs = firstMs + i * stepMs;
+        char line[64];
+        snprintf(line, sizeof(line), "[%02u:%02u.%02u]%s line %d\n", (unsigned)(timeMs / 60000),
+                 (unsigned)(timeMs / 1000 % 60), (unsigned)(timeMs % 1000 / 10), trackId, i);
+        file.print(line);
+    }
+    file.close();
+    return true;
+}
+
+// Plays generated lyrics through the edges of the window of SyncedLyrics and
+// checks the line shown after seeks and a skip to another track
+static int lyricsChecks(const char *directory)
+{
+    fs::FS flash(directory);
+    // more lines than a window holds
+    if (!writeLyrics(flash, "a", 2000, 2000, 300) || !writeLyrics(flash, "b", 1000, 2500, 300))
+    {
+        fprintf(stderr, "could not write the lyrics to %s\n", directory);
+        return 1;
+    }
+    auto expected = [](const char *trackId, uint32_t firstMs, uint32_t stepMs, uint32_t timeMs) -> std::string {
+        if (timeMs < firstMs)
+        {
+            return "";
+        }
+        return std::string(trackId) + " line " + std::to_string((timeMs - firstMs) / stepMs);
+    };
+    auto lineA = [&](uint32_t timeMs) { return expected("a", 2000, 2000, timeMs); };
+    auto lineB = [&](uint32_t timeMs) { return expected("b", 1000, 2500, timeMs); };
+
+    SyncedLyrics lyrics(flash);
+    unsigned long failures = 0;
+    auto check = [&](const char *name, uint32_t timeMs, const std::string &line) {
+        const char *shown = lyrics.lineAt(timeMs);
+        bool passed = shown != NULL && line == shown;
+        printf("%s: %s\n", passed ? "ok" : "FAILED", name);
+        if (!passed)
+        {
+            fprintf(stderr, "  at %u ms: \"%s\" instead of \"%s\"\n", timeMs, shown != NULL ? shown : "(null)",
+                    line.c_str());
+            failures++;
+        }
+    };
+
+    if (!lyrics.load("a"))
+    {
+        fprintf(stderr, "could not load the lyrics from %s\n", directory);
+        return 1;
+    }
+    // the file is in time order, so the first window ends at the stamp of the line after it
+    const uint32_t windowEndMs = 2000 + lyrics.windowLines() * 2000;
+    bool shorter = lyrics.windowLines() < 300;
+    printf("%s: %s\n", shorter ? "ok" : "FAILED", "the file is longer than a window");
+    failures += shorter ? 0 : 1;
+    check("nothing before the first line", 1999, "");
+    check("the first line at its stamp", 2000, lineA(2000));
+
+    // frames of 50 ms up to the end of the window and over it
+    bool framesPassed = true;
+    for (uint32_t timeMs = 2000; timeMs < windowEndMs + 5000 && framesPassed; timeMs += 50)
+    {
+        const char *shown = lyrics.lineAt(timeMs);
+        framesPassed = shown != NULL && lineA(timeMs) == shown;
+        if (!framesPassed)
+        {
+            fprintf(stderr, "  at %u ms: \"%s\" instead of \"%s\"\n", timeMs, shown != NULL ? shown : "(null)",
+                    lineA(timeMs).c_str());
+        }
+    }
+    printf("%s: %s\n", framesPassed ? "ok" : "FAILED", "playback over the end of the window");
+    failures += framesPassed ? 0 : 1;
+
+    unsigned long windows = lyrics.stats.windows;
+    check("a seek forward past the end of the window", windowEndMs + 200000 + 700, lineA(windowEndMs + 200700));
+    check("the next frame after the seek forward", windowEndMs + 200750, lineA(windowEndMs + 200750));
+    check("a seek back past the start of the window", 30100, lineA(30100));
+    check("a seek back before the first line", 500, "");
+    bool streamed = lyrics.stats.windows == windows + 3;
+    printf("%s: %s\n", streamed ? "ok" : "FAILED", "every seek out of the window streams one window");
+    failures += streamed ? 0 : 1;
+
+    check("a seek within the window", 31000, lineA(31000));
+    // skipped to track b in the middle of the window of a
+    lyrics.load("b");
+    check("a skip to another track mid-window shows its line", 31000, lineB(31000));
+    check("the line of the new track before its first stamp", 900, "");
+    check("the next frame of the new track", 31050, lineB(31050));
+    const char *next = lyrics.nextLine();
+    bool nextPassed = next != NULL && lineB(31050 + 2500) == next;
+    printf("%s: %s\n", nextPassed ? "ok" : "FAILED", "the next line is of the new track");
+    failures += nextPassed ? 0 : 1;
+
+    // a Spotify track id has 22 characters, its file must keep within the names of SPIFFS
+    const char *trackId = "4uLU6hMCjMI75M1A2tKUQC";
+    bool fits = writeLyrics(flash, trackId, 1000, 2500, 3) && lyrics.load(trackId);
+    printf("%s: %s\n", fits ? "ok" : "FAILED", "the file of a track id fits a SPIFFS name");
+    failures += fits ? 0 : 1;
+    return failures == 0 ? 0 : 1;
+}
+
+static int lyricsPlayback(const char *directory, const char *trackId, int argc, char **argv)
+{
+    const char *server = NULL;
+    unsigned long seeks = 200;
+    uint32_t seed = 1;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+        {
+            server = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seeks") == 0 && i + 1 < argc)
+        {
+            seeks = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoul(argv[++i], NULL, 10) | 1;
+        }
+    }
+
+    fs::FS flash(directory);
+    SyncedLyrics lyrics(flash);
+    if (server != NULL)
+    {
+        std::string host(server);
+        size_t colon = host.rfind(':');
+        uint16_t port = colon == std::string::npos ? 8080 : atoi(host.c_str() + colon + 1);
+        host = host.substr(0, colon);
+        NativeTcpClient client;
+        if (!lyrics.download(client, host.c_str(), port, trackId))
+        {
+            fprintf(stderr, "no lyrics for %s from %s\n", trackId, server);
+            return 1;
+        }
+    }
+    std::vector<ReferenceLine> reference;
+    std::string path = std::string(directory) + LYRICS_DIR "/" + trackId + ".lrc";
+    if (!parseWholeLrc(path.c_str(), reference) || !lyrics.load(trackId))
+    {
+        fprintf(stderr, "could not read %s\n", path.c_str());
+        return 1;
+    }
+    if (reference.empty())
+    {
+        fprintf(stderr, "%s has no time stamps\n", path.c_str());
+        return 1;
+    }
+
+    // frames of 50 ms through the track and a bit after the last line, with seeks in between
+    const uint32_t frameMs = 50;
+    const uint32_t endMs = reference.back().timeMs + 10000;
+    unsigned long frames = 0;
+    unsigned long mismatches = 0;
+    unsigned long skips = 0;
+    uint32_t progressMs = 0;
+    auto check = [&]() {
+        frames++;
+        const char *line = lyrics.lineAt(progressMs);
+        const char *expected = referenceLineAt(reference, progressMs);
+        if (line == NULL || strcmp(line, expected) != 0)
+        {
+            if (mismatches++ < 5)
+            {
+                fprintf(stderr, "at %u ms: \"%s\" instead of \"%s\"\n", progressMs, line != NULL ? line : "(null)",
+                        expected);
+            }
+        }
+    };
+    for (unsigned long seek = 0; seek <= seeks; seek++)
+    {
+        // a stretch of normal playback
+        uint32_t playMs = 1000 + nextRandom(seed) % 30000;
+        for (uint32_t played = 0; played < playMs && progressMs < endMs; played += frameMs)
+        {
+            check();
+            progressMs += frameMs;
+        }
+        uint32_t pick = nextRandom(seed) % 10;
+        if (pick == 0 || progressMs >= endMs)
+        {
+            // skipped to this track again, it starts from the beginning
+            skips++;
+            lyrics.load(trackId);
+            progressMs = 0;
+        }
+        else
+        {
+            progressMs = nextRandom(seed) % endMs;
+        }
+    }
+
+    const SyncedLyricsStats &stats = lyrics.stats;
+    printf("%zu lines, %lu frames with %lu seeks and %lu skips: %lu wrong lines\n", reference.size(), frames,
+           seeks - skips, skips, mismatches);
+    printf("lookups %lu: %lu steps to the next line, %lu searches, %lu windows streamed (%.0f us average)\n",
+           stats.lookups, stats.steps, stats.searches, stats.windows,
+           stats.windows > 0 ? (double)stats.windowMicros / stats.windows : 0.0);
+    printf("%u lines in the last window, %zu bytes for any length of lyrics\n", lyrics.windowLines(),
+           sizeof(SyncedLyrics));
+    return mismatches == 0 ? 0 : 1;
+}
+
+// the beat at progressMs by a walk over the whole grid
+static bool referenceBeat(const BeatGrid &grid, long progressMs, BeatPhase &phase)
+{
+    long index = -1;
+    for (uint16_t i = 0; i < grid.count && (long)grid.start[i] * BEAT_TIME_UNIT_MS <= progressMs; i++)
+    {
+        index = i;
+    }
+    if (index < 0)
+    {
+        return false;
+    }
+    long lengthMs = index + 1 < grid.count ? (grid.start[index + 1] - grid.start[index]) * BEAT_TIME_UNIT_MS
+                    : index > 0            ? (grid.start[index] - grid.start[index - 1]) * BEAT_TIME_UNIT_MS
+                                           : 50 * BEAT_TIME_UNIT_MS;
+    long intoMs = progressMs - (long)grid.start[index] * BEAT_TIME_UNIT_MS;
+    if (intoMs >= lengthMs)
+    {
+        return false;
+    }
+    phase.index = index;
+    phase.phase = intoMs * 256 / lengthMs;
+    phase.loudness = grid.loudness[index];
+    phase.lengthMs = lengthMs;
+    return true;
+}
+
+// beats of 300 to 700 ms from firstMs on, with a loudness per beat
+static void randomBeatGrid(BeatGrid &grid, uint16_t count, uint32_t firstMs, uint32_t &seed)
+{
+    grid.count = count;
+    grid.truncated = false;
+    uint32_t startMs = firstMs;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        grid.start[i] = startMs / BEAT_TIME_UNIT_MS;
+        grid.loudness[i] = nextRandom(seed) % 60000;
+        startMs += 300 + nextRandom(seed) % 400;
+    }
+}
+
+// Moves a BeatCursor through random beat grids with playback, seeks and track
+// changes and checks every frame against a walk over the whole grid
+static int beatCursor(int argc, char **argv)
+{
+    uint32_t seed = 1;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = strtoul(argv[++i], NULL, 10) | 1;
+        }
+    }
+
+    static BeatGrid grid;
+    BeatCursor cursor(grid);
+    unsigned long failures = 0;
+    unsigned long frames = 0;
+    unsigned long wrong = 0;
+    auto frame = [&](long progressMs) {
+        frames++;
+        BeatPhase phase = {0, 0, 0, 0};
+        BeatPhase expected = {0, 0, 0, 0};
+        bool found = cursor.at(progressMs, phase);
+        bool expectedFound = referenceBeat(grid, progressMs, expected);
+        bool same = found == expectedFound &&
+                    (!found || (phase.index == expected.index && phase.phase == expected.phase &&
+                                phase.loudness == expected.loudness && phase.lengthMs == expected.lengthMs));
+        if (!same && wrong++ < 5)
+        {
+            fprintf(stderr, "  at %ld ms: %s beat %u phase %u instead of %s beat %u phase %u\n", progressMs,
+                    found ? "" : "no", phase.index, phase.phase, expectedFound ? "" : "no", expected.index,
+                    expected.phase);
+        }
+        return found;
+    };
+    auto check = [&](const char *name, bool passed) {
+        printf("%s: %s\n", passed ? "ok" : "FAILED", name);
+        if (!passed)
+        {
+            failures++;
+        }
+    };
+
+    // frames of 16 ms through a track, from before the first beat to after the last
+    randomBeatGrid(grid, 400, 1500, seed);
+    cursor.reset();
+    const long endMs = (long)grid.start[grid.count - 1] * BEAT_TIME_UNIT_MS + 2000;
+    unsigned long wrongBefore = wrong;
+    for (long progressMs = 0; progressMs < endMs; progressMs += 16)
+    {
+        frame(progressMs);
+    }
+    check("playback through the track gives the beat of every frame", wrong == wrongBefore);
+    // one step onto every beat, the first included
+    check("playback only steps, it does not search", cursor.searches == 0 && cursor.steps == grid.count);
+    BeatPhase phase;
+    check("no beat before the first one", !cursor.at(1499, phase) && cursor.at(1500, phase) && phase.phase == 0);
+    check("no beat after the last one", !cursor.at(endMs, phase));
+
+    // seeks anywhere in the track and a bit of playback after each
+    wrongBefore = wrong;
+    unsigned long searches = cursor.searches;
+    for (int seek = 0; seek < 2000; seek++)
+    {
+        long progressMs = (long)(nextRandom(seed) % (uint32_t)(endMs + 1000)) - 500;
+        for (int step = 0; step < 20; step++)
+        {
+            frame(progressMs + step * 16);
+        }
+    }
+    check("seeks in both directions give the beat of every frame", wrong == wrongBefore);
+    check("a seek searches at most once", cursor.searches - searches <= 2000);
+
+    // another track without a reset, shorter and with the beats elsewhere
+    wrongBefore = wrong;
+    frame(endMs - 3000);
+    randomBeatGrid(grid, 120, 300, seed);
+    for (long progressMs = 0; progressMs < 20000; progressMs += 16)
+    {
+        frame(progressMs);
+    }
+    frame(endMs - 3000);
+    check("a new grid without a reset gives its own beats", wrong == wrongBefore);
+
+    // a single beat is 500 ms long, an empty grid has none
+    randomBeatGrid(grid, 1, 1000, seed);
+    cursor.reset();
+    check("a single beat lasts 500 ms", cursor.at(1499, phase) && phase.lengthMs == 500 && !cursor.at(1500, phase));
+    grid.count = 0;
+    check("an empty grid has no beat", !cursor.at(1000, phase));
+
+    printf("%lu frames, %lu wrong, %lu steps, %lu searches\n", frames, wrong, cursor.steps, cursor.searches);
+    return failures == 0 && wrong == 0 ? 0 : 1;
+}
+
+static NativeTcpServer *statusListener = NULL;
+static NativeTcpClient statusClient;
+static bool renderStatusSample(StatusPath path, uint8_t section, Print &out);
+static StatusServer statusServer(renderStatusSample);
+static unsigned long statusFrames = 0;
+
+// a frame of the panel, 3 ms of work
+static void statusFrame()
+{
+    unsigned long start = micros();
+    while (micros() - start < 3000)
+    {
+    }
+    statusFrames++;
+}
+
+static void statusServe()
+{
+    if (!statusServer.busy() && statusListener->accept(statusClient))
+    {
+        LOG_INFO("status connection %u", statusClient.connections);
+        statusServer.begin(statusClient);
+    }
+    statusServer.poll();
+}
+
+static Task statusTasks[] = {
+    {"fast_update", statusFrame, 50, 50000, 0, {}},
+    {"status", statusServe, 20, 5000, 0, {}},
+    {"log", []() { logDrain(LOG_LINE_LENGTH); }, 20, 2000, 0, {}},
+};
+static TaskScheduler statusScheduler(statusTasks, 3);
+
+static bool renderStatusSample(StatusPath path, uint8_t section, Print &out)
+{
+    if (path == status_state)
+    {
+        if (section > 0)
+        {
+            return false;
+        }
+        out.print("{\"playing\":true,\"title\":");
+        StatusServer::printJsonString(out, "Say \"Hello\"\tagain \\ again");
+        out.print(",\"frames\":");
+        out.print(statusFrames);
+        out.print("}\n");
+        return true;
+    }
+    if (section == 0)
+    {
+        StatusServer::printMetric(out, "uptime_seconds", millis() / 1000);
+        StatusServer::printMetric(out, "frames_total", statusFrames);
+        StatusServer::printMetric(out, "log_lines_total", logStats.lines[LOG_LEVEL_INFO], "level=\"info\"");
+        StatusServer::printMetric(out, "status_requests_total", statusServer.stats.requests);
+        StatusServer::printMetric(out, "status_slowest_poll_us", statusServer.stats.slowestPollUs);
+        return true;
+    }
+    if (section - 1 >= statusScheduler.taskCount())
+    {
+        return false;
+    }
+    statusScheduler.printMetrics(out, section - 1);
+    return true;
+}
+
+// A connection that hands out a scripted request and takes at most writeLimit bytes per write
+class ScriptedClient : public Client
+{
+public:
+    int connect(IPAddress ip, uint16_t port) override { return 0; }
+    int connect(const char *host, uint16_t port) override { return 0; }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        size_t count = size < writeLimit ? size : writeLimit;
+        received.append((const char *)buf, count);
+        return count;
+    }
+    int available() override { return (int)(sendable - position); }
+    int read() override { return position < sendable ? (uint8_t)request[position++] : -1; }
+    int read(uint8_t *buf, size_t size) override
+    {
+        size_t count = 0;
+        while (count < size && position < sendable)
+        {
+            buf[count++] = request[position++];
+        }
+        return count > 0 ? (int)count : -1;
+    }
+    int peek() override { return position < sendable ? (uint8_t)request[position] : -1; }
+    void flush() override {}
+    void stop() override { open = false; }
+    uint8_t connected() override { return open; }
+    operator bool() override { return open; }
+    using Print::write;
+
+    // the next part of the request arrives
+    void arrive(size_t length) { sendable = std::min(request.size(), sendable + length); }
+
+    std::string request;
+    std::string received;
+    size_t writeLimit = 1 << 20;
+    bool open = true;
+
+private:
+    size_t position = 0;
+    size_t sendable = 0;
+};
+
+static uint8_t checkSections = 3;
+
+// checkSections sections of /metrics, the second one larger than a section buffer
+static bool renderCheckSections(StatusPath path, uint8_t section, Print &out)
+{
+    if (section >= checkSections || (path == status_state && section > 0))
+    {
+        return false;
+    }
+    if (path == status_state)
+    {
+        out.print("{\"title\":");
+        StatusServer::printJsonString(out, "Say \"Hi\"\t\\");
+        out.print("}\n");
+        return true;
+    }
+    if (section == 1)
+    {
+        for (int i = 0; i < STATUS_SERVER_SECTION_SIZE + 10; i++)
+        {
+            out.print('x');
+        }
+        return true;
+    }
+    StatusServer::printMetric(out, "section", section, section == 2 ? "kind=\"last\"" : NULL);
+    return true;
+}
+
+// full sections of /metrics, far more than the send buffer of a socket takes
+static bool renderFullSections(StatusPath path, uint8_t section, Print &out)
+{
+    if (section >= 200)
+    {
+        return false;
+    }
+    for (int i = 0; i < STATUS_SERVER_SECTION_SIZE; i++)
+    {
+        out.print('y');
+    }
+    return true;
+}
+
+// Serves scripted connections with the status server and checks the responses,
+// cut sections and the deadline of a connection
+static int statusChecks()
+{
+    unsigned long failures = 0;
+    auto check = [&](const char *name, bool passed, const std::string &received) {
+        printf("%s: %s\n", passed ? "ok" : "FAILED", name);
+        if (!passed)
+        {
+            fprintf(stderr, "  received %zu bytes: %.200s\n", received.size(), received.c_str());
+            failures++;
+        }
+    };
+    // polls every 20 ms like the task of the app, until the connection is closed or for at most maxMs
+    auto serve = [](StatusServer &server, ScriptedClient &client, unsigned long maxMs) {
+        server.begin(client);
+        unsigned long polledMs = 0;
+        while (server.poll() && polledMs < maxMs)
+        {
+            advanceClock(20);
+            polledMs += 20;
+        }
+        return polledMs;
+    };
+    auto contains = [](const std::string &text, const char *part) { return text.find(part) != std::string::npos; };
+
+    {
+        StatusServer server(renderCheckSections);
+        ScriptedClient client;
+        client.request = "GET /metrics?x=1 HTTP/1.1\r\nHost: display\r\nAccept: */*\r\n\r\n";
+        client.arrive(client.request.size());
+        serve(server, client, 10000);
+        check("/metrics gets a 200 and every section",
+              client.received.compare(0, 15, "HTTP/1.1 200 OK") == 0 &&
+                  contains(client.received, "text/plain; version=0.0.4") && contains(client.received, "\nsection 0\n") &&
+                  contains(client.received, "section{kind=\"last\"} 2\n") && !client.open,
+              client.received);
+        check("a section too large for the buffer is cut and counted",
+              server.stats.overflows == 1 && contains(client.received, std::string(STATUS_SERVER_SECTION_SIZE, 'x').c_str()),
+              client.received);
+        check("the bytes sent are counted", server.stats.bytesSent == client.received.size(), client.received);
+    }
+    {
+        StatusServer server(renderCheckSections);
+        ScriptedClient client;
+        client.request = "GET /state HTTP/1.1\r\n\r\n";
+        server.begin(client);
+        for (size_t part = 0; part < client.request.size(); part += 5)
+        {
+            client.arrive(5);
+            server.poll();
+            advanceClock(20);
+        }
+        // begin() is ignored while the connection is served
+        serve(server, client, 10000);
+        check("a request in pieces gets /state as JSON",
+              contains(client.received, "application/json") &&
+                  contains(client.received, "{\"title\":\"Say \\\"Hi\\\"\\u0009\\\\\"}\n"),
+              client.received);
+    }
+    {
+        StatusServer server(renderCheckSections);
+        ScriptedClient client;
+        client.request = "GET /nothing HTTP/1.1\r\n\r\n";
+        client.arrive(client.request.size());
+        serve(server, client, 10000);
+        check("another path gets a 404",
+              client.received.compare(0, 22, "HTTP/1.1 404 Not Found") == 0 && server.stats.notFound == 1,
+              client.received);
+    }
+    {
+        StatusServer server(renderCheckSections);
+        ScriptedClient client;
+        client.request = "GET /metrics HTTP/1.1\r\n\r\n";
+        client.arrive(10);
+        unsigned long servedMs = serve(server, client, 10000);
+        check("a request that does not come through is closed at the deadline",
+              !client.open && server.stats.timeouts == 1 && servedMs >= STATUS_SERVER_TIMEOUT_MS &&
+                  servedMs <= STATUS_SERVER_TIMEOUT_MS + 20 && client.received.empty(),
+              client.received);
+    }
+    {
+        // the client takes a few bytes per poll, the response would take minutes
+        StatusServer server(renderCheckSections);
+        ScriptedClient client;
+        client.request = "GET /metrics HTTP/1.1\r\n\r\n";
+        client.arrive(client.request.size());
+        client.writeLimit = 8;
+        unsigned long servedMs = serve(server, client, 60000);
+        check("a client that reads slowly is closed at the deadline",
+              !client.open && server.stats.timeouts == 1 && servedMs <= STATUS_SERVER_TIMEOUT_MS + 20 &&
+                  client.received.size() < 1000,
+              client.received);
+        // the next connection is served again
+        ScriptedClient next;
+        next.request = "GET /state HTTP/1.1\r\n\r\n";
+        next.arrive(next.request.size());
+        serve(server, next, 10000);
+        check("the next connection is served after a timeout", contains(next.received, "{\"title\":"),
+              next.received);
+    }
+    {
+        // a socket that gets its request and is not read from, with a small send buffer
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+        {
+            fprintf(stderr, "no socket pair\n");
+            return 1;
+        }
+        int bufferSize = 4096;
+        setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+        // a write that waits for the reader fails the check instead of hanging it
+        struct timeval sendTimeout = {1, 0};
+        setsockopt(sockets[0], SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+        const char request[] = "GET /metrics HTTP/1.1\r\n\r\n";
+        write(sockets[1], request, sizeof(request) - 1);
+        NativeTcpClient client;
+        client.attach(sockets[0]);
+        client.waitForWrites = false;
+        StatusServer server(renderFullSections);
+        server.begin(client);
+        while (server.poll())
+        {
+            advanceClock(20);
+        }
+        close(sockets[1]);
+        check("a socket that is not read from holds up no poll",
+              server.stats.timeouts == 1 && server.stats.slowestPollUs < 100000 &&
+                  server.stats.bytesSent < 200 * STATUS_SERVER_SECTION_SIZE,
+              std::to_string(server.stats.slowestPollUs) + " us slowest poll");
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+static int statusServe(uint16_t port, int argc, char **argv)
+{
+    unsigned long seconds = 10;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            seconds = strtoul(argv[++i], NULL, 10);
+        }
+    }
+    NativeTcpServer listener(port);
+    if (!listener.begin())
+    {
+        fprintf(stderr, "could not listen on port %u\n", port);
+        return 1;
+    }
+    statusListener = &listener;
+    statusClient.waitForWrites = false;
+    statusScheduler.begin();
+    unsigned long end = millis() + seconds * 1000;
+    while ((long)(millis() - end) < 0)
+    {
+        uint32_t idleMs = statusScheduler.runDue();
+        if (idleMs > 0)
+        {
+            delay(1);
+        }
+    }
+    const TaskStats &frames = statusTasks[0].stats;
+    printf("status: %lu requests, %lu not found, %lu timeouts, %lu overflows, %lu bytes, slowest poll %lu us\n",
+           statusServer.stats.requests, statusServer.stats.notFound, statusServer.stats.timeouts,
+           statusServer.stats.overflows, statusServer.stats.bytesSent, (unsigned long)statusServer.stats.slowestPollUs);
+    printf("frames: %lu, missed %lu, latest start %lu ms late, status task max %lu us\n", frames.runs,
+           frames.missed, (unsigned long)frames.latestMs, (unsigned long)statusTasks[1].stats.slowestUs);
+    return 0;
+}
+
+static int accountsLoad(unsigned long count, int argc, char **argv)
+{
+    const char *server = NULL;
+    unsigned long seconds = 10;
+    unsigned long intervalMs = 1000;
+    unsigned long budget = 20;
+    bool issuedTokens = false;
+    const char *caFile = NULL;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+        {
+            server = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            seconds = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+        {
+            intervalMs = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+        {
+            budget = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--tokens") == 0)
+        {
+            issuedTokens = true;
+        }
+        else if (strcmp(argv[i], "--tls") == 0 && i + 1 < argc)
+        {
+            caFile = argv[++i];
+        }
+    }
+    if (server == NULL || count == 0 || count > SPOTIFY_ACCOUNTS_MAX || budget == 0)
+    {
+        fprintf(stderr, "--accounts needs 1 to %d accounts, --server and a budget above 0\n", SPOTIFY_ACCOUNTS_MAX);
+        return 1;
+    }
+    char host[64];
+    strncpy(host, server, sizeof(host));
+    host[sizeof(host) - 1] = '\0';
+    char *colon = strrchr(host, ':');
+    uint16_t port = 80;
+    if (colon != NULL)
+    {
+        *colon = '\0';
+        port = (uint16_t)atoi(colon + 1);
+    }
+
+    NativeTcpClient tcpClient(host, port);
+    NativeTlsClient tlsClient(host, port);
+    if (caFile != NULL && !tlsClient.setCACertFile(caFile))
+    {
+        fprintf(stderr, "no certificate in %s\n", caFile);
+        return 1;
+    }
+    Client &client = caFile != NULL ? (Client &)tlsClient : (Client &)tcpClient;
+    ArduinoSpotify spotify(client, "stand-in-client", "stand-in-secret", "");
+    spotify.portNumber = port;
+    if (caFile != NULL)
+    {
+        spotify.enableTlsSessions(tlsClient);
+    }
+    spotify.setRequestBudget(endpoint_currently_playing, budget, budget < 1000 ? 1000 / budget : 1);
+
+    // the refresh tokens and tokens of the stand-in: account 0 has the ones of a single account
+    static char tokens[SPOTIFY_ACCOUNTS_MAX][24];
+    SpotifyAccount accounts[SPOTIFY_ACCOUNTS_MAX];
+    SpotifyAccountPool pool(spotify, accounts, count);
+    pool.pollIntervalMs = intervalMs;
+    for (unsigned long account = 0; account < count; account++)
+    {
+        if (issuedTokens)
+        {
+            snprintf(tokens[account], sizeof(tokens[account]), account == 0 ? "token-0" : "a%lu-token-0", account);
+            pool.addAccountWithToken(tokens[account]);
+        }
+        else
+        {
+            snprintf(tokens[account], sizeof(tokens[account]), "refresh-%lu", account);
+            pool.addAccount(tokens[account]);
+        }
+    }
+
+    unsigned long start = millis();
+    unsigned long end = start + seconds * 1000;
+    while ((long)(millis() - end) < 0)
+    {
+        if (pool.pollNext() < 0)
+        {
+            delay(1);
+        }
+    }
+    unsigned long elapsedMs = millis() - start;
+    pool.close();
+
+    const SpotifyAccountPoolStats &stats = pool.stats;
+    uint32_t fewest = 0xFFFFFFFF;
+    uint32_t most = 0;
+    bool complete = true;
+    for (uint8_t index = 0; index < pool.count(); index++)
+    {
+        const SpotifyAccount &account = pool.account(index);
+        fewest = std::min(fewest, account.polls);
+        most = std::max(most, account.polls);
+        complete = complete && account.valid;
+        printf("account %2u: %lu polls, %u failures, status %d, %s %s - %s, %u / %u ms\n", index,
+               (unsigned long)account.polls, account.failures, account.statusCode,
+               account.playback.isPlaying ? "playing" : "paused ", account.playback.artistName,
+               account.playback.trackName, (unsigned)pool.progressMs(index), (unsigned)account.playback.durationMs);
+    }
+    printf("%lu polls in %lu ms, %.1f polls/s, %lu to %lu per account, %lu failures, %lu deferred by the budget, "
+           "%lu token refreshes\n",
+           stats.polls, elapsedMs, elapsedMs > 0 ? stats.polls * 1000.0 / elapsedMs : 0.0, (unsigned long)fewest,
+           (unsigned long)most, stats.failures, stats.deferred, stats.tokenRefreshes);
+    printf("latency us: mean %lu max %lu, %lu body bytes parsed in %lu us, %u connections\n",
+           stats.polls > 0 ? stats.totalPollUs / stats.polls : 0, (unsigned long)stats.slowestPollUs,
+           pool.parser.stats.bytes, pool.parser.stats.parseMicros,
+           caFile != NULL ? tlsClient.handshakes : tcpClient.connections);
+    printf("memory: %u bytes per account slot, %u for %lu slots and the pool, "
+           "%u per ArduinoSpotify (one each would be %lu, plus a %d byte document per poll)\n",
+           (unsigned)sizeof(SpotifyAccount), (unsigned)(sizeof(SpotifyAccount) * count + sizeof(SpotifyAccountPool)), count,
+           (unsigned)sizeof(ArduinoSpotify), (unsigned long)sizeof(ArduinoSpotify) * count, spotify.currentlyPlayingBufferSize);
+    if (!complete || fewest == 0)
+    {
+        fprintf(stderr, "an account was never polled successfully\n");
+        return 1;
+    }
+    return 0;
+}
+
+// A /me/player/devices body with a device per name, ids "device-<n>", the second device active
+static std::string devicesBody(const std::vector<std::string> &names)
+{
+    std::string body = "{\"devices\":[";
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        body += i > 0 ? "," : "";
+        body += "{\"id\":\"device-" + std::to_string(i) + "\",\"is_active\":" + (i == 1 ? "true" : "false") +
+                ",\"name\":\"" + names[i] + "\",\"type\":\"Speaker\",\"volume_percent\":" +
+                std::to_string(i * 10 % 101) + "}";
+    }
+    return body + "]}";
+}
+
+static bool parseDevices(SpotifyDevicesParser &parser, const std::string &body, size_t piece, SpotifyDevice *devices,
+                         uint8_t capacity)
+{
+    parser.begin(devices, capacity);
+    for (size_t start = 0; start < body.size(); start += piece)
+    {
+        parser.feed((const uint8_t *)body.data() + start, std::min(piece, body.size() - start));
+    }
+    return parser.finish();
+}
+
+// the bytes of the UTF-8 character that starts with lead, 0 within a character
+static uint8_t utf8Length(uint8_t lead)
+{
+    return (lead & 0x80) == 0 ? 1 : (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : (lead & 0xF8) == 0xF0 ? 4 : 0;
+}
+
+static int devicesParse()
+{
+    unsigned long failures = 0;
+    auto check = [&](const char *name, bool passed, const SpotifyDevice *device) {
+        printf("%s: %s\n", passed ? "ok" : "FAILED", name);
+        if (!passed)
+        {
+            if (device != NULL)
+            {
+                fprintf(stderr, "  id \"%s\", name \"%s\", type \"%s\", active %d, volume %d\n", device->id, device->name,
+                        device->type, device->isActive, device->volumePercent);
+            }
+            failures++;
+        }
+    };
+    SpotifyDevicesParser parser;
+    static SpotifyDevice devices[SPOTIFY_DEVICE_TABLE_SIZE + 1];
+
+    std::string recorded = strstr(sampleDevicesResponse, "\r\n\r\n") + 4;
+    bool parsed = parseDevices(parser, recorded, recorded.size(), devices, SPOTIFY_DEVICE_TABLE_SIZE);
+    check("the recorded list parses", parsed && parser.count() == 3 && parser.total() == 3, NULL);
+    check("the first device is the active speaker",
+          strcmp(devices[0].id, "5fbb3ba6aa454b5534c4ba43a8c7e8e45a63ad0e") == 0 &&
+              strcmp(devices[0].name, "Living Room") == 0 && strcmp(devices[0].type, "Speaker") == 0 &&
+              devices[0].isActive && !devices[0].isRestricted && devices[0].volumePercent == 42,
+          &devices[0]);
+    check("an escaped name is decoded to UTF-8",
+          strcmp(devices[1].id, "a1b2c3d4e5f60718293a4b5c6d7e8f9012345678") == 0 &&
+              strcmp(devices[1].name, "Guest\xe2\x80\x99s iPhone") == 0 && !devices[1].isActive &&
+              devices[1].volumePercent == 100,
+          &devices[1]);
+    check("a restricted device without volume has -1",
+          strcmp(devices[2].name, "Living Room TV") == 0 && devices[2].isRestricted && devices[2].isPrivateSession &&
+              !devices[2].isActive && devices[2].volumePercent == -1,
+          &devices[2]);
+    static SpotifyDevice whole[3];
+    memcpy(whole, devices, sizeof(whole));
+    bool same = true;
+    for (size_t piece = 1; piece <= 64 && same; piece++)
+    {
+        same = parseDevices(parser, recorded, piece, devices, SPOTIFY_DEVICE_TABLE_SIZE) && parser.count() == 3 &&
+               memcmp(devices, whole, sizeof(whole)) == 0;
+    }
+    check("the list parses the same in pieces of 1 to 64 bytes", same, NULL);
+
+    std::vector<std::string> names;
+    for (int i = 0; i < SPOTIFY_DEVICE_TABLE_SIZE + 3; i++)
+    {
+        names.push_back("Speaker " + std::to_string(i));
+    }
+    memset(&devices[SPOTIFY_DEVICE_TABLE_SIZE], 0x55, sizeof(SpotifyDevice));
+    parsed = parseDevices(parser, devicesBody(names), 7, devices, SPOTIFY_DEVICE_TABLE_SIZE);
+    bool kept = parsed;
+    for (int i = 0; i < SPOTIFY_DEVICE_TABLE_SIZE; i++)
+    {
+        kept = kept && strcmp(devices[i].id, ("device-" + std::to_string(i)).c_str()) == 0 &&
+               names[i] == devices[i].name && devices[i].isActive == (i == 1) && devices[i].volumePercent == i * 10;
+    }
+    check("a longer list keeps the first devices and counts all",
+          kept && parser.count() == SPOTIFY_DEVICE_TABLE_SIZE && parser.total() == SPOTIFY_DEVICE_TABLE_SIZE + 3,
+          &devices[SPOTIFY_DEVICE_TABLE_SIZE - 1]);
+    SpotifyDevice untouched;
+    memset(&untouched, 0x55, sizeof(untouched));
+    check("nothing is written after the array", memcmp(&devices[SPOTIFY_DEVICE_TABLE_SIZE], &untouched, sizeof(untouched)) == 0,
+          NULL);
+
+    // names longer than the field, the cut falls at every byte of a 2, 3 and 4 byte character
+    const char *characters[] = {"\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x94\x8a"};
+    names.clear();
+    std::vector<std::string> full;
+    for (const char *character : characters)
+    {
+        for (size_t lead = 0; lead < 4; lead++)
+        {
+            std::string name(lead, 'a');
+            while (name.size() < SPOTIFY_DEVICE_NAME_CHAR_LENGTH + 4)
+            {
+                name += character;
+            }
+            names.push_back(name);
+            full.push_back(name);
+        }
+    }
+    // the same as \u escapes, decoded while the name is read
+    std::string escaped = "ab";
+    std::string decoded = "ab";
+    while (decoded.size() < SPOTIFY_DEVICE_NAME_CHAR_LENGTH + 4)
+    {
+        escaped += "\\u20ac";
+        decoded += "\xe2\x82\xac";
+    }
+    names.push_back(escaped);
+    full.push_back(decoded);
+    static SpotifyDevice cut[16];
+    parsed = parseDevices(parser, devicesBody(names), 13, cut, names.size());
+    bool wholeCharacters = parsed && parser.count() == names.size();
+    const SpotifyDevice *wrong = NULL;
+    for (size_t i = 0; i < names.size() && wholeCharacters; i++)
+    {
+        size_t length = strlen(cut[i].name);
+        // a prefix of the name that ends after a whole character and the next one would not fit
+        bool ok = length < SPOTIFY_DEVICE_NAME_CHAR_LENGTH && full[i].compare(0, length, cut[i].name) == 0 &&
+                  length + utf8Length(full[i][length]) >= SPOTIFY_DEVICE_NAME_CHAR_LENGTH;
+        for (size_t at = 0; at < length && ok;)
+        {
+            uint8_t bytes = utf8Length(cut[i].name[at]);
+            ok = bytes > 0 && at + bytes <= length;
+            at += bytes > 0 ? bytes : 1;
+        }
+        // the fields after the name are still read
+        ok = ok && strcmp(cut[i].type, "Speaker") == 0 && cut[i].volumePercent == (int)(i * 10 % 101);
+        if (!ok)
+        {
+            wrong = &cut[i];
+        }
+        wholeCharacters = ok;
+    }
+    check("a long name is cut before a character that does not fit whole", wholeCharacters, wrong);
+    return failures == 0 ? 0 : 1;
+}
+
+static int deviceCommands(const char *server, int argc, char **argv)
+{
+    unsigned long commands = 100;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--commands") == 0 && i + 1 < argc)
+        {
+            commands = strtoul(argv[++i], NULL, 10);
+        }
+    }
+    char host[64];
+    strncpy(host, server, sizeof(host));
+    host[sizeof(host) - 1] = '\0';
+    char *colon = strrchr(host, ':');
+    uint16_t port = 80;
+    if (colon != NULL)
+    {
+        *colon = '\0';
+        port = (uint16_t)atoi(colon + 1);
+    }
+    NativeTcpClient client(host, port);
+    char token[] = "token-0";
+    ArduinoSpotify spotify(client, token);
+    spotify.portNumber = port;
+    spotify.autoTokenRefresh = false;
+    // every command is a request, the budget of the display would spread them out
+    spotify.setRequestBudget(endpoint_player, 0xFFFF, 1);
+
+    static SpotifyDeviceTable table(spotify);
+    const char *names[] = {"Living Room", "kitchen"};
+    unsigned long failed = 0;
+    unsigned long requestsBefore = spotify.rateLimitStats.requests;
+    unsigned long start = millis();
+    for (unsigned long command = 0; command < commands; command++)
+    {
+        const char *name = names[command / 3 % 2];
+        bool done = command % 3 == 0   ? table.transferPlayback(name)
+                    : command % 3 == 1 ? table.setVolume(name, command % 101)
+                                       : table.transferPlayback(name);
+        if (!done)
+        {
+            failed++;
+        }
+    }
+    unsigned long elapsedMs = millis() - start;
+    unsigned long requests = spotify.rateLimitStats.requests - requestsBefore;
+
+    // what the table expects has to be what the stand-in has now
+    static SpotifyDevice expected[SPOTIFY_DEVICE_TABLE_SIZE];
+    uint8_t expectedCount = table.count();
+    memcpy(expected, &table.device(0), sizeof(SpotifyDevice) * expectedCount);
+    if (!table.refresh())
+    {
+        fprintf(stderr, "could not list the devices of %s\n", server);
+        return 1;
+    }
+    bool same = table.count() == expectedCount;
+    for (uint8_t i = 0; i < table.count(); i++)
+    {
+        const SpotifyDevice &device = table.device(i);
+        printf("device %u: %s \"%s\" (%s)%s volume %d\n", i, device.id, device.name, device.type,
+               device.isActive ? " active," : ",", device.volumePercent);
+        same = same && i < expectedCount && strcmp(device.id, expected[i].id) == 0 &&
+               device.isActive == expected[i].isActive && device.volumePercent == expected[i].volumePercent;
+    }
+    const SpotifyDeviceTableStats &stats = table.stats;
+    printf("%lu commands in %lu ms, %lu failed, %lu requests (%lu device lists), %lu not sent; "
+           "%lu requests with a device list before every command\n",
+           commands, elapsedMs, failed, requests, stats.refreshes - 1, stats.requestsSaved,
+           2 * commands);
+    printf("memory: %u bytes per device, table %u bytes for %d devices\n", (unsigned)sizeof(SpotifyDevice),
+           (unsigned)sizeof(SpotifyDeviceTable), SPOTIFY_DEVICE_TABLE_SIZE);
+    if (!same || failed > 0)
+    {
+        fprintf(stderr, "the cached devices differ from the list of the stand-in\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    // the messages of the library are written when a mode returns
+    atexit([]() { logFlush(); });
+    if (argc >= 3 && strcmp(argv[1], "--server") == 0)
+    {
+        return pollServer(argv[2], argc - 3, argv + 3);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--command-queue") == 0)
+    {
+        return commandQueue();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--dns-cache") == 0)
+    {
+        return dnsCache();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--reconcile") == 0)
+    {
+        return reconcileCommands();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--album-art") == 0)
+    {
+        return albumArtDecode();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--feature-bars") == 0)
+    {
+        return featureBars();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--packed-features") == 0)
+    {
+        return packedFeatures(argc - 2, argv + 2);
+    }
+    if (argc >= 4 && strcmp(argv[1], "--art-cache") == 0)
+    {
+        return artCache(argv[2], argv[3], argc - 4, argv + 4);
+    }
+    if (argc >= 3 && strcmp(argv[1], "--snapshot") == 0)
+    {
+        return snapshot(argv[2], argc - 3, argv + 3);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--pages") == 0)
+    {
+        return pageScheduling();
+    }
+    if (argc >= 3 && strcmp(argv[1], "--history") == 0)
+    {
+        return history(strtoul(argv[2], NULL, 10), argc - 3, argv + 3);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--scheduler") == 0)
+    {
+        return schedulerChecks();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--wifi-checks") == 0)
+    {
+        return wifiChecks();
+    }
+    if (argc >= 3 && strcmp(argv[1], "--wifi") == 0)
+    {
+        return wifi(strtoul(argv[2], NULL, 10), argc - 3, argv + 3);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--beat-cursor") == 0)
+    {
+        return beatCursor(argc - 2, argv + 2);
+    }
+    if (argc >= 3 && strcmp(argv[1], "--lyrics-checks") == 0)
+    {
+        return lyricsChecks(argv[2]);
+    }
+    if (argc >= 4 && strcmp(argv[1], "--lyrics") == 0)
+    {
+        return lyricsPlayback(argv[2], argv[3], argc - 4, argv + 4);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--brightness") == 0)
+    {
+        return brightnessModel(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--log-checks") == 0)
+    {
+        return logChecks();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--status-checks") == 0)
+    {
+        return statusChecks();
+    }
+    if (argc >= 3 && strcmp(argv[1], "--status") == 0)
+    {
+        return statusServe(strtoul(argv[2], NULL, 10), argc - 3, argv + 3);
+    }
+    if (argc >= 3 && strcmp(argv[1], "--accounts") == 0)
+    {
+        return accountsLoad(strtoul(argv[2], NULL, 10), argc - 3, argv + 3);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--devices-parse") == 0)
+    {
+        return devicesParse();
+    }
+    if (argc >= 3 && strcmp(argv[1], "--devices") == 0)
+    {
+        return deviceCommands(argv[2], argc - 3, argv + 3);
+    }
+    if (argc >= 3 && strcmp(argv[1], "--power") == 0)
+    {
+        return powerStandby(strtoul(argv[2], NULL, 10), argc - 3, argv + 3);
+    }
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <capture> [--features] [--latency ms] [--fragment bytes] [--disconnect bytes]\n", argv[0]);
+        fprintf(stderr, "       %s --server host:port [--polls n] [--interval ms] [--features] [--tls ca.pem [--no-resume]]\n"
+                        "            [--dns ttl [--dns-latency ms]]\n", argv[0]);
+        fprintf(stderr, "       %s --command-queue\n", argv[0]);
+        fprintf(stderr, "       %s --dns-cache\n", argv[0]);
+        fprintf(stderr, "       %s --reconcile\n", argv[0]);
+        fprintf(stderr, "       %s --album-art\n", argv[0]);
+        fprintf(stderr, "       %s --feature-bars\n", argv[0]);
+        fprintf(stderr, "       %s --packed-features [--seed n]\n", argv[0]);
+        fprintf(stderr, "       %s --art-cache dir albums.txt [--budget bytes] [--jpeg cover.jpg]\n", argv[0]);
+        fprintf(stderr, "       %s --history tracks [--log dir] [--seed n] [--check n]\n", argv[0]);
+        fprintf(stderr, "       %s --snapshot dir [--jpeg cover.jpg]\n", argv[0]);
+        fprintf(stderr, "       %s --pages\n", argv[0]);
+        fprintf(stderr, "       %s --scheduler\n", argv[0]);
+        fprintf(stderr, "       %s --wifi outages [--seed n] [--no-cache]\n", argv[0]);
+        fprintf(stderr, "       %s --wifi-checks\n", argv[0]);
+        fprintf(stderr, "       %s --power hours [--seed n] [--timeout minutes]\n", argv[0]);
+        fprintf(stderr, "       %s --brightness [--depth bit planes]\n", argv[0]);
+        fprintf(stderr, "       %s --lyrics dir track_id [--server host:port] [--seeks n] [--seed n]\n", argv[0]);
+        fprintf(stderr, "       %s --lyrics-checks dir\n", argv[0]);
+        fprintf(stderr, "       %s --beat-cursor [--seed n]\n", argv[0]);
+        fprintf(stderr, "       %s --status port [--seconds n]\n", argv[0]);
+        fprintf(stderr, "       %s --status-checks\n", argv[0]);
+        fprintf(stderr, "       %s --log-checks\n", argv[0]);
+        fprintf(stderr, "       %s --accounts n --server host:port [--seconds n] [--interval ms] [--budget polls per s]\n"
+                        "            [--tokens] [--tls ca.pem]\n", argv[0]);
+        fprintf(stderr, "       %s --devices host:port [--commands n]\n", argv[0]);
+        fprintf(stderr, "       %s --devices-parse\n", argv[0]);
+        return 2;
+    }
+    return replayCapture(argv[1], argc - 2, argv + 2);
+}
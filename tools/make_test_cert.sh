@@ -0,0 +1,23 @@
+#!/bin/sh
+# Generates a local CA and a server certificate for the Spotify host names, so
+# tools/spotify_stand_in.py can serve TLS to the native build:
+#
+#     tools/make_test_cert.sh /tmp/spotify-tls
+#     python3 tools/spotify_stand_in.py --port 8443 --tls-cert /tmp/spotify-tls/server.pem --tls-key /tmp/spotify-tls/server.key
+#     .pio/build/native/program --server 127.0.0.1:8443 --tls /tmp/spotify-tls/ca.pem --polls 100
+#
+# Only for testing, the keys are not protected.
+set -e
+dir=${1:-tls}
+mkdir -p "$dir"
+cd "$dir"
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 365 -subj "/CN=Spotify stand-in CA" \
+    -keyout ca.key -out ca.pem 2>/dev/null
+openssl req -newkey rsa:2048 -nodes -subj "/CN=api.spotify.com" \
+    -keyout server.key -out server.csr 2>/dev/null
+printf 'subjectAltName=DNS:api.spotify.com,DNS:accounts.spotify.com,DNS:i.scdn.co\n' > server.ext
+openssl x509 -req -in server.csr -CA ca.pem -CAkey ca.key -CAcreateserial -days 365 \
+    -extfile server.ext -out server.pem 2>/dev/null
+rm server.csr server.ext
+echo "CA: $dir/ca.pem, server: $dir/server.pem $dir/server.key"
@@ -0,0 +1,494 @@
+#!/usr/bin/env python3
+"""Local stand-in for the Spotify Web API endpoints the display uses.
+
+Plain HTTP/1.1 with keep-alive, meant for the native build (NativeTcpClient
+redirects api.spotify.com and accounts.spotify.com here):
+
+    python3 tools/spotify_stand_in.py --port 8080 --script "ok*5,next,idle,expired,ratelimit:2,drip,cut"
+    .pio/build/native/program --server 127.0.0.1:8080 --polls 1000
+
+--script is a comma separated list of what happens to the next
+currently-playing request, repeated forever ("step*N" repeats a step):
+
+    ok           200 with the current track
+    next         switch to the next track, then like ok
+    idle         204, nothing playing
+    expired      401 until the token is refreshed via /api/token
+    ratelimit:S  429 with "Retry-After: S"
+    drip         200, but the body trickles in 16 byte pieces (--drip-ms apart)
+    cut          200, connection closed in the middle of the body
+
+GET /stats returns the request counters as JSON.
+
+GET /lyrics/<track id>.lrc serves synced lyrics in LRC format: the file of
+--lyrics-dir if there is one, otherwise generated lines over the whole track
+with a chorus that has several stamps per line.
+
+GET /v1/audio-analysis/<track id> serves an analysis in the layout of Spotify
+(meta, track, bars, beats, sections, segments with pitches and timbre,
+tatums), beats at the tempo of /v1/audio-features, sent with chunked encoding.
+
+GET /v1/me/player/devices lists a "Living Room" speaker and a "Kitchen" phone;
+transfers, play and volume with a device_id act on the device, an unknown
+device_id is a 404.
+
+With --accounts N it plays for N accounts, each with its own track, script
+position and tokens: account 0 has the tokens "token-<n>" as before, account
+k > 0 "a<k>-token-<n>", issued by /api/token for the refresh token
+"refresh-<k>". The access token "a<k>-token-0" is valid from the start, so a
+load test can poll without refreshing (main_native --accounts).
+
+With --tls-cert and --tls-key it serves HTTPS instead, with session tickets so
+clients can resume their sessions (certificates from tools/make_test_cert.sh).
+"""
+
+import argparse
+import itertools
+import json
+import os
+import ssl
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+TRACKS = [
+    ("0vFOzaXqZHahrZp6enQwQb", "Money - 2011 Remastered Version", "Pink Floyd", 382296, 74),
+    ("3n3Ppam7vgaVa1iaRUc9Lp", "Mr. Brightside", "The Killers", 222973, 86),
+    ("7GhIk7Il098yCjg4BQjzvb", "Never Gonna Give You Up", "Rick Astley", 213573, 78),
+    ("4uLU6hMCjMI75M1A2tKUQC", "Bohemian Rhapsody (Remastered 2011)", "Queen", 354320, 82),
+]
+
+DEVICES = [
+    ("5fbb3ba6aa454b5534c4ba43a8c7e8e45a63ad0e", "Living Room", "Speaker"),
+    ("a1b2c3d4e5f60718293a4b5c6d7e8f9012345678", "Kitchen", "Smartphone"),
+]
+
+
+class Player:
+    def __init__(self, script, account=0):
+        self.lock = threading.Lock()
+        self.steps = itertools.cycle(script)
+        self.account = account
+        self.track = account % len(TRACKS)
+        self.is_playing = account % 4 != 3
+        self.volumes = [50, 30]
+        self.active_device = 0
+        self.started = time.monotonic()
+        self.progress_at_start = 0
+        self.token_number = 0
+        self.token_expired = False
+        self.counters = {}
+
+    def count(self, name):
+        with self.lock:
+            self.counters[name] = self.counters.get(name, 0) + 1
+
+    def token(self):
+        prefix = "a%d-" % self.account if self.account else ""
+        return "%stoken-%d" % (prefix, self.token_number)
+
+    def progress_ms(self):
+        progress = self.progress_at_start
+        if self.is_playing:
+            progress += int((time.monotonic() - self.started) * 1000)
+        return min(progress, TRACKS[self.track][3])
+
+    def seek(self, position_ms):
+        self.progress_at_start = position_ms
+        self.started = time.monotonic()
+
+    def set_playing(self, is_playing):
+        self.seek(self.progress_ms())
+        self.is_playing = is_playing
+
+    def change_track(self, step):
+        self.track = (self.track + step) % len(TRACKS)
+        self.seek(0)
+
+    def next_step(self):
+        with self.lock:
+            return next(self.steps)
+
+    def currently_playing(self):
+        track_id, name, artist, duration, popularity = TRACKS[self.track]
+        return {
+            "timestamp": int(time.time() * 1000),
+            "progress_ms": self.progress_ms(),
+            "is_playing": self.is_playing,
+            "currently_playing_type": "track",
+            "item": {
+                "album": {
+                    "name": name.split(" - ")[0] + " (Album)",
+                    "uri": "spotify:album:" + track_id[::-1],
+                    "images": [
+                        {"height": 640, "width": 640, "url": "https://i.scdn.co/image/640" + track_id},
+                        {"height": 300, "width": 300, "url": "https://i.scdn.co/image/300" + track_id},
+                        {"height": 64, "width": 64, "url": "https://i.scdn.co/image/64" + track_id},
+                    ],
+                },
+                "artists": [{"name": artist, "uri": "spotify:artist:" + track_id[:11]}],
+                "duration_ms": duration,
+                "id": track_id,
+                "name": name,
+                "popularity": popularity,
+                "uri": "spotify:track:" + track_id,
+            },
+        }
+
+
+def parse_script(text):
+    steps = []
+    for part in text.split(","):
+        part = part.strip()
+        if not part:
+            continue
+        step, _, repeat = part.partition("*")
+        steps.extend([step] * int(repeat or 1))
+    return steps or ["ok"]
+
+
+def audio_features(track_id):
+    # stable pseudo features per track
+    seed = sum(ord(c) for c in track_id)
+    fraction = lambda n: round(((seed * (n + 7)) % 1000) / 1000.0, 3)
+    return {
+        "danceability": fraction(1), "energy": fraction(2), "key": seed % 12,
+        "loudness": -fraction(3) * 20, "mode": seed % 2, "speechiness": fraction(4),
+        "acousticness": fraction(5), "instrumentalness": fraction(6), "liveness": fraction(7),
+        "valence": fraction(8), "tempo": 60 + fraction(9) * 140, "id": track_id,
+    }
+
+
+def audio_analysis(track_id):
+    # beats at the tempo with a little jitter, four segments per beat, louder on the downbeat
+    for track in TRACKS:
+        if track[0] == track_id:
+            break
+    else:
+        return None
+    duration = track[3] / 1000.0
+    tempo = audio_features(track_id)["tempo"]
+    seed = sum(ord(c) for c in track_id)
+    period = 60.0 / tempo
+
+    def interval(start, length, confidence):
+        return {"start": round(start, 5), "duration": round(length, 5), "confidence": round(confidence, 3)}
+
+    beats = []
+    time_s = 0.31
+    while time_s < duration - period:
+        seed = (seed * 1103515245 + 12345) % 2 ** 31
+        beats.append(interval(time_s, period, 0.4 + (seed % 600) / 1000.0))
+        time_s += period + ((seed >> 8) % 21 - 10) / 1000.0
+    segments = []
+    for number, beat in enumerate(beats):
+        for quarter in range(4):
+            seed = (seed * 1103515245 + 12345) % 2 ** 31
+            loudness = -4.0 - (0 if quarter else 3.0 * (number % 4 != 0)) - quarter * 5.0 - (seed % 300) / 100.0
+            segments.append(dict(interval(beat["start"] + quarter * period / 4, period / 4, 0.5),
+                                 loudness_start=round(loudness - 20, 3), loudness_max_time=0.021,
+                                 loudness_max=round(loudness, 3), loudness_end=0,
+                                 pitches=[round(((seed >> n) % 1000) / 1000.0, 3) for n in range(12)],
+                                 timbre=[round(((seed >> n) % 2000) / 10.0 - 100, 3) for n in range(12)]))
+    return {
+        "meta": {"analyzer_version": "4.0.0", "platform": "Linux", "detailed_status": "OK",
+                 "status_code": 0, "timestamp": 1500000000, "analysis_time": 6.9, "input_process": "libvorbisfile L+R 44100->22050"},
+        "track": {"num_samples": int(duration * 22050), "duration": duration, "sample_md5": "",
+                  "offset_seconds": 0, "window_seconds": 0, "analysis_sample_rate": 22050,
+                  "analysis_channels": 1, "end_of_fade_in": 0.31, "start_of_fade_out": duration - 4,
+                  "loudness": -6.5, "tempo": round(tempo, 3), "tempo_confidence": 0.73,
+                  "time_signature": 4, "time_signature_confidence": 1, "key": seed % 12,
+                  "key_confidence": 0.4, "mode": seed % 2, "mode_confidence": 0.5,
+                  "codestring": "eJxVnAmS5DgOBL9S", "code_version": 3.15, "echoprintstring": "eJzFnQuS5DiSZK",
+                  "echoprint_version": 4.12, "synchstring": "eJxlm4mRJDEIRV", "synch_version": 1,
+                  "rhythmstring": "eJyNnAmS5DgOBL", "rhythm_version": 1},
+        "bars": [interval(beats[n]["start"], period * 4, 0.5) for n in range(0, len(beats), 4)],
+        "beats": beats,
+        "sections": [dict(interval(start, 30.0, 0.6), loudness=-7.2, tempo=round(tempo, 3),
+                          tempo_confidence=0.7, key=seed % 12, key_confidence=0.4, mode=1,
+                          mode_confidence=0.5, time_signature=4, time_signature_confidence=1)
+                     for start in range(0, int(duration), 30)],
+        "segments": segments,
+        "tatums": [interval(beat["start"] + half * period / 2, period / 2, 0.5) for beat in beats for half in range(2)],
+    }
+
+
+def generated_lyrics(track_id):
+    # a line every 2.5 to 6 s, a chorus of two lines four times
+    for track in TRACKS:
+        if track[0] == track_id:
+            break
+    else:
+        return None
+    _, name, artist, duration, _ = track
+    seed = sum(ord(c) for c in track_id)
+    stamp = lambda ms: "[%02d:%02d.%02d]" % (ms // 60000, ms // 1000 % 60, ms // 10 % 100)
+    lines = ["[ar:%s]" % artist, "[ti:%s]" % name]
+    chorus = [duration * quarter // 4 + 1000 for quarter in range(4)]
+    lines.append("".join(stamp(ms) for ms in chorus) + "Oh %s, %s" % (name, name))
+    lines.append("".join(stamp(ms + 3000) for ms in chorus) + "the chorus of %s goes on and on" % artist)
+    time_ms = 4000
+    number = 1
+    while time_ms < duration - 2000:
+        seed = (seed * 1103515245 + 12345) % 2 ** 31
+        lines.append("%sLine %d of %s" % (stamp(time_ms), number, name))
+        time_ms += 2500 + seed % 3500
+        number += 1
+    return "\n".join(lines) + "\n"
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    # headers and body are two writes, on a reused connection the body would wait for the delayed ACK
+    disable_nagle_algorithm = True
+    server_version = "spotify-stand-in"
+    players = []
+    options = None
+
+    @property
+    def player(self):
+        # the account of the access token, the first one without a token of another
+        token = (self.headers.get("Authorization") or "")[len("Bearer "):]
+        account, _, _ = token.partition("-token-")
+        if account.startswith("a") and account[1:].isdigit() and int(account[1:]) < len(self.players):
+            return self.players[int(account[1:])]
+        return self.players[0]
+
+    @classmethod
+    def counters(cls):
+        total = {}
+        for player in cls.players:
+            for name, count in player.counters.items():
+                total[name] = total.get(name, 0) + count
+        return total
+
+    def log_message(self, format, *args):
+        if self.options.verbose:
+            super().log_message(format, *args)
+
+    def send_json(self, status, document, headers=(), drip=False, cut=False):
+        body = json.dumps(document, indent=2).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json; charset=utf-8")
+        self.send_header("Content-Length", str(len(body)))
+        for name, value in headers:
+            self.send_header(name, value)
+        self.end_headers()
+        if cut:
+            self.wfile.write(body[: len(body) // 2])
+            self.wfile.flush()
+            self.close_connection = True
+            return
+        if drip:
+            for start in range(0, len(body), 16):
+                self.wfile.write(body[start:start + 16])
+                self.wfile.flush()
+                time.sleep(self.options.drip_ms / 1000.0)
+            return
+        self.wfile.write(body)
+
+    def send_chunked(self, document, chunk_size=4096):
+        body = json.dumps(document).encode()
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json; charset=utf-8")
+        self.send_header("Transfer-Encoding", "chunked")
+        self.end_headers()
+        for start in range(0, len(body), chunk_size):
+            piece = body[start:start + chunk_size]
+            self.wfile.write(b"%x\r\n%s\r\n" % (len(piece), piece))
+        self.wfile.write(b"0\r\n\r\n")
+
+    def send_empty(self, status, headers=()):
+        self.send_response(status)
+        self.send_header("Content-Length", "0")
+        for name, value in headers:
+            self.send_header(name, value)
+        self.end_headers()
+
+    def read_body(self):
+        length = int(self.headers.get("Content-Length") or 0)
+        return self.rfile.read(length).decode() if length else ""
+
+    def authorized(self):
+        player = self.player
+        expected = "Bearer " + player.token()
+        if player.token_expired or self.headers.get("Authorization") != expected:
+            player.count("401")
+            self.send_json(401, {"error": {"status": 401, "message": "The access token expired"}})
+            return False
+        return True
+
+    def do_GET(self):
+        url = urlparse(self.path)
+        player = self.player
+        if url.path.startswith("/v1/audio-features/"):
+            player.count("GET /v1/audio-features/")
+        elif url.path.startswith("/v1/audio-analysis/"):
+            player.count("GET /v1/audio-analysis/")
+        elif url.path.startswith("/lyrics/"):
+            player.count("GET /lyrics/")
+        else:
+            player.count("GET " + url.path)
+        if url.path == "/stats":
+            self.send_json(200, self.counters())
+        elif url.path == "/v1/me/player/currently-playing":
+            self.currently_playing()
+        elif url.path.startswith("/v1/audio-features/"):
+            if self.authorized():
+                self.send_json(200, audio_features(url.path.rsplit("/", 1)[1]))
+        elif url.path.startswith("/v1/audio-analysis/"):
+            if self.authorized():
+                analysis = audio_analysis(url.path.rsplit("/", 1)[1])
+                if analysis is None:
+                    self.send_json(404, {"error": {"status": 404, "message": "analysis not found"}})
+                else:
+                    self.send_chunked(analysis)
+        elif url.path.startswith("/lyrics/") and url.path.endswith(".lrc"):
+            self.lyrics(url.path[len("/lyrics/"):-len(".lrc")])
+        elif url.path == "/v1/me/player/devices":
+            if self.authorized():
+                self.send_json(200, {"devices": [
+                    {"id": device_id, "is_active": number == player.active_device, "is_private_session": False,
+                     "is_restricted": False, "name": name, "type": kind, "volume_percent": player.volumes[number]}
+                    for number, (device_id, name, kind) in enumerate(DEVICES)]})
+        else:
+            self.send_json(404, {"error": {"status": 404, "message": "Service not found"}})
+
+    def currently_playing(self):
+        player = self.player
+        step = player.next_step()
+        name, _, argument = step.partition(":")
+        if name == "expired":
+            player.token_expired = True
+        if not self.authorized():
+            return
+        player.count("step " + name)
+        if name == "idle":
+            self.send_empty(204)
+        elif name == "ratelimit":
+            self.send_json(429, {"error": {"status": 429, "message": "API rate limit exceeded"}},
+                           headers=[("Retry-After", argument or "1")])
+        else:
+            if name == "next":
+                player.change_track(1)
+            self.send_json(200, player.currently_playing(), drip=(name == "drip"), cut=(name == "cut"))
+
+    def lyrics(self, track_id):
+        text = None
+        if self.options.lyrics_dir and "/" not in track_id:
+            path = os.path.join(self.options.lyrics_dir, track_id + ".lrc")
+            if os.path.exists(path):
+                with open(path, encoding="utf-8") as file:
+                    text = file.read()
+        if text is None:
+            text = generated_lyrics(track_id)
+        if text is None:
+            self.send_empty(404)
+            return
+        body = text.encode()
+        self.send_response(200)
+        self.send_header("Content-Type", "text/plain; charset=utf-8")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_POST(self):
+        url = urlparse(self.path)
+        player = self.player
+        player.count("POST " + url.path)
+        if url.path == "/api/token":
+            body = parse_qs(self.read_body())
+            if "grant_type" not in body:
+                self.send_json(400, {"error": "unsupported_grant_type"})
+                return
+            refresh = body.get("refresh_token", [""])[0]
+            if refresh.startswith("refresh-") and refresh[len("refresh-"):].isdigit():
+                player = self.players[int(refresh[len("refresh-"):]) % len(self.players)]
+            player.token_number += 1
+            player.token_expired = False
+            self.send_json(200, {"access_token": player.token(), "token_type": "Bearer",
+                                 "expires_in": self.options.token_ttl, "refresh_token": "refresh"})
+            return
+        self.read_body()
+        if not self.authorized():
+            return
+        if url.path == "/v1/me/player/next":
+            player.change_track(1)
+        elif url.path == "/v1/me/player/previous":
+            player.change_track(-1)
+        else:
+            self.send_json(404, {"error": {"status": 404, "message": "Service not found"}})
+            return
+        self.send_empty(204)
+
+    def do_PUT(self):
+        url = urlparse(self.path)
+        query = parse_qs(url.query)
+        player = self.player
+        player.count("PUT " + url.path)
+        body = self.read_body()
+        if not self.authorized():
+            return
+        # the device of device_id (the body of a transfer), the active one without
+        device_ids = [device_id for device_id, _, _ in DEVICES]
+        device_id = query.get("device_id", [None])[0]
+        if url.path == "/v1/me/player" and body:
+            device_id = (json.loads(body).get("device_ids") or [None])[0]
+        if device_id is not None and device_id not in device_ids:
+            self.send_json(404, {"error": {"status": 404, "message": "Device not found"}})
+            return
+        device = device_ids.index(device_id) if device_id is not None else player.active_device
+        if url.path == "/v1/me/player/play":
+            player.active_device = device
+            player.set_playing(True)
+        elif url.path == "/v1/me/player/pause":
+            player.set_playing(False)
+        elif url.path == "/v1/me/player/volume":
+            player.volumes[device] = int(query.get("volume_percent", ["50"])[0])
+        elif url.path == "/v1/me/player/seek":
+            player.seek(int(query.get("position_ms", ["0"])[0]))
+        elif url.path == "/v1/me/player":
+            player.active_device = device
+        elif url.path in ("/v1/me/player/shuffle", "/v1/me/player/repeat"):
+            pass
+        else:
+            self.send_json(404, {"error": {"status": 404, "message": "Service not found"}})
+            return
+        self.send_empty(204)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--script", default="ok", help="scenario steps, see above")
+    parser.add_argument("--drip-ms", type=int, default=50, help="pause between two drip pieces")
+    parser.add_argument("--token-ttl", type=int, default=3600, help="expires_in of issued tokens")
+    parser.add_argument("--accounts", type=int, default=1, help="accounts with their own tokens and playback")
+    parser.add_argument("--verbose", action="store_true", help="log every request")
+    parser.add_argument("--tls-cert", help="serve TLS with this certificate (PEM)")
+    parser.add_argument("--tls-key", help="private key of --tls-cert")
+    parser.add_argument("--lyrics-dir", help="<track id>.lrc files served under /lyrics/")
+    options = parser.parse_args()
+
+    Handler.players = [Player(parse_script(options.script), account) for account in range(max(options.accounts, 1))]
+    Handler.options = options
+    server = ThreadingHTTPServer((options.host, options.port), Handler)
+    server.daemon_threads = True
+    scheme = "http"
+    if options.tls_cert:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(options.tls_cert, options.tls_key)
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+        scheme = "https"
+    print("Spotify stand-in on %s://%s:%d, script: %s" % (scheme, options.host, options.port, options.script))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    print(json.dumps(Handler.counters(), indent=2, sort_keys=True))
+
+
+if __name__ == "__main__":
+    main()